@@ -0,0 +1,509 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <typeinfo>
+
+using namespace std;
+
+namespace bytecode {
+
+namespace {
+const char* const MNEMONICS[] = {
+#define MYTHON_OPCODE_NAME(name, mnemonic) mnemonic,
+    MYTHON_OPCODES(MYTHON_OPCODE_NAME)
+#undef MYTHON_OPCODE_NAME
+};
+
+using ComparatorFn = bool (*)(const runtime::ObjectHolder&, const runtime::ObjectHolder&,
+                              runtime::Context&);
+
+//builtin comparators are compiled to dedicated instructions
+std::optional<OpCode> GetComparisonOpCode(const ast::Comparison::Comparator& cmp) {
+    auto fn_ptr = cmp.target<ComparatorFn>();
+    if(!fn_ptr) {
+        return std::nullopt;
+    }
+    const std::pair<ComparatorFn, OpCode> builtins[] = {
+        {runtime::Equal, OpCode::Equal},
+        {runtime::NotEqual, OpCode::NotEqual},
+        {runtime::Less, OpCode::Less},
+        {runtime::Greater, OpCode::Greater},
+        {runtime::LessOrEqual, OpCode::LessOrEqual},
+        {runtime::GreaterOrEqual, OpCode::GreaterOrEqual},
+    };
+    for(const auto& [fn, op] : builtins) {
+        if(*fn_ptr == fn) {
+            return op;
+        }
+    }
+    return std::nullopt;
+}
+
+class FunctionCompiler {
+public:
+    FunctionCompiler(Module& module, Function& function)
+        : module_(module)
+        , function_(function)
+    {
+    }
+
+    // Закрепляет регистры за self, параметрами и переменными тела body
+    void DeclareScope(const std::vector<std::string>& params, const ast::Statement& body) {
+        for(const auto& name : params) {
+            DeclareVariable(name);
+        }
+        std::vector<std::string> names;
+        ast::CollectAssignedVariables(body, names);
+        for(const auto& name : names) {
+            DeclareVariable(name);
+        }
+        first_temp_ = next_temp_ = static_cast<uint32_t>(function_.register_names.size());
+        function_.register_count = first_temp_;
+    }
+
+    void CompileStatement(const ast::Statement& node) {
+        if(auto compound = dynamic_cast<const ast::Compound*>(&node)) {
+            for(const auto& stmt : compound->Statements()) {
+                CompileStatement(*stmt);
+            }
+        }
+        else if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+            CompileInto(*assignment->Value(), variables_.at(assignment->GetName()));
+        }
+        else if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            const auto& cls = definition->GetClass();
+            for(const auto& method : cls.GetMethods()) {
+                module_.GetMethod(cls, method);
+            }
+            Emit(OpCode::LoadConst, variables_.at(cls.GetName()),
+                 AddConstant(runtime::ObjectHolder::Share(const_cast<runtime::Class&>(cls))));
+        }
+        else if(auto if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+            uint32_t mark = next_temp_;
+            uint32_t condition = CompileOperand(*if_else->Condition());
+            size_t jump_to_else = Emit(OpCode::JumpIfFalse, condition);
+            next_temp_ = mark;
+            CompileStatement(*if_else->IfBody());
+            if(if_else->ElseBody()) {
+                size_t jump_to_end = Emit(OpCode::Jump);
+                PatchJump(jump_to_else);
+                CompileStatement(*if_else->ElseBody());
+                PatchJump(jump_to_end);
+            }
+            else {
+                PatchJump(jump_to_else);
+            }
+        }
+        else if(auto body = dynamic_cast<const ast::MethodBody*>(&node)) {
+            CompileStatement(*body->Body());
+        }
+        else if(auto ret = dynamic_cast<const ast::Return*>(&node)) {
+            uint32_t mark = next_temp_;
+            Emit(OpCode::Return, CompileOperand(*ret->Value()));
+            next_temp_ = mark;
+        }
+        else if(auto field_assignment = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+            uint32_t mark = next_temp_;
+            uint32_t object = CompileOperand(field_assignment->Object());
+            uint32_t value = CompileOperand(*field_assignment->Value());
+            Emit(OpCode::SetField, object, AddName(field_assignment->GetFieldName()), value);
+            next_temp_ = mark;
+        }
+        else if(auto print = dynamic_cast<const ast::Print*>(&node)) {
+            uint32_t mark = next_temp_;
+            uint32_t first = CompileArgs(print->Args());
+            Emit(OpCode::Print, first, static_cast<uint32_t>(print->Args().size()));
+            next_temp_ = mark;
+        }
+        else {
+            //expression statement, its value is dropped
+            uint32_t mark = next_temp_;
+            CompileInto(node, NewTemp());
+            next_temp_ = mark;
+        }
+    }
+
+    void Finish() {
+        Emit(OpCode::ReturnNone);
+    }
+
+private:
+    void DeclareVariable(const std::string& name) {
+        if(variables_.count(name) == 0) {
+            variables_[name] = static_cast<uint32_t>(function_.register_names.size());
+            function_.register_names.push_back(name);
+        }
+    }
+
+    uint32_t NewTemp() {
+        uint32_t result = next_temp_++;
+        function_.register_count = std::max(function_.register_count, next_temp_);
+        return result;
+    }
+
+    bool IsTemp(uint32_t reg) const {
+        return reg >= first_temp_;
+    }
+
+    size_t Emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0) {
+        function_.code.push_back({op, a, b, c});
+        return function_.code.size() - 1u;
+    }
+
+    void PatchJump(size_t instruction) {
+        function_.code[instruction].b = static_cast<uint32_t>(function_.code.size());
+    }
+
+    //literals interned by the parser share an object and so a constant slot
+    uint32_t AddConstant(runtime::ObjectHolder value) {
+        auto [it, inserted] = constant_slots_.emplace(value.Get(), static_cast<uint32_t>(function_.constants.size()));
+        if(inserted) {
+            function_.constants.push_back(std::move(value));
+        }
+        return it->second;
+    }
+
+    uint32_t AddName(const std::string& name) {
+        auto [it, inserted] = names_.emplace(name, static_cast<uint32_t>(function_.names.size()));
+        if(inserted) {
+            function_.names.push_back(name);
+        }
+        return it->second;
+    }
+
+    uint32_t AddCallSite(CallSite site) {
+        function_.call_sites.push_back(site);
+        return static_cast<uint32_t>(function_.call_sites.size() - 1u);
+    }
+
+    // Вычисляет аргументы в последовательные регистры, возвращает номер первого из них
+    uint32_t CompileArgs(const ast::StatementList& args) {
+        uint32_t first = next_temp_;
+        for(size_t i = 0; i < args.size(); ++i) {
+            NewTemp();
+        }
+        for(size_t i = 0; i < args.size(); ++i) {
+            CompileInto(*args[i], first + static_cast<uint32_t>(i));
+        }
+        return first;
+    }
+
+    // Возвращает регистр, содержащий значение выражения. Переменные не копируются
+    uint32_t CompileOperand(const ast::Statement& node) {
+        if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+            auto ids = var->GetDottedIds();
+            if(ids.size() == 1u && variables_.count(ids.front())) {
+                return variables_.at(ids.front());
+            }
+        }
+        uint32_t result = NewTemp();
+        CompileInto(node, result);
+        return result;
+    }
+
+    void CompileVariable(const std::vector<std::string>& ids, uint32_t dst) {
+        auto it = variables_.find(ids.front());
+        if(it == variables_.end()) {
+            Emit(OpCode::Undefined, dst, AddName(ids.front()));
+            return;
+        }
+        if(ids.size() == 1u) {
+            Emit(OpCode::Move, dst, it->second);
+            return;
+        }
+        uint32_t object = it->second;
+        for(size_t i = 1; i < ids.size(); ++i) {
+            Emit(OpCode::GetField, dst, object, AddName(ids[i]));
+            object = dst;
+        }
+    }
+
+    template <typename Operation>
+    bool TryCompileBinary(const ast::Statement& node, OpCode op, uint32_t dst) {
+        auto operation = dynamic_cast<const Operation*>(&node);
+        if(!operation) {
+            return false;
+        }
+        uint32_t mark = next_temp_;
+        uint32_t lhs = CompileOperand(*operation->Lhs());
+        uint32_t rhs = CompileOperand(*operation->Rhs());
+        Emit(op, dst, lhs, rhs);
+        next_temp_ = mark;
+        return true;
+    }
+
+    // and/or: результат вычисляется во временный регистр, чтобы не затереть переменную,
+    // которая используется во втором операнде
+    void CompileLogical(const ast::BinaryOperation& operation, OpCode short_circuit, uint32_t dst) {
+        uint32_t mark = next_temp_;
+        uint32_t result = IsTemp(dst) ? dst : NewTemp();
+        Emit(OpCode::ToBool, result, CompileOperand(*operation.Lhs()));
+        size_t jump = Emit(short_circuit, result);
+        Emit(OpCode::ToBool, result, CompileOperand(*operation.Rhs()));
+        PatchJump(jump);
+        if(result != dst) {
+            Emit(OpCode::Move, dst, result);
+        }
+        next_temp_ = mark;
+    }
+
+    void CompileInto(const ast::Statement& node, uint32_t dst) {
+        uint32_t mark = next_temp_;
+        if(auto num = dynamic_cast<const ast::NumericConst*>(&node)) {
+            Emit(OpCode::LoadConst, dst, AddConstant(num->GetObject()));
+        }
+        else if(auto str = dynamic_cast<const ast::StringConst*>(&node)) {
+            Emit(OpCode::LoadConst, dst, AddConstant(str->GetObject()));
+        }
+        else if(auto boolean = dynamic_cast<const ast::BoolConst*>(&node)) {
+            Emit(OpCode::LoadConst, dst, AddConstant(boolean->GetObject()));
+        }
+        else if(dynamic_cast<const ast::None*>(&node)) {
+            Emit(OpCode::LoadNone, dst);
+        }
+        else if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+            CompileVariable(var->GetDottedIds(), dst);
+        }
+        else if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+            uint32_t var_reg = variables_.at(assignment->GetName());
+            CompileInto(*assignment->Value(), var_reg);
+            Emit(OpCode::Move, dst, var_reg);
+        }
+        else if(auto field_assignment = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+            uint32_t object = CompileOperand(field_assignment->Object());
+            uint32_t value = CompileOperand(*field_assignment->Value());
+            Emit(OpCode::SetField, object, AddName(field_assignment->GetFieldName()), value);
+            Emit(OpCode::Move, dst, value);
+        }
+        else if(auto inlined = dynamic_cast<const ast::InlinedMethodCall*>(&node)) {
+            //the virtual machine has its own inline caches, so it runs the ordinary call
+            CompileInto(inlined->GetCall(), dst);
+        }
+        else if(auto call = dynamic_cast<const ast::MethodCall*>(&node)) {
+            uint32_t object = CompileOperand(*call->Object());
+            CallSite site;
+            site.target = AddName(call->GetMethodName());
+            site.arg_count = static_cast<uint32_t>(call->Args().size());
+            site.first_arg = CompileArgs(call->Args());
+            Emit(OpCode::Call, dst, object, AddCallSite(site));
+        }
+        else if(auto new_instance = dynamic_cast<const ast::NewInstance*>(&node)) {
+            const auto& cls = new_instance->GetClass();
+            function_.classes.push_back(&cls);
+            CallSite site;
+            site.target = static_cast<uint32_t>(function_.classes.size() - 1u);
+            //like the tree walker, arguments are evaluated only if a suitable __init__ exists
+            const auto* init = cls.GetMethod("__init__"s);
+            if(init && init->formal_params.size() == new_instance->Args().size()) {
+                site.init = init;
+                site.arg_count = static_cast<uint32_t>(new_instance->Args().size());
+                site.first_arg = CompileArgs(new_instance->Args());
+            }
+            Emit(OpCode::NewInstance, dst, 0, AddCallSite(site));
+        }
+        else if(auto print = dynamic_cast<const ast::Print*>(&node)) {
+            uint32_t first = CompileArgs(print->Args());
+            Emit(OpCode::Print, first, static_cast<uint32_t>(print->Args().size()));
+            Emit(OpCode::LoadNone, dst);
+        }
+        else if(auto stringify = dynamic_cast<const ast::Stringify*>(&node)) {
+            Emit(OpCode::Stringify, dst, CompileOperand(*stringify->Argument()));
+        }
+        else if(auto not_op = dynamic_cast<const ast::Not*>(&node)) {
+            Emit(OpCode::Not, dst, CompileOperand(*not_op->Argument()));
+        }
+        else if(auto or_op = dynamic_cast<const ast::Or*>(&node)) {
+            CompileLogical(*or_op, OpCode::JumpIfTrue, dst);
+        }
+        else if(auto and_op = dynamic_cast<const ast::And*>(&node)) {
+            CompileLogical(*and_op, OpCode::JumpIfFalse, dst);
+        }
+        else if(auto comparison = dynamic_cast<const ast::Comparison*>(&node)) {
+            if(auto op = GetComparisonOpCode(comparison->GetComparator())) {
+                uint32_t lhs = CompileOperand(*comparison->Lhs());
+                uint32_t rhs = CompileOperand(*comparison->Rhs());
+                Emit(*op, dst, lhs, rhs);
+            }
+            else {
+                uint32_t lhs = NewTemp();
+                uint32_t rhs = NewTemp();
+                CompileInto(*comparison->Lhs(), lhs);
+                CompileInto(*comparison->Rhs(), rhs);
+                function_.comparators.push_back(comparison->GetComparator());
+                Emit(OpCode::Compare, dst, lhs, static_cast<uint32_t>(function_.comparators.size() - 1u));
+            }
+        }
+        else if(TryCompileBinary<ast::Add>(node, OpCode::Add, dst)
+             || TryCompileBinary<ast::Sub>(node, OpCode::Sub, dst)
+             || TryCompileBinary<ast::Mult>(node, OpCode::Mult, dst)
+             || TryCompileBinary<ast::Div>(node, OpCode::Div, dst)) {
+        }
+        else if(dynamic_cast<const ast::Compound*>(&node) || dynamic_cast<const ast::IfElse*>(&node)
+             || dynamic_cast<const ast::Return*>(&node) || dynamic_cast<const ast::ClassDefinition*>(&node)
+             || dynamic_cast<const ast::MethodBody*>(&node)) {
+            CompileStatement(node);
+            Emit(OpCode::LoadNone, dst);
+        }
+        else {
+            throw CompileError("unsupported statement: "s + typeid(node).name());
+        }
+        next_temp_ = mark;
+    }
+
+    Module& module_;
+    Function& function_;
+    std::unordered_map<std::string, uint32_t> variables_;
+    std::unordered_map<std::string, uint32_t> names_;
+    std::unordered_map<const runtime::Object*, uint32_t> constant_slots_;
+    uint32_t first_temp_ = 0;
+    uint32_t next_temp_ = 0;
+};
+
+std::string FormatRegister(const Function& function, uint32_t reg) {
+    std::string result = "r"s + std::to_string(reg);
+    if(reg < function.register_names.size()) {
+        result += "("s + function.register_names[reg] + ")"s;
+    }
+    return result;
+}
+
+std::string FormatConstant(const runtime::ObjectHolder& value) {
+    if(!value) {
+        return "None"s;
+    }
+    std::ostringstream out;
+    runtime::DummyContext context;
+    if(value.TryAs<runtime::String>()) {
+        out << '\'' << value.TryAs<runtime::String>()->GetValue() << '\'';
+    }
+    else {
+        value->Print(out, context);
+    }
+    return out.str();
+}
+
+void DisassembleInstruction(const Function& function, const Instruction& instr, std::ostream& out) {
+    auto reg = [&function](uint32_t r) {
+        return FormatRegister(function, r);
+    };
+    out << std::left << std::setw(10) << GetMnemonic(instr.op);
+    switch(instr.op) {
+        case OpCode::LoadConst:
+            out << reg(instr.a) << ", k"sv << instr.b << "    ; "sv << FormatConstant(function.constants[instr.b]);
+            break;
+        case OpCode::LoadNone:
+        case OpCode::Return:
+            out << reg(instr.a);
+            break;
+        case OpCode::Move:
+        case OpCode::Not:
+        case OpCode::ToBool:
+        case OpCode::Stringify:
+            out << reg(instr.a) << ", "sv << reg(instr.b);
+            break;
+        case OpCode::GetField:
+            out << reg(instr.a) << ", "sv << reg(instr.b) << ", ."sv << function.names[instr.c];
+            break;
+        case OpCode::SetField:
+            out << reg(instr.a) << ", ."sv << function.names[instr.b] << ", "sv << reg(instr.c);
+            break;
+        case OpCode::Compare:
+            out << reg(instr.a) << ", "sv << reg(instr.b) << ", "sv << reg(instr.b + 1u) << ", c"sv << instr.c;
+            break;
+        case OpCode::Jump:
+            out << instr.b;
+            break;
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfTrue:
+            out << reg(instr.a) << ", "sv << instr.b;
+            break;
+        case OpCode::Call: {
+            const auto& site = function.call_sites[instr.c];
+            out << reg(instr.a) << ", "sv << reg(instr.b) << '.' << function.names[site.target]
+                << "(r"sv << site.first_arg << " x"sv << site.arg_count << ')';
+            break;
+        }
+        case OpCode::NewInstance: {
+            const auto& site = function.call_sites[instr.c];
+            out << reg(instr.a) << ", "sv << function.classes[site.target]->GetName()
+                << "(r"sv << site.first_arg << " x"sv << site.arg_count << ')';
+            break;
+        }
+        case OpCode::Print:
+            out << 'r' << instr.a << " x"sv << instr.b;
+            break;
+        case OpCode::Undefined:
+            out << reg(instr.a) << ", "sv << function.names[instr.b];
+            break;
+        case OpCode::ReturnNone:
+            break;
+        default:
+            out << reg(instr.a) << ", "sv << reg(instr.b) << ", "sv << reg(instr.c);
+            break;
+    }
+}
+
+}  // namespace
+
+const char* GetMnemonic(OpCode op) {
+    return MNEMONICS[static_cast<size_t>(op)];
+}
+
+const Function* Module::GetMethod(const runtime::Class& cls, const runtime::Method& method) {
+    if(auto it = method_index.find(&method); it != method_index.end()) {
+        return it->second;
+    }
+    auto body = dynamic_cast<const ast::MethodBody*>(method.body.get());
+    if(!body) {
+        method_index[&method] = nullptr;
+        return nullptr;
+    }
+    auto function = std::make_unique<Function>();
+    function->name = cls.GetName() + "."s + method.name;
+    function->param_count = static_cast<uint32_t>(method.formal_params.size() + 1u);
+    //register the function before compiling the body, so recursive lookups terminate
+    method_index[&method] = function.get();
+    std::vector<std::string> params{"self"s};
+    params.insert(params.end(), method.formal_params.begin(), method.formal_params.end());
+
+    FunctionCompiler compiler(*this, *function);
+    compiler.DeclareScope(params, *body);
+    compiler.CompileStatement(*body);
+    compiler.Finish();
+    methods.push_back(std::move(function));
+    return methods.back().get();
+}
+
+Module Compile(const ast::Statement& program) {
+    Module module;
+    module.main.name = "<main>"s;
+    FunctionCompiler compiler(module, module.main);
+    compiler.DeclareScope({}, program);
+    compiler.CompileStatement(program);
+    compiler.Finish();
+    return module;
+}
+
+void Disassemble(const Function& function, std::ostream& out) {
+    out << "function "sv << function.name << " (params: "sv << function.param_count
+        << ", registers: "sv << function.register_count
+        << ", constants: "sv << function.constants.size() << ")\n"sv;
+    for(size_t i = 0; i < function.code.size(); ++i) {
+        out << "  "sv << std::right << std::setw(4) << std::setfill('0') << i << std::setfill(' ') << "  "sv;
+        DisassembleInstruction(function, function.code[i], out);
+        out << '\n';
+    }
+}
+
+void Disassemble(const Module& module, std::ostream& out) {
+    Disassemble(module.main, out);
+    for(const auto& method : module.methods) {
+        out << '\n';
+        Disassemble(*method, out);
+    }
+}
+
+}  // namespace bytecode
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bytecode {
+
+/*
+Набор инструкций регистровой виртуальной машины.
+Каждая инструкция имеет до трёх операндов a, b, c. В комментариях:
+  R[i] - регистр текущей функции,
+  K[i] - константа из пула констант функции,
+  N[i] - имя поля или метода,
+  S[i] - описание точки вызова (метод или конструктор и его аргументы),
+  C[i] - пользовательская функция сравнения.
+*/
+#define MYTHON_OPCODES(OP)                                                               \
+    OP(LoadConst, "LOADK")          /* R[a] = K[b]                                   */ \
+    OP(LoadNone, "LOADNONE")        /* R[a] = None                                   */ \
+    OP(Move, "MOVE")                /* R[a] = R[b]                                   */ \
+    OP(GetField, "GETFIELD")        /* R[a] = R[b].N[c]                              */ \
+    OP(SetField, "SETFIELD")        /* R[a].N[b] = R[c]                              */ \
+    OP(Add, "ADD")                  /* R[a] = R[b] + R[c]                            */ \
+    OP(Sub, "SUB")                  /* R[a] = R[b] - R[c]                            */ \
+    OP(Mult, "MUL")                 /* R[a] = R[b] * R[c]                            */ \
+    OP(Div, "DIV")                  /* R[a] = R[b] / R[c]                            */ \
+    OP(Equal, "EQ")                 /* R[a] = R[b] == R[c]                           */ \
+    OP(NotEqual, "NE")              /* R[a] = R[b] != R[c]                           */ \
+    OP(Less, "LT")                  /* R[a] = R[b] < R[c]                            */ \
+    OP(Greater, "GT")               /* R[a] = R[b] > R[c]                            */ \
+    OP(LessOrEqual, "LE")           /* R[a] = R[b] <= R[c]                           */ \
+    OP(GreaterOrEqual, "GE")        /* R[a] = R[b] >= R[c]                           */ \
+    OP(Compare, "CMP")              /* R[a] = C[c](R[b], R[b + 1])                   */ \
+    OP(Not, "NOT")                  /* R[a] = not R[b]                               */ \
+    OP(ToBool, "TOBOOL")            /* R[a] = Bool(R[b])                             */ \
+    OP(Jump, "JMP")                 /* goto b                                        */ \
+    OP(JumpIfFalse, "JMPF")         /* if not R[a]: goto b                           */ \
+    OP(JumpIfTrue, "JMPT")          /* if R[a]: goto b                               */ \
+    OP(Call, "CALL")                /* R[a] = R[b].method(args) as described by S[c] */ \
+    OP(NewInstance, "NEW")          /* R[a] = class(args) as described by S[c]       */ \
+    OP(Stringify, "STR")            /* R[a] = str(R[b])                              */ \
+    OP(Print, "PRINT")              /* print R[a], ..., R[a + b - 1]                 */ \
+    OP(Undefined, "UNDEF")          /* throw error: variable N[b] is not defined     */ \
+    OP(Return, "RET")               /* return R[a]                                   */ \
+    OP(ReturnNone, "RETNONE")       /* return None                                   */
+
+enum class OpCode : uint8_t {
+#define MYTHON_OPCODE_ENUM(name, mnemonic) name,
+    MYTHON_OPCODES(MYTHON_OPCODE_ENUM)
+#undef MYTHON_OPCODE_ENUM
+};
+
+// Возвращает мнемонику инструкции, например "ADD"
+const char* GetMnemonic(OpCode op);
+
+struct Instruction {
+    OpCode op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+// Точка вызова метода или конструктора. Аргументы вызова лежат в регистрах
+// first_arg ... first_arg + arg_count - 1
+struct CallSite {
+    // Для CALL - индекс имени метода в Function::names,
+    // для NEW - индекс класса в Function::classes
+    uint32_t target = 0;
+    uint32_t first_arg = 0;
+    uint32_t arg_count = 0;
+    // Для NEW: конструктор __init__, вызываемый после создания объекта, либо nullptr
+    const runtime::Method* init = nullptr;
+    // Встроенный кэш CALL: метод, найденный для объектов класса cached_class
+    mutable const runtime::Class* cached_class = nullptr;
+    mutable const runtime::Method* cached_method = nullptr;
+};
+
+// Скомпилированная функция: тело метода либо программа верхнего уровня.
+// У метода регистр 0 содержит self, регистры 1..n - формальные параметры
+struct Function {
+    std::string name;
+    uint32_t param_count = 0;
+    uint32_t register_count = 0;
+    std::vector<Instruction> code;
+    std::vector<runtime::ObjectHolder> constants;
+    std::vector<std::string> names;
+    std::vector<CallSite> call_sites;
+    std::vector<const runtime::Class*> classes;
+    std::vector<ast::Comparison::Comparator> comparators;
+    // Имена переменных, закреплённых за регистрами. Используются дизассемблером
+    std::vector<std::string> register_names;
+};
+
+// Скомпилированная программа: функция верхнего уровня и тела методов объявленных в ней классов
+struct Module {
+    Function main;
+    std::vector<std::unique_ptr<Function>> methods;
+    std::unordered_map<const runtime::Method*, const Function*> method_index;
+
+    // Возвращает скомпилированное тело метода, при необходимости компилируя его.
+    // Если тело метода не является синтаксическим деревом Mython, возвращает nullptr
+    const Function* GetMethod(const runtime::Class& cls, const runtime::Method& method);
+};
+
+class CompileError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Компилирует синтаксическое дерево программы, полученное от ParseProgram.
+// Методы классов, объявленных в программе, компилируются вместе с ней
+Module Compile(const ast::Statement& program);
+
+// Выводит в out листинг функции
+void Disassemble(const Function& function, std::ostream& out);
+// Выводит в out листинг всех функций модуля
+void Disassemble(const Module& module, std::ostream& out);
+
+}  // namespace bytecode
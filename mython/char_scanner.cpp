@@ -0,0 +1,111 @@
+#include "char_scanner.h"
+
+#if defined(MYTHON_AVX2) && defined(__AVX2__)
+#include <immintrin.h>
+#define MYTHON_SIMD_BLOCK 32u
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MYTHON_SIMD_BLOCK 16u
+#endif
+
+using namespace std;
+
+namespace parse {
+
+namespace {
+
+#ifdef MYTHON_SIMD_BLOCK
+
+constexpr size_t BLOCK_SIZE = MYTHON_SIMD_BLOCK;
+
+//bit i is set when first <= data[i] <= last
+uint32_t RangeMask(const char* data, unsigned char first, unsigned char last) {
+    //a byte is in the range when subtracting first leaves at most last - first,
+    //which an unsigned saturating subtraction of last - first turns into zero
+#if MYTHON_SIMD_BLOCK == 32u
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(static_cast<char>(first)));
+    const __m256i excess = _mm256_subs_epu8(shifted, _mm256_set1_epi8(static_cast<char>(last - first)));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(excess, _mm256_setzero_si256())));
+#else
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(static_cast<char>(first)));
+    const __m128i excess = _mm_subs_epu8(shifted, _mm_set1_epi8(static_cast<char>(last - first)));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(excess, _mm_setzero_si128())));
+#endif
+}
+
+constexpr uint32_t FULL_MASK = BLOCK_SIZE == 32u ? ~uint32_t{0} : (uint32_t{1} << BLOCK_SIZE) - 1u;
+
+#endif
+
+}  // namespace
+
+size_t CharClass::FindFirstIn(string_view text, size_t pos) const {
+    if(IsEmpty()) {
+        return string_view::npos;
+    }
+    const char* data = text.data();
+#ifdef MYTHON_SIMD_BLOCK
+    for( ; pos + BLOCK_SIZE <= text.size(); pos += BLOCK_SIZE) {
+        for(uint32_t candidates = RangeMask(data + pos, first_, last_); candidates != 0; candidates &= candidates - 1u) {
+            const size_t found = pos + static_cast<size_t>(__builtin_ctz(candidates));
+            if(Contains(data[found])) {
+                return found;
+            }
+        }
+    }
+#endif
+    for( ; pos < text.size(); ++pos) {
+        if(Contains(data[pos])) {
+            return pos;
+        }
+    }
+    return string_view::npos;
+}
+
+size_t CharClass::FindFirstNotIn(string_view text, size_t pos) const {
+    if(IsEmpty()) {
+        return pos < text.size() ? pos : string_view::npos;
+    }
+    const char* data = text.data();
+#ifdef MYTHON_SIMD_BLOCK
+    for( ; pos + BLOCK_SIZE <= text.size(); pos += BLOCK_SIZE) {
+        uint32_t candidates = ~RangeMask(data + pos, core_first_, core_last_) & FULL_MASK;
+        for( ; candidates != 0; candidates &= candidates - 1u) {
+            const size_t found = pos + static_cast<size_t>(__builtin_ctz(candidates));
+            if(!Contains(data[found])) {
+                return found;
+            }
+        }
+    }
+#endif
+    for( ; pos < text.size(); ++pos) {
+        if(!Contains(data[pos])) {
+            return pos;
+        }
+    }
+    return string_view::npos;
+}
+
+string_view Unescape(string_view raw_string, string& buffer) {
+    const string_view content = raw_string.substr(1u, raw_string.size() - 2u); //quotes are not needed
+    size_t pos = content.find('\\');
+    if(pos == content.npos) {
+        return content;
+    }
+    buffer.assign(content, 0, pos);
+    while(pos < content.size()) {
+        const size_t backslash = min(content.find('\\', pos), content.size());
+        buffer.append(content, pos, backslash - pos);
+        if(backslash + 1u >= content.size()) {
+            break;
+        }
+        const char escaped = content[backslash + 1u];
+        buffer += escaped == 'n' ? '\n' : escaped == 't' ? '\t' : escaped;
+        pos = backslash + 2u;
+    }
+    return buffer;
+}
+
+}  // namespace parse
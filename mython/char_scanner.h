@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace parse {
+
+/*
+Класс символов лексера, заданный битовой картой на 256 значений байта. Поиск первого
+символа класса или первого символа не из класса просматривает текст блоками по 16 байт
+(SSE2) или 32 байта (AVX2, если интерпретатор собран с MYTHON_AVX2). В блоке векторно
+отбираются кандидаты: для поиска символа класса - байты из диапазона между наименьшим
+и наибольшим символом класса, для поиска символа не из класса - байты вне самого длинного
+непрерывного участка класса. Кандидаты проверяются по карте, поэтому результат всегда
+совпадает со скалярным поиском, которым обрабатывается хвост текста и платформы без SSE2
+*/
+class CharClass {
+public:
+    constexpr explicit CharClass(std::string_view chars) {
+        for(const char c : chars) {
+            const auto byte = static_cast<unsigned char>(c);
+            bits_[byte / 64u] |= uint64_t{1} << (byte % 64u);
+        }
+        //the bounding range and the longest run of consecutive bytes of the class
+        size_t run_start = 0;
+        size_t longest_run = 0;
+        for(size_t byte = 0; byte < 256u; ++byte) {
+            if(!Contains(static_cast<char>(byte))) {
+                continue;
+            }
+            if(byte == 0 || !Contains(static_cast<char>(byte - 1u))) {
+                run_start = byte;
+            }
+            if(byte - run_start + 1u > longest_run) {
+                longest_run = byte - run_start + 1u;
+                core_first_ = static_cast<unsigned char>(run_start);
+                core_last_ = static_cast<unsigned char>(byte);
+            }
+            first_ = std::min(first_, static_cast<unsigned char>(byte));
+            last_ = static_cast<unsigned char>(byte);
+        }
+    }
+
+    [[nodiscard]] constexpr bool Contains(char c) const {
+        const auto byte = static_cast<unsigned char>(c);
+        return (bits_[byte / 64u] >> (byte % 64u)) & 1u;
+    }
+
+    // Возвращают позицию первого символа text не раньше pos, который принадлежит классу
+    // или не принадлежит ему, либо std::string_view::npos, если такого символа нет
+    [[nodiscard]] size_t FindFirstIn(std::string_view text, size_t pos = 0) const;
+    [[nodiscard]] size_t FindFirstNotIn(std::string_view text, size_t pos = 0) const;
+
+private:
+    [[nodiscard]] constexpr bool IsEmpty() const {
+        return first_ > last_;
+    }
+
+    std::array<uint64_t, 4> bits_{};
+    unsigned char first_ = 255u;
+    unsigned char last_ = 0;
+    unsigned char core_first_ = 255u;
+    unsigned char core_last_ = 0;
+};
+
+namespace char_class {
+// Пробелы между словами строки. Обратная косая черта вне строк пропускается как пробел
+inline constexpr CharClass SPACE{" \\"};
+inline constexpr CharClass DIGIT{"0123456789"};
+// Символы операторов и кавычки, каждый из них начинает новую лексему
+inline constexpr CharClass OPERATOR{",.\'\"+-*/():<>!="};
+// Символы, на которых заканчивается идентификатор или ключевое слово
+inline constexpr CharClass WORD_END{" #,.\'\"+-*/():<>!="};
+// Символы, на которых может закончиться строка программы: перевод строки и кавычки,
+// внутри которых перевод строки входит в строковую константу
+inline constexpr CharClass LINE_END{"\n\'\""};
+// Символы, которые остаются в тексте программы: печатные, перевод строки и табуляция
+inline constexpr CharClass ALLOWED{
+    "\t\n\r !\"#$%&\'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+    "abcdefghijklmnopqrstuvwxyz{|}~"};
+}  // namespace char_class
+
+// Возвращает содержимое строковой константы raw_string без кавычек, заменяя за один проход
+// \n и \t переводом строки и табуляцией, а \ перед любым другим символом отбрасывая.
+// Содержимое без \ возвращается как часть raw_string, иначе собирается в buffer
+std::string_view Unescape(std::string_view raw_string, std::string& buffer);
+
+}  // namespace parse
@@ -0,0 +1,474 @@
+#include "closure_compiler.h"
+
+#include <algorithm>
+#include <optional>
+
+using namespace std;
+
+namespace closure_compiler {
+
+using runtime::ObjectHolder;
+
+namespace {
+
+const ObjectHolder TRUE_VALUE = ObjectHolder::Own(runtime::Bool{true});
+const ObjectHolder FALSE_VALUE = ObjectHolder::Own(runtime::Bool{false});
+
+inline const ObjectHolder& MakeBool(bool value) {
+    return value ? TRUE_VALUE : FALSE_VALUE;
+}
+
+using ComparatorFn = bool (*)(const ObjectHolder&, const ObjectHolder&, runtime::Context&);
+
+// Операции над числами с общим путём для остальных типов
+struct AddOp {
+    static int Apply(int lhs, int rhs) {
+        return lhs + rhs;
+    }
+    static ObjectHolder Generic(const ObjectHolder& lhs, const ObjectHolder& rhs, runtime::Context& context) {
+        return runtime::Add(lhs, rhs, context);
+    }
+};
+
+struct SubOp {
+    static int Apply(int lhs, int rhs) {
+        return lhs - rhs;
+    }
+    static ObjectHolder Generic(const ObjectHolder& lhs, const ObjectHolder& rhs, runtime::Context&) {
+        return runtime::Sub(lhs, rhs);
+    }
+};
+
+struct MultOp {
+    static int Apply(int lhs, int rhs) {
+        return lhs * rhs;
+    }
+    static ObjectHolder Generic(const ObjectHolder& lhs, const ObjectHolder& rhs, runtime::Context&) {
+        return runtime::Mult(lhs, rhs);
+    }
+};
+
+template <typename Op>
+Expression MakeArithmetic(Expression lhs, Expression rhs, std::optional<int> rhs_const) {
+    if(rhs_const) {
+        //constant operand is bound into the closure
+        return [lhs = std::move(lhs), value = *rhs_const,
+                holder = ObjectHolder::Own(runtime::Number{*rhs_const})](Frame& frame) {
+            auto lhs_value = lhs(frame);
+            if(auto num = lhs_value.TryAsExact<runtime::Number>()) {
+                return ObjectHolder::Own(runtime::Number{Op::Apply(num->GetValue(), value)});
+            }
+            return Op::Generic(lhs_value, holder, frame.context);
+        };
+    }
+    return [lhs = std::move(lhs), rhs = std::move(rhs)](Frame& frame) {
+        auto lhs_value = lhs(frame);
+        auto rhs_value = rhs(frame);
+        auto lhs_num = lhs_value.TryAsExact<runtime::Number>();
+        auto rhs_num = rhs_value.TryAsExact<runtime::Number>();
+        if(lhs_num && rhs_num) {
+            return ObjectHolder::Own(runtime::Number{Op::Apply(lhs_num->GetValue(), rhs_num->GetValue())});
+        }
+        return Op::Generic(lhs_value, rhs_value, frame.context);
+    };
+}
+
+template <typename IntCompare>
+Expression MakeComparison(Expression lhs, Expression rhs, ComparatorFn generic) {
+    return [lhs = std::move(lhs), rhs = std::move(rhs), generic](Frame& frame) -> ObjectHolder {
+        auto lhs_value = lhs(frame);
+        auto rhs_value = rhs(frame);
+        auto lhs_num = lhs_value.TryAsExact<runtime::Number>();
+        auto rhs_num = rhs_value.TryAsExact<runtime::Number>();
+        if(lhs_num && rhs_num) {
+            return MakeBool(IntCompare{}(lhs_num->GetValue(), rhs_num->GetValue()));
+        }
+        return MakeBool(generic(lhs_value, rhs_value, frame.context));
+    };
+}
+
+runtime::ClassInstance& ExpectInstance(const ObjectHolder& holder) {
+    auto instance = holder.TryAsExact<runtime::ClassInstance>();
+    if(!instance) {
+        throw std::runtime_error("object is not a ClassInstance"s);
+    }
+    return *instance;
+}
+
+class FunctionCompiler {
+public:
+    FunctionCompiler(const std::vector<std::string>& params, const ast::Statement& body) {
+        for(const auto& name : params) {
+            DeclareVariable(name);
+        }
+        std::vector<std::string> names;
+        ast::CollectAssignedVariables(body, names);
+        for(const auto& name : names) {
+            DeclareVariable(name);
+        }
+    }
+
+    size_t SlotCount() const {
+        return slots_.size();
+    }
+
+    Action CompileAction(const ast::Statement& node) {
+        if(auto compound = dynamic_cast<const ast::Compound*>(&node)) {
+            std::vector<Action> actions;
+            for(const auto& stmt : compound->Statements()) {
+                actions.push_back(CompileAction(*stmt));
+            }
+            return [actions = std::move(actions)](Frame& frame) {
+                for(const auto& action : actions) {
+                    if(action(frame)) {
+                        return true;
+                    }
+                }
+                return false;
+            };
+        }
+        if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+            return [slot = slots_.at(assignment->GetName()),
+                    value = CompileExpression(*assignment->Value())](Frame& frame) {
+                frame.slots[slot] = value(frame);
+                return false;
+            };
+        }
+        if(auto if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+            auto condition = CompileExpression(*if_else->Condition());
+            auto if_body = CompileAction(*if_else->IfBody());
+            if(!if_else->ElseBody()) {
+                return [condition = std::move(condition), if_body = std::move(if_body)](Frame& frame) {
+                    return runtime::IsTrue(condition(frame)) && if_body(frame);
+                };
+            }
+            return [condition = std::move(condition), if_body = std::move(if_body),
+                    else_body = CompileAction(*if_else->ElseBody())](Frame& frame) {
+                return runtime::IsTrue(condition(frame)) ? if_body(frame) : else_body(frame);
+            };
+        }
+        if(auto ret = dynamic_cast<const ast::Return*>(&node)) {
+            return [value = CompileExpression(*ret->Value())](Frame& frame) {
+                frame.result = value(frame);
+                return true;
+            };
+        }
+        if(auto body = dynamic_cast<const ast::MethodBody*>(&node)) {
+            return CompileAction(*body->Body());
+        }
+        if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            const auto& cls = definition->GetClass();
+            return [slot = slots_.at(cls.GetName()),
+                    holder = ObjectHolder::Share(const_cast<runtime::Class&>(cls))](Frame& frame) {
+                frame.slots[slot] = holder;
+                return false;
+            };
+        }
+        return [value = CompileExpression(node)](Frame& frame) {
+            value(frame);
+            return false;
+        };
+    }
+
+    Expression CompileExpression(const ast::Statement& node) {
+        if(auto num = dynamic_cast<const ast::NumericConst*>(&node)) {
+            return [value = num->GetObject()](Frame&) {
+                return value;
+            };
+        }
+        if(auto str = dynamic_cast<const ast::StringConst*>(&node)) {
+            return [value = str->GetObject()](Frame&) {
+                return value;
+            };
+        }
+        if(auto boolean = dynamic_cast<const ast::BoolConst*>(&node)) {
+            return [value = MakeBool(boolean->GetValue().GetValue())](Frame&) {
+                return value;
+            };
+        }
+        if(dynamic_cast<const ast::None*>(&node)) {
+            return [](Frame&) {
+                return ObjectHolder::None();
+            };
+        }
+        if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+            return CompileVariable(var->GetDottedIds());
+        }
+        if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+            return [slot = slots_.at(assignment->GetName()),
+                    value = CompileExpression(*assignment->Value())](Frame& frame) {
+                return frame.slots[slot] = value(frame);
+            };
+        }
+        if(auto field_assignment = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+            return [object = CompileVariable(field_assignment->Object().GetDottedIds()),
+                    name = field_assignment->GetFieldName(),
+                    value = CompileExpression(*field_assignment->Value())](Frame& frame) {
+                auto& instance = ExpectInstance(object(frame));
+                return instance.Fields()[name] = value(frame);
+            };
+        }
+        if(auto call = dynamic_cast<const ast::MethodCall*>(&node)) {
+            return CompileMethodCall(*call);
+        }
+        if(auto inlined = dynamic_cast<const ast::InlinedMethodCall*>(&node)) {
+            //slots are allocated per method, so the inlined body's temporaries are not mapped
+            return CompileMethodCall(inlined->GetCall());
+        }
+        if(auto new_instance = dynamic_cast<const ast::NewInstance*>(&node)) {
+            const auto& cls = new_instance->GetClass();
+            const auto* init = cls.GetMethod("__init__"s);
+            if(!init || init->formal_params.size() != new_instance->Args().size()) {
+                init = nullptr;
+            }
+            return [&cls, init, args = CompileArgs(new_instance->Args())](Frame& frame) {
+                auto holder = ObjectHolder::Own(runtime::ClassInstance{cls});
+                if(init) {
+                    std::vector<ObjectHolder> values;
+                    values.reserve(args.size());
+                    for(const auto& arg : args) {
+                        values.push_back(arg(frame));
+                    }
+                    static_cast<runtime::ClassInstance*>(holder.Get())->Call(*init, values, frame.context);
+                }
+                return holder;
+            };
+        }
+        if(auto print = dynamic_cast<const ast::Print*>(&node)) {
+            return [args = CompileArgs(print->Args())](Frame& frame) {
+                auto& out = frame.context.GetOutputStream();
+                bool first = true;
+                for(const auto& arg : args) {
+                    if(!first) {
+                        out << ' ';
+                    }
+                    first = false;
+                    auto value = arg(frame);
+                    if(value) {
+                        value->Print(out, frame.context);
+                    }
+                    else {
+                        out << "None"sv;
+                    }
+                }
+                out << '\n';
+                return ObjectHolder::None();
+            };
+        }
+        if(auto stringify = dynamic_cast<const ast::Stringify*>(&node)) {
+            return [arg = CompileExpression(*stringify->Argument())](Frame& frame) {
+                return ObjectHolder::Own(runtime::String{runtime::ToString(arg(frame), frame.context)});
+            };
+        }
+        if(auto not_op = dynamic_cast<const ast::Not*>(&node)) {
+            return [arg = CompileExpression(*not_op->Argument())](Frame& frame) {
+                return MakeBool(!runtime::IsTrue(arg(frame)));
+            };
+        }
+        if(auto or_op = dynamic_cast<const ast::Or*>(&node)) {
+            return [lhs = CompileExpression(*or_op->Lhs()), rhs = CompileExpression(*or_op->Rhs())](Frame& frame) {
+                return MakeBool(runtime::IsTrue(lhs(frame)) || runtime::IsTrue(rhs(frame)));
+            };
+        }
+        if(auto and_op = dynamic_cast<const ast::And*>(&node)) {
+            return [lhs = CompileExpression(*and_op->Lhs()), rhs = CompileExpression(*and_op->Rhs())](Frame& frame) {
+                return MakeBool(runtime::IsTrue(lhs(frame)) && runtime::IsTrue(rhs(frame)));
+            };
+        }
+        if(auto comparison = dynamic_cast<const ast::Comparison*>(&node)) {
+            return CompileComparison(*comparison);
+        }
+        if(auto add = dynamic_cast<const ast::Add*>(&node)) {
+            return MakeArithmetic<AddOp>(CompileExpression(*add->Lhs()), CompileExpression(*add->Rhs()),
+                                         GetNumericConst(*add->Rhs()));
+        }
+        if(auto sub = dynamic_cast<const ast::Sub*>(&node)) {
+            return MakeArithmetic<SubOp>(CompileExpression(*sub->Lhs()), CompileExpression(*sub->Rhs()),
+                                         GetNumericConst(*sub->Rhs()));
+        }
+        if(auto mult = dynamic_cast<const ast::Mult*>(&node)) {
+            return MakeArithmetic<MultOp>(CompileExpression(*mult->Lhs()), CompileExpression(*mult->Rhs()),
+                                          GetNumericConst(*mult->Rhs()));
+        }
+        if(auto div = dynamic_cast<const ast::Div*>(&node)) {
+            return [lhs = CompileExpression(*div->Lhs()), rhs = CompileExpression(*div->Rhs())](Frame& frame) {
+                auto lhs_value = lhs(frame);
+                auto rhs_value = rhs(frame);
+                auto lhs_num = lhs_value.TryAsExact<runtime::Number>();
+                auto rhs_num = rhs_value.TryAsExact<runtime::Number>();
+                if(lhs_num && rhs_num && rhs_num->GetValue() != 0) {
+                    return ObjectHolder::Own(runtime::Number{lhs_num->GetValue() / rhs_num->GetValue()});
+                }
+                return runtime::Div(lhs_value, rhs_value);
+            };
+        }
+        if(dynamic_cast<const ast::Compound*>(&node) || dynamic_cast<const ast::IfElse*>(&node)
+           || dynamic_cast<const ast::Return*>(&node) || dynamic_cast<const ast::ClassDefinition*>(&node)
+           || dynamic_cast<const ast::MethodBody*>(&node)) {
+            return [action = CompileAction(node)](Frame& frame) {
+                action(frame);
+                return ObjectHolder::None();
+            };
+        }
+        throw std::runtime_error("closure compiler: unsupported statement: "s + typeid(node).name());
+    }
+
+private:
+    void DeclareVariable(const std::string& name) {
+        slots_.emplace(name, slots_.size());
+    }
+
+    static std::optional<int> GetNumericConst(const ast::Statement& node) {
+        if(auto num = dynamic_cast<const ast::NumericConst*>(&node)) {
+            return num->GetValue().GetValue();
+        }
+        return std::nullopt;
+    }
+
+    std::vector<Expression> CompileArgs(const ast::StatementList& args) {
+        std::vector<Expression> result;
+        result.reserve(args.size());
+        for(const auto& arg : args) {
+            result.push_back(CompileExpression(*arg));
+        }
+        return result;
+    }
+
+    Expression CompileVariable(const std::vector<std::string>& ids) {
+        auto it = slots_.find(ids.front());
+        if(it == slots_.end()) {
+            return [name = ids.front()](Frame&) -> ObjectHolder {
+                throw std::runtime_error("there is no object: "s + name);
+            };
+        }
+        size_t slot = it->second;
+        if(ids.size() == 1u) {
+            return [slot](Frame& frame) {
+                return frame.slots[slot];
+            };
+        }
+        return [slot, fields = std::vector<std::string>(ids.begin() + 1, ids.end())](Frame& frame) {
+            ObjectHolder current = frame.slots[slot];
+            for(const auto& name : fields) {
+                auto& object_fields = ExpectInstance(current).Fields();
+                auto field = object_fields.find(name);
+                if(field == object_fields.end()) {
+                    throw std::runtime_error("there is no field: "s + name);
+                }
+                current = field->second;
+            }
+            return current;
+        };
+    }
+
+    Expression CompileMethodCall(const ast::MethodCall& call) {
+        struct InlineCache {
+            const runtime::Class* cls = nullptr;
+            const runtime::Method* method = nullptr;
+        };
+        return [object = CompileExpression(*call.Object()), name = call.GetMethodName(),
+                args = CompileArgs(call.Args()), cache = InlineCache{}](Frame& frame) mutable {
+            auto receiver = object(frame);
+            auto& instance = ExpectInstance(receiver);
+            if(cache.cls != &instance.GetClass()) {
+                const auto* method = instance.GetClass().GetMethod(name);
+                if(!method || method->formal_params.size() != args.size()) {
+                    throw std::runtime_error("object has no method: "s + name);
+                }
+                cache = {&instance.GetClass(), method};
+            }
+            std::vector<ObjectHolder> values;
+            values.reserve(args.size());
+            for(const auto& arg : args) {
+                values.push_back(arg(frame));
+            }
+            return instance.Call(*cache.method, values, frame.context);
+        };
+    }
+
+    Expression CompileComparison(const ast::Comparison& comparison) {
+        auto lhs = CompileExpression(*comparison.Lhs());
+        auto rhs = CompileExpression(*comparison.Rhs());
+        if(auto fn_ptr = comparison.GetComparator().target<ComparatorFn>()) {
+            if(*fn_ptr == runtime::Equal) {
+                return MakeComparison<std::equal_to<int>>(std::move(lhs), std::move(rhs), runtime::Equal);
+            }
+            if(*fn_ptr == runtime::NotEqual) {
+                return MakeComparison<std::not_equal_to<int>>(std::move(lhs), std::move(rhs), runtime::NotEqual);
+            }
+            if(*fn_ptr == runtime::Less) {
+                return MakeComparison<std::less<int>>(std::move(lhs), std::move(rhs), runtime::Less);
+            }
+            if(*fn_ptr == runtime::Greater) {
+                return MakeComparison<std::greater<int>>(std::move(lhs), std::move(rhs), runtime::Greater);
+            }
+            if(*fn_ptr == runtime::LessOrEqual) {
+                return MakeComparison<std::less_equal<int>>(std::move(lhs), std::move(rhs), runtime::LessOrEqual);
+            }
+            if(*fn_ptr == runtime::GreaterOrEqual) {
+                return MakeComparison<std::greater_equal<int>>(std::move(lhs), std::move(rhs), runtime::GreaterOrEqual);
+            }
+        }
+        return [lhs = std::move(lhs), rhs = std::move(rhs), cmp = comparison.GetComparator()](Frame& frame) {
+            auto lhs_value = lhs(frame);
+            return MakeBool(cmp(lhs_value, rhs(frame), frame.context));
+        };
+    }
+
+    std::unordered_map<std::string, size_t> slots_;
+};
+
+}  // namespace
+
+Engine::Engine(const ast::Statement& program) {
+    FunctionCompiler compiler({}, program);
+    main_.body = compiler.CompileAction(program);
+    main_.slot_count = compiler.SlotCount();
+}
+
+void Engine::Run(runtime::Context& context) {
+    runtime::ExecutorContext engine_context(context, *this);
+    std::vector<ObjectHolder> slots(main_.slot_count);
+    Frame frame{slots.data(), engine_context};
+    main_.body(frame);
+}
+
+const Function* Engine::GetMethod(const runtime::Method& method) {
+    if(auto it = methods_.find(&method); it != methods_.end()) {
+        return it->second.get();
+    }
+    auto body = dynamic_cast<const ast::MethodBody*>(method.body.get());
+    if(!body) {
+        methods_[&method] = nullptr;
+        return nullptr;
+    }
+    std::vector<std::string> params{"self"s};
+    params.insert(params.end(), method.formal_params.begin(), method.formal_params.end());
+    FunctionCompiler compiler(params, *body);
+    auto function = std::make_unique<Function>();
+    function->body = compiler.CompileAction(*body);
+    function->slot_count = compiler.SlotCount();
+    return (methods_[&method] = std::move(function)).get();
+}
+
+ObjectHolder Engine::Invoke(runtime::ClassInstance& self, const runtime::Method& method,
+                            const std::vector<ObjectHolder>& actual_args, runtime::Context& context) {
+    const Function* function = GetMethod(method);
+    if(!function) {
+        //method body is not a Mython syntax tree, execute it directly
+        runtime::Closure arguments;
+        for(size_t i = 0; i < method.formal_params.size(); ++i) {
+            arguments[method.formal_params[i]] = actual_args[i];
+        }
+        arguments["self"s] = ObjectHolder::Share(self);
+        return method.body->Execute(arguments, context);
+    }
+    std::vector<ObjectHolder> slots(function->slot_count);
+    slots[0] = ObjectHolder::Share(self);
+    std::copy(actual_args.begin(), actual_args.end(), slots.begin() + 1);
+    Frame frame{slots.data(), context};
+    function->body(frame);
+    return std::move(frame.result);
+}
+
+}  // namespace closure_compiler
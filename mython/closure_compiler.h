@@ -0,0 +1,57 @@
+#pragma once
+
+#include "runtime.h"
+#include "statement.h"
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace closure_compiler {
+
+// Кадр исполнения скомпилированной функции: значения переменных, закреплённых за слотами,
+// и результат инструкции return
+struct Frame {
+    runtime::ObjectHolder* slots;
+    runtime::Context& context;
+    runtime::ObjectHolder result{};
+};
+
+// Скомпилированное выражение возвращает своё значение
+using Expression = std::function<runtime::ObjectHolder(Frame&)>;
+// Скомпилированная инструкция возвращает true, если была выполнена инструкция return
+using Action = std::function<bool(Frame&)>;
+
+// Функция верхнего уровня либо тело метода, скомпилированные в дерево замыканий.
+// У метода слот 0 содержит self, слоты 1..n - формальные параметры
+struct Function {
+    size_t slot_count = 0;
+    Action body;
+};
+
+// Механизм исполнения, который однократно превращает синтаксическое дерево в дерево
+// специализированных замыканий. Константы, номера слотов переменных и виды операций
+// связываются с замыканиями при компиляции, поэтому при исполнении нет виртуальных вызовов
+// Execute, dynamic_cast при выборе узла и поиска переменных по имени
+class Engine : public runtime::MethodExecutor {
+public:
+    explicit Engine(const ast::Statement& program);
+
+    // Выполняет программу. Вывод направляется в context
+    void Run(runtime::Context& context);
+
+    runtime::ObjectHolder Invoke(runtime::ClassInstance& self, const runtime::Method& method,
+                                 const std::vector<runtime::ObjectHolder>& actual_args,
+                                 runtime::Context& context) override;
+
+private:
+    // Возвращает скомпилированное тело метода либо nullptr, если тело не является
+    // синтаксическим деревом Mython
+    const Function* GetMethod(const runtime::Method& method);
+
+    Function main_;
+    std::unordered_map<const runtime::Method*, std::unique_ptr<Function>> methods_;
+};
+
+}  // namespace closure_compiler
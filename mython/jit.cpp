@@ -0,0 +1,870 @@
+#include "jit.h"
+
+#include "vm.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define MYTHON_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace jit {
+
+using bytecode::Instruction;
+using bytecode::OpCode;
+using runtime::ObjectHolder;
+
+namespace {
+
+#ifdef MYTHON_JIT_X86_64
+
+//helpers called from native code. An exception must not unwind through native frames,
+//so a helper that may throw stores it in the frame and returns a nonzero status
+
+void ExecuteGeneric(Frame& frame, const Instruction& ins) {
+    ObjectHolder* r = frame.registers;
+    const auto& function = *frame.function;
+    auto& context = *frame.context;
+    switch(ins.op) {
+        case OpCode::LoadConst:
+            r[ins.a] = function.constants[ins.b];
+            break;
+        case OpCode::LoadNone:
+            r[ins.a] = ObjectHolder::None();
+            break;
+        case OpCode::Move:
+            r[ins.a] = r[ins.b];
+            break;
+        case OpCode::GetField: {
+            auto& fields = vm::GetFields(r[ins.b]);
+            const auto& name = function.names[ins.c];
+            auto it = fields.find(name);
+            if(it == fields.end()) {
+                throw std::runtime_error("there is no field: "s + name);
+            }
+            r[ins.a] = it->second;
+            break;
+        }
+        case OpCode::SetField:
+            vm::GetFields(r[ins.a])[function.names[ins.b]] = r[ins.c];
+            break;
+        case OpCode::Add:
+            r[ins.a] = runtime::Add(r[ins.b], r[ins.c], context);
+            break;
+        case OpCode::Sub:
+            r[ins.a] = runtime::Sub(r[ins.b], r[ins.c]);
+            break;
+        case OpCode::Mult:
+            r[ins.a] = runtime::Mult(r[ins.b], r[ins.c]);
+            break;
+        case OpCode::Div:
+            r[ins.a] = runtime::Div(r[ins.b], r[ins.c]);
+            break;
+        case OpCode::Equal:
+            r[ins.a] = vm::MakeBool(runtime::Equal(r[ins.b], r[ins.c], context));
+            break;
+        case OpCode::NotEqual:
+            r[ins.a] = vm::MakeBool(runtime::NotEqual(r[ins.b], r[ins.c], context));
+            break;
+        case OpCode::Less:
+            r[ins.a] = vm::MakeBool(runtime::Less(r[ins.b], r[ins.c], context));
+            break;
+        case OpCode::Greater:
+            r[ins.a] = vm::MakeBool(runtime::Greater(r[ins.b], r[ins.c], context));
+            break;
+        case OpCode::LessOrEqual:
+            r[ins.a] = vm::MakeBool(runtime::LessOrEqual(r[ins.b], r[ins.c], context));
+            break;
+        case OpCode::GreaterOrEqual:
+            r[ins.a] = vm::MakeBool(runtime::GreaterOrEqual(r[ins.b], r[ins.c], context));
+            break;
+        case OpCode::Compare:
+            r[ins.a] = vm::MakeBool(function.comparators[ins.c](r[ins.b], r[ins.b + 1u], context));
+            break;
+        case OpCode::Not:
+            r[ins.a] = vm::MakeBool(!runtime::IsTrue(r[ins.b]));
+            break;
+        case OpCode::ToBool:
+            r[ins.a] = vm::MakeBool(runtime::IsTrue(r[ins.b]));
+            break;
+        case OpCode::Call: {
+            const auto& site = function.call_sites[ins.c];
+            auto instance = r[ins.b].TryAsExact<runtime::ClassInstance>();
+            if(!instance) {
+                throw std::runtime_error("object is not ClassInstance"s);
+            }
+            const auto& method = vm::ResolveMethod(*instance, function, site);
+            r[ins.a] = frame.machine->CallMethod(r[ins.b], method, r + site.first_arg, context);
+            break;
+        }
+        case OpCode::NewInstance:
+            r[ins.a] = frame.machine->CreateInstance(function, function.call_sites[ins.c], r, context);
+            break;
+        case OpCode::Stringify:
+            r[ins.a] = ObjectHolder::Own(runtime::String{runtime::ToString(r[ins.b], context)});
+            break;
+        case OpCode::Print:
+            vm::PrintValues(r + ins.a, ins.b, context);
+            break;
+        case OpCode::Undefined:
+            throw std::runtime_error("there is no object: "s + function.names[ins.b]);
+        case OpCode::Jump:
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfTrue:
+        case OpCode::Return:
+        case OpCode::ReturnNone:
+            throw std::logic_error("control flow instruction must be compiled to native code"s);
+    }
+}
+
+int ExecuteInstruction(Frame* frame, const Instruction* ins) {
+    try {
+        ExecuteGeneric(*frame, *ins);
+        return 0;
+    }
+    catch(...) {
+        frame->error = std::current_exception();
+        return 1;
+    }
+}
+
+int StoreNumber(Frame* frame, const Instruction* ins, int value) {
+    try {
+        auto& target = frame->registers[ins->a];
+        //a number no one else holds is overwritten instead of allocating a new one
+        if(auto number = target.TryAsExact<runtime::Number>(); number && target.IsExclusive()) {
+            *number = runtime::Number{value};
+            return 0;
+        }
+        target = ObjectHolder::Own(runtime::Number{value});
+        return 0;
+    }
+    catch(...) {
+        frame->error = std::current_exception();
+        return 1;
+    }
+}
+
+void LoadConstant(Frame* frame, const Instruction* ins) noexcept {
+    frame->registers[ins->a] = frame->function->constants[ins->b];
+}
+
+void CopyRegister(Frame* frame, const Instruction* ins) noexcept {
+    frame->registers[ins->a] = frame->registers[ins->b];
+}
+
+void StoreBool(Frame* frame, const Instruction* ins, int value) noexcept {
+    frame->registers[ins->a] = vm::MakeBool(value != 0);
+}
+
+int IsTrue(Frame* frame, const Instruction* ins) noexcept {
+    return runtime::IsTrue(frame->registers[ins->a]) ? 1 : 0;
+}
+
+void StoreResult(Frame* frame, const Instruction* ins) noexcept {
+    frame->result = frame->registers[ins->a];
+}
+
+//field access on an object already known to be a ClassInstance
+int GetField(Frame* frame, const Instruction* ins, runtime::Object* object) {
+    try {
+        auto& fields = static_cast<runtime::ClassInstance*>(object)->Fields();
+        const auto& name = frame->function->names[ins->c];
+        auto it = fields.find(name);
+        if(it == fields.end()) {
+            throw std::runtime_error("there is no field: "s + name);
+        }
+        frame->registers[ins->a] = it->second;
+        return 0;
+    }
+    catch(...) {
+        frame->error = std::current_exception();
+        return 1;
+    }
+}
+
+int SetField(Frame* frame, const Instruction* ins, runtime::Object* object) {
+    try {
+        static_cast<runtime::ClassInstance*>(object)->Fields()[frame->function->names[ins->b]] =
+            frame->registers[ins->c];
+        return 0;
+    }
+    catch(...) {
+        frame->error = std::current_exception();
+        return 1;
+    }
+}
+
+//where the vtable pointer of an exact runtime type points and where its value is stored
+struct ValueLayout {
+    uint64_t vtable = 0;
+    int32_t value_offset = 0;
+};
+
+template <typename T>
+ValueLayout DescribeValue(const T& object) {
+    const runtime::Object& base = object;
+    ValueLayout result;
+    std::memcpy(&result.vtable, static_cast<const void*>(&base), sizeof(result.vtable));
+    result.value_offset = static_cast<int32_t>(reinterpret_cast<const char*>(&object.GetValue())
+                                               - reinterpret_cast<const char*>(&base));
+    return result;
+}
+
+struct Layouts {
+    ValueLayout number;
+    ValueLayout boolean;
+    uint64_t instance_vtable = 0;
+    bool valid = false;
+};
+
+const Layouts& GetLayouts() {
+    static const Layouts layouts = [] {
+        Layouts result;
+        result.number = DescribeValue(runtime::Number{0});
+        result.boolean = DescribeValue(runtime::Bool{false});
+        runtime::Class cls("Layout"s, {}, nullptr);
+        runtime::ClassInstance instance(cls);
+        const runtime::Object& base = instance;
+        std::memcpy(&result.instance_vtable, static_cast<const void*>(&base), sizeof(result.instance_vtable));
+        //native code reads the object pointer straight from the first word of an ObjectHolder
+        auto holder = ObjectHolder::Own(runtime::Number{0});
+        runtime::Object* stored = nullptr;
+        std::memcpy(&stored, static_cast<const void*>(&holder), sizeof(stored));
+        result.valid = sizeof(ObjectHolder) == 2u * sizeof(void*) && stored == holder.Get();
+        return result;
+    }();
+    return layouts;
+}
+
+enum Register : uint8_t {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RSI = 6,
+};
+
+enum Condition : uint8_t {
+    EQUAL = 0x4,
+    NOT_EQUAL = 0x5,
+    LESS = 0xC,
+    GREATER_OR_EQUAL = 0xD,
+    LESS_OR_EQUAL = 0xE,
+    GREATER = 0xF,
+};
+
+//emits x86-64 machine code. rbx holds the Frame pointer and r12 the registers
+//of the function during the whole call
+class Assembler {
+public:
+    using Label = size_t;
+
+    Label NewLabel() {
+        labels_.push_back(UNBOUND);
+        return labels_.size() - 1u;
+    }
+
+    void Bind(Label label) {
+        labels_[label] = code_.size();
+    }
+
+    void Emit(std::initializer_list<uint8_t> bytes) {
+        code_.insert(code_.end(), bytes);
+    }
+
+    void Emit32(uint32_t value) {
+        for(int i = 0; i < 4; ++i) {
+            code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void Emit64(uint64_t value) {
+        for(int i = 0; i < 8; ++i) {
+            code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    void Jump(Label label) {
+        Emit({0xE9});
+        EmitFixup(label);
+    }
+
+    void JumpIf(Condition condition, Label label) {
+        Emit({0x0F, static_cast<uint8_t>(0x80 | condition)});
+        EmitFixup(label);
+    }
+
+    //mov reg, imm64
+    void MoveImmediate(Register reg, uint64_t value) {
+        Emit({0x48, static_cast<uint8_t>(0xB8 | reg)});
+        Emit64(value);
+    }
+
+    //mov rdi, rbx; mov rsi, ins; mov rax, fn; call rax
+    template <typename Fn>
+    void CallHelper(Fn* fn, const Instruction& ins) {
+        Emit({0x48, 0x89, 0xDF});
+        MoveImmediate(RSI, reinterpret_cast<uint64_t>(&ins));
+        MoveImmediate(RAX, reinterpret_cast<uint64_t>(fn));
+        Emit({0xFF, 0xD0});
+    }
+
+    //test eax, eax; jnz error
+    void CheckStatus(Label error) {
+        Emit({0x85, 0xC0});
+        JumpIf(NOT_EQUAL, error);
+    }
+
+    //mov reg, [r12 + index * sizeof(ObjectHolder)] - the object pointer of a register
+    void LoadObject(Register reg, uint32_t index) {
+        Emit({0x49, 0x8B, static_cast<uint8_t>(0x84 | (reg << 3)), 0x24});
+        Emit32(index * static_cast<uint32_t>(sizeof(ObjectHolder)));
+    }
+
+    //test reg, reg; jz label
+    void JumpIfNull(Register reg, Label label) {
+        Emit({0x48, 0x85, static_cast<uint8_t>(0xC0 | (reg << 3) | reg)});
+        JumpIf(EQUAL, label);
+    }
+
+    //mov r11, vtable; cmp [reg], r11; jne label
+    void JumpIfNotType(Register reg, uint64_t vtable, Label label) {
+        Emit({0x49, 0xBB});
+        Emit64(vtable);
+        Emit({0x4C, 0x39, static_cast<uint8_t>(0x18 | reg)});
+        JumpIf(NOT_EQUAL, label);
+    }
+
+    //mov reg32, [reg + offset]
+    void LoadValue(Register reg, int32_t offset) {
+        Emit({0x8B, static_cast<uint8_t>(0x80 | (reg << 3) | reg)});
+        Emit32(static_cast<uint32_t>(offset));
+    }
+
+    //mov reg32, imm32
+    void LoadImmediate(Register reg, int32_t value) {
+        Emit({static_cast<uint8_t>(0xB8 | reg)});
+        Emit32(static_cast<uint32_t>(value));
+    }
+
+    [[nodiscard]] std::vector<uint8_t> Finish() {
+        for(const auto& [at, label] : fixups_) {
+            auto offset = static_cast<int64_t>(labels_[label]) - static_cast<int64_t>(at + 4u);
+            auto value = static_cast<uint32_t>(static_cast<int32_t>(offset));
+            for(int i = 0; i < 4; ++i) {
+                code_[at + i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+        return std::move(code_);
+    }
+
+private:
+    static constexpr size_t UNBOUND = std::numeric_limits<size_t>::max();
+
+    void EmitFixup(Label label) {
+        fixups_.emplace_back(code_.size(), label);
+        Emit32(0);
+    }
+
+    std::vector<uint8_t> code_;
+    std::vector<size_t> labels_;
+    std::vector<std::pair<size_t, Label>> fixups_;
+};
+
+bool IsJump(OpCode op) {
+    return op == OpCode::Jump || op == OpCode::JumpIfFalse || op == OpCode::JumpIfTrue;
+}
+
+bool IsComparison(OpCode op) {
+    return op == OpCode::Equal || op == OpCode::NotEqual || op == OpCode::Less || op == OpCode::Greater
+           || op == OpCode::LessOrEqual || op == OpCode::GreaterOrEqual;
+}
+
+//operations with a native path for two numbers
+bool IsNumeric(OpCode op) {
+    return op == OpCode::Add || op == OpCode::Sub || op == OpCode::Mult || op == OpCode::Div || IsComparison(op);
+}
+
+//calls fn for every register the instruction reads
+template <typename Fn>
+void ForEachRead(const bytecode::Function& function, const Instruction& ins, Fn fn) {
+    switch(ins.op) {
+        case OpCode::Move:
+        case OpCode::GetField:
+        case OpCode::Not:
+        case OpCode::ToBool:
+        case OpCode::Stringify:
+            fn(ins.b);
+            break;
+        case OpCode::SetField:
+            fn(ins.a);
+            fn(ins.c);
+            break;
+        case OpCode::Compare:
+            fn(ins.b);
+            fn(ins.b + 1u);
+            break;
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfTrue:
+        case OpCode::Return:
+            fn(ins.a);
+            break;
+        case OpCode::Call:
+        case OpCode::NewInstance: {
+            if(ins.op == OpCode::Call) {
+                fn(ins.b);
+            }
+            const auto& site = function.call_sites[ins.c];
+            for(uint32_t i = 0; i < site.arg_count; ++i) {
+                fn(site.first_arg + i);
+            }
+            break;
+        }
+        case OpCode::Print:
+            for(uint32_t i = 0; i < ins.b; ++i) {
+                fn(ins.a + i);
+            }
+            break;
+        default:
+            if(IsNumeric(ins.op)) {
+                fn(ins.b);
+                fn(ins.c);
+            }
+            break;
+    }
+}
+
+bool WritesRegister(OpCode op) {
+    switch(op) {
+        case OpCode::SetField:
+        case OpCode::Jump:
+        case OpCode::JumpIfFalse:
+        case OpCode::JumpIfTrue:
+        case OpCode::Print:
+        case OpCode::Undefined:
+        case OpCode::Return:
+        case OpCode::ReturnNone:
+            return false;
+        default:
+            return true;
+    }
+}
+
+//which registers may still be read after each instruction of a function. Registers are released
+//when the function returns, so a value that is not read any more does not have to be stored
+class Liveness {
+public:
+    explicit Liveness(const bytecode::Function& function)
+        : live_after_(function.code.size(), std::vector<bool>(function.register_count))
+        , jump_targets_(function.code.size() + 1u)
+    {
+        const auto& code = function.code;
+        for(const auto& ins : code) {
+            if(IsJump(ins.op)) {
+                jump_targets_[ins.b] = true;
+            }
+        }
+        std::vector<std::vector<bool>> live_before(code.size() + 1u, std::vector<bool>(function.register_count));
+        for(bool changed = true; changed;) {
+            changed = false;
+            for(size_t i = code.size(); i-- > 0;) {
+                const auto& ins = code[i];
+                std::vector<bool> live(function.register_count);
+                auto merge = [&live](const std::vector<bool>& successor) {
+                    for(size_t reg = 0; reg < live.size(); ++reg) {
+                        live[reg] = live[reg] || successor[reg];
+                    }
+                };
+                if(ins.op != OpCode::Jump && ins.op != OpCode::Return && ins.op != OpCode::ReturnNone
+                   && ins.op != OpCode::Undefined) {
+                    merge(live_before[i + 1u]);
+                }
+                if(IsJump(ins.op)) {
+                    merge(live_before[ins.b]);
+                }
+                if(live != live_after_[i]) {
+                    live_after_[i] = live;
+                    changed = true;
+                }
+                if(WritesRegister(ins.op)) {
+                    live[ins.a] = false;
+                }
+                ForEachRead(function, ins, [&live](uint32_t reg) {
+                    live[reg] = true;
+                });
+                live_before[i] = std::move(live);
+            }
+        }
+    }
+
+    [[nodiscard]] bool IsLiveAfter(size_t index, uint32_t reg) const {
+        return live_after_[index][reg];
+    }
+
+    [[nodiscard]] bool IsJumpTarget(size_t index) const {
+        return jump_targets_[index];
+    }
+
+private:
+    std::vector<std::vector<bool>> live_after_;
+    std::vector<bool> jump_targets_;
+};
+
+//an operand of a numeric operation: a register, or a number constant whose LOADK into that
+//register is fused with the operation
+struct Operand {
+    uint32_t reg = 0;
+    const Instruction* load = nullptr;
+    int32_t value = 0;
+};
+
+class FunctionCompiler {
+public:
+    explicit FunctionCompiler(const bytecode::Function& function)
+        : function_(function)
+        , layouts_(GetLayouts())
+        , liveness_(function)
+    {
+    }
+
+    std::vector<uint8_t> Compile() {
+        const auto& code = function_.code;
+        for(size_t i = 0; i <= code.size(); ++i) {
+            asm_.NewLabel();
+        }
+        epilogue_ = asm_.NewLabel();
+        error_ = asm_.NewLabel();
+
+        //push rbx; push r12; push r13 (keeps the stack aligned for calls); mov rbx, rdi; mov r12, rsi
+        asm_.Emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});
+        //labels of fused instructions other than the first stay unbound: nothing jumps to them
+        for(size_t i = 0; i < code.size();) {
+            asm_.Bind(i);
+            i = CompileInstruction(i);
+        }
+        //falling off the end returns None: xor eax, eax
+        asm_.Bind(code.size());
+        asm_.Emit({0x31, 0xC0});
+        asm_.Jump(epilogue_);
+
+        //mov eax, 1
+        asm_.Bind(error_);
+        asm_.Emit({0xB8});
+        asm_.Emit32(1);
+        //pop r13; pop r12; pop rbx; ret
+        asm_.Bind(epilogue_);
+        asm_.Emit({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+        return asm_.Finish();
+    }
+
+private:
+    //compiles the instruction at index with the instructions fused into it and returns the index
+    //of the next instruction to compile
+    size_t CompileInstruction(size_t index) {
+        const Instruction& ins = function_.code[index];
+        if(IsNumeric(ins.op)) {
+            return CompileNumeric(index, nullptr);
+        }
+        switch(ins.op) {
+            case OpCode::LoadConst:
+                if(auto next = TryFuseConstant(index)) {
+                    return next;
+                }
+                asm_.CallHelper(LoadConstant, ins);
+                break;
+            case OpCode::Move:
+                asm_.CallHelper(CopyRegister, ins);
+                break;
+            case OpCode::GetField:
+                CompileFieldAccess(ins, ins.b, GetField);
+                break;
+            case OpCode::SetField:
+                CompileFieldAccess(ins, ins.a, SetField);
+                break;
+            case OpCode::Jump:
+                asm_.Jump(ins.b);
+                break;
+            case OpCode::JumpIfFalse:
+                CompileBranch(ins, index + 1u, ins.b);
+                break;
+            case OpCode::JumpIfTrue:
+                CompileBranch(ins, ins.b, index + 1u);
+                break;
+            case OpCode::Return:
+                asm_.CallHelper(StoreResult, ins);
+                asm_.Emit({0x31, 0xC0});
+                asm_.Jump(epilogue_);
+                break;
+            case OpCode::ReturnNone:
+                asm_.Emit({0x31, 0xC0});
+                asm_.Jump(epilogue_);
+                break;
+            default:
+                CompileGeneric(ins);
+                break;
+        }
+        return index + 1u;
+    }
+
+    void CompileGeneric(const Instruction& ins) {
+        asm_.CallHelper(ExecuteInstruction, ins);
+        asm_.CheckStatus(error_);
+    }
+
+    //a number constant loaded only for the numeric operation right after it becomes an immediate
+    //operand of that operation. Returns 0 if the load cannot be fused
+    size_t TryFuseConstant(size_t index) {
+        const auto& code = function_.code;
+        const Instruction& load = code[index];
+        const size_t user = index + 1u;
+        if(user == code.size() || liveness_.IsJumpTarget(user) || !IsNumeric(code[user].op)
+           || !function_.constants[load.b].TryAsExact<runtime::Number>()) {
+            return 0;
+        }
+        const Instruction& ins = code[user];
+        if((ins.b != load.a && ins.c != load.a) || (ins.a != load.a && liveness_.IsLiveAfter(user, load.a))) {
+            return 0;
+        }
+        return CompileNumeric(user, &load);
+    }
+
+    Operand MakeOperand(uint32_t reg, const Instruction* load) const {
+        if(load && load->a == reg) {
+            return {reg, load, function_.constants[load->b].TryAsExact<runtime::Number>()->GetValue()};
+        }
+        return {reg};
+    }
+
+    //loads the value of a number operand into reg, jumping to slow_path if it is not a number
+    void LoadNumber(Register reg, const Operand& operand, Assembler::Label slow_path) {
+        if(operand.load) {
+            asm_.LoadImmediate(reg, operand.value);
+            return;
+        }
+        asm_.LoadObject(reg, operand.reg);
+        asm_.JumpIfNull(reg, slow_path);
+        asm_.JumpIfNotType(reg, layouts_.number.vtable, slow_path);
+        asm_.LoadValue(reg, layouts_.number.value_offset);
+    }
+
+    //the slow path runs the fused load and the instructions from first to last as the VM would
+    void CompileSlowPath(const Instruction* load, size_t first, size_t last) {
+        if(load) {
+            asm_.CallHelper(LoadConstant, *load);
+        }
+        for(size_t i = first; i <= last; ++i) {
+            CompileGeneric(function_.code[i]);
+        }
+    }
+
+    //returns the index of the TOBOOL or branch instruction at index that only passes on the result
+    //of the comparison in reg, or 0
+    size_t FindUserOfCondition(size_t index, uint32_t reg, std::initializer_list<OpCode> ops) const {
+        const auto& code = function_.code;
+        if(index == code.size() || liveness_.IsJumpTarget(index)) {
+            return 0;
+        }
+        const Instruction& ins = code[index];
+        const bool reads = ins.op == OpCode::ToBool ? ins.b == reg : ins.a == reg;
+        const bool overwrites = ins.op == OpCode::ToBool && ins.a == reg;
+        if(std::find(ops.begin(), ops.end(), ins.op) == ops.end() || !reads
+           || (!overwrites && liveness_.IsLiveAfter(index, reg))) {
+            return 0;
+        }
+        return index;
+    }
+
+    //numbers are added, subtracted, multiplied, divided and compared in registers. A comparison
+    //whose result only feeds TOBOOL and a conditional jump becomes a native compare and jump
+    size_t CompileNumeric(size_t index, const Instruction* load) {
+        const Instruction& ins = function_.code[index];
+        auto slow_path = asm_.NewLabel();
+        auto done = asm_.NewLabel();
+        LoadNumber(RAX, MakeOperand(ins.b, load), slow_path);
+        LoadNumber(RCX, MakeOperand(ins.c, load), slow_path);
+        if(!IsComparison(ins.op)) {
+            if(ins.op == OpCode::Div) {
+                //division by zero is left to the slow path, which reports the error.
+                //test ecx, ecx; jz slow_path; cdq; idiv ecx
+                asm_.Emit({0x85, 0xC9});
+                asm_.JumpIf(EQUAL, slow_path);
+                asm_.Emit({0x99, 0xF7, 0xF9});
+            }
+            else {
+                //add eax, ecx / sub eax, ecx / imul eax, ecx
+                asm_.Emit(ins.op == OpCode::Add ? std::initializer_list<uint8_t>{0x01, 0xC8}
+                          : ins.op == OpCode::Sub ? std::initializer_list<uint8_t>{0x29, 0xC8}
+                                                  : std::initializer_list<uint8_t>{0x0F, 0xAF, 0xC1});
+            }
+            //mov edx, eax
+            asm_.Emit({0x89, 0xC2});
+            asm_.CallHelper(StoreNumber, ins);
+            asm_.CheckStatus(error_);
+            asm_.Jump(done);
+            asm_.Bind(slow_path);
+            CompileSlowPath(load, index, index);
+            asm_.Bind(done);
+            return index + 1u;
+        }
+
+        const Condition condition = GetCondition(ins.op);
+        size_t last = index;
+        uint32_t result = ins.a;
+        if(auto to_bool = FindUserOfCondition(last + 1u, result, {OpCode::ToBool})) {
+            last = to_bool;
+            result = function_.code[to_bool].a;
+        }
+        //cmp eax, ecx
+        asm_.Emit({0x39, 0xC8});
+        if(auto branch = FindUserOfCondition(last + 1u, result, {OpCode::JumpIfFalse, OpCode::JumpIfTrue})) {
+            const Instruction& jump = function_.code[branch];
+            const Assembler::Label next = branch + 1u;
+            const Assembler::Label if_true = jump.op == OpCode::JumpIfTrue ? jump.b : next;
+            const Assembler::Label if_false = jump.op == OpCode::JumpIfTrue ? next : jump.b;
+            asm_.JumpIf(condition, if_true);
+            asm_.Jump(if_false);
+            asm_.Bind(slow_path);
+            CompileSlowPath(load, index, last);
+            CompileBranch(jump, if_true, if_false);
+            return branch + 1u;
+        }
+        //setcc al; movzx edx, al
+        asm_.Emit({0x0F, static_cast<uint8_t>(0x90 | condition), 0xC0, 0x0F, 0xB6, 0xD0});
+        asm_.CallHelper(StoreBool, function_.code[last]);
+        asm_.Jump(done);
+        asm_.Bind(slow_path);
+        CompileSlowPath(load, index, last);
+        asm_.Bind(done);
+        return last + 1u;
+    }
+
+    static Condition GetCondition(OpCode op) {
+        switch(op) {
+            case OpCode::Equal:
+                return EQUAL;
+            case OpCode::NotEqual:
+                return NOT_EQUAL;
+            case OpCode::Less:
+                return LESS;
+            case OpCode::Greater:
+                return GREATER;
+            case OpCode::LessOrEqual:
+                return LESS_OR_EQUAL;
+            default:
+                return GREATER_OR_EQUAL;
+        }
+    }
+
+    template <typename Helper>
+    void CompileFieldAccess(const Instruction& ins, uint32_t object, Helper* helper) {
+        auto slow_path = asm_.NewLabel();
+        auto done = asm_.NewLabel();
+        asm_.LoadObject(RAX, object);
+        asm_.JumpIfNull(RAX, slow_path);
+        asm_.JumpIfNotType(RAX, layouts_.instance_vtable, slow_path);
+        //mov rdx, rax
+        asm_.Emit({0x48, 0x89, 0xC2});
+        asm_.CallHelper(helper, ins);
+        asm_.CheckStatus(error_);
+        asm_.Jump(done);
+        asm_.Bind(slow_path);
+        CompileGeneric(ins);
+        asm_.Bind(done);
+    }
+
+    void CompileBranch(const Instruction& ins, Assembler::Label if_true, Assembler::Label if_false) {
+        auto slow_path = asm_.NewLabel();
+        asm_.LoadObject(RAX, ins.a);
+        asm_.JumpIfNull(RAX, if_false);
+        asm_.JumpIfNotType(RAX, layouts_.boolean.vtable, slow_path);
+        //cmp byte [rax + value], 0
+        asm_.Emit({0x80, 0xB8});
+        asm_.Emit32(static_cast<uint32_t>(layouts_.boolean.value_offset));
+        asm_.Emit({0x00});
+        asm_.JumpIf(EQUAL, if_false);
+        asm_.Jump(if_true);
+        asm_.Bind(slow_path);
+        asm_.CallHelper(IsTrue, ins);
+        asm_.Emit({0x85, 0xC0});
+        asm_.JumpIf(EQUAL, if_false);
+        asm_.Jump(if_true);
+    }
+
+    const bytecode::Function& function_;
+    const Layouts& layouts_;
+    const Liveness liveness_;
+    Assembler asm_;
+    Assembler::Label epilogue_ = 0;
+    Assembler::Label error_ = 0;
+};
+
+#endif  // MYTHON_JIT_X86_64
+
+}  // namespace
+
+NativeFunction::NativeFunction(const bytecode::Function& function, void* memory, size_t memory_size)
+    : function_(function)
+    , memory_(memory)
+    , memory_size_(memory_size)
+{
+}
+
+NativeFunction::~NativeFunction() {
+#ifdef MYTHON_JIT_X86_64
+    munmap(memory_, memory_size_);
+#endif
+}
+
+ObjectHolder NativeFunction::Run(vm::VirtualMachine& machine, ObjectHolder* registers, runtime::Context& context) const {
+    Frame frame{&machine, registers, &function_, &context};
+    auto entry = reinterpret_cast<Entry>(memory_);
+    if(entry(&frame, registers) != 0) {
+        std::rethrow_exception(frame.error);
+    }
+    return frame.result;
+}
+
+bool IsSupported() {
+#ifdef MYTHON_JIT_X86_64
+    return GetLayouts().valid;
+#else
+    return false;
+#endif
+}
+
+std::unique_ptr<NativeFunction> Compile(const bytecode::Function& function) {
+#ifdef MYTHON_JIT_X86_64
+    if(!IsSupported()) {
+        return nullptr;
+    }
+    auto code = FunctionCompiler(function).Compile();
+    const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = (code.size() + page_size - 1u) / page_size * page_size;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    //the code is never writable and executable at the same time
+    if(mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    return std::make_unique<NativeFunction>(function, memory, size);
+#else
+    (void)function;
+    return nullptr;
+#endif
+}
+
+}  // namespace jit
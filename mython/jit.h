@@ -0,0 +1,68 @@
+#pragma once
+
+#include "bytecode.h"
+#include "runtime.h"
+
+#include <cstddef>
+#include <exception>
+#include <memory>
+
+namespace vm {
+class VirtualMachine;
+}  // namespace vm
+
+namespace jit {
+
+// Состояние вызова скомпилированной функции. Машинный код передаёт его вспомогательным
+// функциям runtime, а они сохраняют в нём результат return и исключение
+struct Frame {
+    // Машина, которая выполняет методы, вызванные из машинного кода
+    vm::VirtualMachine* machine;
+    runtime::ObjectHolder* registers;
+    const bytecode::Function* function;
+    runtime::Context* context;
+    runtime::ObjectHolder result{};
+    std::exception_ptr error{};
+};
+
+// Машинный код функции байт-кода, размещённый в исполняемой памяти
+class NativeFunction {
+public:
+    using Entry = int (*)(Frame* frame, runtime::ObjectHolder* registers);
+
+    NativeFunction(const bytecode::Function& function, void* memory, size_t memory_size);
+    NativeFunction(const NativeFunction&) = delete;
+    NativeFunction& operator=(const NativeFunction&) = delete;
+    ~NativeFunction();
+
+    // Выполняет функцию над регистрами registers, которые подготовлены так же,
+    // как для виртуальной машины machine, и возвращает значение return
+    runtime::ObjectHolder Run(vm::VirtualMachine& machine, runtime::ObjectHolder* registers,
+                              runtime::Context& context) const;
+
+    [[nodiscard]] size_t GetCodeSize() const {
+        return memory_size_;
+    }
+
+private:
+    const bytecode::Function& function_;
+    void* memory_;
+    size_t memory_size_;
+};
+
+// Возвращает true, если на этой платформе функции можно компилировать в машинный код
+bool IsSupported();
+
+/*
+Компилирует функцию байт-кода в машинный код x86-64.
+Каждая инструкция превращается в свой фрагмент кода, переходы становятся машинными переходами.
+Сложение, вычитание, умножение, деление и сравнение чисел, а также проверка условия для Bool
+выполняются прямо в машинном коде, остальное - вызовами вспомогательных функций runtime.
+Числовая константа, загружаемая только для следующей операции, становится её операндом,
+а сравнение, результат которого нужен лишь условному переходу, - машинным переходом.
+Методы, скомпилированные в байт-код, вызываются напрямую через виртуальную машину.
+Возвращает nullptr, если платформа не поддерживается
+*/
+std::unique_ptr<NativeFunction> Compile(const bytecode::Function& function);
+
+}  // namespace jit
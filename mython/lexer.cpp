@@ -1,13 +1,64 @@
 #include "lexer.h"
 
+#include "char_scanner.h"
+
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
 #include <charconv>
+#include <istream>
+#include <iterator>
+#include <thread>
 #include <unordered_map>
 
 using namespace std;
 
 namespace parse {
 
+namespace {
+
+const std::string EMPTY_SYMBOL;
+
+}  // namespace
+
+Symbol::Symbol()
+    : text_(&EMPTY_SYMBOL) {
+}
+
+Symbol SymbolPool::Intern(std::string_view name) {
+    return Find(names_, name);
+}
+
+Symbol SymbolPool::InternLiteral(std::string_view text) {
+    return Find(literals_, text);
+}
+
+Symbol SymbolPool::Find(Table& table, std::string_view text) {
+    if(auto it = table.find(text); it != table.end()) {
+        return Symbol(it->second);
+    }
+    const std::string& stored = strings_.emplace_back(text);
+    table.emplace(stored, &stored);
+    return Symbol(&stored);
+}
+
+void SymbolPool::Adopt(std::shared_ptr<SymbolPool> other) {
+    adopted_.push_back(std::move(other));
+}
+
+bool operator==(const Symbol& lhs, std::string_view rhs) {
+    return lhs.View() == rhs;
+}
+
+bool operator!=(const Symbol& lhs, std::string_view rhs) {
+    return !(lhs == rhs);
+}
+
+std::ostream& operator<<(std::ostream& os, const Symbol& symbol) {
+    return os << symbol.View();
+}
+
 bool operator==(const Token& lhs, const Token& rhs) {
     using namespace token_type;
 
@@ -77,31 +128,86 @@ std::ostream& operator<<(std::ostream& os, const Token& rhs) {
 
 constexpr size_t indent_length = 2u;
 
-const std::set<char> Lexer::op_symbols{',', '.', '\'', '\"', '+', '-', '*', '/', '(', ')', ':', '<', '>', '!', '='};
-
-const std::map<std::string_view, Token> Lexer::reserved_words{{"class"sv, token_type::Class{}},
-                                                              {"return"sv, token_type::Return{}},
-                                                              {"if"sv, token_type::If{}},
-                                                              {"else"sv, token_type::Else{}},
-                                                              {"def"sv, token_type::Def{}},
-                                                              {"print"sv, token_type::Print{}},
-                                                              {"and"sv, token_type::And{}},
-                                                              {"or"sv, token_type::Or{}},
-                                                              {"not"sv, token_type::Not{}},
-                                                              {"None"sv, token_type::None{}},
-                                                              {"True"sv, token_type::True{}},
-                                                              {"False"sv, token_type::False{}},
-                                                              {"<="sv, token_type::LessOrEq{}},
-                                                              {">="sv, token_type::GreaterOrEq{}},
-                                                              {"!="sv, token_type::NotEq{}},
-                                                              {"=="sv, token_type::Eq{}}};
+namespace {
+
+//keywords and two-character operators
+constexpr std::pair<std::string_view, Token> RESERVED_WORDS[] = {{"class"sv, token_type::Class{}},
+                                                                {"return"sv, token_type::Return{}},
+                                                                {"if"sv, token_type::If{}},
+                                                                {"else"sv, token_type::Else{}},
+                                                                {"def"sv, token_type::Def{}},
+                                                                {"print"sv, token_type::Print{}},
+                                                                {"and"sv, token_type::And{}},
+                                                                {"or"sv, token_type::Or{}},
+                                                                {"not"sv, token_type::Not{}},
+                                                                {"None"sv, token_type::None{}},
+                                                                {"True"sv, token_type::True{}},
+                                                                {"False"sv, token_type::False{}},
+                                                                {"<="sv, token_type::LessOrEq{}},
+                                                                {">="sv, token_type::GreaterOrEq{}},
+                                                                {"!="sv, token_type::NotEq{}},
+                                                                {"=="sv, token_type::Eq{}}};
+constexpr size_t RESERVED_WORD_COUNT = std::size(RESERVED_WORDS);
+constexpr size_t RESERVED_TABLE_SIZE = 32u;
+
+constexpr size_t HashWord(std::string_view word, size_t seed) {
+    return (static_cast<unsigned char>(word.front()) * seed + static_cast<unsigned char>(word.back()) + word.size())
+           % RESERVED_TABLE_SIZE;
+}
+
+//the smallest seed which gives every reserved word a slot of its own
+constexpr size_t FindPerfectSeed() {
+    for(size_t seed = 1; ; ++seed) {
+        std::array<bool, RESERVED_TABLE_SIZE> used{};
+        bool collision = false;
+        for(size_t i = 0; i < RESERVED_WORD_COUNT; ++i) {
+            const size_t slot = HashWord(RESERVED_WORDS[i].first, seed);
+            collision = collision || used[slot];
+            used[slot] = true;
+        }
+        if(!collision) {
+            return seed;
+        }
+    }
+}
+
+constexpr size_t RESERVED_SEED = FindPerfectSeed();
+
+//index in RESERVED_WORDS of the word in each slot, RESERVED_WORD_COUNT for an empty slot
+constexpr std::array<uint8_t, RESERVED_TABLE_SIZE> BuildReservedTable() {
+    std::array<uint8_t, RESERVED_TABLE_SIZE> table{};
+    for(auto& slot : table) {
+        slot = static_cast<uint8_t>(RESERVED_WORD_COUNT);
+    }
+    for(size_t i = 0; i < RESERVED_WORD_COUNT; ++i) {
+        table[HashWord(RESERVED_WORDS[i].first, RESERVED_SEED)] = static_cast<uint8_t>(i);
+    }
+    return table;
+}
+
+constexpr std::array<uint8_t, RESERVED_TABLE_SIZE> RESERVED_TABLE = BuildReservedTable();
+
+//one hash and at most one comparison for any word
+constexpr const Token* FindReservedWord(std::string_view word) {
+    if(word.empty()) {
+        return nullptr;
+    }
+    const size_t index = RESERVED_TABLE[HashWord(word, RESERVED_SEED)];
+    return index < RESERVED_WORD_COUNT && RESERVED_WORDS[index].first == word ? &RESERVED_WORDS[index].second : nullptr;
+}
+
+static_assert(FindReservedWord("return"sv)->Is<token_type::Return>());
+static_assert(FindReservedWord("!="sv)->Is<token_type::NotEq>());
+static_assert(FindReservedWord("returns"sv) == nullptr && FindReservedWord("Class"sv) == nullptr);
+
+}  // namespace
 
 std::string_view GetString(std::string_view& line) {
     size_t head_pos{};
     const char head = line[head_pos];
     std::string_view word;
     while(true) {
-        auto tail = line.find_first_of(head, head_pos + 1u);
+        auto tail = line.find(head, head_pos + 1u);
         if(tail == line.npos) { //unclosed string will be close force
             word = line;
             line.remove_prefix(line.size());
@@ -134,7 +240,7 @@ std::string_view GetOperator(std::string_view& line) {
 }
 
 std::string_view GetWord(std::string_view& line) {
-    auto tail = line.find_first_of(" #,.\'\"+-*/():<>!="sv, 1u);
+    auto tail = char_class::WORD_END.FindFirstIn(line, 1u);
     std::string_view word = line.substr(0, tail);
     if(tail == line.npos || line[tail] == '#') {
         line.remove_prefix(line.size());
@@ -146,7 +252,7 @@ std::string_view GetWord(std::string_view& line) {
 }
 
 std::string_view GetNumber(std::string_view& line) {
-    auto tail = line.find_first_not_of("0123456789"sv, 1u);
+    auto tail = char_class::DIGIT.FindFirstNotIn(line, 1u);
     std::string_view word = line.substr(0, tail);
     if(tail == line.npos) {
         line.remove_prefix(line.size());
@@ -157,12 +263,11 @@ std::string_view GetNumber(std::string_view& line) {
     return word;
 }
 
-std::vector<std::string_view> Lexer::ParseToWords(std::string_view raw_line) const {
-    std::vector<std::string_view> result;
-    result.reserve(5);
+void Lexer::ParseToWords(std::string_view raw_line, std::vector<std::string_view>& result) const {
+    result.clear();
     while(true) {
         
-        auto head = raw_line.find_first_not_of(" \\"sv, 0);
+        auto head = char_class::SPACE.FindFirstNotIn(raw_line);
         if(head == raw_line.npos || raw_line[head] == '#') {
             break;
         }
@@ -172,12 +277,11 @@ std::vector<std::string_view> Lexer::ParseToWords(std::string_view raw_line) con
         
         std::string_view word = raw_line[0] == '\"' ? GetString(raw_line) //inside string
                               : raw_line[0] == '\'' ? GetString(raw_line) //also inside string
-                              : op_symbols.find(raw_line[0]) != op_symbols.end() ? GetOperator(raw_line) //operator
-                              : raw_line[0] >= '0' && raw_line[0] <= '9' ? GetNumber(raw_line) //number
+                              : char_class::OPERATOR.Contains(raw_line[0]) ? GetOperator(raw_line) //operator
+                              : char_class::DIGIT.Contains(raw_line[0]) ? GetNumber(raw_line) //number
                               : GetWord(raw_line); //general word
         result.push_back(word);
     }
-    return result;
 }
 
 size_t GetIndent(std::string_view line) {
@@ -188,146 +292,434 @@ size_t GetIndent(std::string_view line) {
     return tail / indent_length;
 }
 
-bool IsForbiddenChar(const char c) {
-    return !(std::isprint(c) || c == '\n' || c == '\r' || c == '\t');
+Lexer::LineEnd Lexer::FindLineEnd() const {
+    //a quote of the other kind inside a string literal is its ordinary character
+    char open_quote = 0;
+    for(size_t pos = char_class::LINE_END.FindFirstIn(text_, pos_); pos != text_.npos;
+        pos = char_class::LINE_END.FindFirstIn(text_, pos + 1u)) {
+        const char c = text_[pos];
+        if(c == '\n') {
+            if(open_quote == 0) {
+                return {pos, open_quote};
+            }
+        }
+        else if(open_quote == 0) {
+            open_quote = c;
+        }
+        else if(open_quote == c) {
+            open_quote = 0;
+        }
+    }
+    return {text_.size(), open_quote};
+}
+
+bool Lexer::ReadChunk() {
+    if(!source_ || !*source_) {
+        return false;
+    }
+    chunk_.erase(0, pos_);
+    pos_ = 0;
+    const size_t kept = chunk_.size();
+    chunk_.resize(kept + CHUNK_SIZE);
+    source_->read(chunk_.data() + kept, CHUNK_SIZE);
+    chunk_.resize(kept + static_cast<size_t>(source_->gcount()));
+    text_ = chunk_;
+    return chunk_.size() > kept;
 }
 
-std::string Lexer::GetLine() const {
-    if(!source_) {
-        return {};
+bool Lexer::GetLine(std::string_view& line) {
+    LineEnd end = FindLineEnd();
+    //a line cut by the end of the chunk is looked for again once the next block is read
+    while(end.pos == text_.size() && ReadChunk()) {
+        end = FindLineEnd();
     }
-    bool inside_single_quoted_str = false;
-    bool inside_double_quoted_str = false;
-    std::string result{};
-    result.reserve(100);
-    for(char c = source_.get(); source_ && c != source_.eof(); c = source_.get()) {
-        if(IsForbiddenChar(c)) {
-            continue;
-        }
-        switch(c) {
-            case '\'':
-                result += c;
-                inside_single_quoted_str = inside_double_quoted_str ? false
-                                         : !inside_single_quoted_str;
-                break;
-            case '\"':
-                result += c;
-                inside_double_quoted_str = inside_single_quoted_str ? false
-                                         : !inside_double_quoted_str;
-                break;
-            case '\n':
-                if(inside_single_quoted_str || inside_double_quoted_str) {
-                    result += c;
+    if(pos_ >= text_.size()) {
+        return false;
+    }
+    const bool has_line_break = end.pos < text_.size();
+    line = text_.substr(pos_, end.pos - pos_);
+    pos_ = has_line_break ? end.pos + 1u : end.pos;
+    lines_read_ += static_cast<size_t>(std::count(line.begin(), line.end(), '\n')) + (has_line_break ? 1u : 0u);
+
+    //the text is used in place unless characters have to be dropped or a string closed
+    if(end.open_quote == 0 && char_class::ALLOWED.FindFirstNotIn(line) == line.npos) {
+        return true;
+    }
+    fixed_line_.clear();
+    std::copy_if(line.begin(), line.end(), std::back_inserter(fixed_line_), [](char c) {
+        return char_class::ALLOWED.Contains(c);
+    });
+    if(end.open_quote != 0) {
+        string_left_open_ = true;
+        fixed_line_ += end.open_quote;
+    }
+    line = fixed_line_;
+    return true;
+}
+
+Lexer::Lexer(std::istream& input) 
+    : source_(&input) {
+    ParseNextLine();
+}
+
+Lexer::Lexer(std::string_view text)
+    : text_(text) {
+    ParseNextLine();
+}
+
+Lexer::Lexer(std::vector<LocatedToken> tokens, std::shared_ptr<SymbolPool> symbols)
+    : symbols_(std::move(symbols)) {
+    for(auto& [token, line, column] : tokens) {
+        token.SetColumn(column);
+        PushToken(token, line);
+    }
+    Token eof = token_type::Eof{};
+    eof.SetColumn(1u);
+    PushToken(eof, tokens.empty() ? 1u : tokens.back().line);
+    bufer_.eof_buffered = true;
+}
+
+Lexer::Lexer(std::string_view text, size_t threads, size_t chunk_size)
+    : text_(text)
+    , threads_(std::max(threads, size_t{1}))
+    , parallel_chunk_size_(std::max(chunk_size, size_t{1})) {
+    ParseNextLine();
+}
+
+Lexer::Lexer(std::string_view part, PartTag)
+    : text_(part) {
+}
+
+struct Lexer::Pipeline {
+    struct Batch {
+        std::vector<BufferedToken> tokens; //keeps its storage when the slot is reused
+        std::exception_ptr error;          //thrown by the source after the tokens
+    };
+
+    explicit Pipeline(std::unique_ptr<Lexer> lexer)
+        : source(std::move(lexer))
+        , producer([this] { Produce(); }) {
+    }
+
+    ~Pipeline() {
+        stop.store(true, std::memory_order_relaxed);
+        producer.join();
+    }
+
+    void Produce();
+
+    std::unique_ptr<Lexer> source;
+    std::array<Batch, PIPELINE_SLOTS> slots;
+    //the counters only grow, a slot is the counter modulo PIPELINE_SLOTS. Each one is written
+    //by one thread and lives on its own cache line
+    alignas(64) std::atomic<size_t> taken{0};     //batches the consumer is done with
+    alignas(64) std::atomic<size_t> published{0}; //batches the producer has filled
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> lexing_ns{0};
+    std::atomic<int64_t> lexer_waiting_ns{0};
+    std::chrono::nanoseconds parser_waiting{}; //used by the consumer only
+    std::thread producer;                      //started last, when the rest is ready
+};
+
+void Lexer::Pipeline::Produce() {
+    using Clock = std::chrono::steady_clock;
+    bool done = false;
+    for(size_t count = 0; !done; ++count) {
+        if(count - taken.load(std::memory_order_acquire) == PIPELINE_SLOTS) {
+            const auto wait_start = Clock::now();
+            while(count - taken.load(std::memory_order_acquire) == PIPELINE_SLOTS) {
+                if(stop.load(std::memory_order_relaxed)) {
+                    return;
                 }
-                else {
-                    return result; //do not append endline to result
+                std::this_thread::yield();
+            }
+            lexer_waiting_ns.fetch_add((Clock::now() - wait_start).count(), std::memory_order_relaxed);
+        }
+        const auto start = Clock::now();
+        Batch& batch = slots[count % PIPELINE_SLOTS];
+        batch.tokens.clear();
+        batch.error = nullptr;
+        try {
+            while(batch.tokens.size() < PIPELINE_BATCH_SIZE) {
+                const Token& token = source->CurrentToken();
+                batch.tokens.push_back({token, source->CurrentLine()});
+                if(token.Is<token_type::Eof>()) {
+                    done = true;
+                    break;
                 }
-                break;
-            default:
-                result += c;
-                break;
+                source->NextToken();
+            }
+        }
+        catch(...) {
+            batch.error = std::current_exception();
+            done = true;
         }
+        lexing_ns.fetch_add((Clock::now() - start).count(), std::memory_order_relaxed);
+        published.store(count + 1u, std::memory_order_release);
     }
-    if(inside_single_quoted_str) {
-        result += '\'';
+}
+
+Lexer::Lexer(std::unique_ptr<Lexer> source)
+    : symbols_(source->symbols_)
+    , pipeline_(std::make_unique<Pipeline>(std::move(source))) {
+    ParseNextLine();
+}
+
+Lexer::Lexer(Lexer&&) noexcept = default;
+Lexer& Lexer::operator=(Lexer&&) noexcept = default;
+Lexer::~Lexer() = default;
+
+bool Lexer::TakeBatch() {
+    Pipeline& pipeline = *pipeline_;
+    const size_t count = pipeline.taken.load(std::memory_order_relaxed);
+    if(pipeline.published.load(std::memory_order_acquire) == count) {
+        const auto wait_start = std::chrono::steady_clock::now();
+        while(pipeline.published.load(std::memory_order_acquire) == count) {
+            std::this_thread::yield();
+        }
+        pipeline.parser_waiting += std::chrono::steady_clock::now() - wait_start;
     }
-    else if(inside_double_quoted_str) {
-        result += '\"';
+    const auto& batch = pipeline.slots[count % PIPELINE_SLOTS];
+    for(const auto& [token, line] : batch.tokens) {
+        PushToken(token, line);
     }
+    bufer_.eof_buffered = !batch.tokens.empty() && batch.tokens.back().token.Is<token_type::Eof>();
+    pending_error_ = batch.error;
+    const bool has_tokens = !batch.tokens.empty();
+    pipeline.taken.store(count + 1u, std::memory_order_release);
+    if(pending_error_ && !has_tokens) {
+        std::rethrow_exception(pending_error_);
+    }
+    return true;
+}
+
+std::optional<PipelineStats> Lexer::GetPipelineStats() const {
+    if(!pipeline_) {
+        return std::nullopt;
+    }
+    PipelineStats stats;
+    stats.lexing = std::chrono::nanoseconds(pipeline_->lexing_ns.load(std::memory_order_relaxed));
+    stats.lexer_waiting = std::chrono::nanoseconds(pipeline_->lexer_waiting_ns.load(std::memory_order_relaxed));
+    stats.parser_waiting = pipeline_->parser_waiting;
+    stats.batches = pipeline_->taken.load(std::memory_order_relaxed);
+    return stats;
+}
+
+Lexer::PartTokens Lexer::LexPart(std::string_view part) {
+    PartTokens result;
+    Lexer lexer(part, PartTag{});
+    try {
+        //the last call buffers the closing dedents and Eof, which the part does not need
+        while(lexer.ParseNextLine() && !lexer.bufer_.eof_buffered) {
+            result.count = lexer.bufer_.size;
+            result.last_indent = lexer.bufer_.current_indent;
+        }
+    }
+    catch(...) {
+        result.error = std::current_exception();
+    }
+    result.lines = lexer.lines_read_;
+    result.string_left_open = lexer.string_left_open_;
+    result.tokens = std::move(lexer.bufer_.ring);
+    result.symbols = std::move(lexer.symbols_);
     return result;
 }
 
-Lexer::Lexer(std::istream& input) 
-    : source_(input) {
-    ParseNextLine();
+void Lexer::AppendPart(PartTokens& part) {
+    //the part was lexed as if its first line were not indented by the lines before it
+    size_t first = 0;
+    while(first < part.count && part.tokens[first].token.Is<token_type::Indent>()) {
+        ++first;
+    }
+    if(first < part.count) {
+        const size_t line = part.tokens[first].line + lines_read_;
+        Token indent_change = first < bufer_.current_indent ? Token(token_type::Dedent{}) : Token(token_type::Indent{});
+        indent_change.SetColumn(1u);
+        while(bufer_.current_indent != first) {
+            PushToken(indent_change, line);
+            bufer_.current_indent = first < bufer_.current_indent ? bufer_.current_indent - 1u : bufer_.current_indent + 1u;
+        }
+        for(size_t i = first; i < part.count; ++i) {
+            PushToken(part.tokens[i].token, part.tokens[i].line + lines_read_);
+        }
+        bufer_.current_indent = part.last_indent;
+    }
+    lines_read_ += part.lines;
+    symbols_->Adopt(std::move(part.symbols));
+}
+
+bool Lexer::LexParallel() {
+    const auto next_line_start = [this](size_t pos) {
+        const size_t line_break = text_.find('\n', pos);
+        return line_break == text_.npos ? text_.size() : line_break + 1u;
+    };
+    const size_t size_before = bufer_.size;
+    while(bufer_.size == size_before && pos_ < text_.size()) {
+        std::vector<size_t> bounds{pos_};
+        while(bounds.size() <= threads_ && bounds.back() < text_.size()) {
+            bounds.push_back(next_line_start(bounds.back() + parallel_chunk_size_));
+        }
+        std::vector<PartTokens> parts(bounds.size() - 1u);
+        std::vector<std::thread> workers;
+        for(size_t i = 1; i < parts.size(); ++i) {
+            workers.emplace_back([this, &parts, &bounds, i] {
+                parts[i] = LexPart(text_.substr(bounds[i], bounds[i + 1u] - bounds[i]));
+            });
+        }
+        parts[0] = LexPart(text_.substr(bounds[0], bounds[1] - bounds[0]));
+        for(auto& worker : workers) {
+            worker.join();
+        }
+
+        //a part which ends inside a string literal does not end at a line boundary, so the next
+        //part was lexed from a wrong start. It is lexed again at the next window
+        size_t end = bounds[1];
+        while(parts[0].string_left_open && end < text_.size()) {
+            end = next_line_start(end + parallel_chunk_size_);
+            parts.resize(1u);
+            parts[0] = LexPart(text_.substr(pos_, end - pos_));
+        }
+        bounds[1] = end;
+        for(size_t i = 0; i < parts.size(); ++i) {
+            if(i > 0 && parts[i].string_left_open && bounds[i + 1u] < text_.size()) {
+                break;
+            }
+            AppendPart(parts[i]);
+            pos_ = bounds[i + 1u];
+            if(parts[i].error) {
+                pending_error_ = parts[i].error;
+                if(bufer_.size == size_before) {
+                    std::rethrow_exception(pending_error_);
+                }
+                return true;
+            }
+        }
+    }
+    if(bufer_.size > size_before) {
+        return true;
+    }
+    //the closing dedents and Eof are added as by the sequential lexer
+    threads_ = 1;
+    return ParseNextLine();
 }
 
 const Token& Lexer::CurrentToken() const {
-    return bufer_.current_token;
+    return bufer_.ring[bufer_.head].token;
+}
+
+size_t Lexer::CurrentLine() const {
+    return bufer_.ring[bufer_.head].line;
 }
 
-Token Lexer::NextToken() {
-    if(bufer_.current_token == token_type::Eof{}) {
-        return bufer_.current_token;
+size_t Lexer::CurrentColumn() const {
+    return CurrentToken().GetColumn();
+}
+
+const Token& Lexer::Peek(size_t k) {
+    while(bufer_.size <= k && ParseNextLine()) {
     }
-    else if(++bufer_.current_token_pos >= bufer_.tokens_on_line.size()) {
-        ParseNextLine();
-        return bufer_.current_token;
+    const size_t offset = std::min(k, bufer_.size - 1u);
+    return bufer_.ring[(bufer_.head + offset) & (bufer_.ring.size() - 1u)].token;
+}
+
+const Token& Lexer::NextToken() {
+    //a token other than Eof is always followed by one more
+    if(bufer_.size == 1u && !ParseNextLine()) {
+        return CurrentToken();
     }
-    return bufer_.current_token = bufer_.tokens_on_line.at(bufer_.current_token_pos);
+    bufer_.head = (bufer_.head + 1u) & (bufer_.ring.size() - 1u);
+    --bufer_.size;
+    return CurrentToken();
 }
 
-std::string GetCleanedString(std::string_view raw_string) {
-    std::string result{raw_string.substr(1u, raw_string.size() - 2u)}; //quots are no need there
-    for(auto pos_to_remove = result.find('\\'); pos_to_remove != result.npos; pos_to_remove = result.find('\\')) {
-        switch(result[pos_to_remove + 1u]) {
-            case 'n':
-                result[pos_to_remove + 1u] = '\n';
-                break;
-            case 't':
-                result[pos_to_remove + 1u] = '\t';
-                break;
+void Lexer::PushToken(Token token, size_t line) {
+    auto& ring = bufer_.ring;
+    if(bufer_.size == ring.size()) {
+        std::vector<BufferedToken> grown(ring.size() * 2u);
+        for(size_t i = 0; i < bufer_.size; ++i) {
+            grown[i] = ring[(bufer_.head + i) & (ring.size() - 1u)];
         }
-        result.erase(pos_to_remove, 1u);
+        ring = std::move(grown);
+        bufer_.head = 0;
     }
-    return result;
+    ring[(bufer_.head + bufer_.size) & (ring.size() - 1u)] = {token, line};
+    ++bufer_.size;
 }
 
-void Lexer::ParseNextLine() {
-    bufer_.tokens_on_line.clear();
-    bufer_.current_token_pos = 0;
-    if(!source_) {
-        for( ; bufer_.current_indent != 0; --bufer_.current_indent) {
-            bufer_.tokens_on_line.push_back(token_type::Dedent{});
+bool Lexer::ParseNextLine() {
+    if(bufer_.eof_buffered) {
+        return false;
+    }
+    if(pending_error_) {
+        std::rethrow_exception(pending_error_);
+    }
+    if(pipeline_) {
+        return TakeBatch();
+    }
+    if(threads_ > 1u) {
+        return LexParallel();
+    }
+    std::string_view line;
+    words_.clear();
+    size_t line_number = 0;
+    //blank and comment lines are skipped
+    while(words_.empty()) {
+        line_number = lines_read_ + 1u;
+        if(!GetLine(line)) {
+            Token dedent = token_type::Dedent{};
+            dedent.SetColumn(1u);
+            for( ; bufer_.current_indent != 0; --bufer_.current_indent) {
+                PushToken(dedent, line_number);
+            }
+            Token eof = token_type::Eof{};
+            eof.SetColumn(1u);
+            PushToken(eof, line_number);
+            bufer_.eof_buffered = true;
+            return true;
         }
-        bufer_.tokens_on_line.push_back(token_type::Eof{});
-        bufer_.current_token = bufer_.tokens_on_line.front();
-        return;
-    }
-    std::string line = std::move(GetLine());
-    auto words = std::move(ParseToWords(line));
-    if(line.empty() || words.empty() ||
-       std::all_of(line.begin(), line.end(), [] (char c) {return c == ' ';})) { //pass empty string
-        ParseNextLine();
-        return;
-    }
-    size_t indent = GetIndent(line);
+        ParseToWords(line, words_);
+    }
+    const size_t indent = GetIndent(line);
+    //indents and dedents point to the line start
+    Token indent_change = indent < bufer_.current_indent ? Token(token_type::Dedent{}) : Token(token_type::Indent{});
+    indent_change.SetColumn(1u);
     while(bufer_.current_indent != indent) {
-        if(indent < bufer_.current_indent) {
-            bufer_.tokens_on_line.push_back(token_type::Dedent{});
-            --bufer_.current_indent;
-        }
-        else {
-            bufer_.tokens_on_line.push_back(token_type::Indent{});
-            ++bufer_.current_indent;
-        }
+        PushToken(indent_change, line_number);
+        bufer_.current_indent = indent < bufer_.current_indent ? bufer_.current_indent - 1u : bufer_.current_indent + 1u;
     }
-    for(const auto word : words) {
+    for(const auto word : words_) {
+        Token token;
         //checking for string token
         if(word.front() == '\'' || word.front() == '\"') {
-            bufer_.tokens_on_line.push_back(token_type::String{std::move(GetCleanedString(word))});
-            continue;
+            token = token_type::String{symbols_->InternLiteral(Unescape(word, unescaped_))};
         }
         //checking for reserved words
-        auto iter = reserved_words.find(word);
-        if(iter != reserved_words.end()) {
-            bufer_.tokens_on_line.push_back(iter->second);
+        else if(const Token* reserved = FindReservedWord(word)) {
+            token = *reserved;
         }
         //cheking for single operators
-        else if(word.size() == 1u && (op_symbols.find(word.front()) != op_symbols.end() )) {
-            bufer_.tokens_on_line.push_back(token_type::Char{word.front()});
+        else if(word.size() == 1u && char_class::OPERATOR.Contains(word.front())) {
+            token = token_type::Char{word.front()};
         }
         //cheking for numbers
         else if(std::isdigit(word.front())) {
-            bufer_.tokens_on_line.push_back(token_type::Number{std::stoi(std::string{word})});
+            int value = 0;
+            if(std::from_chars(word.data(), word.data() + word.size(), value).ec != std::errc{}) {
+                throw std::out_of_range("number is too big: "s + std::string(word));
+            }
+            token = token_type::Number{value};
         }
         //other lexem
         else {
-            bufer_.tokens_on_line.push_back(token_type::Id{std::string(word)});
+            token = token_type::Id{symbols_->Intern(word)};
         }
+        token.SetColumn(static_cast<size_t>(word.data() - line.data()) + 1u);
+        PushToken(token, line_number);
     }
-    bufer_.tokens_on_line.push_back(token_type::Newline{});
-    bufer_.current_token = bufer_.tokens_on_line.front();
+    Token newline = token_type::Newline{};
+    newline.SetColumn(line.size() + 1u);
+    PushToken(newline, line_number);
+    return true;
 }
 
 }  // namespace parse
@@ -1,25 +1,116 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <exception>
 #include <iosfwd>
-#include <map>
 #include <memory>
 #include <optional>
-#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
 namespace parse {
 
+class SymbolPool;
+
+/*
+Строка, сохранённая в пуле SymbolPool. Символ занимает один указатель, копируется без
+выделения памяти и действителен, пока существует его пул. Символы одного пула с одинаковым
+текстом совпадают по адресу, поэтому сравниваются без сравнения строк
+*/
+class Symbol {
+public:
+    // Пустая строка
+    Symbol();
+
+    [[nodiscard]] const std::string& Str() const {
+        return *text_;
+    }
+    [[nodiscard]] std::string_view View() const {
+        return *text_;
+    }
+    operator const std::string&() const {
+        return *text_;
+    }
+
+    //symbols of different pools may hold the same text at different addresses
+    friend bool operator==(const Symbol& lhs, const Symbol& rhs) {
+        return lhs.text_ == rhs.text_ || *lhs.text_ == *rhs.text_;
+    }
+    friend bool operator!=(const Symbol& lhs, const Symbol& rhs) {
+        return !(lhs == rhs);
+    }
+
+private:
+    friend class SymbolPool;
+
+    explicit Symbol(const std::string* text)
+        : text_(text) {
+    }
+
+    const std::string* text_;
+};
+
+bool operator==(const Symbol& lhs, std::string_view rhs);
+bool operator!=(const Symbol& lhs, std::string_view rhs);
+std::ostream& operator<<(std::ostream& os, const Symbol& symbol);
+
+/*
+Хранилище имён идентификаторов и текстов строковых констант, которые лексер помещает в
+токены. Каждый лексер заполняет свой пул, поэтому пул не нужно защищать от одновременного
+доступа, а память освобождается вместе с последним владельцем пула: лексером или телом
+метода, токены которого сохранены до первого вызова. Имена и строковые константы хранятся
+в разных таблицах, чтобы тексты строк не попадали в таблицу имён
+*/
+class SymbolPool {
+public:
+    SymbolPool() = default;
+    SymbolPool(const SymbolPool&) = delete;
+    SymbolPool& operator=(const SymbolPool&) = delete;
+
+    // Возвращает символ с именем name, сохраняя имя, если его ещё нет в таблице имён
+    Symbol Intern(std::string_view name);
+    // Возвращает символ с текстом строковой константы text
+    Symbol InternLiteral(std::string_view text);
+    // Продлевает жизнь пула other до разрушения этого пула
+    void Adopt(std::shared_ptr<SymbolPool> other);
+
+    [[nodiscard]] size_t GetNameCount() const {
+        return names_.size();
+    }
+    [[nodiscard]] size_t GetLiteralCount() const {
+        return literals_.size();
+    }
+
+private:
+    using Table = std::unordered_map<std::string_view, const std::string*>;
+    Symbol Find(Table& table, std::string_view text);
+
+    std::deque<std::string> strings_; //deque elements never move, so the keys stay valid
+    Table names_;
+    Table literals_;
+    std::vector<std::shared_ptr<SymbolPool>> adopted_;
+};
+
 namespace token_type {
 struct Number {  // Лексема «число»
     int value{};   // число
 };
 
 struct Id {             // Лексема «идентификатор»
-    std::string value{};  // Имя идентификатора
+    Id() = default;
+    Id(Symbol name)
+        : value(name) {
+    }
+    Symbol value{};  // Имя идентификатора
 };
 
 struct Char {    // Лексема «символ»
@@ -27,7 +118,11 @@ struct Char {    // Лексема «символ»
 };
 
 struct String {  // Лексема «строковая константа»
-    std::string value{};
+    String() = default;
+    String(Symbol text)
+        : value(text) {
+    }
+    Symbol value{};
 };
 
 struct Class {};    // Лексема «class»
@@ -52,60 +147,214 @@ struct True {};         // Лексема «True»
 struct False {};        // Лексема «False»
 }  // namespace token_type
 
-using TokenBase
-    = std::variant<token_type::Number, token_type::Id, token_type::Char, token_type::String,
-                   token_type::Class, token_type::Return, token_type::If, token_type::Else,
-                   token_type::Def, token_type::Newline, token_type::Print, token_type::Indent,
-                   token_type::Dedent, token_type::And, token_type::Or, token_type::Not,
-                   token_type::Eq, token_type::NotEq, token_type::LessOrEq, token_type::GreaterOrEq,
-                   token_type::None, token_type::True, token_type::False, token_type::Eof>;
+// Типы лексем в порядке их номеров, которые возвращает Token::index()
+using TokenTypes
+    = std::tuple<token_type::Number, token_type::Id, token_type::Char, token_type::String,
+                 token_type::Class, token_type::Return, token_type::If, token_type::Else,
+                 token_type::Def, token_type::Newline, token_type::Print, token_type::Indent,
+                 token_type::Dedent, token_type::And, token_type::Or, token_type::Not,
+                 token_type::Eq, token_type::NotEq, token_type::LessOrEq, token_type::GreaterOrEq,
+                 token_type::None, token_type::True, token_type::False, token_type::Eof>;
+
+namespace detail {
+template <typename T, typename... Types>
+constexpr size_t IndexOf(const std::tuple<Types...>*) {
+    constexpr bool matches[] = {std::is_same_v<T, Types>...};
+    for(size_t i = 0; i < sizeof...(Types); ++i) {
+        if(matches[i]) {
+            return i;
+        }
+    }
+    return sizeof...(Types);
+}
+
+// Номер типа лексемы T в TokenTypes или размер TokenTypes, если T - не лексема
+template <typename T>
+inline constexpr size_t TOKEN_INDEX = IndexOf<T>(static_cast<const TokenTypes*>(nullptr));
+}  // namespace detail
+
+/*
+Лексема размером 16 байт: номер типа, позиция в строке исходного текста и значение - число,
+символ или Symbol с именем идентификатора или текстом строковой константы. Копируется без
+выделения памяти. Лексемы без значения хранят только тип
+*/
+class Token {
+public:
+    constexpr Token()
+        : Token(token_type::Number{}) {
+    }
+
+    template <typename T, typename = std::enable_if_t<(detail::TOKEN_INDEX<T> < std::tuple_size_v<TokenTypes>)>>
+    constexpr Token(T value)
+        : kind_(static_cast<uint8_t>(detail::TOKEN_INDEX<T>)) {
+        if constexpr(std::is_same_v<T, token_type::Number>) {
+            payload_.number = value;
+        }
+        else if constexpr(std::is_same_v<T, token_type::Id>) {
+            payload_.id = value;
+        }
+        else if constexpr(std::is_same_v<T, token_type::Char>) {
+            payload_.character = value;
+        }
+        else if constexpr(std::is_same_v<T, token_type::String>) {
+            payload_.string = value;
+        }
+    }
 
-struct Token : TokenBase {
-    using TokenBase::TokenBase;
+    // Номер типа лексемы в TokenTypes
+    [[nodiscard]] constexpr size_t index() const {
+        return kind_;
+    }
 
     template <typename T>
-    [[nodiscard]] bool Is() const {
-        return std::holds_alternative<T>(*this);
+    [[nodiscard]] constexpr bool Is() const {
+        return kind_ == detail::TOKEN_INDEX<T>;
     }
 
     template <typename T>
     [[nodiscard]] const T& As() const {
-        return std::get<T>(*this);
+        if(const T* value = TryAs<T>()) {
+            return *value;
+        }
+        throw std::bad_variant_access();
     }
 
     template <typename T>
     [[nodiscard]] const T* TryAs() const {
-        return std::get_if<T>(this);
+        if(!Is<T>()) {
+            return nullptr;
+        }
+        if constexpr(std::is_same_v<T, token_type::Number>) {
+            return &payload_.number;
+        }
+        else if constexpr(std::is_same_v<T, token_type::Id>) {
+            return &payload_.id;
+        }
+        else if constexpr(std::is_same_v<T, token_type::Char>) {
+            return &payload_.character;
+        }
+        else if constexpr(std::is_same_v<T, token_type::String>) {
+            return &payload_.string;
+        }
+        else {
+            static constexpr T unvalued{};
+            return &unvalued;
+        }
     }
+
+    // Позиция начала лексемы в строке исходного текста, начиная с 1. 0, если лексема
+    // создана не лексером
+    [[nodiscard]] size_t GetColumn() const {
+        return column_;
+    }
+    void SetColumn(size_t column) {
+        column_ = static_cast<uint32_t>(column);
+    }
+
+private:
+    union Payload {
+        constexpr Payload()
+            : number{} {
+        }
+
+        token_type::Number number;
+        token_type::Id id;
+        token_type::Char character;
+        token_type::String string;
+    };
+
+    uint8_t kind_;
+    uint32_t column_ = 0;
+    Payload payload_;
 };
 
+static_assert(sizeof(Token) <= 16u);
+
 bool operator==(const Token& lhs, const Token& rhs);
 bool operator!=(const Token& lhs, const Token& rhs);
 
 std::ostream& operator<<(std::ostream& os, const Token& rhs);
 
+// Токен и положение его начала в исходном тексте
+struct LocatedToken {
+    Token token;
+    size_t line = 0;
+    size_t column = 0;
+};
+
 class LexerError : public std::runtime_error {
 public:
     using std::runtime_error::runtime_error;
 };
 
+// Время работы стадий лексера, который разбирает текст в отдельном потоке
+struct PipelineStats {
+    std::chrono::nanoseconds lexing{};         // разбор текста в потоке лексера
+    std::chrono::nanoseconds lexer_waiting{};  // ожидание лексером места в очереди
+    std::chrono::nanoseconds parser_waiting{}; // ожидание токенов тем, кто их читает
+    size_t batches = 0;                        // пачки токенов, переданные через очередь
+};
+
 class Lexer {
 public:
+    // Читает текст программы из потока блоками по CHUNK_SIZE байт
     explicit Lexer(std::istream& input);
+    // Разбирает текст программы text, который должен существовать, пока существует лексер
+    explicit Lexer(std::string_view text);
+    // Создаёт лексер, который выдаёт ранее прочитанные токены tokens с их положениями,
+    // а после них - token_type::Eof. Имена и строки токенов хранятся в пуле symbols
+    Lexer(std::vector<LocatedToken> tokens, std::shared_ptr<SymbolPool> symbols);
+    // Разбирает текст программы text в threads потоках. Текст делится на части примерно по
+    // chunk_size байт на границах строк, части разбираются одновременно, а их токены
+    // склеиваются с согласованием отступов на стыках. Часть, которая закончилась внутри
+    // многострочной строковой константы, разбирается заново вместе со следующей. Одновременно
+    // в памяти находятся токены не более чем threads частей. Токены, их положения и ошибки
+    // совпадают с выдаваемыми лексером Lexer(text)
+    Lexer(std::string_view text, size_t threads, size_t chunk_size = PARALLEL_CHUNK_SIZE);
+    // Разбирает текст лексером source в отдельном потоке, пока этот лексер выдаёт токены.
+    // Токены передаются пачками по PIPELINE_BATCH_SIZE через очередь без блокировок на
+    // PIPELINE_SLOTS пачек, так что разбор текста и его потребитель работают одновременно.
+    // Ошибка лексера source выбрасывается после выдачи токенов перед ней. Деструктор ждёт,
+    // пока поток закончит текущую пачку, поэтому source не должен ждать ввода бесконечно
+    explicit Lexer(std::unique_ptr<Lexer> source);
+
+    Lexer(Lexer&&) noexcept;
+    Lexer& operator=(Lexer&&) noexcept;
+    ~Lexer();
 
     // Возвращает ссылку на текущий токен или token_type::Eof, если поток токенов закончился
     [[nodiscard]] const Token& CurrentToken() const;
 
-    // Возвращает следующий токен, либо token_type::Eof, если поток токенов закончился
-    Token NextToken();
+    // Делает текущим следующий токен и возвращает ссылку на него, либо на token_type::Eof,
+    // если поток токенов закончился. Ссылки на токены, полученные от лексера, действительны
+    // до следующего вызова NextToken или Peek
+    const Token& NextToken();
+
+    // Возвращает токен, стоящий через k токенов после текущего, не делая его текущим.
+    // Peek(0) - текущий токен. За концом потока находится token_type::Eof
+    const Token& Peek(size_t k);
+
+    // Возвращают номер строки и позицию в строке (начиная с 1), с которых начинается текущий токен
+    [[nodiscard]] size_t CurrentLine() const;
+    [[nodiscard]] size_t CurrentColumn() const;
+
+    // Возвращает время работы потока лексера и ожиданий на очереди к текущему моменту,
+    // если лексер создан из другого лексера, разбирающего текст в отдельном потоке
+    [[nodiscard]] std::optional<PipelineStats> GetPipelineStats() const;
+
+    // Пул имён и строк токенов лексера. Токены, сохранённые вместе с пулом, остаются
+    // действительными после разрушения лексера
+    [[nodiscard]] const std::shared_ptr<SymbolPool>& GetSymbols() const {
+        return symbols_;
+    }
 
     // Если текущий токен имеет тип T, метод возвращает ссылку на него.
     // В противном случае метод выбрасывает исключение LexerError
     template <typename T>
     const T& Expect() const {
         using namespace std::literals;
-        if(bufer_.current_token.Is<T>()) {
-            return bufer_.current_token.As<T>();
+        if(CurrentToken().Is<T>()) {
+            return CurrentToken().As<T>();
         }
         else {
             throw LexerError("wrong token type"s);
@@ -117,8 +366,7 @@ public:
     template <typename T, typename U>
     void Expect(const U& value) const {
         using namespace std::literals;
-        //const auto& token = Expect<T>();
-        auto token_ptr = bufer_.current_token.TryAs<T>();
+        auto token_ptr = CurrentToken().TryAs<T>();
         if(token_ptr == nullptr || token_ptr->value != value) {
             throw LexerError("wrong token value"s);
         }
@@ -129,8 +377,8 @@ public:
     template <typename T>
     const T& ExpectNext() {
         using namespace std::literals;
-        if(NextToken().Is<T>()) {
-            return bufer_.current_token.As<T>();
+        if(const auto& token = NextToken(); token.Is<T>()) {
+            return token.As<T>();
         }
         else {
             throw LexerError("wrong token type"s);
@@ -142,36 +390,94 @@ public:
     template <typename T, typename U>
     void ExpectNext(const U& value) {
         using namespace std::literals;
-        NextToken();
-        auto token_ptr = bufer_.current_token.TryAs<T>();
+        auto token_ptr = NextToken().TryAs<T>();
         if(token_ptr == nullptr || token_ptr->value != value) {
             throw LexerError("wrong token value"s);
         }
     }
 
+    // Размер блока, которым читается поток
+    static constexpr size_t CHUNK_SIZE = 64u * 1024u;
+    // Размер части текста, которую разбирает один поток при параллельном разборе
+    static constexpr size_t PARALLEL_CHUNK_SIZE = 1024u * 1024u;
+    // Число токенов в пачке и число пачек в очереди лексера, работающего в отдельном потоке
+    static constexpr size_t PIPELINE_BATCH_SIZE = 1024u;
+    static constexpr size_t PIPELINE_SLOTS = 64u;
+
 private:
+    struct LineEnd {
+        size_t pos = 0;   //position of the line break or the end of text_
+        char open_quote = 0; //quote of a string literal left open at pos, 0 if there is none
+    };
+
     //cause of there is possible appearance of \n symbols inside Mythop string
-    //literals, make custom getline method
-    std::string GetLine() const;
-    void ParseNextLine();
-    std::vector<std::string_view> ParseToWords(std::string_view line) const;
+    //literals, make custom getline method. Returns false when the input is over
+    bool GetLine(std::string_view& line);
+    LineEnd FindLineEnd() const;
+    //drops the consumed part of chunk_ and appends the next block of the stream
+    bool ReadChunk();
+    //appends the tokens of the next line to the buffer, or the closing dedents and Eof
+    //once the input is over. Returns false if Eof is already buffered
+    bool ParseNextLine();
+    void PushToken(Token token, size_t line);
+
+    struct PartTag {};
+    //lexer of a part of the text given to the parallel lexer, which lexes nothing until asked
+    Lexer(std::string_view part, PartTag);
+
+    struct BufferedToken {
+        Token token;
+        size_t line = 0;
+    };
+    //tokens of a part of the text lexed as if it were a whole program
+    struct PartTokens {
+        std::vector<BufferedToken> tokens; //the ring of the part lexer, starting at 0
+        size_t count = 0;        //tokens of the complete lines, without the closing dedents and Eof
+        size_t lines = 0;        //line breaks in the part
+        size_t last_indent = 0;
+        bool string_left_open = false; //the part ended inside a string literal
+        std::exception_ptr error;      //thrown while lexing the line after the tokens
+        std::shared_ptr<SymbolPool> symbols; //names and strings of the tokens
+    };
+    static PartTokens LexPart(std::string_view part);
+    //lexes the next parts of the text in parallel and appends their tokens
+    bool LexParallel();
+    void AppendPart(PartTokens& part);
+    //single producer, single consumer queue of token batches and the thread filling it
+    struct Pipeline;
+    //appends the next batch of the pipeline to the buffer, waiting for it if needed
+    bool TakeBatch();
+    //splits line into words, reusing the storage of words
+    void ParseToWords(std::string_view line, std::vector<std::string_view>& words) const;
 private:
     // Реализуйте приватную часть самостоятельно
-    std::istream& source_;
-    Token current_token_;
-    
+    std::istream* source_ = nullptr; //nullptr when the whole text is given or tokens are replayed
+    std::string chunk_;              //the part of the stream being lexed
+    std::string_view text_;          //the text being lexed, either given or chunk_
+    size_t pos_ = 0;                 //start of the next line in text_
+    std::string fixed_line_;         //copy of a line which had to be changed
+    std::string unescaped_;          //content of the last string literal with escape sequences
+    std::vector<std::string_view> words_; //words of the line being lexed
+    bool string_left_open_ = false;  //a string literal was closed forcibly at the end of the text
+    size_t threads_ = 1;             //more than one when the text is lexed in parallel
+    size_t parallel_chunk_size_ = 0;
+    std::exception_ptr pending_error_; //lexing error to throw once the tokens before it are used
+    std::shared_ptr<SymbolPool> symbols_ = std::make_shared<SymbolPool>();
+    std::unique_ptr<Pipeline> pipeline_; //set when the tokens come from a lexer on another thread
+
+    //lexed tokens starting from the current one, kept in a ring buffer of a power of two size
+    //which grows when Peek looks further than it holds
     struct LexerState {
-        Token current_token{};
-        std::vector<Token> tokens_on_line{};
-        size_t current_token_pos{}; //position of current token in the line
+        std::vector<BufferedToken> ring = std::vector<BufferedToken>(16u);
+        size_t head{}; //position of the current token in ring
+        size_t size{}; //number of buffered tokens including the current one
         size_t current_indent{};
+        bool eof_buffered{}; //the last buffered token is Eof and nothing follows it
     };
     
+    size_t lines_read_ = 0;
+    
     LexerState bufer_{};
-private:
-    //static const std::set<char> op_symbols_00;
-    static const std::set<char> op_symbols;
-    static const std::map<std::string_view, Token> reserved_words;
 };
 
 }  // namespace parse
@@ -1,6 +1,8 @@
+#include "char_scanner.h"
 #include "lexer.h"
 #include "test_runner_p.h"
 
+#include <memory>
 #include <sstream>
 #include <string>
 
@@ -9,11 +11,25 @@ using namespace std;
 namespace parse {
 
 namespace {
+// Пул имён и строк токенов, с которыми тесты сравнивают токены лексеров
+SymbolPool& GetTestSymbols() {
+    static SymbolPool symbols;
+    return symbols;
+}
+
+Token IdToken(string_view name) {
+    return token_type::Id{GetTestSymbols().Intern(name)};
+}
+
+Token StringToken(string_view text) {
+    return token_type::String{GetTestSymbols().InternLiteral(text)};
+}
+
 void TestSimpleAssignment() {
     istringstream input("x = 42\n"s);
     Lexer lexer(input);
 
-    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{42}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
@@ -55,13 +71,13 @@ void TestIds() {
     istringstream input("x    _42 big_number   Return Class  dEf"s);
     Lexer lexer(input);
 
-    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"_42"s}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"big_number"s}));
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("_42"s));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("big_number"s));
     ASSERT_EQUAL(lexer.NextToken(),
-                 Token(token_type::Id{"Return"s}));  // keywords are case-sensitive
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"Class"s}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"dEf"s}));
+                 IdToken("Return"s));  // keywords are case-sensitive
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("Class"s));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("dEf"s));
 }
 
 void TestStrings() {
@@ -69,12 +85,12 @@ void TestStrings() {
         R"('word' "two words" 'long string with a double quote " inside' "another long string with single quote ' inside")"s);
     Lexer lexer(input);
 
-    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::String{"word"s}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"two words"s}));
+    ASSERT_EQUAL(lexer.CurrentToken(), StringToken("word"s));
+    ASSERT_EQUAL(lexer.NextToken(), StringToken("two words"s));
     ASSERT_EQUAL(lexer.NextToken(),
-                 Token(token_type::String{"long string with a double quote \" inside"s}));
+                 StringToken("long string with a double quote \" inside"s));
     ASSERT_EQUAL(lexer.NextToken(),
-                 Token(token_type::String{"another long string with single quote ' inside"s}));
+                 StringToken("another long string with single quote ' inside"s));
 }
 
 void TestOperations() {
@@ -112,33 +128,33 @@ no_indent
 
     Lexer lexer(input);
 
-    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"no_indent"s}));
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("no_indent"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_one"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_one"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_two"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_two"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_three"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_three"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_three"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_three"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_three"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_three"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_two"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_two"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_one"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_one"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"indent_two"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("indent_two"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"no_indent"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("no_indent"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
 }
@@ -154,18 +170,18 @@ x = 1
 )"s);
     Lexer lexer(input);
 
-    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("y"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{2}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     // Пустая строка, состоящая только из пробельных символов не меняет текущий отступ,
     // поэтому следующая лексема — это Id, а не Dedent
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"z"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("z"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{3}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
@@ -191,70 +207,70 @@ print str(p)
 )"s);
     Lexer lexer(input);
 
-    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{4}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("y"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"hello"s}));
+    ASSERT_EQUAL(lexer.NextToken(), StringToken("hello"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Class{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"Point"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("Point"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Def{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"__init__"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("__init__"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("y"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("y"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("y"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Def{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"__str__"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("__str__"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Return{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"str"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("str"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{" "s}));
+    ASSERT_EQUAL(lexer.NextToken(), StringToken(" "s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"str"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("str"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"y"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("y"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"p"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("p"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"Point"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("Point"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
@@ -262,9 +278,9 @@ print str(p)
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"str"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("str"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"p"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("p"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
@@ -295,97 +311,97 @@ print x.call_count
     Lexer lexer(input);
     
     ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Class{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"GCD"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("GCD"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Def{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"__init__"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("__init__"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"call_count"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("call_count"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{0}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Def{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"calc"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("calc"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"a"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("a"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"call_count"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("call_count"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"call_count"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("call_count"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{1}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::If{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"a"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("a"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'<'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Return{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"calc"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("calc"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"a"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("a"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::If{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eq{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{0}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{':'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Indent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Return{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"a"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("a"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Return{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"self"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("self"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"calc"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("calc"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"a"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("a"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'-'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Dedent{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"GCD"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("GCD"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"calc"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("calc"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{510510}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
@@ -393,9 +409,9 @@ print x.call_count
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"calc"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("calc"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'('}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{22}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{','}));
@@ -403,9 +419,9 @@ print x.call_count
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{')'}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Print{}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"x"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("x"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'.'}));
-    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"call_count"s}));
+    ASSERT_EQUAL(lexer.NextToken(), IdToken("call_count"s));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
@@ -441,8 +457,8 @@ void TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine() {
         istringstream is("a b"s);
         Lexer lexer(is);
 
-        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"a"s}));
-        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"b"s}));
+        ASSERT_EQUAL(lexer.CurrentToken(), IdToken("a"s));
+        ASSERT_EQUAL(lexer.NextToken(), IdToken("b"s));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
@@ -481,17 +497,285 @@ abc#
 #)"s);
 
         Lexer lexer(is);
-        ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::Id{"x"s}));
+        ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Id{"abc"s}));
+        ASSERT_EQUAL(lexer.NextToken(), IdToken("abc"s));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"#"s}));
+        ASSERT_EQUAL(lexer.NextToken(), StringToken("#"s));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
-        ASSERT_EQUAL(lexer.NextToken(), Token(token_type::String{"#123"s}));
+        ASSERT_EQUAL(lexer.NextToken(), StringToken("#123"s));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
         ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
     }
 }
+void TestTokenLocations() {
+    istringstream input("x = 1\n\nif x:\n  print 'a',  y\n"s);
+    Lexer lexer(input);
+
+    auto expect_at = [&lexer](size_t line, size_t column) {
+        ASSERT_EQUAL(lexer.CurrentLine(), line);
+        ASSERT_EQUAL(lexer.CurrentColumn(), column);
+        lexer.NextToken();
+    };
+    //x = 1 and the newline
+    expect_at(1, 1);
+    expect_at(1, 3);
+    expect_at(1, 5);
+    expect_at(1, 6);
+    //the empty line is skipped
+    expect_at(3, 1);
+    expect_at(3, 4);
+    expect_at(3, 5);
+    expect_at(3, 6);
+    //indent, print 'a', y and the newline
+    expect_at(4, 1);
+    expect_at(4, 3);
+    expect_at(4, 9);
+    expect_at(4, 12);
+    expect_at(4, 15);
+    expect_at(4, 16);
+}
+
+void TestManyBlankLines() {
+    string text;
+    for(int i = 0; i < 300000; ++i) {
+        text += i % 2 ? "   \n"s : "# comment\n"s;
+    }
+    text += "x\n"s;
+    Lexer lexer(text);
+
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
+    ASSERT_EQUAL(lexer.CurrentLine(), 300001u);
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Newline{}));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Eof{}));
+}
+
+void TestStreamChunks() {
+    //lines and a multi-line string literal cross the boundaries of the blocks read from the stream
+    string text;
+    for(size_t i = 0; text.size() < 3u * Lexer::CHUNK_SIZE; ++i) {
+        text += "value_"s + to_string(i) + " = 'a\nb' + \"some text\"\n"s;
+    }
+    text += "s = 'unclosed"s;
+
+    istringstream input(text);
+    Lexer stream_lexer(input);
+    Lexer buffer_lexer(text);
+    size_t tokens = 1;
+    for( ; buffer_lexer.CurrentToken() != Token(token_type::Eof{}); ++tokens) {
+        ASSERT_EQUAL(stream_lexer.CurrentToken(), buffer_lexer.CurrentToken());
+        ASSERT_EQUAL(stream_lexer.CurrentLine(), buffer_lexer.CurrentLine());
+        ASSERT_EQUAL(stream_lexer.CurrentColumn(), buffer_lexer.CurrentColumn());
+        if(buffer_lexer.CurrentToken() == IdToken("s"s)) {
+            ASSERT_EQUAL(buffer_lexer.NextToken(), Token(token_type::Char{'='}));
+            ASSERT_EQUAL(buffer_lexer.NextToken(), StringToken("unclosed"s));
+            stream_lexer.NextToken();
+            stream_lexer.NextToken();
+        }
+        buffer_lexer.NextToken();
+        stream_lexer.NextToken();
+    }
+    ASSERT_EQUAL(stream_lexer.CurrentToken(), Token(token_type::Eof{}));
+    ASSERT(tokens > 3u * Lexer::CHUNK_SIZE / 10u);
+}
+
+void TestCharClasses() {
+    //every position of every byte value, so that each one is met inside a block and in the tail
+    string text(100u, 'a');
+    for(int byte = 0; byte < 256; ++byte) {
+        for(size_t pos = 0; pos < text.size(); pos += 7u) {
+            text[pos] = static_cast<char>(byte);
+            for(const auto& [chars, cls] : {pair{" \\"sv, char_class::SPACE}, pair{"0123456789"sv, char_class::DIGIT},
+                                            pair{" #,.\'\"+-*/():<>!="sv, char_class::WORD_END}}) {
+                ASSERT_EQUAL(cls.Contains(static_cast<char>(byte)), chars.find(static_cast<char>(byte)) != chars.npos);
+                for(size_t from : {size_t{0}, size_t{5}, size_t{90}}) {
+                    ASSERT_EQUAL(cls.FindFirstIn(text, from), text.find_first_of(chars, from));
+                    ASSERT_EQUAL(cls.FindFirstNotIn(text, from), text.find_first_not_of(chars, from));
+                }
+            }
+            text[pos] = 'a';
+        }
+    }
+    ASSERT_EQUAL(char_class::DIGIT.FindFirstNotIn(string(40u, '7'), 40u), string_view::npos);
+}
+
+void TestEscapes() {
+    string buffer;
+    ASSERT_EQUAL(Unescape(R"('a\nb\tc\'d\\n')"sv, buffer), "a\nb\tc'd\\n"sv);
+    ASSERT_EQUAL(Unescape("\"\""sv, buffer), ""sv);
+    //text without escape sequences is not copied
+    const string_view plain = "'plain text'"sv;
+    ASSERT_EQUAL(Unescape(plain, buffer).data(), plain.data() + 1);
+
+    Lexer lexer(R"(s = 'it\'s' + "tab\there")"sv);
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'='}));
+    ASSERT_EQUAL(lexer.NextToken(), StringToken("it's"s));
+    ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{'+'}));
+    ASSERT_EQUAL(lexer.NextToken(), StringToken("tab\there"s));
+}
+
+void TestSymbols() {
+    SymbolPool pool;
+    const string name = "interned_"s + to_string(57);
+    ASSERT(pool.Intern(name) == pool.Intern("interned_57"sv));
+    ASSERT(&pool.Intern(name).Str() == &pool.Intern("interned_57"sv).Str());
+    ASSERT(pool.Intern(""sv) == Symbol());
+    ASSERT(pool.Intern(name) != pool.Intern("interned_58"sv));
+    //string literals do not get into the table of names
+    ASSERT(pool.InternLiteral(name) == pool.Intern(name));
+    ASSERT(&pool.InternLiteral(name).Str() != &pool.Intern(name).Str());
+    ASSERT_EQUAL(pool.GetNameCount(), 3u);
+    ASSERT_EQUAL(pool.GetLiteralCount(), 1u);
+
+    weak_ptr<SymbolPool> lexer_symbols;
+    Token saved;
+    {
+        Lexer lexer("x = x + 'x'\n"sv);
+        const Token id = lexer.CurrentToken();
+        lexer.NextToken();
+        ASSERT_EQUAL(lexer.NextToken(), id);
+        ASSERT_EQUAL(lexer.CurrentColumn(), 5u);
+        ASSERT(&lexer.CurrentToken().As<token_type::Id>().value.Str() == &id.As<token_type::Id>().value.Str());
+        lexer.NextToken();
+        ASSERT(lexer.NextToken().As<token_type::String>().value == id.As<token_type::Id>().value);
+        ASSERT_EQUAL(lexer.GetSymbols()->GetNameCount(), 1u);
+        ASSERT_EQUAL(lexer.GetSymbols()->GetLiteralCount(), 1u);
+
+        //every lexer keeps its own pool
+        Lexer other("x\n"sv);
+        ASSERT_EQUAL(other.CurrentToken(), id);
+        ASSERT(&other.CurrentToken().As<token_type::Id>().value.Str() != &id.As<token_type::Id>().value.Str());
+        lexer_symbols = lexer.GetSymbols();
+    }
+    //the pool goes away with the lexer unless someone keeps it
+    ASSERT(lexer_symbols.expired());
+
+    shared_ptr<SymbolPool> kept;
+    {
+        Lexer lexer("name\n"sv);
+        saved = lexer.CurrentToken();
+        kept = lexer.GetSymbols();
+    }
+    ASSERT_EQUAL(saved, IdToken("name"s));
+}
+
+void TestPeek() {
+    string text = "x = 1\nif x:\n  y = 2\n"s;
+    for(int i = 0; i < 50; ++i) {
+        text += "z = "s + to_string(i) + "\n"s;
+    }
+    Lexer lexer(text);
+
+    ASSERT_EQUAL(lexer.Peek(0), IdToken("x"s));
+    ASSERT_EQUAL(lexer.Peek(4), Token(token_type::If{}));
+    ASSERT_EQUAL(lexer.Peek(8), Token(token_type::Indent{}));
+    //far beyond the initial size of the buffer
+    ASSERT_EQUAL(lexer.Peek(18 + 4 * 48 + 2), Token(token_type::Number{49}));
+    ASSERT_EQUAL(lexer.Peek(1000), Token(token_type::Eof{}));
+    //peeking does not move the lexer
+    ASSERT_EQUAL(lexer.CurrentToken(), IdToken("x"s));
+    ASSERT_EQUAL(lexer.CurrentLine(), 1u);
+
+    for(int i = 0; i < 4; ++i) {
+        lexer.NextToken();
+    }
+    ASSERT_EQUAL(lexer.CurrentToken(), Token(token_type::If{}));
+    ASSERT_EQUAL(lexer.CurrentLine(), 2u);
+    ASSERT_EQUAL(lexer.Peek(4), Token(token_type::Indent{}));
+    const Token& next = lexer.NextToken();
+    ASSERT_EQUAL(&next, &lexer.CurrentToken());
+    ASSERT_EQUAL(next, IdToken("x"s));
+
+    auto symbols = make_shared<SymbolPool>();
+    Lexer replay(vector<LocatedToken>{{token_type::Id{symbols->Intern("a"sv)}, 3, 5}, {token_type::Char{'.'}, 3, 6}},
+                 symbols);
+    ASSERT_EQUAL(replay.Peek(1), Token(token_type::Char{'.'}));
+    ASSERT_EQUAL(replay.Peek(2), Token(token_type::Eof{}));
+    ASSERT_EQUAL(replay.CurrentColumn(), 5u);
+    replay.NextToken();
+    ASSERT_EQUAL(replay.CurrentColumn(), 6u);
+}
+
+// Проверяет, что лексер tested выдаёт те же токены с теми же положениями и ту же ошибку,
+// что и последовательный лексер текста text
+void AssertSameTokens(string_view text, Lexer& tested) {
+    Lexer sequential(text);
+    while(true) {
+        ASSERT_EQUAL(tested.CurrentToken(), sequential.CurrentToken());
+        ASSERT_EQUAL(tested.CurrentLine(), sequential.CurrentLine());
+        ASSERT_EQUAL(tested.CurrentColumn(), sequential.CurrentColumn());
+        if(sequential.CurrentToken().Is<token_type::Eof>()) {
+            break;
+        }
+        bool sequential_failed = false;
+        try {
+            sequential.NextToken();
+        }
+        catch(const invalid_argument&) {
+            sequential_failed = true;
+        }
+        if(sequential_failed) {
+            ASSERT_THROWS(tested.NextToken(), invalid_argument);
+            return;
+        }
+        tested.NextToken();
+    }
+    ASSERT(tested.NextToken().Is<token_type::Eof>());
+}
+
+void TestParallelLexing() {
+    string text = "# generated\n\n"s;
+    for(int i = 0; i < 40; ++i) {
+        text += "class C"s + to_string(i) + ":\n  def m(x):\n    if x > "s + to_string(i) + ":\n"s
+              + "      return 'multi\nline \" string\n'\n\n    # comment\n"s
+              + "    return \"x\"\n"s + (i % 3 == 0 ? "print 'a', \"b\n\nc\"\n"s : ""s);
+    }
+    text += "s = 'unclosed\n  at the end"s;
+    for(size_t chunk_size : {size_t{1}, size_t{13}, size_t{200}, size_t{100000}}) {
+        for(size_t threads : {size_t{2}, size_t{3}, size_t{8}}) {
+            Lexer parallel(text, threads, chunk_size);
+            AssertSameTokens(text, parallel);
+        }
+    }
+    //an error surfaces after the tokens before it
+    const string_view bad_indent = "x = 1\nif x:\n  y = 2\n   z = 3\nw = 4\n"sv;
+    Lexer parallel_bad(bad_indent, 4, 1);
+    AssertSameTokens(bad_indent, parallel_bad);
+    Lexer parallel_empty(""sv, 2, 1);
+    AssertSameTokens(""sv, parallel_empty);
+}
+
+void TestPipelinedLexing() {
+    //enough batches to fill the queue, so that the lexer thread waits for free slots
+    string text;
+    for(size_t i = 0; text.size() < 4u * 1024u * 1024u; ++i) {
+        text += "class C"s + to_string(i) + ":\n  def m(x):\n    return x + 'a\nb' * "s + to_string(i) + "\n"s;
+    }
+    Lexer pipelined(make_unique<Lexer>(text));
+    AssertSameTokens(text, pipelined);
+    const auto stats = pipelined.GetPipelineStats();
+    ASSERT(stats.has_value());
+    ASSERT(stats->batches > Lexer::PIPELINE_SLOTS);
+    ASSERT(!Lexer(text).GetPipelineStats());
+
+    //the source may read a stream or lex in parallel itself
+    istringstream input(text);
+    Lexer from_stream(make_unique<Lexer>(input));
+    AssertSameTokens(text, from_stream);
+    Lexer from_parallel(make_unique<Lexer>(text, 3, 1000));
+    AssertSameTokens(text, from_parallel);
+
+    const string_view bad_indent = "x = 1\nif x:\n  y = 2\n   z = 3\nw = 4\n"sv;
+    Lexer pipelined_bad(make_unique<Lexer>(bad_indent));
+    AssertSameTokens(bad_indent, pipelined_bad);
+    Lexer pipelined_empty(make_unique<Lexer>(""sv));
+    AssertSameTokens(""sv, pipelined_empty);
+
+    //the lexer thread stops at the full queue when the tokens are not read to the end
+    Lexer abandoned(make_unique<Lexer>(text));
+    ASSERT(abandoned.NextToken().Is<token_type::Id>());
+}
+
 }  // namespace
 
 void RunOpenLexerTests(TestRunner& tr) {
@@ -509,6 +793,15 @@ void RunOpenLexerTests(TestRunner& tr) {
     RUN_TEST(tr, parse::TestMythonProgram2);
     RUN_TEST(tr, parse::TestAlwaysEmitsNewlineAtTheEndOfNonemptyLine);
     RUN_TEST(tr, parse::TestCommentsAreIgnored);
+    RUN_TEST(tr, parse::TestTokenLocations);
+    RUN_TEST(tr, parse::TestManyBlankLines);
+    RUN_TEST(tr, parse::TestStreamChunks);
+    RUN_TEST(tr, parse::TestCharClasses);
+    RUN_TEST(tr, parse::TestEscapes);
+    RUN_TEST(tr, parse::TestSymbols);
+    RUN_TEST(tr, parse::TestPeek);
+    RUN_TEST(tr, parse::TestParallelLexing);
+    RUN_TEST(tr, parse::TestPipelinedLexing);
 }
 
 }  // namespace parse
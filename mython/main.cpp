@@ -1,10 +1,25 @@
+#include "bytecode.h"
+#include "closure_compiler.h"
 #include "lexer.h"
+#include "mapped_file.h"
+#include "optimizer.h"
 #include "parse.h"
+#include "profile.h"
 #include "runtime.h"
 #include "statement.h"
 #include "test_runner_p.h"
+#include "transpiler.h"
+#include "type_inference.h"
+#include "vm.h"
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <thread>
 #include <getopt.h>
 
 using namespace std;
@@ -23,19 +38,268 @@ void RunObjectsTests(TestRunner& tr);
 
 void TestParseProgram(TestRunner& tr);
 
+namespace vm {
+void RunVirtualMachineTests(TestRunner& tr);
+}  // namespace vm
+
+namespace optimizer {
+void RunOptimizerTests(TestRunner& tr);
+void RunTypeInferenceTests(TestRunner& tr);
+}  // namespace optimizer
+
+namespace profile {
+void RunProfileTests(TestRunner& tr);
+}  // namespace profile
+
+namespace transpiler {
+void RunTranspilerTests(TestRunner& tr);
+}  // namespace transpiler
+
 namespace {
 
-void RunMythonProgram(istream& input, ostream& output) {
-    parse::Lexer lexer(input);
-    auto program = ParseProgram(lexer);
+// Объём стека C++, резервируемый на один уровень вложенности вызовов Mython-методов.
+// Простой рекурсивный вызов занимает меньше 1 КБ во всех механизмах. Вызовы, вложенные в
+// глубокие выражения, занимают больше, и если стек кончится раньше, чем будет достигнута
+// глубина max_call_depth, runtime::CheckNativeStack выбросит StackOverflowError
+#ifdef __SANITIZE_ADDRESS__
+//AddressSanitizer surrounds stack variables with redzones, which makes frames larger
+constexpr size_t STACK_BYTES_PER_CALL = 8u * 1024u;
+#else
+constexpr size_t STACK_BYTES_PER_CALL = 4u * 1024u;
+#endif
+// Объём стека C++, резервируемый для разбора программы и выполнения верхнего уровня
+constexpr size_t BASE_STACK_BYTES = 8u * 1024u * 1024u;
+// Наибольшая допустимая глубина вызовов. Под неё резервируется около 400 МБ адресного
+// пространства, которое занимается памятью только по мере роста стека
+constexpr size_t MAX_CALL_DEPTH = 100'000u;
+
+// Механизм исполнения программы
+enum class Engine {
+    TREE_WALKER,  // обход синтаксического дерева
+    VM,           // компиляция в байт-код и исполнение регистровой виртуальной машиной
+    CLOSURES,     // компиляция в дерево специализированных замыканий
+};
+
+struct RunOptions {
+    // Максимальная глубина вызовов методов. Если 0, записи активаций размещаются
+    // на стеке C++ и глубина ограничена только его размером
+    size_t max_call_depth = 0;
+    Engine engine = Engine::TREE_WALKER;
+    // Если задан, в этот поток выводится листинг байт-кода перед исполнением
+    ostream* disassembly = nullptr;
+    // Сколько раз нужно вызвать метод, чтобы виртуальная машина скомпилировала его
+    // в машинный код. 0 отключает компиляцию
+    size_t jit_threshold = vm::VirtualMachine::DEFAULT_JIT_THRESHOLD;
+    // Уровень оптимизации синтаксического дерева перед исполнением
+    int optimization_level = 0;
+    // Наибольший размер тела метода в узлах, при котором оно встраивается в место вызова.
+    // 0 отключает встраивание
+    size_t inline_budget = optimizer::DEFAULT_INLINE_BUDGET;
+    // Если задан, в этот поток выводятся сведения о работе проходов оптимизатора
+    ostream* optimization_report = nullptr;
+    // Если задан, перед исполнением узлы дерева переводятся в состояния из этого профиля
+    const profile::Profile* profile_in = nullptr;
+    // Если задан, после исполнения в него добавляется профиль программы
+    profile::Profile* profile_out = nullptr;
+    // Сколько раз выполнить разобранную программу одну за другой. Каждое выполнение начинается
+    // с пустыми переменными и создаёт свои объекты, а кэши узлов дерева и байт-кода сохраняются
+    // между выполнениями. Одно дерево можно одновременно выполнять и из нескольких потоков:
+    // каждый вызов ExecuteProgram строит свои байт-код и замыкания
+    size_t sequential_runs = 1;
+    // Строить деревья тел методов при первом вызове. Действует только для обхода дерева без
+    // оптимизаций и без профиля: остальным нужны тела всех методов сразу. Синтаксическая
+    // ошибка в теле метода тогда обнаруживается только при его вызове
+    bool lazy_method_bodies = false;
+    // Выполнять каждую инструкцию верхнего уровня сразу после разбора (только обходом дерева)
+    bool stream = false;
+};
+
+struct RunStats {
+    size_t peak_call_depth = 0;
+};
+
+void ExecuteProgram(ast::Statement& program, runtime::Context& context, const RunOptions& options) {
+    switch(options.engine) {
+        case Engine::TREE_WALKER: {
+            for(size_t run = 0; run < options.sequential_runs; ++run) {
+                runtime::Closure closure;
+                program.Execute(closure, context);
+            }
+            break;
+        }
+        case Engine::VM: {
+            vm::VirtualMachine machine(bytecode::Compile(program));
+            if(options.disassembly) {
+                bytecode::Disassemble(machine.GetModule(), *options.disassembly);
+            }
+            machine.SetJitThreshold(options.jit_threshold);
+            for(size_t run = 0; run < options.sequential_runs; ++run) {
+                machine.Run(context);
+            }
+            break;
+        }
+        case Engine::CLOSURES: {
+            closure_compiler::Engine engine(program);
+            for(size_t run = 0; run < options.sequential_runs; ++run) {
+                engine.Run(context);
+            }
+            break;
+        }
+    }
+}
+
+unique_ptr<ast::Statement> ParseAndOptimize(parse::Lexer& lexer, const RunOptions& options) {
+    ParseOptions parse_options;
+    parse_options.lazy_method_bodies = options.lazy_method_bodies && options.engine == Engine::TREE_WALKER
+                                       && options.optimization_level == 0 && !options.profile_in;
+    auto program = ParseProgram(lexer, parse_options);
+    auto reports = optimizer::MakePipeline(options.optimization_level, options.inline_budget).Run(program);
+    if(options.optimization_report) {
+        optimizer::PrintReport(reports, *options.optimization_report);
+    }
+    if(options.profile_in) {
+        options.profile_in->Apply(*program);
+    }
+    return program;
+}
 
-    runtime::SimpleContext context{output};
+// Как часто при потоковом исполнении сбрасывается буфер вывода
+constexpr auto STREAM_FLUSH_INTERVAL = std::chrono::milliseconds(50);
+
+//classes are declared by statements only, so expressions are not looked into
+bool DeclaresClass(const ast::Statement& node) {
+    if(dynamic_cast<const ast::ClassDefinition*>(&node)) {
+        return true;
+    }
+    if(auto compound = dynamic_cast<const ast::Compound*>(&node)) {
+        return std::any_of(compound->Statements().begin(), compound->Statements().end(), [](const auto& statement) {
+            return DeclaresClass(*statement);
+        });
+    }
+    if(auto if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+        return DeclaresClass(*if_else->IfBody()) || (if_else->ElseBody() && DeclaresClass(*if_else->ElseBody()));
+    }
+    return false;
+}
+
+// Оптимизирует и выполняет каждую инструкцию верхнего уровня сразу после разбора, после чего
+// освобождает её. В памяти остаются только инструкции, объявляющие классы
+void StreamProgram(parse::Lexer& lexer, runtime::Context& context, const RunOptions& options) {
+    ParseOptions parse_options;
+    parse_options.lazy_method_bodies = options.lazy_method_bodies && options.optimization_level == 0;
+    const auto pipeline = optimizer::MakePipeline(options.optimization_level, options.inline_budget);
     runtime::Closure closure;
-    program->Execute(closure, context);
+    vector<unique_ptr<ast::Statement>> class_definitions;
+    auto last_flush = std::chrono::steady_clock::now();
+    ParseProgramStatements(lexer, [&](unique_ptr<ast::Statement> statement) {
+        const bool keep = DeclaresClass(*statement);
+        unique_ptr<ast::Statement> program = std::move(statement);
+        if(!pipeline.IsEmpty()) {
+            //passes expect a program, so every statement is optimized as a program of its own
+            auto chunk = make_unique<ast::Compound>();
+            chunk->AddStatement(std::move(program));
+            program = std::move(chunk);
+            auto reports = pipeline.Run(program);
+            if(options.optimization_report) {
+                optimizer::PrintReport(reports, *options.optimization_report);
+            }
+        }
+        program->Execute(closure, context);
+        if(keep) {
+            class_definitions.push_back(std::move(program));
+        }
+        if(const auto now = std::chrono::steady_clock::now(); now - last_flush >= STREAM_FLUSH_INTERVAL) {
+            context.GetOutputStream().flush();
+            last_flush = now;
+        }
+    }, parse_options);
+}
+
+void ParseAndExecute(parse::Lexer& lexer, runtime::Context& context, const RunOptions& options) {
+    if(options.stream) {
+        StreamProgram(lexer, context, options);
+        return;
+    }
+    auto program = ParseAndOptimize(lexer, options);
+    ExecuteProgram(*program, context, options);
+    if(options.profile_out) {
+        options.profile_out->Collect(*program);
+    }
+}
+
+RunStats RunMythonProgram(parse::Lexer& lexer, ostream& output, const RunOptions& options) {
+    if(options.max_call_depth == 0) {
+        runtime::SimpleContext context{output};
+        ParseAndExecute(lexer, context, options);
+        return {};
+    }
+    if(options.max_call_depth > MAX_CALL_DEPTH) {
+        throw std::invalid_argument("call depth limit must not exceed "s + to_string(MAX_CALL_DEPTH));
+    }
+    runtime::CallStack call_stack(options.max_call_depth);
+    runtime::RunOnHeapStack(BASE_STACK_BYTES + options.max_call_depth * STACK_BYTES_PER_CALL, [&] {
+        runtime::SimpleContext context{output, &call_stack};
+        ParseAndExecute(lexer, context, options);
+    });
+    return {call_stack.PeakDepth()};
+}
+
+RunStats RunMythonProgram(istream& input, ostream& output, const RunOptions& options = {}) {
+    parse::Lexer lexer(input);
+    return RunMythonProgram(lexer, output, options);
+}
+
+// Выводит в out время работы потока лексера, ожиданий на очереди токенов и время разбора
+// текста, скрытое за работой парсера
+void ReportLexerPipeline(const parse::PipelineStats& stats, ostream& out) {
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+    //without the pipeline the parser would have lexed the text itself
+    const auto overlapped = std::max(stats.lexing - stats.parser_waiting, std::chrono::nanoseconds{0});
+    out << "lexer pipeline: lexing "s << Milliseconds(stats.lexing).count() << " ms, lexer waited "s
+        << Milliseconds(stats.lexer_waiting).count() << " ms, parser waited "s
+        << Milliseconds(stats.parser_waiting).count() << " ms, overlapped "s << Milliseconds(overlapped).count()
+        << " ms, batches: "s << stats.batches << std::endl;
+}
+
+// Разбирает text на токены в threads потоках, не строя дерево программы, и выводит в out
+// число токенов, время и скорость работы лексера. С pipelined токены разбираются в отдельном
+// потоке и читаются через очередь
+void BenchmarkLexer(std::string_view text, size_t threads, bool pipelined, ostream& out) {
+    const auto start = std::chrono::steady_clock::now();
+    parse::Lexer lexer = pipelined ? parse::Lexer(std::make_unique<parse::Lexer>(text, threads))
+                                   : parse::Lexer(text, threads);
+    size_t tokens = 1;
+    for( ; !lexer.CurrentToken().Is<parse::token_type::Eof>(); lexer.NextToken()) {
+        ++tokens;
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    out << "tokens: "s << tokens << ", bytes: "s << text.size() << ", time: "s << elapsed.count() * 1000.0
+        << " ms, "s << static_cast<double>(text.size()) / (1024.0 * 1024.0) / elapsed.count() << " MiB/s"s << std::endl;
+    if(auto stats = lexer.GetPipelineStats()) {
+        ReportLexerPipeline(*stats, out);
+    }
+}
+
+const Engine ALL_ENGINES[] = {Engine::TREE_WALKER, Engine::VM, Engine::CLOSURES};
+
+// Выполняет программу каждым механизмом исполнения на всех уровнях оптимизации
+// и проверяет, что вывод совпадает с expected
+void AssertOutputOnAllEngines(const string& program, const string& expected) {
+    for(Engine engine : ALL_ENGINES) {
+        for(int level = 0; level <= optimizer::MAX_OPTIMIZATION_LEVEL; ++level) {
+            istringstream input(program);
+            ostringstream output;
+            RunOptions options;
+            options.engine = engine;
+            options.optimization_level = level;
+            RunMythonProgram(input, output, options);
+            ASSERT_EQUAL(output.str(), expected);
+        }
+    }
 }
 
 void TestSimplePrints() {
-    istringstream input(R"(
+    AssertOutputOnAllEngines(R"(
 print 57
 print 10, 24, -8
 print 'hello'
@@ -43,16 +307,11 @@ print "world"
 print True, False
 print
 print None
-)");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
-
-    ASSERT_EQUAL(output.str(), "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
+)", "57\n10 24 -8\nhello\nworld\nTrue False\n\nNone\n");
 }
 
 void TestAssignments() {
-    istringstream input(R"(
+    AssertOutputOnAllEngines(R"(
 x = 57
 print x
 x = 'C++ black belt'
@@ -62,25 +321,16 @@ x = y
 print x
 x = None
 print x, y
-)");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
-
-    ASSERT_EQUAL(output.str(), "57\nC++ black belt\nFalse\nNone False\n");
+)", "57\nC++ black belt\nFalse\nNone False\n");
 }
 
 void TestArithmetics() {
-    istringstream input("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2");
-
-    ostringstream output;
-    RunMythonProgram(input, output);
-
-    ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
+    AssertOutputOnAllEngines("print 1+2+3+4+5, 1*2*3*4*5, 1-2-3-4-5, 36/4/3, 2*5+10/2",
+                             "15 120 -13 3 15\n");
 }
 
 void TestVariablesArePointers() {
-    istringstream input(R"(
+    AssertOutputOnAllEngines(R"(
 class Counter:
   def __init__():
     self.value = 0
@@ -104,41 +354,557 @@ d = Dummy()
 d.do_add(x)
 
 print y.value
+)", "2\n3\n");
+}
+
+void TestClassesAndOperators() {
+    AssertOutputOnAllEngines(R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+  def __lt__(other):
+    return self.x < other.x or self.x == other.x and self.y < other.y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+class Point3(Point):
+  def __init__(x, y, z):
+    self.x = x
+    self.y = y
+    self.z = z
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ', ' + str(self.z) + ')'
+
+a = Point(1, 2)
+b = Point(3, 4)
+print a == b, a != b, a < b, a > b, a <= b, a >= b
+p = Point3(1, 2, 3)
+p.x = p.x * 10 - 2 / 2
+print a, p, p.x, Point
+if not a < b:
+  print 'wrong'
+else:
+  print 'right'
+print 0 or 'value', 1 and None, not None, 'a' < 'b', 10 / 3
+)", "False True True False True False\n(1, 2) (9, 2, 3) 9 Class Point\nright\nTrue False True True 3\n");
+}
+
+void TestDeepRecursion() {
+    istringstream input(R"(
+class Counter:
+  def down(n):
+    if n > 0:
+      return self.down(n - 1) + 1
+    return 0
+
+c = Counter()
+print c.down(50000)
 )");
 
-    ostringstream output;
-    RunMythonProgram(input, output);
+    for(Engine engine : ALL_ENGINES) {
+        RunOptions options;
+        options.engine = engine;
+        options.max_call_depth = 100000u;
+        istringstream program(input.str());
+        ostringstream output;
+        auto stats = RunMythonProgram(program, output, options);
+
+        ASSERT_EQUAL(output.str(), "50000\n");
+        ASSERT_EQUAL(stats.peak_call_depth, 50001u);
+
+        options.max_call_depth = 1000u;
+        istringstream overflow_program(input.str());
+        ASSERT_THROWS(RunMythonProgram(overflow_program, output, options), runtime::StackOverflowError);
+
+        options.max_call_depth = MAX_CALL_DEPTH + 1u;
+        istringstream too_deep_program(input.str());
+        ASSERT_THROWS(RunMythonProgram(too_deep_program, output, options), std::invalid_argument);
+    }
 
-    ASSERT_EQUAL(output.str(), "2\n3\n");
+    //calls nested in deep expressions exhaust the C++ stack before the call depth limit;
+    //that is reported like the limit, not as a crash
+    string nested = "self.down(n - 1)"s;
+    for(int i = 0; i < 200; ++i) {
+        nested = "1 + ("s + nested + ")"s;
+    }
+    const string nested_program = "class Counter:\n  def down(n):\n    if n > 0:\n      return "s + nested
+                                + "\n    return 0\n\nc = Counter()\nprint c.down(10)\nprint c.down(100000)\n"s;
+#ifdef __SANITIZE_ADDRESS__
+    //AddressSanitizer cannot unwind an exception from a stack larger than 64 MB
+    const vector<size_t> max_call_depths = {0u, 5000u};
+#else
+    const vector<size_t> max_call_depths = {0u, 5000u, 50000u};
+#endif
+    for(Engine engine : ALL_ENGINES) {
+        for(size_t max_call_depth : max_call_depths) {
+            RunOptions options;
+            options.engine = engine;
+            options.max_call_depth = max_call_depth;
+            istringstream program(nested_program);
+            ostringstream output;
+            if(engine == Engine::VM && max_call_depth == 0) {
+                //the virtual machine keeps the calls it makes off the C++ stack
+                RunMythonProgram(program, output, options);
+                ASSERT_EQUAL(output.str(), "2000\n20000000\n"s);
+                continue;
+            }
+            ASSERT_THROWS(RunMythonProgram(program, output, options), runtime::StackOverflowError);
+            ASSERT_EQUAL(output.str(), "2000\n"s);
+        }
+    }
+}
+
+void TestMethodsWithoutReturn() {
+    //small methods are inlined with -O 2, but still return None without return
+    AssertOutputOnAllEngines(R"(
+class A:
+  def noret():
+    x = 1
+  def f(a):
+    self.q = a
+  def get():
+    return self.q
+
+a = A()
+print a.noret(), a.f(5), a.get()
+)", "None None 5\n");
+}
+
+void TestSyntaxErrorsBeforeRunning() {
+    const string program = "print 'first'\nclass A:\n  def f():\n    x = = 1\n"s;
+    {
+        //every method body is parsed before the first statement runs
+        istringstream input(program);
+        ostringstream output;
+        ASSERT_THROWS(RunMythonProgram(input, output, RunOptions{}), parse::LexerError);
+        ASSERT_EQUAL(output.str(), ""s);
+    }
+    {
+        //a lazily parsed method that is never called hides its error
+        istringstream input(program);
+        ostringstream output;
+        RunOptions options;
+        options.lazy_method_bodies = true;
+        RunMythonProgram(input, output, options);
+        ASSERT_EQUAL(output.str(), "first\n"s);
+    }
+}
+
+void TestDeepestExpressions() {
+    //the parser rejects deeper trees, so every pass that walks a tree recursively handles these
+    const size_t nesting = MAX_EXPRESSION_DEPTH - 1u;
+    string sum = "n"s;
+    string negations;
+    for(size_t i = 0; i < nesting; ++i) {
+        sum = "1 + ("s + sum + ")"s;
+        negations += "not "s;
+    }
+    const string program = "class A:\n  def f(n):\n    return "s + sum + "\n\na = A()\nprint a.f(1), "s
+                         + string(nesting, '-') + "1, "s + negations + "False\n"s;
+    AssertOutputOnAllEngines(program, to_string(nesting + 1u) + " -1 True\n"s);
+
+    for(int level = 0; level <= optimizer::MAX_OPTIMIZATION_LEVEL; ++level) {
+        RunOptions options;
+        options.optimization_level = level;
+        istringstream types_input(program);
+        parse::Lexer types_lexer(types_input);
+        ostringstream types;
+        optimizer::DumpTypes(*ParseAndOptimize(types_lexer, options), types);
+        istringstream cpp_input(program);
+        parse::Lexer cpp_lexer(cpp_input);
+        ostringstream cpp;
+        transpiler::EmitCpp(*ParseAndOptimize(cpp_lexer, options), cpp);
+        ASSERT(!cpp.str().empty());
+    }
+}
+
+void TestRepeatedRuns() {
+    const string program = R"(
+class Point:
+  def __init__(x):
+    self.x = x
+
+class Factory:
+  def make(x):
+    return Point(x)
+
+f = Factory()
+a = f.make(1)
+b = f.make(2)
+print a.x, b.x
+a.x = a.x + 10
+print a.x, b.x
+)"s;
+    const string expected = "1 2\n11 2\n"s;
+    AssertOutputOnAllEngines(program, expected);
+
+    for(Engine engine : ALL_ENGINES) {
+        istringstream input(program);
+        ostringstream output;
+        RunOptions options;
+        options.engine = engine;
+        options.sequential_runs = 3;
+        RunMythonProgram(input, output, options);
+        ASSERT_EQUAL(output.str(), expected + expected + expected);
+    }
+}
+
+// Одно разобранное дерево выполняется одновременно в нескольких потоках, каждый со своим контекстом.
+// Узлы дерева специализируются, деоптимизируются и строят тела методов во время этих выполнений
+void TestConcurrentRuns() {
+    const string program = R"(
+class Shape:
+  def area():
+    return 0
+
+class Square(Shape):
+  def __init__(side):
+    self.side = side
+
+  def area():
+    return self.side * self.side
+
+class Rect(Shape):
+  def __init__(w, h):
+    self.w = w
+    self.h = h
+
+  def area():
+    return self.w * self.h
+
+class Walker:
+  def join(a, b):
+    return a + b
+
+  def walk(n, total):
+    if n == 0:
+      return total
+    if n / 2 * 2 == n and not n == 8 or n == 9:
+      shape = Square(n)
+    else:
+      shape = Rect(n, 2)
+    return self.walk(n - 1, self.join(total, shape.area()))
+
+w = Walker()
+print w.walk(200, 0), w.join('a', 'b'), w.join(1, 2)
+s = Shape()
+print w.walk(50, 0), s.area()
+)"s;
+    const string expected = "1373415 ab 3\n23365 0\n"s;
+    AssertOutputOnAllEngines(program, expected);
+
+    constexpr size_t THREADS = 4;
+    constexpr size_t RUNS = 5;
+    for(Engine engine : ALL_ENGINES) {
+        for(int level = 0; level <= optimizer::MAX_OPTIMIZATION_LEVEL; ++level) {
+            RunOptions options;
+            options.engine = engine;
+            options.optimization_level = level;
+            options.lazy_method_bodies = true;
+            options.sequential_runs = RUNS;
+            istringstream input(program);
+            parse::Lexer lexer(input);
+            const auto tree = ParseAndOptimize(lexer, options);
+
+            vector<ostringstream> outputs(THREADS);
+            vector<exception_ptr> errors(THREADS);
+            vector<thread> threads;
+            for(size_t i = 0; i < THREADS; ++i) {
+                threads.emplace_back([&, i] {
+                    try {
+                        runtime::SimpleContext context{outputs[i]};
+                        ExecuteProgram(*tree, context, options);
+                    }
+                    catch(...) {
+                        errors[i] = current_exception();
+                    }
+                });
+            }
+            for(auto& thread : threads) {
+                thread.join();
+            }
+            for(size_t i = 0; i < THREADS; ++i) {
+                if(errors[i]) {
+                    rethrow_exception(errors[i]);
+                }
+                string all_runs;
+                for(size_t run = 0; run < RUNS; ++run) {
+                    all_runs += expected;
+                }
+                ASSERT_EQUAL(outputs[i].str(), all_runs);
+            }
+        }
+    }
+}
+
+void TestStreaming() {
+    const string program = R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+  def add(n):
+    self.value = self.value + n
+    return self
+
+c = Counter(1)
+c.add(2)
+print c.value
+if c.value > 2:
+  class Twice(Counter):
+    def add(n):
+      self.value = self.value + 2 * n
+      return self
+  d = Twice(10)
+d.add(5)
+print d.value, 'text' + str(c.value)
+)"s;
+    for(int level = 0; level <= optimizer::MAX_OPTIMIZATION_LEVEL; ++level) {
+        istringstream input(program);
+        ostringstream output;
+        RunOptions options;
+        options.optimization_level = level;
+        options.stream = true;
+        RunMythonProgram(input, output, options);
+        ASSERT_EQUAL(output.str(), "3\n20 text3\n"s);
+    }
+
+    //statements before a syntax error have already run
+    istringstream broken("print 'first'\nx = = 2\n"s);
+    ostringstream output;
+    RunOptions options;
+    options.stream = true;
+    ASSERT_THROWS(RunMythonProgram(broken, output, options), parse::LexerError);
+    ASSERT_EQUAL(output.str(), "first\n"s);
 }
 
-void TestAll() {
-    TestRunner tr;
+void TestAll(const std::string& filter = {}) {
+    TestRunner tr(filter);
     parse::RunOpenLexerTests(tr);
     runtime::RunObjectHolderTests(tr);
     runtime::RunObjectsTests(tr);
     ast::RunUnitTests(tr);
     TestParseProgram(tr);
+    vm::RunVirtualMachineTests(tr);
+    optimizer::RunOptimizerTests(tr);
+    optimizer::RunTypeInferenceTests(tr);
+    profile::RunProfileTests(tr);
+    transpiler::RunTranspilerTests(tr);
 
     RUN_TEST(tr, TestSimplePrints);
     RUN_TEST(tr, TestAssignments);
     RUN_TEST(tr, TestArithmetics);
     RUN_TEST(tr, TestVariablesArePointers);
+    RUN_TEST(tr, TestClassesAndOperators);
+    RUN_TEST(tr, TestDeepRecursion);
+    RUN_TEST(tr, TestMethodsWithoutReturn);
+    RUN_TEST(tr, TestSyntaxErrorsBeforeRunning);
+    RUN_TEST(tr, TestDeepestExpressions);
+    RUN_TEST(tr, TestRepeatedRuns);
+    RUN_TEST(tr, TestConcurrentRuns);
+    RUN_TEST(tr, TestStreaming);
 }
 
 }  // namespace
 
 int main(int argc, char** argv) {
     const std::string help{
-R"(Usage: interpreter [OPTIONS]
+R"(Usage: interpreter [OPTIONS] [FILE]
+Runs the program from FILE or, if it is not given, from standard input
 -h     - Print help and exit
--t     - Run tests before start)"};
+-t     - Run tests before start
+-d N   - Keep method activation records on a heap stack limited to N nested calls
+         and report peak call depth to stderr
+-e E   - Execution engine: "tree" (syntax tree walker, default), "vm" (bytecode VM)
+         or "closure" (syntax tree compiled to specialized closures)
+-D     - Print bytecode listing to stderr before running (with -e vm)
+-J     - Do not compile hot methods to native code (with -e vm)
+-O N   - Optimize the syntax tree before running: 0 - no optimization (default),
+         1 - fold unary minus and constant expressions, 2 - also drop dead if/else branches
+         inline small methods into call sites, use operations without type checks
+         where operand types are inferred and keep intermediate numbers unboxed
+-P     - Report time spent and syntax tree nodes removed or added by each optimization pass
+         to stderr
+-s     - Report self-specializing syntax tree node statistics to stderr (with -e tree)
+-a     - Report the number of objects allocated on the heap while running to stderr
+-L     - Report how many method bodies were parsed on first call and how many were never
+         called to stderr (with --lazy-methods)
+--inline-budget=N
+       - Inline only method bodies of at most N syntax tree nodes (with -O 2, default 12,
+         0 disables inlining)
+--dump-types
+       - Print the syntax tree with inferred expression types and the number of typed
+         operations instead of running the program (after optimizations chosen with -O)
+--lazy-methods
+       - Parse a method body when the method is called for the first time (with -e tree,
+         without -O and profiles). A syntax error in a method is then reported only when it
+         is called, after the program may have printed something
+--stream
+       - Run every top-level statement as soon as it is parsed and free it afterwards, keeping
+         only class declarations (with -e tree; not with --repeat or profiles)
+--repeat=N
+       - Parse the program once and run it N times in a row, each time with fresh variables
+         and objects. Runs share the caches kept in the syntax tree and bytecode
+--profile-out=FILE
+       - Save the operand types and receiver classes observed while running to FILE
+         (with -e tree)
+--profile-in=FILE
+       - Start with the operand types and receiver classes saved to FILE by an earlier run
+         (with -e tree)
+--lex-threads=N
+       - Split the program text into parts at line boundaries and lex up to N parts at once
+         on separate threads. Standard input is read to memory first
+--lex-pipeline
+       - Lex the program on a separate thread while it is parsed and report the lexing time,
+         the time each stage waited for the other and the lexing time overlapped with parsing
+         to stderr
+--bench-lexer
+       - Split the program into tokens without parsing or running it and report the number
+         of tokens and the lexer throughput to stderr. Standard input is read to memory first
+--emit-cpp
+       - Print the program translated to C++ instead of running it. The result is built
+         against the mython_runtime library)"};
+    enum LongOption {
+        EMIT_CPP = 256,
+        INLINE_BUDGET,
+        DUMP_TYPES,
+        PROFILE_OUT,
+        PROFILE_IN,
+        REPEAT,
+        LAZY_METHODS,
+        STREAM,
+        BENCH_LEXER,
+        LEX_THREADS,
+        LEX_PIPELINE,
+        TESTS,
+    };
+    const option long_options[] = {
+        {"emit-cpp", no_argument, nullptr, EMIT_CPP},
+        {"inline-budget", required_argument, nullptr, INLINE_BUDGET},
+        {"dump-types", no_argument, nullptr, DUMP_TYPES},
+        {"profile-out", required_argument, nullptr, PROFILE_OUT},
+        {"profile-in", required_argument, nullptr, PROFILE_IN},
+        {"repeat", required_argument, nullptr, REPEAT},
+        {"lazy-methods", no_argument, nullptr, LAZY_METHODS},
+        {"stream", no_argument, nullptr, STREAM},
+        {"bench-lexer", no_argument, nullptr, BENCH_LEXER},
+        {"lex-threads", required_argument, nullptr, LEX_THREADS},
+        {"lex-pipeline", no_argument, nullptr, LEX_PIPELINE},
+        {"tests", required_argument, nullptr, TESTS},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+    const char* const short_options = "htd:e:DJO:PsaL";
     try {
-        for(int opt = getopt(argc, argv, "ht"); opt != -1; opt = getopt(argc, argv, "ht")) {
+        RunOptions options;
+        bool report_specializations = false;
+        bool report_allocations = false;
+        bool report_lazy_methods = false;
+        bool emit_cpp = false;
+        bool dump_types = false;
+        bool bench_lexer = false;
+        size_t lex_threads = 1;
+        bool lex_pipeline = false;
+        std::string profile_out_path;
+        std::string profile_in_path;
+        for(int opt = getopt_long(argc, argv, short_options, long_options, nullptr); opt != -1;
+            opt = getopt_long(argc, argv, short_options, long_options, nullptr)) {
             switch(opt) {
+                case 'e':
+                    if(optarg == "tree"sv) {
+                        options.engine = Engine::TREE_WALKER;
+                    }
+                    else if(optarg == "vm"sv) {
+                        options.engine = Engine::VM;
+                    }
+                    else if(optarg == "closure"sv) {
+                        options.engine = Engine::CLOSURES;
+                    }
+                    else {
+                        throw std::invalid_argument("unknown engine: "s + optarg);
+                    }
+                    break;
+                case 'D':
+                    options.disassembly = &std::cerr;
+                    break;
+                case 'J':
+                    options.jit_threshold = 0;
+                    break;
+                case 'O':
+                    options.optimization_level = std::stoi(optarg);
+                    if(options.optimization_level < 0 || options.optimization_level > optimizer::MAX_OPTIMIZATION_LEVEL) {
+                        throw std::invalid_argument("unknown optimization level: "s + optarg);
+                    }
+                    break;
+                case 'P':
+                    options.optimization_report = &std::cerr;
+                    break;
+                case 's':
+                    report_specializations = true;
+                    break;
+                case 'a':
+                    report_allocations = true;
+                    break;
+                case 'L':
+                    report_lazy_methods = true;
+                    break;
+                case STREAM:
+                    options.stream = true;
+                    break;
+                case LAZY_METHODS:
+                    options.lazy_method_bodies = true;
+                    break;
+                case BENCH_LEXER:
+                    bench_lexer = true;
+                    break;
+                case LEX_THREADS:
+                    lex_threads = std::stoul(optarg);
+                    if(lex_threads == 0) {
+                        throw std::invalid_argument("number of lexer threads must be positive"s);
+                    }
+                    break;
+                case LEX_PIPELINE:
+                    lex_pipeline = true;
+                    break;
+                case EMIT_CPP:
+                    emit_cpp = true;
+                    break;
+                case DUMP_TYPES:
+                    dump_types = true;
+                    break;
+                case PROFILE_OUT:
+                    profile_out_path = optarg;
+                    break;
+                case PROFILE_IN:
+                    profile_in_path = optarg;
+                    break;
+                case REPEAT:
+                    options.sequential_runs = std::stoul(optarg);
+                    if(options.sequential_runs == 0) {
+                        throw std::invalid_argument("number of runs must be positive"s);
+                    }
+                    break;
+                case INLINE_BUDGET:
+                    options.inline_budget = std::stoul(optarg);
+                    break;
                 case 't':
                     TestAll();
                     break;
+                case TESTS:
+                    TestAll(optarg);
+                    return 0;
+                case 'd':
+                    options.max_call_depth = std::stoul(optarg);
+                    if(options.max_call_depth == 0) {
+                        throw std::invalid_argument("call depth limit must be positive"s);
+                    }
+                    break;
                 case 'h':
                     std::cout << help << std::endl;
                     return 0;
@@ -150,7 +916,102 @@ R"(Usage: interpreter [OPTIONS]
                     return 1;
             }
         }
-        RunMythonProgram(std::cin, std::cout);
+        //only the tree walker specializes nodes and fills call caches
+        if((!profile_out_path.empty() || !profile_in_path.empty()) && options.engine != Engine::TREE_WALKER) {
+            throw std::invalid_argument("profiles are supported only by the tree engine"s);
+        }
+        //a streamed program is gone by the time it could be run again or profiled
+        if(options.stream && (options.engine != Engine::TREE_WALKER || options.sequential_runs != 1
+                              || !profile_out_path.empty() || !profile_in_path.empty())) {
+            throw std::invalid_argument("--stream works only with the tree engine, without --repeat and profiles"s);
+        }
+        profile::Profile profile_in;
+        if(!profile_in_path.empty()) {
+            std::ifstream file(profile_in_path);
+            if(!file) {
+                throw std::runtime_error("cannot open profile: "s + profile_in_path);
+            }
+            profile_in = profile::Profile::Load(file);
+            options.profile_in = &profile_in;
+        }
+        profile::Profile profile_out;
+        if(!profile_out_path.empty()) {
+            options.profile_out = &profile_out;
+        }
+        //a program given by path is lexed right in the mapped file. Standard input is read
+        //to memory only when the lexer needs the whole text at once
+        std::optional<parse::MappedFile> source_file;
+        std::string input_text;
+        std::string_view text;
+        const bool whole_text = optind < argc || bench_lexer || lex_threads > 1;
+        if(optind < argc) {
+            text = source_file.emplace(argv[optind]).GetText();
+        }
+        else if(whole_text) {
+            input_text.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+            text = input_text;
+        }
+        if(bench_lexer) {
+            BenchmarkLexer(text, lex_threads, lex_pipeline, std::cerr);
+            return 0;
+        }
+        std::optional<parse::Lexer> lexer;
+        if(whole_text) {
+            lexer.emplace(text, lex_threads);
+        }
+        else {
+            lexer.emplace(std::cin);
+        }
+        if(lex_pipeline) {
+            lexer.emplace(std::make_unique<parse::Lexer>(std::move(*lexer)));
+        }
+        const auto report_pipeline = [&lexer] {
+            if(auto stats = lexer->GetPipelineStats()) {
+                ReportLexerPipeline(*stats, std::cerr);
+            }
+        };
+        if(dump_types) {
+            options.lazy_method_bodies = false;
+            auto program = ParseAndOptimize(*lexer, options);
+            optimizer::DumpTypes(*program, std::cout);
+            report_pipeline();
+            return 0;
+        }
+        if(emit_cpp) {
+            options.lazy_method_bodies = false;
+            auto program = ParseAndOptimize(*lexer, options);
+            transpiler::EmitCpp(*program, std::cout);
+            report_pipeline();
+            return 0;
+        }
+        ast::ResetSpecializationStats();
+        ast::ResetLazyCompilationStats();
+        const size_t allocations_before = runtime::ObjectHolder::GetAllocationCount();
+        auto stats = RunMythonProgram(*lexer, std::cout, options);
+        report_pipeline();
+        if(report_allocations) {
+            std::cerr << "allocations: "s << runtime::ObjectHolder::GetAllocationCount() - allocations_before << std::endl;
+        }
+        if(options.profile_out) {
+            std::ofstream file(profile_out_path);
+            profile_out.Save(file);
+            if(!file) {
+                throw std::runtime_error("cannot write profile: "s + profile_out_path);
+            }
+        }
+        if(options.max_call_depth != 0) {
+            std::cerr << "peak call depth: "s << stats.peak_call_depth << std::endl;
+        }
+        if(report_lazy_methods) {
+            auto lazy = ast::GetLazyCompilationStats();
+            std::cerr << "lazy method bodies: "s << lazy.deferred << ", compiled: "s << lazy.compiled
+                      << ", never compiled: "s << lazy.deferred - lazy.compiled << std::endl;
+        }
+        if(report_specializations) {
+            auto specialization = ast::GetSpecializationStats();
+            std::cerr << "specializations: "s << specialization.specializations
+                      << ", deoptimizations: "s << specialization.deoptimizations << std::endl;
+        }
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -0,0 +1,42 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace parse {
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw runtime_error("cannot open file: "s + path);
+    }
+    struct stat info{};
+    if(fstat(fd, &info) != 0) {
+        close(fd);
+        throw runtime_error("cannot read file: "s + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    //an empty file cannot be mapped, and there is nothing to map anyway
+    if(size_ != 0) {
+        void* memory = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(memory == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("cannot map file: "s + path);
+        }
+        data_ = static_cast<const char*>(memory);
+        madvise(memory, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+}  // namespace parse
@@ -0,0 +1,102 @@
+#include "node_arena.h"
+#include "statement.h"
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+using namespace std;
+
+namespace ast {
+
+namespace {
+
+thread_local NodeArena* current_arena = nullptr;
+atomic<size_t> live_arenas{0};
+
+//every node starts with the arena it was allocated from, nullptr for the heap
+constexpr size_t NODE_HEADER_SIZE = alignof(max_align_t);
+
+}  // namespace
+
+NodeArena::Scope::Scope()
+    : arena_(new NodeArena)
+    , previous_(current_arena) {
+    arena_->AddUser();
+    current_arena = arena_;
+}
+
+NodeArena::Scope::~Scope() {
+    current_arena = previous_;
+    arena_->Release();
+}
+
+NodeArena* NodeArena::Current() {
+    return current_arena;
+}
+
+void* NodeArena::Allocate(size_t size, size_t alignment) {
+    auto padding = static_cast<size_t>(-reinterpret_cast<uintptr_t>(free_) & (alignment - 1u));
+    if(free_ == nullptr || padding + size > free_size_) {
+        //a large array gets a block of its own
+        const size_t block_size = max(BLOCK_SIZE, size + alignment);
+        auto* block = static_cast<byte*>(::operator new(block_size));
+        blocks_.push_back(block);
+        free_ = block;
+        free_size_ = block_size;
+        padding = static_cast<size_t>(-reinterpret_cast<uintptr_t>(free_) & (alignment - 1u));
+    }
+    byte* result = free_ + padding;
+    free_ += padding + size;
+    free_size_ -= padding + size;
+    ++users_;
+    return result;
+}
+
+void NodeArena::AddUser() noexcept {
+    ++users_;
+}
+
+void NodeArena::Release() noexcept {
+    if(--users_ == 0) {
+        delete this;
+    }
+}
+
+size_t NodeArena::GetLiveCount() {
+    return live_arenas.load(memory_order_relaxed);
+}
+
+NodeArena::NodeArena() {
+    live_arenas.fetch_add(1, memory_order_relaxed);
+}
+
+NodeArena::~NodeArena() {
+    live_arenas.fetch_sub(1, memory_order_relaxed);
+    for(byte* block : blocks_) {
+        ::operator delete(block);
+    }
+}
+
+void* Statement::operator new(size_t size) {
+    NodeArena* arena = current_arena;
+    void* memory = arena ? arena->Allocate(NODE_HEADER_SIZE + size, NODE_HEADER_SIZE)
+                         : ::operator new(NODE_HEADER_SIZE + size);
+    *static_cast<NodeArena**>(memory) = arena;
+    return static_cast<byte*>(memory) + NODE_HEADER_SIZE;
+}
+
+void Statement::operator delete(void* node) noexcept {
+    if(node == nullptr) {
+        return;
+    }
+    void* memory = static_cast<byte*>(node) - NODE_HEADER_SIZE;
+    if(NodeArena* arena = *static_cast<NodeArena**>(memory)) {
+        arena->Release();
+    }
+    else {
+        ::operator delete(memory);
+    }
+}
+
+}  // namespace ast
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace ast {
+
+/*
+Арена узлов синтаксического дерева. Пока в потоке действует NodeArena::Scope, узлы
+(наследники Statement), созданные оператором new, и массивы, размещённые аллокатором
+NodeArenaAllocator, занимают память подряд в больших блоках арены, а не отдельными
+выделениями из кучи. Удаление узла или массива только уменьшает счётчик пользователей
+арены. Блоки освобождаются все сразу, когда не остаётся ни узлов и массивов арены, ни
+аллокаторов и Scope, которые на неё ссылаются. Поэтому узлы, перенесённые в другое дерево
+или в тело метода класса, остаются действительными, пока существуют сами.
+Арену используют объекты одного потока
+*/
+class NodeArena {
+public:
+    // Создаёт новую арену и делает её текущей в потоке до своего разрушения
+    class Scope {
+    public:
+        Scope();
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        NodeArena* arena_;
+        NodeArena* previous_;
+    };
+
+    // Арена, в которой размещаются узлы, создаваемые в этом потоке, либо nullptr
+    static NodeArena* Current();
+
+    // Размещает size байт с выравниванием alignment. Размещённая память считается
+    // пользователем арены до вызова Release
+    void* Allocate(size_t size, size_t alignment);
+
+    void AddUser() noexcept;
+    // Уменьшает счётчик пользователей и освобождает арену, если их не осталось
+    void Release() noexcept;
+
+    // Число существующих арен во всех потоках
+    static size_t GetLiveCount();
+
+    // Размер блока, которым арена запрашивает память у кучи
+    static constexpr size_t BLOCK_SIZE = 64u * 1024u;
+
+private:
+    NodeArena();
+    ~NodeArena();
+
+    std::vector<std::byte*> blocks_;
+    std::byte* free_ = nullptr;  //the unused part of the last block
+    size_t free_size_ = 0;
+    size_t users_ = 0;
+};
+
+// Аллокатор, который размещает память в арене, текущей при его создании, либо в куче, если
+// текущей арены нет. Аллокатор удерживает свою арену от освобождения
+template <typename T>
+class NodeArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    NodeArenaAllocator() noexcept
+        : NodeArenaAllocator(NodeArena::Current()) {
+    }
+
+    explicit NodeArenaAllocator(NodeArena* arena) noexcept
+        : arena_(arena) {
+        if(arena_) {
+            arena_->AddUser();
+        }
+    }
+
+    template <typename U>
+    NodeArenaAllocator(const NodeArenaAllocator<U>& other) noexcept
+        : NodeArenaAllocator(other.GetArena()) {
+    }
+
+    NodeArenaAllocator(const NodeArenaAllocator& other) noexcept
+        : NodeArenaAllocator(other.arena_) {
+    }
+
+    NodeArenaAllocator& operator=(const NodeArenaAllocator& other) noexcept {
+        NodeArenaAllocator copy(other);
+        std::swap(arena_, copy.arena_);
+        return *this;
+    }
+
+    ~NodeArenaAllocator() {
+        if(arena_) {
+            arena_->Release();
+        }
+    }
+
+    T* allocate(size_t n) {
+        if(arena_) {
+            return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+        }
+        return std::allocator<T>{}.allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        if(arena_) {
+            arena_->Release();
+        }
+        else {
+            std::allocator<T>{}.deallocate(p, n);
+        }
+    }
+
+    [[nodiscard]] NodeArena* GetArena() const noexcept {
+        return arena_;
+    }
+
+    template <typename U>
+    bool operator==(const NodeArenaAllocator<U>& other) const noexcept {
+        return arena_ == other.GetArena();
+    }
+
+    template <typename U>
+    bool operator!=(const NodeArenaAllocator<U>& other) const noexcept {
+        return arena_ != other.GetArena();
+    }
+
+private:
+    NodeArena* arena_;
+};
+
+}  // namespace ast
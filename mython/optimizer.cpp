@@ -0,0 +1,738 @@
+#include "optimizer.h"
+#include "type_inference.h"
+
+#include <climits>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <typeinfo>
+#include <unordered_map>
+
+using namespace std;
+
+namespace optimizer {
+
+using ast::Statement;
+using runtime::ObjectHolder;
+
+namespace {
+
+//after parsing, ClassDefinition nodes are the only owners of the classes,
+//so passes must never drop them
+bool ContainsClassDefinition(const Statement& node) {
+    if(dynamic_cast<const ast::ClassDefinition*>(&node)) {
+        return true;
+    }
+    bool found = false;
+    ast::ForEachChild(node, [&found](const Statement& child) {
+        found = found || ContainsClassDefinition(child);
+    });
+    return found;
+}
+
+void CollectMethodBodies(Statement& node, vector<unique_ptr<Statement>*>& bodies) {
+    if(auto definition = dynamic_cast<ast::ClassDefinition*>(&node)) {
+        for(const auto& method : definition->GetClass().GetMethods()) {
+            if(auto body = dynamic_cast<ast::MethodBody*>(method.body.get())) {
+                bodies.push_back(&body->Body());
+                CollectMethodBodies(*body->Body(), bodies);
+            }
+        }
+        return;
+    }
+    ast::ForEachChild(node, [&bodies](unique_ptr<Statement>& child) {
+        CollectMethodBodies(*child, bodies);
+    });
+}
+
+bool IsConstant(const Statement& node) {
+    return dynamic_cast<const ast::NumericConst*>(&node) || dynamic_cast<const ast::StringConst*>(&node)
+        || dynamic_cast<const ast::BoolConst*>(&node) || dynamic_cast<const ast::None*>(&node);
+}
+
+//evaluates an expression whose operands are constants
+ObjectHolder Evaluate(Statement& node) {
+    runtime::Closure closure;
+    ostringstream output;
+    runtime::SimpleContext context{output};
+    return node.Execute(closure, context);
+}
+
+//equal constants made from one pool share their object, like literals of a parsed program
+unique_ptr<Statement> MakeConstant(const ObjectHolder& value, ast::ConstantPool& constants) {
+    if(!value) {
+        return make_unique<ast::None>();
+    }
+    if(auto number = value.TryAs<runtime::Number>()) {
+        return constants.MakeNumber(number->GetValue());
+    }
+    if(auto str = value.TryAs<runtime::String>()) {
+        return constants.MakeString(str->GetValue());
+    }
+    if(auto boolean = value.TryAs<runtime::Bool>()) {
+        return constants.MakeBool(boolean->GetValue());
+    }
+    return nullptr;
+}
+
+const ast::NumericConst* AsNumericConst(const unique_ptr<Statement>& node) {
+    return dynamic_cast<const ast::NumericConst*>(node.get());
+}
+
+//runtime arithmetic uses int, a result out of its range is left for run time
+bool Overflows(const Statement& node) {
+    auto binary = dynamic_cast<const ast::BinaryOperation*>(&node);
+    if(!binary) {
+        return false;
+    }
+    auto lhs = AsNumericConst(binary->Lhs());
+    auto rhs = AsNumericConst(binary->Rhs());
+    if(!lhs || !rhs) {
+        return false;
+    }
+    int64_t l = lhs->GetValue().GetValue();
+    int64_t r = rhs->GetValue().GetValue();
+    int64_t result = 0;
+    if(dynamic_cast<const ast::Add*>(&node)) {
+        result = l + r;
+    }
+    else if(dynamic_cast<const ast::Sub*>(&node)) {
+        result = l - r;
+    }
+    else if(dynamic_cast<const ast::Mult*>(&node)) {
+        result = l * r;
+    }
+    else if(dynamic_cast<const ast::Div*>(&node)) {
+        result = r == 0 ? 0 : l / r;
+    }
+    return result < INT_MIN || result > INT_MAX;
+}
+
+// Проход, переписывающий каждое дерево снизу вверх: сначала потомков узла, затем сам узел
+class TreePass : public Pass {
+public:
+    void Run(unique_ptr<Statement>& program) override {
+        Transform(program);
+        vector<unique_ptr<Statement>*> bodies;
+        CollectMethodBodies(*program, bodies);
+        for(auto body : bodies) {
+            Transform(*body);
+        }
+        //constants already made are kept alive by their nodes
+        constants_.Clear();
+    }
+
+protected:
+    virtual void Rewrite(unique_ptr<Statement>& node) = 0;
+
+    //constants that Rewrite creates during one Run
+    ast::ConstantPool constants_;
+
+private:
+    void Transform(unique_ptr<Statement>& node) {
+        ast::ForEachChild(*node, [this](unique_ptr<Statement>& child) {
+            Transform(child);
+        });
+        Rewrite(node);
+    }
+};
+
+class ConstantFolding : public TreePass {
+public:
+    [[nodiscard]] string_view GetName() const override {
+        return "constant-folding"sv;
+    }
+
+protected:
+    void Rewrite(unique_ptr<Statement>& node) override {
+        if(!IsFoldable(*node) || Overflows(*node)) {
+            return;
+        }
+        bool constant_operands = true;
+        ast::ForEachChild(*node, [&constant_operands](const unique_ptr<Statement>& child) {
+            constant_operands = constant_operands && IsConstant(*child);
+        });
+        if(!constant_operands) {
+            return;
+        }
+        ObjectHolder value;
+        try {
+            value = Evaluate(*node);
+        }
+        catch(const std::runtime_error&) {
+            //the error must still happen at run time
+            return;
+        }
+        if(auto constant = MakeConstant(value, constants_)) {
+            node = std::move(constant);
+        }
+    }
+
+private:
+    static bool IsFoldable(const Statement& node) {
+        if(auto comparison = dynamic_cast<const ast::Comparison*>(&node)) {
+            return comparison->HasBuiltinComparator();
+        }
+        return dynamic_cast<const ast::Add*>(&node) || dynamic_cast<const ast::Sub*>(&node)
+            || dynamic_cast<const ast::Mult*>(&node) || dynamic_cast<const ast::Div*>(&node)
+            || dynamic_cast<const ast::Or*>(&node) || dynamic_cast<const ast::And*>(&node)
+            || dynamic_cast<const ast::Not*>(&node) || dynamic_cast<const ast::Stringify*>(&node);
+    }
+};
+
+class UnaryMinusFolding : public TreePass {
+public:
+    [[nodiscard]] string_view GetName() const override {
+        return "unary-minus-folding"sv;
+    }
+
+protected:
+    void Rewrite(unique_ptr<Statement>& node) override {
+        auto mult = dynamic_cast<ast::Mult*>(node.get());
+        if(!mult) {
+            return;
+        }
+        auto value = AsNumericConst(mult->Lhs());
+        auto minus_one = AsNumericConst(mult->Rhs());
+        if(value && minus_one && minus_one->GetValue().GetValue() == -1 && value->GetValue().GetValue() != INT_MIN) {
+            node = constants_.MakeNumber(-value->GetValue().GetValue());
+        }
+    }
+};
+
+class DeadBranchElimination : public TreePass {
+public:
+    [[nodiscard]] string_view GetName() const override {
+        return "dead-branch-elimination"sv;
+    }
+
+protected:
+    void Rewrite(unique_ptr<Statement>& node) override {
+        if(auto if_else = dynamic_cast<ast::IfElse*>(node.get())) {
+            RewriteIfElse(*if_else, node);
+        }
+        else if(auto compound = dynamic_cast<ast::Compound*>(node.get())) {
+            Flatten(*compound);
+        }
+    }
+
+private:
+    static void RewriteIfElse(ast::IfElse& if_else, unique_ptr<Statement>& node) {
+        if(!IsConstant(*if_else.Condition())) {
+            return;
+        }
+        const bool condition = runtime::IsTrue(Evaluate(*if_else.Condition()));
+        auto& taken = condition ? if_else.IfBody() : if_else.ElseBody();
+        auto& skipped = condition ? if_else.ElseBody() : if_else.IfBody();
+        if(skipped && ContainsClassDefinition(*skipped)) {
+            return;
+        }
+        unique_ptr<Statement> replacement = taken ? std::move(taken) : make_unique<ast::Compound>();
+        node = std::move(replacement);
+    }
+
+    //a nested Compound only sequences statements, so its statements can be spliced in place
+    static void Flatten(ast::Compound& compound) {
+        auto& statements = compound.Statements();
+        ast::StatementList flattened;
+        flattened.reserve(statements.size());
+        for(auto& stmt : statements) {
+            if(auto nested = dynamic_cast<ast::Compound*>(stmt.get())) {
+                for(auto& nested_stmt : nested->Statements()) {
+                    flattened.push_back(std::move(nested_stmt));
+                }
+            }
+            else {
+                flattened.push_back(std::move(stmt));
+            }
+        }
+        statements = std::move(flattened);
+    }
+};
+
+
+//variables of an inlined body get names which cannot clash with the caller's ones
+using Renaming = unordered_map<string, string>;
+
+void CollectLocals(const Statement& node, vector<string>& names) {
+    if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+        names.push_back(assignment->GetName());
+    }
+    ast::ForEachChild(node, [&names](const Statement& child) {
+        CollectLocals(child, names);
+    });
+}
+
+bool CallsMethod(const Statement& node, const string& name) {
+    if(auto call = dynamic_cast<const ast::MethodCall*>(&node); call && call->GetMethodName() == name) {
+        return true;
+    }
+    bool found = false;
+    ast::ForEachChild(node, [&found, &name](const Statement& child) {
+        found = found || CallsMethod(child, name);
+    });
+    return found;
+}
+
+unique_ptr<Statement> Clone(const Statement& node, const Renaming& names);
+
+ast::StatementList CloneAll(const ast::StatementList& nodes, const Renaming& names) {
+    ast::StatementList result;
+    result.reserve(nodes.size());
+    for(const auto& node : nodes) {
+        auto copy = Clone(*node, names);
+        if(!copy) {
+            return {};
+        }
+        result.push_back(std::move(copy));
+    }
+    return result;
+}
+
+unique_ptr<ast::VariableValue> CloneVariable(const ast::VariableValue& var, const Renaming& names) {
+    auto ids = var.GetDottedIds();
+    auto it = names.find(ids.front());
+    if(it == names.end()) {
+        return nullptr;
+    }
+    ids.front() = it->second;
+    return make_unique<ast::VariableValue>(std::move(ids));
+}
+
+template <typename Operation>
+unique_ptr<Statement> CloneBinary(const ast::BinaryOperation& operation, const Renaming& names) {
+    auto lhs = Clone(*operation.Lhs(), names);
+    auto rhs = Clone(*operation.Rhs(), names);
+    if(!lhs || !rhs) {
+        return nullptr;
+    }
+    auto copy = make_unique<Operation>(std::move(lhs), std::move(rhs));
+    copy->SetLocation(operation.GetLocation());
+    return copy;
+}
+
+template <typename Operation>
+unique_ptr<Statement> CloneUnary(const ast::UnaryOperation& operation, const Renaming& names) {
+    auto argument = Clone(*operation.Argument(), names);
+    return argument ? make_unique<Operation>(std::move(argument)) : nullptr;
+}
+
+//copies an expression or a simple statement renaming its variables,
+//returns nullptr for nodes which cannot be inlined
+unique_ptr<Statement> Clone(const Statement& node, const Renaming& names) {
+    //copies of a constant share its object
+    if(auto num = dynamic_cast<const ast::NumericConst*>(&node)) {
+        return make_unique<ast::NumericConst>(num->GetObject());
+    }
+    if(auto str = dynamic_cast<const ast::StringConst*>(&node)) {
+        return make_unique<ast::StringConst>(str->GetObject());
+    }
+    if(auto boolean = dynamic_cast<const ast::BoolConst*>(&node)) {
+        return make_unique<ast::BoolConst>(boolean->GetObject());
+    }
+    if(dynamic_cast<const ast::None*>(&node)) {
+        return make_unique<ast::None>();
+    }
+    if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+        return CloneVariable(*var, names);
+    }
+    if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+        auto value = Clone(*assignment->Value(), names);
+        if(!value) {
+            return nullptr;
+        }
+        return make_unique<ast::Assignment>(names.at(assignment->GetName()), std::move(value));
+    }
+    if(auto field_assignment = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+        auto object = CloneVariable(field_assignment->Object(), names);
+        auto value = Clone(*field_assignment->Value(), names);
+        if(!object || !value) {
+            return nullptr;
+        }
+        return make_unique<ast::FieldAssignment>(std::move(*object), field_assignment->GetFieldName(), std::move(value));
+    }
+    if(auto call = dynamic_cast<const ast::MethodCall*>(&node)) {
+        auto object = Clone(*call->Object(), names);
+        auto args = CloneAll(call->Args(), names);
+        if(!object || args.size() != call->Args().size()) {
+            return nullptr;
+        }
+        auto copy = make_unique<ast::MethodCall>(std::move(object), call->GetMethodName(), std::move(args));
+        copy->SetLocation(call->GetLocation());
+        return copy;
+    }
+    if(auto print = dynamic_cast<const ast::Print*>(&node)) {
+        auto args = CloneAll(print->Args(), names);
+        if(args.size() != print->Args().size()) {
+            return nullptr;
+        }
+        return make_unique<ast::Print>(std::move(args));
+    }
+    if(auto compound = dynamic_cast<const ast::Compound*>(&node)) {
+        auto statements = CloneAll(compound->Statements(), names);
+        if(statements.size() != compound->Statements().size()) {
+            return nullptr;
+        }
+        auto copy = make_unique<ast::Compound>();
+        copy->Statements() = std::move(statements);
+        return copy;
+    }
+    if(auto comparison = dynamic_cast<const ast::Comparison*>(&node)) {
+        auto lhs = Clone(*comparison->Lhs(), names);
+        auto rhs = Clone(*comparison->Rhs(), names);
+        if(!lhs || !rhs) {
+            return nullptr;
+        }
+        auto copy = make_unique<ast::Comparison>(comparison->GetComparator(), std::move(lhs), std::move(rhs));
+        copy->SetLocation(comparison->GetLocation());
+        return copy;
+    }
+    if(dynamic_cast<const ast::Add*>(&node)) {
+        return CloneBinary<ast::Add>(static_cast<const ast::BinaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::Sub*>(&node)) {
+        return CloneBinary<ast::Sub>(static_cast<const ast::BinaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::Mult*>(&node)) {
+        return CloneBinary<ast::Mult>(static_cast<const ast::BinaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::Div*>(&node)) {
+        return CloneBinary<ast::Div>(static_cast<const ast::BinaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::Or*>(&node)) {
+        return CloneBinary<ast::Or>(static_cast<const ast::BinaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::And*>(&node)) {
+        return CloneBinary<ast::And>(static_cast<const ast::BinaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::Not*>(&node)) {
+        return CloneUnary<ast::Not>(static_cast<const ast::UnaryOperation&>(node), names);
+    }
+    if(dynamic_cast<const ast::Stringify*>(&node)) {
+        return CloneUnary<ast::Stringify>(static_cast<const ast::UnaryOperation&>(node), names);
+    }
+    //Return, IfElse, NewInstance, ClassDefinition and already inlined calls are left as they are
+    return nullptr;
+}
+
+//returns the statement a method body consists of, looking through single-statement Compound nodes
+const Statement& Unwrap(const Statement& node) {
+    auto compound = dynamic_cast<const ast::Compound*>(&node);
+    if(compound && compound->Statements().size() == 1u) {
+        return Unwrap(*compound->Statements().front());
+    }
+    return node;
+}
+
+class Inlining : public TreePass {
+public:
+    explicit Inlining(size_t budget)
+        : budget_(budget)
+    {
+    }
+
+    [[nodiscard]] string_view GetName() const override {
+        return "inlining"sv;
+    }
+
+    void Run(unique_ptr<Statement>& program) override {
+        if(budget_ == 0) {
+            return;
+        }
+        CollectMethods(*program);
+        TreePass::Run(program);
+    }
+
+protected:
+    void Rewrite(unique_ptr<Statement>& node) override {
+        auto call = dynamic_cast<ast::MethodCall*>(node.get());
+        if(!call) {
+            return;
+        }
+        auto method = FindTarget(*call);
+        if(!method) {
+            return;
+        }
+        //the body is inlined either as the returned expression or as a sequence of statements
+        const auto& body = Unwrap(*static_cast<const ast::MethodBody&>(*method->body).Body());
+        const Statement* inlined = &body;
+        auto ret = dynamic_cast<const ast::Return*>(&body);
+        if(ret) {
+            inlined = ret->Value().get();
+        }
+        else if(ContainsReturnOrBranch(body)) {
+            return;
+        }
+        if(CountNodes(*inlined) > budget_ || CallsMethod(*inlined, method->name)) {
+            return;
+        }
+
+        const string suffix = "@"s + to_string(++sites_);
+        Renaming names;
+        vector<string> bindings{"self"s + suffix};
+        names["self"s] = bindings.front();
+        for(const auto& param : method->formal_params) {
+            bindings.push_back(param + suffix);
+            names[param] = bindings.back();
+        }
+        vector<string> assigned;
+        CollectLocals(*inlined, assigned);
+        vector<string> locals;
+        for(const auto& name : assigned) {
+            if(names.emplace(name, name + suffix).second) {
+                locals.push_back(name + suffix);
+            }
+        }
+        auto copy = Clone(*inlined, names);
+        if(!copy) {
+            return;
+        }
+        unique_ptr<ast::MethodCall> original{static_cast<ast::MethodCall*>(node.release())};
+        node = make_unique<ast::InlinedMethodCall>(std::move(original), *method, std::move(bindings),
+                                                   std::move(locals), std::move(copy), ret != nullptr);
+    }
+
+private:
+    void CollectMethods(Statement& node) {
+        if(auto definition = dynamic_cast<ast::ClassDefinition*>(&node)) {
+            for(const auto& method : definition->GetClass().GetMethods()) {
+                methods_.emplace(method.name, &method);
+            }
+            return;
+        }
+        ast::ForEachChild(node, [this](unique_ptr<Statement>& child) {
+            CollectMethods(*child);
+        });
+    }
+
+    //the target must be the only method with this name and number of parameters,
+    //otherwise the call site is polymorphic and is left to the inline cache of MethodCall
+    const runtime::Method* FindTarget(const ast::MethodCall& call) const {
+        const runtime::Method* target = nullptr;
+        auto [first, last] = methods_.equal_range(call.GetMethodName());
+        for(auto it = first; it != last; ++it) {
+            if(it->second->formal_params.size() != call.Args().size()) {
+                continue;
+            }
+            if(target) {
+                return nullptr;
+            }
+            target = it->second;
+        }
+        if(!target || !dynamic_cast<const ast::MethodBody*>(target->body.get())) {
+            return nullptr;
+        }
+        return target;
+    }
+
+    static bool ContainsReturnOrBranch(const Statement& node) {
+        if(dynamic_cast<const ast::Return*>(&node) || dynamic_cast<const ast::IfElse*>(&node)) {
+            return true;
+        }
+        bool found = false;
+        ast::ForEachChild(node, [&found](const Statement& child) {
+            found = found || ContainsReturnOrBranch(child);
+        });
+        return found;
+    }
+
+    size_t budget_;
+    size_t sites_ = 0;
+    unordered_multimap<string, const runtime::Method*> methods_;
+};
+
+class TypeSpecialization : public TreePass {
+public:
+    [[nodiscard]] string_view GetName() const override {
+        return "type-specialization"sv;
+    }
+
+    void Run(unique_ptr<Statement>& program) override {
+        types_ = InferTypes(*program);
+        TreePass::Run(program);
+    }
+
+protected:
+    void Rewrite(unique_ptr<Statement>& node) override {
+        auto binary = dynamic_cast<ast::BinaryOperation*>(node.get());
+        if(!binary) {
+            return;
+        }
+        const ValueType lhs = TypeOf(*binary->Lhs());
+        const ValueType rhs = TypeOf(*binary->Rhs());
+        if(lhs != rhs || (lhs != ValueType::NUMBER && lhs != ValueType::STRING)) {
+            return;
+        }
+        const bool numbers = lhs == ValueType::NUMBER;
+        unique_ptr<Statement> typed;
+        //already typed variants are derived from these classes, so the type is compared exactly
+        const type_info& type = typeid(*node);
+        if(type == typeid(ast::Add)) {
+            typed = numbers ? MakeTyped<ast::NumberAdd>(*binary) : MakeTyped<ast::StringAdd>(*binary);
+        }
+        else if(numbers && type == typeid(ast::Sub)) {
+            typed = MakeTyped<ast::NumberSub>(*binary);
+        }
+        else if(numbers && type == typeid(ast::Mult)) {
+            typed = MakeTyped<ast::NumberMult>(*binary);
+        }
+        else if(numbers && type == typeid(ast::Div)) {
+            typed = MakeTyped<ast::NumberDiv>(*binary);
+        }
+        else if(type == typeid(ast::Comparison)) {
+            auto& comparison = static_cast<ast::Comparison&>(*binary);
+            if(!comparison.HasBuiltinComparator()) {
+                return;
+            }
+            typed = numbers ? MakeTypedComparison<ast::NumberComparison>(comparison)
+                            : MakeTypedComparison<ast::StringComparison>(comparison);
+        }
+        if(!typed) {
+            return;
+        }
+        //the parent looks the node up by its new address
+        const ValueType result = TypeOf(*node);
+        types_.erase(node.get());
+        node = std::move(typed);
+        types_[node.get()] = result;
+    }
+
+private:
+    ValueType TypeOf(const Statement& node) const {
+        auto it = types_.find(&node);
+        return it == types_.end() ? ValueType::ANY : it->second;
+    }
+
+    template <typename Typed>
+    static unique_ptr<Statement> MakeTyped(ast::BinaryOperation& operation) {
+        auto typed = make_unique<Typed>(std::move(operation.Lhs()), std::move(operation.Rhs()));
+        typed->SetLocation(operation.GetLocation());
+        return typed;
+    }
+
+    template <typename Typed>
+    static unique_ptr<Statement> MakeTypedComparison(ast::Comparison& comparison) {
+        auto typed = make_unique<Typed>(comparison.GetComparator(), std::move(comparison.Lhs()), std::move(comparison.Rhs()));
+        typed->SetLocation(comparison.GetLocation());
+        return typed;
+    }
+
+    TypeMap types_;
+};
+
+//the value of an operand escapes unless a numeric operation consumes it at once:
+//assignments, fields, method arguments, print and return need the boxed object
+class EscapeAnalysis : public TreePass {
+public:
+    [[nodiscard]] string_view GetName() const override {
+        return "escape-analysis"sv;
+    }
+
+protected:
+    void Rewrite(unique_ptr<Statement>& node) override {
+        auto operands = dynamic_cast<ast::NumberOperands*>(node.get());
+        if(!operands) {
+            return;
+        }
+        auto& operation = dynamic_cast<ast::BinaryOperation&>(*node);
+        operands->SetUnboxedOperands(dynamic_cast<ast::IntExpression*>(operation.Lhs().get()),
+                                     dynamic_cast<ast::IntExpression*>(operation.Rhs().get()));
+    }
+};
+
+}  // namespace
+
+void Pipeline::AddPass(unique_ptr<Pass> pass) {
+    passes_.push_back(std::move(pass));
+}
+
+vector<PassReport> Pipeline::Run(unique_ptr<Statement>& program) const {
+    vector<PassReport> reports;
+    reports.reserve(passes_.size());
+    for(const auto& pass : passes_) {
+        PassReport report;
+        report.name = pass->GetName();
+        report.nodes_before = CountNodes(*program);
+        auto start = chrono::steady_clock::now();
+        pass->Run(program);
+        report.time = chrono::steady_clock::now() - start;
+        report.nodes_after = CountNodes(*program);
+        reports.push_back(std::move(report));
+    }
+    return reports;
+}
+
+bool Pipeline::IsEmpty() const {
+    return passes_.empty();
+}
+
+unique_ptr<Pass> MakeConstantFolding() {
+    return make_unique<ConstantFolding>();
+}
+
+unique_ptr<Pass> MakeUnaryMinusFolding() {
+    return make_unique<UnaryMinusFolding>();
+}
+
+unique_ptr<Pass> MakeDeadBranchElimination() {
+    return make_unique<DeadBranchElimination>();
+}
+
+unique_ptr<Pass> MakeInlining(size_t budget) {
+    return make_unique<Inlining>(budget);
+}
+
+unique_ptr<Pass> MakeTypeSpecialization() {
+    return make_unique<TypeSpecialization>();
+}
+
+unique_ptr<Pass> MakeEscapeAnalysis() {
+    return make_unique<EscapeAnalysis>();
+}
+
+Pipeline MakePipeline(int level, size_t inline_budget) {
+    Pipeline pipeline;
+    if(level >= 1) {
+        pipeline.AddPass(MakeUnaryMinusFolding());
+        pipeline.AddPass(MakeConstantFolding());
+    }
+    if(level >= 2) {
+        pipeline.AddPass(MakeDeadBranchElimination());
+        pipeline.AddPass(MakeInlining(inline_budget));
+        pipeline.AddPass(MakeTypeSpecialization());
+        pipeline.AddPass(MakeEscapeAnalysis());
+    }
+    return pipeline;
+}
+
+size_t CountNodes(const Statement& program) {
+    size_t count = 1;
+    if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&program)) {
+        for(const auto& method : definition->GetClass().GetMethods()) {
+            if(auto body = ast::GetMethodBody(method)) {
+                count += CountNodes(*body);
+            }
+        }
+    }
+    ast::ForEachChild(program, [&count](const Statement& child) {
+        count += CountNodes(child);
+    });
+    return count;
+}
+
+void PrintReport(const vector<PassReport>& reports, ostream& out) {
+    for(const auto& report : reports) {
+        const bool grown = report.nodes_after > report.nodes_before;
+        out << report.name << ": "sv << fixed << setprecision(3)
+            << chrono::duration<double, milli>(report.time).count() << " ms, "sv;
+        if(grown) {
+            out << report.nodes_after - report.nodes_before << " nodes added ("sv;
+        }
+        else {
+            out << report.nodes_before - report.nodes_after << " nodes removed ("sv;
+        }
+        out << report.nodes_before << " -> "sv << report.nodes_after << ")\n"sv;
+    }
+}
+
+}  // namespace optimizer
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "statement.h"
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace optimizer {
+
+// Проход оптимизатора. Преобразует синтаксическое дерево программы на месте,
+// включая тела методов объявленных в ней классов
+class Pass {
+public:
+    virtual ~Pass() = default;
+
+    [[nodiscard]] virtual std::string_view GetName() const = 0;
+    // Корень дерева может быть заменён другим узлом
+    virtual void Run(std::unique_ptr<ast::Statement>& program) = 0;
+};
+
+// Сведения о работе прохода
+struct PassReport {
+    std::string name;
+    std::chrono::steady_clock::duration time{};
+    size_t nodes_before = 0;
+    size_t nodes_after = 0;
+};
+
+// Последовательность проходов, выполняемых между разбором и исполнением программы
+class Pipeline {
+public:
+    void AddPass(std::unique_ptr<Pass> pass);
+
+    // Выполняет проходы по порядку и возвращает сведения о каждом из них
+    std::vector<PassReport> Run(std::unique_ptr<ast::Statement>& program) const;
+
+    [[nodiscard]] bool IsEmpty() const;
+
+private:
+    std::vector<std::unique_ptr<Pass>> passes_;
+};
+
+// Свёртка выражений над константами NumericConst, StringConst, BoolConst и None.
+// Выражение, вычисление которого завершилось бы ошибкой, не сворачивается
+std::unique_ptr<Pass> MakeConstantFolding();
+// Замена Mult(<число>, -1), в которую разбирается унарный минус, отрицательной константой
+std::unique_ptr<Pass> MakeUnaryMinusFolding();
+// Замена IfElse с константным условием выполняемой ветвью и слияние вложенных Compound
+std::unique_ptr<Pass> MakeDeadBranchElimination();
+
+constexpr size_t DEFAULT_INLINE_BUDGET = 12;
+
+/*
+Встраивание небольших методов в места их вызова. Вызов MethodCall заменяется на InlinedMethodCall,
+если среди объявленных в программе классов есть ровно один метод с таким именем и количеством
+параметров и его тело:
+    - состоит из одного return <выражение> либо из операторов без return и if;
+    - содержит не больше budget узлов;
+    - не вызывает метод с тем же именем (то есть не рекурсивно);
+    - обращается только к self, параметрам и своим локальным переменным.
+Класс объекта проверяется при каждом вызове, при несовпадении метод вызывается обычным образом.
+При budget, равном нулю, проход ничего не делает
+*/
+std::unique_ptr<Pass> MakeInlining(size_t budget = DEFAULT_INLINE_BUDGET);
+
+// Замена Add, Sub, Mult, Div и Comparison вариантами без проверки типов (NumberAdd, StringAdd и т.д.),
+// если по выведенным типам (InferTypes) оба аргумента - числа либо оба - строки
+std::unique_ptr<Pass> MakeTypeSpecialization();
+
+/*
+Анализ выхода значений за пределы выражения. Промежуточный результат числовой операции
+(NumberAdd, NumberSub, NumberMult, NumberDiv), который сразу потребляет другая числовая операция
+или сравнение чисел, передаётся как int и не размещается в куче. Результаты, которые присваиваются,
+передаются в методы, выводятся или возвращаются, по-прежнему упаковываются в runtime::Number.
+Должен выполняться после MakeTypeSpecialization и последним: последующая замена
+аргументов операций делает собранные сведения недействительными
+*/
+std::unique_ptr<Pass> MakeEscapeAnalysis();
+
+constexpr int MAX_OPTIMIZATION_LEVEL = 2;
+
+/*
+Создаёт набор проходов для уровня оптимизации:
+    0 - без оптимизаций
+    1 - свёртка унарного минуса и констант
+    2 - то же, затем удаление недостижимых ветвей, встраивание методов с размером тела
+        не больше inline_budget узлов, замена операций вариантами для выведенных типов
+        и анализ выхода значений числовых выражений
+*/
+Pipeline MakePipeline(int level, size_t inline_budget = DEFAULT_INLINE_BUDGET);
+
+// Возвращает количество узлов в дереве program и в телах методов объявленных в нём классов
+size_t CountNodes(const ast::Statement& program);
+
+// Выводит время работы и количество удалённых или добавленных узлов для каждого прохода
+void PrintReport(const std::vector<PassReport>& reports, std::ostream& out);
+
+}  // namespace optimizer
@@ -0,0 +1,228 @@
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace optimizer {
+
+namespace {
+
+unique_ptr<ast::Statement> Parse(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+const ast::Compound& AsCompound(const unique_ptr<ast::Statement>& program) {
+    return dynamic_cast<const ast::Compound&>(*program);
+}
+
+// Возвращает значение, присваиваемое инструкцией index программы, если оно - числовая константа
+const ast::NumericConst* AssignedNumber(const unique_ptr<ast::Statement>& program, size_t index) {
+    const auto& assignment = dynamic_cast<const ast::Assignment&>(*AsCompound(program).Statements().at(index));
+    return dynamic_cast<const ast::NumericConst*>(assignment.Value().get());
+}
+
+void TestConstantFolding() {
+    auto program = Parse("x = 2*5+10/2\ny = 'a' + 'b' == 'ab'\nz = -7\nw = 1/0\nv = x + 1\nu = 2147483647 + 1\nt = 3*5\n"s);
+    auto reports = MakePipeline(1).Run(program);
+    ASSERT_EQUAL(reports.size(), 2u);
+    ASSERT_EQUAL(reports[0].name, "unary-minus-folding"s);
+    ASSERT_EQUAL(reports[0].nodes_before - reports[0].nodes_after, 2u);
+    ASSERT_EQUAL(reports[1].name, "constant-folding"s);
+
+    ASSERT(AssignedNumber(program, 0) && AssignedNumber(program, 0)->GetValue().GetValue() == 15);
+    const auto& y = dynamic_cast<const ast::Assignment&>(*AsCompound(program).Statements()[1]);
+    auto y_value = dynamic_cast<const ast::BoolConst*>(y.Value().get());
+    ASSERT(y_value && y_value->GetValue().GetValue());
+    ASSERT(AssignedNumber(program, 2) && AssignedNumber(program, 2)->GetValue().GetValue() == -7);
+    //errors, overflows and variables are left for run time
+    ASSERT(!AssignedNumber(program, 3));
+    ASSERT(!AssignedNumber(program, 4));
+    ASSERT(!AssignedNumber(program, 5));
+    //folded constants are interned like literals
+    ASSERT(AssignedNumber(program, 6)
+           && AssignedNumber(program, 6)->GetObject().Get() == AssignedNumber(program, 0)->GetObject().Get());
+}
+
+void TestDeadBranchElimination() {
+    auto program = Parse(R"(
+class A:
+  def f():
+    if 1 > 2:
+      return 1
+    else:
+      return 2
+
+if True:
+  print 'yes'
+else:
+  print 'no'
+if None:
+  print 'never'
+if 0:
+  class B:
+    def g():
+      return 3
+)"s);
+    const size_t before = CountNodes(*program);
+    auto reports = MakePipeline(2).Run(program);
+    ASSERT_EQUAL(reports.at(2).name, "dead-branch-elimination"s);
+    ASSERT(reports[2].nodes_after < reports[2].nodes_before);
+    ASSERT(CountNodes(*program) < before);
+
+    const auto& statements = AsCompound(program).Statements();
+    ASSERT_EQUAL(statements.size(), 3u);
+    ASSERT(dynamic_cast<const ast::Print*>(statements[1].get()));
+    //a branch holding a class definition is kept, the class would be lost otherwise
+    ASSERT(dynamic_cast<const ast::IfElse*>(statements[2].get()));
+
+    const auto& cls = dynamic_cast<const ast::ClassDefinition&>(*statements[0]).GetClass();
+    const auto& body = dynamic_cast<const ast::MethodBody&>(*cls.GetMethod("f"s)->body);
+    const auto& method_statements = AsCompound(body.Body()).Statements();
+    ASSERT_EQUAL(method_statements.size(), 1u);
+    ASSERT(dynamic_cast<const ast::Return*>(method_statements[0].get()));
+
+    ostringstream report;
+    PrintReport(reports, report);
+    ASSERT(report.str().find("dead-branch-elimination: "s) != string::npos);
+}
+
+size_t CountInlinedCalls(const ast::Statement& node) {
+    size_t count = dynamic_cast<const ast::InlinedMethodCall*>(&node) ? 1u : 0u;
+    ast::ForEachChild(node, [&count](const ast::Statement& child) {
+        count += CountInlinedCalls(child);
+    });
+    return count;
+}
+
+void TestInlining() {
+    const string text = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+  def get():
+    return self.value
+  def set(value):
+    self.value = value
+  def add(n):
+    total = self.value + n
+    self.value = total
+  def fact(n):
+    if n < 2:
+      return 1
+    return n * self.fact(n - 1)
+
+c = Counter()
+c.set(5)
+c.add(c.get())
+print c.get(), c.fact(4)
+)"s;
+    {
+        auto program = Parse(text);
+        auto reports = MakePipeline(2).Run(program);
+        ASSERT_EQUAL(reports.at(3).name, "inlining"s);
+        ASSERT(reports[3].nodes_after > reports[3].nodes_before);
+        //set, add, both calls of get; the recursive fact stays an ordinary call
+        ASSERT_EQUAL(CountInlinedCalls(*program), 4u);
+
+        runtime::Closure closure;
+        ostringstream output;
+        runtime::SimpleContext context{output};
+        program->Execute(closure, context);
+        ASSERT_EQUAL(output.str(), "10 24\n"s);
+        //the inlined bodies' variables do not outlive the call
+        for(const auto& [name, value] : closure) {
+            ASSERT(name.find('@') == string::npos);
+        }
+    }
+    {
+        auto program = Parse(text);
+        MakeInlining(1)->Run(program);
+        //only the getter body fits into the budget
+        ASSERT_EQUAL(CountInlinedCalls(*program), 2u);
+    }
+    {
+        auto program = Parse(text);
+        MakeInlining(0)->Run(program);
+        ASSERT_EQUAL(CountInlinedCalls(*program), 0u);
+    }
+}
+
+void TestInliningFallback() {
+    auto program = Parse(R"(
+class A:
+  def get():
+    return 1
+class B:
+  def get(x):
+    return x
+b = B()
+print b.get()
+)"s);
+    MakeInlining()->Run(program);
+    const auto& print = dynamic_cast<const ast::Print&>(*AsCompound(program).Statements().at(3));
+    const auto& call = dynamic_cast<const ast::InlinedMethodCall&>(*print.Args().at(0));
+
+    runtime::Closure closure;
+    ostringstream output;
+    runtime::SimpleContext context{output};
+    //the class of the object does not match, so the call fails as an ordinary one would
+    try {
+        program->Execute(closure, context);
+        ASSERT(false);
+    }
+    catch(const runtime_error& e) {
+        ASSERT_EQUAL(string(e.what()), "object has no method: get"s);
+    }
+    ASSERT_EQUAL(call.GetFallbackCount(), 1u);
+}
+
+void TestEscapeAnalysis() {
+    const string text = "x = 3\ny = 4\nprint (x + y) * (x - y) + x * y / 2 < 0, (x + y) * 2\n"s;
+    auto count_allocations = [&text](bool escape_analysis) {
+        auto program = Parse(text);
+        MakeTypeSpecialization()->Run(program);
+        if(escape_analysis) {
+            MakeEscapeAnalysis()->Run(program);
+        }
+        runtime::Closure closure;
+        ostringstream output;
+        runtime::SimpleContext context{output};
+        const size_t before = runtime::ObjectHolder::GetAllocationCount();
+        program->Execute(closure, context);
+        ASSERT_EQUAL(output.str(), "True 14\n"s);
+        return runtime::ObjectHolder::GetAllocationCount() - before;
+    };
+    //every operation boxes its result
+    ASSERT_EQUAL(count_allocations(false), 9u);
+    //only the values passed to print are boxed
+    ASSERT_EQUAL(count_allocations(true), 2u);
+
+    auto program = Parse(text);
+    MakePipeline(2).Run(program);
+    const auto& print = dynamic_cast<const ast::Print&>(*AsCompound(program).Statements().at(2));
+    ASSERT(dynamic_cast<const ast::NumberOperands&>(*print.Args().at(0)).HasUnboxedOperands());
+}
+
+void TestNoOptimization() {
+    auto program = Parse("x = 2 * 3\n"s);
+    ASSERT(MakePipeline(0).IsEmpty());
+    ASSERT(MakePipeline(0).Run(program).empty());
+    ASSERT(!AssignedNumber(program, 0));
+}
+
+}  // namespace
+
+void RunOptimizerTests(TestRunner& tr) {
+    RUN_TEST(tr, optimizer::TestConstantFolding);
+    RUN_TEST(tr, optimizer::TestDeadBranchElimination);
+    RUN_TEST(tr, optimizer::TestInlining);
+    RUN_TEST(tr, optimizer::TestInliningFallback);
+    RUN_TEST(tr, optimizer::TestEscapeAnalysis);
+    RUN_TEST(tr, optimizer::TestNoOptimization);
+}
+
+}  // namespace optimizer
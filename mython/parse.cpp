@@ -3,6 +3,12 @@
 #include "lexer.h"
 #include "statement.h"
 
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -17,15 +23,109 @@ bool operator!=(const parse::Token& token, char c) {
     return !(token == c);
 }
 
+// Операции выражения, открытые скобки и вызовы, которые ждут своих операндов на стеке
+enum class ExprOperator {
+    GROUP,
+    CALL,
+    OR,
+    AND,
+    NOT,
+    COMPARISON,
+    ADD,
+    SUB,
+    MULT,
+    DIV,
+    NEGATE,
+};
+
+// Приоритеты операций в порядке ExprOperator. Скобки и вызовы не применяются как операции
+constexpr int PRECEDENCE[] = {0, 0, 1, 2, 3, 4, 5, 5, 6, 6, 7};
+
+int GetPrecedence(ExprOperator op) {
+    return PRECEDENCE[static_cast<size_t>(op)];
+}
+
+using ComparatorFunction = bool (*)(const runtime::ObjectHolder&, const runtime::ObjectHolder&, runtime::Context&);
+
+struct BinaryOperator {
+    ExprOperator op;
+    ComparatorFunction comparator = nullptr;
+};
+
+// Возвращает бинарную операцию, которую обозначает token, если он её обозначает
+optional<BinaryOperator> FindBinaryOperator(const parse::Token& token) {
+    if (const auto* c = token.TryAs<TokenType::Char>()) {
+        switch (c->value) {
+            case '+':
+                return BinaryOperator{ExprOperator::ADD};
+            case '-':
+                return BinaryOperator{ExprOperator::SUB};
+            case '*':
+                return BinaryOperator{ExprOperator::MULT};
+            case '/':
+                return BinaryOperator{ExprOperator::DIV};
+            case '<':
+                return BinaryOperator{ExprOperator::COMPARISON, runtime::Less};
+            case '>':
+                return BinaryOperator{ExprOperator::COMPARISON, runtime::Greater};
+            default:
+                return nullopt;
+        }
+    }
+    if (token.Is<TokenType::Or>()) {
+        return BinaryOperator{ExprOperator::OR};
+    }
+    if (token.Is<TokenType::And>()) {
+        return BinaryOperator{ExprOperator::AND};
+    }
+    if (token.Is<TokenType::Eq>()) {
+        return BinaryOperator{ExprOperator::COMPARISON, runtime::Equal};
+    }
+    if (token.Is<TokenType::NotEq>()) {
+        return BinaryOperator{ExprOperator::COMPARISON, runtime::NotEqual};
+    }
+    if (token.Is<TokenType::LessOrEq>()) {
+        return BinaryOperator{ExprOperator::COMPARISON, runtime::LessOrEqual};
+    }
+    if (token.Is<TokenType::GreaterOrEq>()) {
+        return BinaryOperator{ExprOperator::COMPARISON, runtime::GreaterOrEqual};
+    }
+    return nullopt;
+}
+
+struct PendingOperator {
+    ExprOperator op = ExprOperator::GROUP;
+    ast::SourceLocation location{};
+    ComparatorFunction comparator = nullptr;
+    size_t first_argument = 0; //position of the first argument of a call on the operand stack
+    vector<string> names{};    //dotted names of the called method
+};
+
+// Разобранный операнд выражения и глубина его дерева
+struct ParsedOperand {
+    unique_ptr<ast::Statement> node;
+    size_t depth = 1;
+};
+
+// Состояние разбора программы, общее с разбором тел её методов, отложенным до первого вызова
+struct ProgramState {
+    // Одинаковые литералы программы разделяют один объект
+    ast::ConstantPool constants;
+    // Объявленные классы и порядковые номера их объявлений. Классами владеют узлы ClassDefinition
+    unordered_map<string, pair<size_t, const runtime::Class*>> classes;
+};
+
 class Parser {
 public:
-    explicit Parser(parse::Lexer& lexer)
-        : lexer_(lexer) {
+    explicit Parser(parse::Lexer& lexer, ParseOptions options = {})
+        : Parser(lexer, options, make_shared<ProgramState>(), numeric_limits<size_t>::max(), 0) {
     }
 
     // Program -> eps
     //          | Statement \n Program
     unique_ptr<ast::Statement> ParseProgram() {
+        //the nodes of the program and their child arrays are laid out together
+        ast::NodeArena::Scope arena;
         auto result = make_unique<ast::Compound>();
         while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
             result->AddStatement(ParseStatement());
@@ -34,12 +134,96 @@ public:
         return result;
     }
 
+    void ParseStatements(const function<void(unique_ptr<ast::Statement>)>& handle) {
+        while (!lexer_.CurrentToken().Is<TokenType::Eof>()) {
+            unique_ptr<ast::Statement> statement;
+            {
+                //a statement has an arena of its own, so that it is freed once handled
+                ast::NodeArena::Scope arena;
+                statement = ParseStatement();
+            }
+            handle(std::move(statement));
+            //literals of a handled statement are kept alive by its nodes only
+            state_->constants.Clear();
+        }
+    }
+
 private:
+    ast::SourceLocation CurrentLocation() const {
+        return {lexer_.CurrentLine(), lexer_.CurrentColumn()};
+    }
+
+    // Создаёт узел, запоминая в нём положение location
+    template <typename Node, typename... Args>
+    unique_ptr<ast::Statement> MakeAt(ast::SourceLocation location, Args&&... args) {
+        auto node = make_unique<Node>(std::forward<Args>(args)...);
+        node->SetLocation(location);
+        return node;
+    }
+
+    // Парсер тела метода: ему видны только классы, объявленные раньше visible_classes.
+    // Тело вложено в block_depth блоков
+    Parser(parse::Lexer& lexer, ParseOptions options, shared_ptr<ProgramState> state, size_t visible_classes,
+           size_t block_depth)
+        : lexer_(lexer)
+        , options_(options)
+        , state_(std::move(state))
+        , visible_classes_(visible_classes)
+        , block_depth_(block_depth) {
+    }
+
+    const runtime::Class* FindClass(const string& name) const {
+        auto it = state_->classes.find(name);
+        return it != state_->classes.end() && it->second.first < visible_classes_ ? it->second.second : nullptr;
+    }
+
+    // Сохраняет токены блока Suite вместе с их положениями, не разбирая его
+    vector<parse::LocatedToken> RecordSuite() {
+        lexer_.Expect<TokenType::Newline>();
+        vector<parse::LocatedToken> tokens;
+        tokens.push_back({lexer_.CurrentToken(), lexer_.CurrentLine(), lexer_.CurrentColumn()});
+        lexer_.ExpectNext<TokenType::Indent>();
+        for(size_t depth = 0; ; lexer_.NextToken()) {
+            const auto& token = lexer_.CurrentToken();
+            if (token.Is<TokenType::Eof>()) {
+                break;
+            }
+            tokens.push_back({token, lexer_.CurrentLine(), lexer_.CurrentColumn()});
+            if (token.Is<TokenType::Indent>()) {
+                ++depth;
+            }
+            else if (token.Is<TokenType::Dedent>() && --depth == 0) {
+                lexer_.NextToken();
+                break;
+            }
+        }
+        return tokens;
+    }
+
+    // Тело метода, которое разбирается при первом вызове
+    unique_ptr<ast::Statement> MakeLazyMethodBody() {
+        //the saved tokens keep the symbol pool of the lexer alive
+        auto compile = [tokens = RecordSuite(), symbols = lexer_.GetSymbols(), options = options_, state = state_,
+                        visible_classes = state_->classes.size(), block_depth = block_depth_]() mutable {
+            ast::NodeArena::Scope arena;
+            parse::Lexer lexer(std::move(tokens), std::move(symbols));
+            Parser parser(lexer, options, std::move(state), visible_classes, block_depth);
+            auto body = make_unique<ast::MethodBody>(parser.ParseSuite());
+            lexer.Expect<TokenType::Eof>();
+            return unique_ptr<ast::Statement>(std::move(body));
+        };
+        return make_unique<ast::LazyMethodBody>(std::move(compile));
+    }
+
     // Suite -> NEWLINE INDENT (Statement)+ DEDENT
     unique_ptr<ast::Statement> ParseSuite()  // NOLINT
     {
         lexer_.Expect<TokenType::Newline>();
         lexer_.ExpectNext<TokenType::Indent>();
+        if (++block_depth_ > MAX_BLOCK_DEPTH) {
+            throw ParseError("Blocks at line "s + to_string(lexer_.CurrentLine()) + " are nested deeper than "s
+                             + to_string(MAX_BLOCK_DEPTH) + " levels"s);
+        }
 
         lexer_.NextToken();
 
@@ -50,6 +234,7 @@ private:
 
         lexer_.Expect<TokenType::Dedent>();
         lexer_.NextToken();
+        --block_depth_;
 
         return result;
     }
@@ -76,7 +261,12 @@ private:
             lexer_.ExpectNext<TokenType::Char>(':');
             lexer_.NextToken();
 
-            m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            if (options_.lazy_method_bodies) {
+                m.body = MakeLazyMethodBody();
+            }
+            else {
+                m.body = std::make_unique<ast::MethodBody>(ParseSuite());  // NOLINT
+            }
 
             result.push_back(std::move(m));
         }
@@ -92,15 +282,14 @@ private:
 
         const runtime::Class* base_class = nullptr;
         if (lexer_.CurrentToken() == '(') {
-            auto name = lexer_.ExpectNext<TokenType::Id>().value;
+            const string& name = lexer_.ExpectNext<TokenType::Id>().value;
             lexer_.ExpectNext<TokenType::Char>(')');
             lexer_.NextToken();
 
-            auto it = declared_classes_.find(name);
-            if (it == declared_classes_.end()) {
+            base_class = FindClass(name);
+            if (!base_class) {
                 throw ParseError("Base class "s + name + " not found for class "s + class_name);
             }
-            base_class = static_cast<const runtime::Class*>(it->second.Get());  // NOLINT
         }
 
         lexer_.Expect<TokenType::Char>(':');
@@ -112,20 +301,30 @@ private:
         lexer_.Expect<TokenType::Dedent>();
         lexer_.NextToken();
 
-        auto [it, inserted] = declared_classes_.insert({
-            class_name,
-            runtime::ObjectHolder::Own(runtime::Class{class_name, std::move(methods), base_class}),
-        });
-
-        if (!inserted) {
+        if (state_->classes.count(class_name)) {
             throw ParseError("Class "s + class_name + " already exists"s);
         }
+        auto cls = runtime::ObjectHolder::Own(runtime::Class{class_name, std::move(methods), base_class});
+        const size_t order = state_->classes.size();
+        state_->classes.emplace(class_name, pair{order, static_cast<const runtime::Class*>(cls.Get())});
 
-        return make_unique<ast::ClassDefinition>(it->second);
+        return make_unique<ast::ClassDefinition>(std::move(cls));
+    }
+
+    // Число идентификаторов в цепочке Id.Id...Id, которая начинается с текущего токена.
+    // Токены просматриваются без продвижения лексера
+    size_t PeekDottedIdsLength() const {
+        size_t length = 1;
+        while (lexer_.Peek(2 * length - 1) == '.' && lexer_.Peek(2 * length).Is<TokenType::Id>()) {
+            ++length;
+        }
+        return length;
     }
 
     vector<string> ParseDottedIds() {
-        vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
+        vector<string> result;
+        result.reserve(PeekDottedIdsLength());
+        result.push_back(lexer_.Expect<TokenType::Id>().value);
 
         while (lexer_.NextToken() == '.') {
             result.push_back(lexer_.ExpectNext<TokenType::Id>().value);
@@ -139,8 +338,9 @@ private:
     unique_ptr<ast::Statement> ParseAssignmentOrCall() {
         lexer_.Expect<TokenType::Id>();
 
+        const auto location = CurrentLocation();
         vector<string> id_list = ParseDottedIds();
-        string last_name = id_list.back();
+        string last_name = std::move(id_list.back());
         id_list.pop_back();
 
         if (lexer_.CurrentToken() == '=') {
@@ -159,137 +359,43 @@ private:
             throw ParseError("Mython doesn't support functions, only methods: "s + last_name);
         }
 
-        vector<unique_ptr<ast::Statement>> args;
+        ast::StatementList args;
         if (lexer_.CurrentToken() != ')') {
             args = ParseTestList();
         }
         lexer_.Expect<TokenType::Char>(')');
         lexer_.NextToken();
 
-        return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-                                            std::move(last_name), std::move(args));
+        return MakeAt<ast::MethodCall>(location, make_unique<ast::VariableValue>(std::move(id_list)),
+                                       std::move(last_name), std::move(args));
     }
 
-    // Expr -> Adder ['+'/'-' Adder]*
-    unique_ptr<ast::Statement> ParseExpression()  // NOLINT
-    {
-        unique_ptr<ast::Statement> result = ParseAdder();
-        while (lexer_.CurrentToken() == '+' || lexer_.CurrentToken() == '-') {
-            char op = lexer_.CurrentToken().As<TokenType::Char>().value;
-            lexer_.NextToken();
-
-            if (op == '+') {
-                result = make_unique<ast::Add>(std::move(result), ParseAdder());
-            } else {
-                result = make_unique<ast::Sub>(std::move(result), ParseAdder());
-            }
-        }
-        return result;
-    }
-
-    // Adder -> Mult ['*'/'/' Mult]*
-    unique_ptr<ast::Statement> ParseAdder()  // NOLINT
-    {
-        unique_ptr<ast::Statement> result = ParseMult();
-        while (lexer_.CurrentToken() == '*' || lexer_.CurrentToken() == '/') {
-            char op = lexer_.CurrentToken().As<TokenType::Char>().value;
-            lexer_.NextToken();
+    // Создаёт узел вызова names(args): метода объекта, конструктора класса или функции str
+    unique_ptr<ast::Statement> MakeCall(ast::SourceLocation location, vector<string> names,
+                                        ast::StatementList args) {
+        string method_name = std::move(names.back());
+        names.pop_back();
 
-            if (op == '*') {
-                result = make_unique<ast::Mult>(std::move(result), ParseMult());
-            } else {
-                result = make_unique<ast::Div>(std::move(result), ParseMult());
-            }
-        }
-        return result;
-    }
-
-    // Mult -> '(' Expr ')'
-    //       | NUMBER
-    //       | '-' Mult
-    //       | STRING
-    //       | NONE
-    //       | TRUE
-    //       | FALSE
-    //       | DottedIds '(' ExprList ')'
-    //       | DottedIds
-    unique_ptr<ast::Statement> ParseMult()  // NOLINT
-    {
-        if (lexer_.CurrentToken() == '(') {
-            lexer_.NextToken();
-            auto result = ParseTest();
-            lexer_.Expect<TokenType::Char>(')');
-            lexer_.NextToken();
-            return result;
-        }
-        if (lexer_.CurrentToken() == '-') {
-            lexer_.NextToken();
-            return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
+        if (!names.empty()) {
+            return MakeAt<ast::MethodCall>(
+                location, make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
+                std::move(args));
         }
-        if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
-            int result = num->value;
-            lexer_.NextToken();
-            return make_unique<ast::NumericConst>(result);
-        }
-        if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
-            string result = str->value;
-            lexer_.NextToken();
-            return make_unique<ast::StringConst>(std::move(result));
-        }
-        if (lexer_.CurrentToken().Is<TokenType::True>()) {
-            lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(true));
+        if (auto cls = FindClass(method_name)) {
+            return make_unique<ast::NewInstance>(*cls, std::move(args));
         }
-        if (lexer_.CurrentToken().Is<TokenType::False>()) {
-            lexer_.NextToken();
-            return make_unique<ast::BoolConst>(runtime::Bool(false));
-        }
-        if (lexer_.CurrentToken().Is<TokenType::None>()) {
-            lexer_.NextToken();
-            return make_unique<ast::None>();
-        }
-
-        return ParseDottedIdsInMultExpr();
-    }
-
-    std::unique_ptr<ast::Statement> ParseDottedIdsInMultExpr() {
-        vector<string> names = ParseDottedIds();
-
-        if (lexer_.CurrentToken() == '(') {
-            // various calls
-            vector<unique_ptr<ast::Statement>> args;
-            if (lexer_.NextToken() != ')') {
-                args = ParseTestList();
-            }
-            lexer_.Expect<TokenType::Char>(')');
-            lexer_.NextToken();
-
-            auto method_name = names.back();
-            names.pop_back();
-
-            if (!names.empty()) {
-                return make_unique<ast::MethodCall>(
-                    make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-                    std::move(args));
-            }
-            if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
-                return make_unique<ast::NewInstance>(
-                    static_cast<const runtime::Class&>(*it->second), std::move(args));  // NOLINT
-            }
-            if (method_name == "str"sv) {
-                if (args.size() != 1) {
-                    throw ParseError("Function str takes exactly one argument"s);
-                }
-                return make_unique<ast::Stringify>(std::move(args.front()));
+        if (method_name == "str"sv) {
+            if (args.size() != 1) {
+                throw ParseError("Function str takes exactly one argument"s);
             }
-            throw ParseError("Unknown call to "s + method_name + "()"s);
+            return make_unique<ast::Stringify>(std::move(args.front()));
         }
-        return make_unique<ast::VariableValue>(std::move(names));
+        throw ParseError("Unknown call to "s + method_name + "()"s);
     }
 
-    vector<unique_ptr<ast::Statement>> ParseTestList()  // NOLINT
+    ast::StatementList ParseTestList()  // NOLINT
     {
-        vector<unique_ptr<ast::Statement>> result;
+        ast::StatementList result;
         result.push_back(ParseTest());
 
         while (lexer_.CurrentToken() == ',') {
@@ -323,77 +429,200 @@ private:
                                         std::move(else_body));
     }
 
-    // LogicalExpr -> AndTest [OR AndTest]
-    // AndTest -> NotTest [AND NotTest]
-    // NotTest -> [NOT] NotTest
-    //          | Comparison
-    unique_ptr<ast::Statement> ParseTest()  // NOLINT
-    {
-        auto result = ParseAndTest();
-        while (lexer_.CurrentToken().Is<TokenType::Or>()) {
-            lexer_.NextToken();
-            result = make_unique<ast::Or>(std::move(result), ParseAndTest());
-        }
+    // Test       -> AndTest [OR AndTest]*
+    // AndTest    -> NotTest [AND NotTest]*
+    // NotTest    -> NOT NotTest
+    //             | Comparison
+    // Comparison -> Expr [COMP_OP Expr]
+    // Expr       -> Adder ['+'/'-' Adder]*
+    // Adder      -> Mult ['*'/'/' Mult]*
+    // Mult       -> '(' Test ')'
+    //             | '-' Mult
+    //             | NUMBER
+    //             | STRING
+    //             | NONE
+    //             | TRUE
+    //             | FALSE
+    //             | DottedIds '(' TestList ')'
+    //             | DottedIds
+    //
+    // Выражение разбирается по таблице приоритетов операций без рекурсии: ожидающие
+    // операции, открытые скобки и вызовы хранятся на стеке expr_operators_, разобранные
+    // операнды - на стеке expr_operands_, поэтому глубина вложенности выражения не
+    // ограничена стеком вызовов
+    unique_ptr<ast::Statement> ParseTest() {
+        //groups and call arguments are parsed on the same stacks, so the method is never reentered
+        expr_operators_.clear();
+        expr_operands_.clear();
+        do {
+            ParseOperand();
+        } while (ParseOperator());
+        auto result = std::move(expr_operands_.back().node);
+        expr_operands_.pop_back();
         return result;
     }
 
-    unique_ptr<ast::Statement> ParseAndTest()  // NOLINT
-    {
-        auto result = ParseNotTest();
-        while (lexer_.CurrentToken().Is<TokenType::And>()) {
-            lexer_.NextToken();
-            result = make_unique<ast::And>(std::move(result), ParseNotTest());
+    // Кладёт на стек операндов узел node, глубина дерева которого depth
+    void PushOperand(unique_ptr<ast::Statement> node, size_t depth, ast::SourceLocation location) {
+        if (depth > MAX_EXPRESSION_DEPTH) {
+            throw ParseError("Expression at line "s + to_string(location.line) + " is nested deeper than "s
+                             + to_string(MAX_EXPRESSION_DEPTH) + " levels"s);
         }
-        return result;
+        expr_operands_.push_back({std::move(node), depth});
     }
 
-    unique_ptr<ast::Statement> ParseNotTest()  // NOLINT
-    {
-        if (lexer_.CurrentToken().Is<TokenType::Not>()) {
-            lexer_.NextToken();
-            return make_unique<ast::Not>(ParseNotTest());  // NOLINT
+    // Кладёт на стеки префиксные операции, открывающие скобки и вызовы с аргументами,
+    // которые стоят перед очередным операндом, и сам операнд
+    void ParseOperand() {
+        while (true) {
+            const auto& tok = lexer_.CurrentToken();
+            if (tok == '(') {
+                expr_operators_.push_back({ExprOperator::GROUP, CurrentLocation()});
+                lexer_.NextToken();
+                continue;
+            }
+            if (tok == '-') {
+                expr_operators_.push_back({ExprOperator::NEGATE, CurrentLocation()});
+                lexer_.NextToken();
+                continue;
+            }
+            //NOT applies to a whole comparison, so it cannot be an operand of arithmetic
+            //or comparison operations
+            if (tok.Is<TokenType::Not>()
+                && (expr_operators_.empty()
+                    || GetPrecedence(expr_operators_.back().op) <= GetPrecedence(ExprOperator::NOT))) {
+                expr_operators_.push_back({ExprOperator::NOT, CurrentLocation()});
+                lexer_.NextToken();
+                continue;
+            }
+            if (const auto* num = tok.TryAs<TokenType::Number>()) {
+                int result = num->value;
+                lexer_.NextToken();
+                expr_operands_.push_back({state_->constants.MakeNumber(result)});
+                return;
+            }
+            if (const auto* str = tok.TryAs<TokenType::String>()) {
+                string result = str->value;
+                lexer_.NextToken();
+                expr_operands_.push_back({state_->constants.MakeString(std::move(result))});
+                return;
+            }
+            if (tok.Is<TokenType::True>() || tok.Is<TokenType::False>()) {
+                const bool value = tok.Is<TokenType::True>();
+                lexer_.NextToken();
+                expr_operands_.push_back({state_->constants.MakeBool(value)});
+                return;
+            }
+            if (tok.Is<TokenType::None>()) {
+                lexer_.NextToken();
+                expr_operands_.push_back({make_unique<ast::None>()});
+                return;
+            }
+
+            const auto location = CurrentLocation();
+            vector<string> names = ParseDottedIds();
+            if (lexer_.CurrentToken() != '(') {
+                expr_operands_.push_back({make_unique<ast::VariableValue>(std::move(names))});
+                return;
+            }
+            if (lexer_.NextToken() == ')') {
+                lexer_.NextToken();
+                //the call holds the object it is called on
+                PushOperand(MakeCall(location, std::move(names), {}), 2, location);
+                return;
+            }
+            //the arguments are parsed as operands of the call
+            expr_operators_.push_back({ExprOperator::CALL, location, nullptr, expr_operands_.size(), std::move(names)});
         }
-        return ParseComparison();
     }
 
-    // Comparison -> Expr [COMP_OP Expr]
-    unique_ptr<ast::Statement> ParseComparison()  // NOLINT
-    {
-        auto result = ParseExpression();
-
-        const auto tok = lexer_.CurrentToken();
+    // Разбирает токены после операнда: кладёт на стек бинарную операцию либо закрывает
+    // скобки и вызовы. Возвращает true, если дальше ожидается операнд, и false, если
+    // выражение закончилось и его узел - единственный операнд на стеке
+    bool ParseOperator() {
+        while (true) {
+            const auto& tok = lexer_.CurrentToken();
+            if (const auto binary = FindBinaryOperator(tok)) {
+                const int precedence = GetPrecedence(binary->op);
+                //comparisons do not chain: the second one ends the comparison as a foreign token
+                const bool is_comparison = binary->op == ExprOperator::COMPARISON;
+                ReduceOperators(is_comparison ? precedence + 1 : precedence);
+                if (!is_comparison || expr_operators_.empty()
+                    || expr_operators_.back().op != ExprOperator::COMPARISON) {
+                    expr_operators_.push_back({binary->op, CurrentLocation(), binary->comparator});
+                    lexer_.NextToken();
+                    return true;
+                }
+            }
 
-        if (tok == '<') {
-            lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Less, std::move(result),
-                                                ParseExpression());
-        }
-        if (tok == '>') {
-            lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
-                                                ParseExpression());
-        }
-        if (tok.Is<TokenType::Eq>()) {
-            lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
-                                                ParseExpression());
-        }
-        if (tok.Is<TokenType::NotEq>()) {
+            ReduceOperators(GetPrecedence(ExprOperator::OR));
+            if (expr_operators_.empty()) {
+                return false;
+            }
+            auto& frame = expr_operators_.back();
+            if (frame.op == ExprOperator::CALL && tok == ',') {
+                lexer_.NextToken();
+                return true;
+            }
+            lexer_.Expect<TokenType::Char>(')');
             lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
-                                                ParseExpression());
+            if (frame.op == ExprOperator::CALL) {
+                ast::StatementList args;
+                size_t depth = 1;
+                for (auto it = expr_operands_.begin() + frame.first_argument; it != expr_operands_.end(); ++it) {
+                    args.push_back(std::move(it->node));
+                    depth = max(depth, it->depth);
+                }
+                expr_operands_.resize(frame.first_argument);
+                PushOperand(MakeCall(frame.location, std::move(frame.names), std::move(args)), depth + 1,
+                            frame.location);
+            }
+            expr_operators_.pop_back();
         }
-        if (tok.Is<TokenType::LessOrEq>()) {
-            lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
-                                                ParseExpression());
+    }
+
+    // Применяет ожидающие операции с приоритетом не ниже min_precedence к операндам на
+    // вершине стека, пока не дойдёт до открытой скобки или вызова
+    void ReduceOperators(int min_precedence) {
+        while (!expr_operators_.empty() && GetPrecedence(expr_operators_.back().op) >= min_precedence) {
+            const auto& pending = expr_operators_.back();
+            auto rhs = std::move(expr_operands_.back());
+            expr_operands_.pop_back();
+            if (pending.op == ExprOperator::NEGATE) {
+                PushOperand(MakeAt<ast::Mult>(pending.location, std::move(rhs.node), state_->constants.MakeNumber(-1)),
+                            rhs.depth + 1, pending.location);
+            } else if (pending.op == ExprOperator::NOT) {
+                PushOperand(make_unique<ast::Not>(std::move(rhs.node)), rhs.depth + 1, pending.location);
+            } else {
+                auto lhs = std::move(expr_operands_.back());
+                expr_operands_.pop_back();
+                PushOperand(MakeBinaryOperation(pending, std::move(lhs.node), std::move(rhs.node)),
+                            max(lhs.depth, rhs.depth) + 1, pending.location);
+            }
+            expr_operators_.pop_back();
         }
-        if (tok.Is<TokenType::GreaterOrEq>()) {
-            lexer_.NextToken();
-            return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
-                                                ParseExpression());
+    }
+
+    unique_ptr<ast::Statement> MakeBinaryOperation(const PendingOperator& pending, unique_ptr<ast::Statement> lhs,
+                                                   unique_ptr<ast::Statement> rhs) {
+        switch (pending.op) {
+            case ExprOperator::OR:
+                return make_unique<ast::Or>(std::move(lhs), std::move(rhs));
+            case ExprOperator::AND:
+                return make_unique<ast::And>(std::move(lhs), std::move(rhs));
+            case ExprOperator::COMPARISON:
+                return MakeAt<ast::Comparison>(pending.location, pending.comparator, std::move(lhs), std::move(rhs));
+            case ExprOperator::ADD:
+                return MakeAt<ast::Add>(pending.location, std::move(lhs), std::move(rhs));
+            case ExprOperator::SUB:
+                return MakeAt<ast::Sub>(pending.location, std::move(lhs), std::move(rhs));
+            case ExprOperator::MULT:
+                return MakeAt<ast::Mult>(pending.location, std::move(lhs), std::move(rhs));
+            case ExprOperator::DIV:
+                return MakeAt<ast::Div>(pending.location, std::move(lhs), std::move(rhs));
+            default:
+                throw logic_error("not a binary operation"s);
         }
-        return result;
     }
 
     // Statement -> SimpleStatement Newline
@@ -428,7 +657,7 @@ private:
         }
         if (tok.Is<TokenType::Print>()) {
             lexer_.NextToken();
-            vector<unique_ptr<ast::Statement>> args;
+            ast::StatementList args;
             if (!lexer_.CurrentToken().Is<TokenType::Newline>()) {
                 args = ParseTestList();
             }
@@ -438,11 +667,23 @@ private:
     }
 
     parse::Lexer& lexer_;
-    runtime::Closure declared_classes_;
+    ParseOptions options_;
+    shared_ptr<ProgramState> state_;
+    size_t visible_classes_;
+    //number of suites enclosing the statement being parsed
+    size_t block_depth_;
+    //stacks of the expression being parsed, kept to reuse their storage
+    vector<PendingOperator> expr_operators_;
+    vector<ParsedOperand> expr_operands_;
 };
 
 }  // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
-    return Parser{lexer}.ParseProgram();
+unique_ptr<ast::Statement> ParseProgram(parse::Lexer& lexer, ParseOptions options) {
+    return Parser{lexer, options}.ParseProgram();
+}
+
+void ParseProgramStatements(parse::Lexer& lexer, const function<void(unique_ptr<ast::Statement>)>& handle,
+                            ParseOptions options) {
+    Parser{lexer, options}.ParseStatements(handle);
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
 #include <memory>
 #include <stdexcept>
 
@@ -7,12 +9,33 @@ namespace parse {
 class Lexer;
 }
 
-namespace runtime {
-class Executable;
+namespace ast {
+class Statement;
 }
 
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
+// Наибольшая глубина дерева одного выражения: вложенных операций, вызовов и str.
+// Скобки, не образующие узлов, глубину не увеличивают. Обход дерева при оптимизации,
+// компиляции и выполнении рекурсивен, поэтому более глубокое выражение - ParseError
+constexpr size_t MAX_EXPRESSION_DEPTH = 1000;
+// Наибольшая вложенность блоков: тел условий, классов и методов
+constexpr size_t MAX_BLOCK_DEPTH = 100;
+
+struct ParseOptions {
+    // Сохранять токены тел методов и строить их синтаксические деревья при первом вызове
+    // (ast::LazyMethodBody). Синтаксические ошибки в методе, который ни разу не вызван,
+    // тогда не обнаруживаются
+    bool lazy_method_bodies = false;
+};
+
+std::unique_ptr<ast::Statement> ParseProgram(parse::Lexer& lexer, ParseOptions options = {});
+
+// Разбирает программу по одной инструкции верхнего уровня и передаёт каждую в handle сразу
+// после разбора, до чтения следующей. Классы, объявленные в инструкции, доступны следующим
+// инструкциям, пока handle хранит объявившую их инструкцию
+void ParseProgramStatements(parse::Lexer& lexer,
+                            const std::function<void(std::unique_ptr<ast::Statement>)>& handle,
+                            ParseOptions options = {});
@@ -268,6 +268,135 @@ print xh.x, x
     //ASSERT_EQUAL(str, "init XH\ninit X\n0 1\n"s);
 }
 
+void TestLiteralsAreInterned() {
+    auto tree = ParseProgramFromString("print 7, 'a', True, 7, 'a', True, 8, 'b'\nx = 7\n"s);
+    const auto& statements = dynamic_cast<const ast::Compound&>(*tree).Statements();
+    const auto& args = dynamic_cast<const ast::Print&>(*statements.at(0)).Args();
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    auto object = [&](size_t index) {
+        return args.at(index)->Execute(closure, context).Get();
+    };
+    ASSERT(object(0) == object(3));
+    ASSERT(object(1) == object(4));
+    ASSERT(object(2) == object(5));
+    ASSERT(object(0) != object(6));
+    ASSERT(object(1) != object(7));
+    const auto& assignment = dynamic_cast<const ast::Assignment&>(*statements.at(1));
+    ASSERT(&dynamic_cast<const ast::NumericConst&>(*assignment.Value()).GetValue()
+           == &dynamic_cast<const ast::NumericConst&>(*args.at(0)).GetValue());
+
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "7 a True 7 a True 8 b\n"s);
+}
+
+void TestLazyMethodBodies() {
+    const string program = R"(
+class Shape:
+  def area():
+    return 0
+  def broken():
+    return 1 +
+  def name():
+    return 'shape'
+
+class Square(Shape):
+  def __init__(side):
+    self.side = side
+  def area():
+    if self.side > 0:
+      return self.side * self.side
+    return Shape()
+
+s = Square(3)
+print s.area(), s.name(), s.area()
+)"s;
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    ast::ResetLazyCompilationStats();
+    ParseOptions options;
+    options.lazy_method_bodies = true;
+    auto tree = ParseProgram(lexer, options);
+    ASSERT_EQUAL(ast::GetLazyCompilationStats().deferred, 5u);
+    ASSERT_EQUAL(ast::GetLazyCompilationStats().compiled, 0u);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "9 shape 9\n"s);
+    //Shape.area and Shape.broken are never called
+    ASSERT_EQUAL(ast::GetLazyCompilationStats().compiled, 3u);
+
+    //the syntax error surfaces on the first call
+    auto& shape = static_cast<runtime::Class&>(*closure.at("Shape"s).TryAs<runtime::Class>());
+    runtime::ClassInstance instance(shape);
+    ASSERT_THROWS(instance.Call("broken"s, {}, context), LexerError);
+}
+
+void TestDeeplyNestedExpressions() {
+    //nesting is limited by memory only, not by the call stack
+    const size_t depth = 200000;
+    string program = "x = "s + string(depth, '(') + "7"s + string(depth, ')') + " * -2 + 1\nprint x, "s;
+    //brackets do not count, the str calls and the variable make the deepest allowed tree
+    for(size_t i = 0; i + 1 < MAX_EXPRESSION_DEPTH; ++i) {
+        program += "str("s;
+    }
+    program += "(x)"s + string(MAX_EXPRESSION_DEPTH - 1, ')') + "\nprint 1 + 2 * -3 < 4 - 1, not 1 == 2 and 3 > 2 or False, 8 / 2 / 2 - 1 - 1\n"s;
+    auto tree = ParseProgramFromString(program);
+
+    const auto& statements = dynamic_cast<const ast::Compound&>(*tree).Statements();
+    const auto& assignment = dynamic_cast<const ast::Assignment&>(*statements.at(0));
+    const auto& location = dynamic_cast<const ast::Add&>(*assignment.Value()).GetLocation();
+    ASSERT_EQUAL(location.line, 1u);
+    ASSERT_EQUAL(location.column, 2 * depth + 12u);
+
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    tree->Execute(closure, context);
+    ASSERT_EQUAL(context.output.str(), "-13 -13\nTrue True 0\n"s);
+
+    //a comparison does not chain and a group ends with its bracket
+    ASSERT_THROWS(ParseProgramFromString("x = 1 < 2 < 3\n"s), LexerError);
+    ASSERT_THROWS(ParseProgramFromString("x = (1 + (2)\n"s), LexerError);
+    ASSERT_THROWS(ParseProgramFromString("x = 1 + not 2\n"s), LexerError);
+
+    //deeper trees would overflow the call stack of the passes that walk them
+    ASSERT_THROWS(ParseProgramFromString("x = "s + string(MAX_EXPRESSION_DEPTH, '-') + "1\n"s), ParseError);
+    string long_sum = "x = 1"s;
+    for(size_t i = 0; i < MAX_EXPRESSION_DEPTH; ++i) {
+        long_sum += " + 1"s;
+    }
+    ASSERT_THROWS(ParseProgramFromString(long_sum + "\n"s), ParseError);
+    string nested_blocks;
+    for(size_t i = 0; i <= MAX_BLOCK_DEPTH; ++i) {
+        nested_blocks += string(2 * i, ' ') + "if True:\n"s;
+    }
+    nested_blocks += string(2 * MAX_BLOCK_DEPTH + 2, ' ') + "x = 1\n"s;
+    ASSERT_THROWS(ParseProgramFromString(nested_blocks), ParseError);
+}
+
+void TestNodeArena() {
+    const size_t arenas_before = ast::NodeArena::GetLiveCount();
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    {
+        auto tree = ParseProgramFromString("class A:\n  def f(x):\n    return x * 2 + 1\n\na = A()\nprint a.f(20)\n"s);
+        ASSERT_EQUAL(ast::NodeArena::GetLiveCount(), arenas_before + 1u);
+        tree->Execute(closure, context);
+    }
+    //the method body allocated in the arena outlives the rest of the tree
+    ASSERT_EQUAL(ast::NodeArena::GetLiveCount(), arenas_before + 1u);
+    auto& instance = *closure.at("a"s).TryAs<runtime::ClassInstance>();
+    ASSERT_EQUAL(instance.Call("f"s, {runtime::ObjectHolder::Own(runtime::Number(4))}, context).TryAs<runtime::Number>()->GetValue(), 9);
+    closure.clear();
+    ASSERT_EQUAL(ast::NodeArena::GetLiveCount(), arenas_before);
+    ASSERT_EQUAL(context.output.str(), "41\n"s);
+
+    //nodes created without an arena live on the heap
+    auto node = make_unique<ast::NumericConst>(1);
+    ASSERT_EQUAL(ast::NodeArena::GetLiveCount(), arenas_before);
+}
+
 }  // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -280,4 +409,8 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
     RUN_TEST(tr, parse::Test64);
+    RUN_TEST(tr, parse::TestLiteralsAreInterned);
+    RUN_TEST(tr, parse::TestLazyMethodBodies);
+    RUN_TEST(tr, parse::TestDeeplyNestedExpressions);
+    RUN_TEST(tr, parse::TestNodeArena);
 }
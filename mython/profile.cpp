@@ -0,0 +1,197 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <iterator>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+namespace profile {
+
+namespace {
+
+constexpr string_view HEADER = "mython-profile 1"sv;
+
+const pair<ast::OperandTypes, string_view> STATE_NAMES[] = {
+    {ast::OperandTypes::NUMBERS, "numbers"sv},
+    {ast::OperandTypes::STRINGS, "strings"sv},
+    {ast::OperandTypes::GENERIC, "generic"sv},
+};
+
+string_view GetStateName(ast::OperandTypes state) {
+    for(const auto& [value, name] : STATE_NAMES) {
+        if(value == state) {
+            return name;
+        }
+    }
+    return {};
+}
+
+//visits every node of the program including method bodies of the classes declared in it
+void VisitNodes(const ast::Statement& node, const function<void(const ast::Statement&)>& visit) {
+    visit(node);
+    if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+        for(const auto& method : definition->GetClass().GetMethods()) {
+            if(auto body = ast::GetMethodBody(method)) {
+                VisitNodes(*body, visit);
+            }
+        }
+    }
+    ast::ForEachChild(node, [&visit](const ast::Statement& child) {
+        VisitNodes(child, visit);
+    });
+}
+
+void VisitNodes(ast::Statement& node, const function<void(ast::Statement&)>& visit) {
+    visit(node);
+    if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+        for(const auto& method : definition->GetClass().GetMethods()) {
+            if(auto body = ast::GetMethodBody(method)) {
+                VisitNodes(*body, visit);
+            }
+        }
+    }
+    ast::ForEachChild(node, [&visit](unique_ptr<ast::Statement>& child) {
+        VisitNodes(*child, visit);
+    });
+}
+
+//parses the number the whole of part consists of; a number too big for size_t is an error too
+size_t ParseLocationPart(string_view part, const string& text) {
+    size_t value = 0;
+    const auto [end, error] = from_chars(part.data(), part.data() + part.size(), value);
+    if(part.empty() || error != errc{} || end != part.data() + part.size()) {
+        throw ProfileError("invalid source location: "s + text);
+    }
+    return value;
+}
+
+pair<size_t, size_t> ParseLocation(const string& text) {
+    const string_view location = text;
+    const size_t colon = location.find(':');
+    if(colon == string_view::npos) {
+        throw ProfileError("invalid source location: "s + text);
+    }
+    return {ParseLocationPart(location.substr(0, colon), text), ParseLocationPart(location.substr(colon + 1), text)};
+}
+
+}  // namespace
+
+void Profile::AddOperation(Key key, ast::OperandTypes state) {
+    auto [it, inserted] = operations_.emplace(key, state);
+    if(!inserted && it->second != state) {
+        it->second = ast::OperandTypes::GENERIC;
+    }
+}
+
+void Profile::AddCall(Key key, const string& class_name) {
+    auto [it, inserted] = calls_.emplace(key, class_name);
+    if(!inserted && it->second != class_name) {
+        it->second.clear();
+    }
+}
+
+void Profile::Collect(const ast::Statement& program) {
+    VisitNodes(program, [this](const ast::Statement& node) {
+        if(auto operation = dynamic_cast<const ast::BinaryOperation*>(&node)) {
+            const auto& location = operation->GetLocation();
+            const auto state = operation->GetSpecialization().GetState();
+            if(location.line != 0 && state != ast::OperandTypes::UNINITIALIZED) {
+                AddOperation({location.line, location.column}, state);
+            }
+        }
+        else if(auto call = dynamic_cast<const ast::MethodCall*>(&node)) {
+            const auto& location = call->GetLocation();
+            if(location.line != 0 && call->GetCachedClass()) {
+                AddCall({location.line, location.column}, call->GetCachedClass()->GetName());
+            }
+        }
+    });
+}
+
+size_t Profile::Apply(ast::Statement& program) const {
+    unordered_map<string_view, const runtime::Class*> classes;
+    VisitNodes(program, [&classes](const ast::Statement& node) {
+        if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            classes.emplace(definition->GetClass().GetName(), &definition->GetClass());
+        }
+    });
+
+    size_t applied = 0;
+    VisitNodes(program, [this, &classes, &applied](ast::Statement& node) {
+        if(auto operation = dynamic_cast<ast::BinaryOperation*>(&node)) {
+            const auto& location = operation->GetLocation();
+            auto it = operations_.find({location.line, location.column});
+            auto& specialization = operation->GetSpecialization();
+            if(it != operations_.end() && specialization.GetState() == ast::OperandTypes::UNINITIALIZED) {
+                specialization.Preset(it->second);
+                ++applied;
+            }
+        }
+        else if(auto call = dynamic_cast<ast::MethodCall*>(&node)) {
+            const auto& location = call->GetLocation();
+            auto it = calls_.find({location.line, location.column});
+            if(it == calls_.end() || it->second.empty() || call->GetCachedClass()) {
+                return;
+            }
+            //the program may have changed since the profile was saved
+            if(auto cls = classes.find(it->second); cls != classes.end() && call->PrefillCache(*cls->second)) {
+                ++applied;
+            }
+        }
+    });
+    return applied;
+}
+
+void Profile::Save(ostream& out) const {
+    out << HEADER << '\n';
+    for(const auto& [key, state] : operations_) {
+        out << "op "sv << key.first << ':' << key.second << ' ' << GetStateName(state) << '\n';
+    }
+    for(const auto& [key, class_name] : calls_) {
+        if(!class_name.empty()) {
+            out << "call "sv << key.first << ':' << key.second << ' ' << class_name << '\n';
+        }
+    }
+}
+
+Profile Profile::Load(istream& input) {
+    string line;
+    if(!getline(input, line) || line != HEADER) {
+        throw ProfileError("not a mython profile"s);
+    }
+    Profile profile;
+    for(size_t line_number = 2; getline(input, line); ++line_number) {
+        if(line.empty()) {
+            continue;
+        }
+        istringstream fields(line);
+        string kind, location, value, rest;
+        if(!(fields >> kind >> location >> value) || fields >> rest) {
+            throw ProfileError("malformed profile line "s + to_string(line_number));
+        }
+        const Key key = ParseLocation(location);
+        if(kind == "op"sv) {
+            auto state = find_if(begin(STATE_NAMES), end(STATE_NAMES), [&value](const auto& entry) {
+                return entry.second == value;
+            });
+            if(state == end(STATE_NAMES)) {
+                throw ProfileError("unknown operand types at profile line "s + to_string(line_number) + ": "s + value);
+            }
+            profile.AddOperation(key, state->first);
+        }
+        else if(kind == "call"sv) {
+            profile.AddCall(key, value);
+        }
+        else {
+            throw ProfileError("unknown record at profile line "s + to_string(line_number) + ": "s + kind);
+        }
+    }
+    return profile;
+}
+
+}  // namespace profile
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "statement.h"
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace profile {
+
+// Ошибка чтения сохранённого профиля
+class ProfileError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/*
+Профиль исполнения программы деревом: под какие типы операндов специализировались
+арифметические операции и сравнения и для объектов какого класса закэшированы методы в
+вызовах. Узлы определяются положением в исходном тексте (ast::SourceLocation), поэтому
+профиль, собранный одним запуском, применяется к заново разобранной той же программе.
+Узлы, созданные оптимизатором без положения в тексте, в профиль не попадают
+*/
+class Profile {
+public:
+    // Добавляет в профиль состояние узлов программы и тел методов объявленных в ней классов
+    // после исполнения. Если в одном месте текста узлы получили разные состояния, операция
+    // считается GENERIC, а вызов не попадает в профиль
+    void Collect(const ast::Statement& program);
+
+    // Переводит ещё не специализированные узлы программы в сохранённые состояния и заполняет
+    // кэши вызовов классами с теми же именами. Возвращает число изменённых узлов
+    size_t Apply(ast::Statement& program) const;
+
+    // Сохраняет профиль в текстовом виде: заголовок и по строке на узел
+    void Save(std::ostream& out) const;
+    // Читает профиль, сохранённый методом Save. При ошибке выбрасывает ProfileError
+    static Profile Load(std::istream& input);
+
+    [[nodiscard]] size_t GetOperationCount() const {
+        return operations_.size();
+    }
+    [[nodiscard]] size_t GetCallCount() const {
+        return calls_.size();
+    }
+
+private:
+    using Key = std::pair<size_t, size_t>;
+
+    void AddOperation(Key key, ast::OperandTypes state);
+    void AddCall(Key key, const std::string& class_name);
+
+    std::map<Key, ast::OperandTypes> operations_;
+    // Пустое имя класса означает, что в этом месте встречались объекты разных классов
+    std::map<Key, std::string> calls_;
+};
+
+}  // namespace profile
@@ -0,0 +1,102 @@
+#include "lexer.h"
+#include "parse.h"
+#include "profile.h"
+#include "test_runner_p.h"
+
+#include <sstream>
+
+using namespace std;
+
+namespace profile {
+
+namespace {
+
+const string PROGRAM = R"(class Calc:
+  def add(a, b):
+    return a + b
+  def same(a, b):
+    return a == b
+
+c = Calc()
+print c.add(1, 2), c.add(3, 4)
+print c.same(True, False), c.same(None, None), 'a' + 'b'
+)"s;
+
+unique_ptr<ast::Statement> Parse(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+const ast::Print& PrintStatement(const unique_ptr<ast::Statement>& program, size_t index) {
+    return dynamic_cast<const ast::Print&>(*dynamic_cast<const ast::Compound&>(*program).Statements().at(index));
+}
+
+void TestSaveAndApply() {
+    auto program = Parse(PROGRAM);
+    runtime::Closure closure;
+    ostringstream output;
+    runtime::SimpleContext context{output};
+    program->Execute(closure, context);
+
+    Profile collected;
+    collected.Collect(*program);
+    ostringstream saved;
+    collected.Save(saved);
+    //the string addition ran once and is not specialized yet, bools and None never are
+    ASSERT_EQUAL(saved.str(), "mython-profile 1\nop 3:14 numbers\nop 5:14 generic\n"
+                              "call 8:7 Calc\ncall 8:20 Calc\ncall 9:7 Calc\ncall 9:28 Calc\n"s);
+
+    istringstream input(saved.str());
+    const Profile loaded = Profile::Load(input);
+    auto fresh = Parse(PROGRAM);
+    ast::ResetSpecializationStats();
+    ASSERT_EQUAL(loaded.Apply(*fresh), 6u);
+    //the numeric addition and the four call caches
+    ASSERT_EQUAL(ast::GetSpecializationStats().specializations, 5u);
+    for(const auto& arg : PrintStatement(fresh, 2).Args()) {
+        ASSERT(dynamic_cast<const ast::MethodCall&>(*arg).GetCachedClass() != nullptr);
+    }
+    const auto& concatenation = dynamic_cast<const ast::Add&>(*PrintStatement(fresh, 3).Args().at(2));
+    ASSERT(concatenation.GetSpecialization().GetState() == ast::OperandTypes::UNINITIALIZED);
+
+    //preset nodes run as if they had specialized themselves
+    ostringstream fresh_output;
+    runtime::SimpleContext fresh_context{fresh_output};
+    runtime::Closure fresh_closure;
+    fresh->Execute(fresh_closure, fresh_context);
+    ASSERT_EQUAL(fresh_output.str(), output.str());
+}
+
+void TestConflictingSites() {
+    istringstream input("mython-profile 1\nop 1:3 numbers\nop 1:3 strings\ncall 2:1 A\ncall 2:1 B\n"s);
+    ostringstream saved;
+    Profile::Load(input).Save(saved);
+    ASSERT_EQUAL(saved.str(), "mython-profile 1\nop 1:3 generic\n"s);
+}
+
+void TestLoadErrors() {
+    for(const string& text : {"op 1:1 numbers\n"s, "mython-profile 1\nop 1:1 floats\n"s,
+                              "mython-profile 1\nop 1 numbers\n"s, "mython-profile 1\njump 1:1 x\n"s,
+                              "mython-profile 1\ncall 1:1\n"s, "mython-profile 1\nop 1:2:3 numbers\n"s,
+                              "mython-profile 1\nop 99999999999999999999999:1 numbers\n"s,
+                              "mython-profile 1\ncall 1:123456789012345678901234567890 A\n"s}) {
+        istringstream input(text);
+        try {
+            Profile::Load(input);
+            ASSERT(false);
+        }
+        catch(const ProfileError&) {
+        }
+    }
+}
+
+}  // namespace
+
+void RunProfileTests(TestRunner& tr) {
+    RUN_TEST(tr, profile::TestSaveAndApply);
+    RUN_TEST(tr, profile::TestConflictingSites);
+    RUN_TEST(tr, profile::TestLoadErrors);
+}
+
+}  // namespace profile
@@ -1,8 +1,14 @@
 #include "runtime.h"
 
+#include <algorithm>
 #include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <optional>
+#include <pthread.h>
 #include <sstream>
 
 using namespace std;
@@ -18,8 +24,8 @@ void ObjectHolder::AssertIsValid() const {
 }
 
 ObjectHolder ObjectHolder::Share(Object& object) {
-    // Возвращаем невладеющий shared_ptr (его deleter ничего не делает)
-    return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+    // Возвращаем невладеющий shared_ptr: он указывает на объект, но не имеет блока управления
+    return ObjectHolder(std::shared_ptr<Object>(std::shared_ptr<Object>(), &object));
 }
 
 ObjectHolder ObjectHolder::None() {
@@ -44,6 +50,10 @@ ObjectHolder::operator bool() const {
     return Get() != nullptr;
 }
 
+bool ObjectHolder::IsExclusive() const {
+    return data_.use_count() == 1;
+}
+
 bool IsTrue(const ObjectHolder& object) {
     if(!object || object.TryAs<Class>() || object.TryAs<ClassInstance>()) {
         return false;
@@ -90,23 +100,179 @@ ClassInstance::ClassInstance(const Class& cls)
 {
 }
 
+namespace {
+//pops activation record from call stack on any exit from the method
+class FrameGuard {
+public:
+    explicit FrameGuard(CallStack& stack)
+        : stack_(stack)
+        , frame_(stack.Push())
+    {
+    }
+    FrameGuard(const FrameGuard&) = delete;
+    FrameGuard& operator=(const FrameGuard&) = delete;
+    ~FrameGuard() {
+        stack_.Pop();
+    }
+    Closure& Frame() {
+        return frame_;
+    }
+private:
+    CallStack& stack_;
+    Closure& frame_;
+};
+
+ObjectHolder ExecuteMethod(ClassInstance& self, Closure& self_fields, const Method& method,
+                           const std::vector<ObjectHolder>& actual_args,
+                           Closure& arguments, Context& context) {
+    for(size_t i = 0; i < method.formal_params.size(); ++i) {
+        arguments[method.formal_params[i]] = actual_args[i];
+    }
+    self_fields["self"s] = ObjectHolder::Share(self);
+    arguments["self"s] = self_fields.at("self"s);
+    return method.body->Execute(arguments, context);
+}
+}  // namespace
+
 ObjectHolder ClassInstance::Call(const std::string& method,
                                  const std::vector<ObjectHolder>& actual_args,
                                  Context& context) {
     if(HasMethod(method, actual_args.size())) {
-        auto& current_method = *class_ptr_->GetMethod(method);
-        
-        Closure arguments{};
-        for(size_t i = 0; i < current_method.formal_params.size(); ++i) {
-            arguments[current_method.formal_params[i]] = actual_args[i];
-        }
-        fields_["self"s] = ObjectHolder::Share(*this);
-        arguments["self"s] = fields_.at("self"s);
-        return current_method.body->Execute(arguments, context);       
+        return Call(*class_ptr_->GetMethod(method), actual_args, context);
     }
     throw std::runtime_error("unable to call "s.append(method));
 }
 
+ObjectHolder ClassInstance::Call(const Method& method,
+                                 const std::vector<ObjectHolder>& actual_args,
+                                 Context& context) {
+    CheckNativeStack();
+    method.call_count.Increment();
+    auto executor = context.GetMethodExecutor();
+    if(auto stack = context.GetCallStack()) {
+        FrameGuard guard(*stack);
+        if(executor) {
+            return executor->Invoke(*this, method, actual_args, context);
+        }
+        return ExecuteMethod(*this, fields_, method, actual_args, guard.Frame(), context);
+    }
+    if(executor) {
+        return executor->Invoke(*this, method, actual_args, context);
+    }
+    Closure arguments{};
+    return ExecuteMethod(*this, fields_, method, actual_args, arguments, context);
+}
+
+const Class& ClassInstance::GetClass() const {
+    return *class_ptr_;
+}
+
+CallStack::CallStack(size_t max_depth)
+    : max_depth_(max_depth)
+{
+}
+
+Closure& CallStack::Push() {
+    if(depth_ >= max_depth_) {
+        throw StackOverflowError("maximum recursion depth exceeded: "s + std::to_string(max_depth_));
+    }
+    if(depth_ == frames_.size()) {
+        frames_.emplace_back();
+    }
+    peak_depth_ = std::max(peak_depth_, ++depth_);
+    return frames_[depth_ - 1u];
+}
+
+void CallStack::Pop() {
+    assert(depth_ > 0);
+    frames_[--depth_].clear();
+}
+
+size_t CallStack::Depth() const {
+    return depth_;
+}
+
+size_t CallStack::PeakDepth() const {
+    return peak_depth_;
+}
+
+size_t CallStack::MaxDepth() const {
+    return max_depth_;
+}
+
+namespace {
+
+//the lowest address of the stack that calls may reach, or 0 if the stack bounds are unknown
+uintptr_t FindNativeStackLimit() {
+#ifdef __linux__
+    pthread_attr_t attr;
+    if(pthread_getattr_np(pthread_self(), &attr) != 0) {
+        return 0;
+    }
+    void* stack_address = nullptr;
+    size_t stack_size = 0;
+    const int error = pthread_attr_getstack(&attr, &stack_address, &stack_size);
+    pthread_attr_destroy(&attr);
+    if(error != 0 || stack_size <= NATIVE_STACK_RESERVE) {
+        return 0;
+    }
+    return reinterpret_cast<uintptr_t>(stack_address) + NATIVE_STACK_RESERVE;
+#else
+    return 0;
+#endif
+}
+
+//found once per thread, on the first call made in it
+thread_local const uintptr_t native_stack_limit = FindNativeStackLimit();
+
+}  // namespace
+
+void CheckNativeStack() {
+    if(IsNativeStackBelow(0)) {
+        throw StackOverflowError("maximum recursion depth exceeded: the interpreter stack is exhausted"s);
+    }
+}
+
+bool IsNativeStackBelow(size_t bytes) {
+    //the frame address is on the real stack even if AddressSanitizer moves locals to the heap
+    return native_stack_limit != 0
+        && reinterpret_cast<uintptr_t>(__builtin_frame_address(0)) < native_stack_limit + bytes;
+}
+
+void RunOnHeapStack(size_t stack_size, const std::function<void()>& task) {
+    struct Job {
+        const std::function<void()>& task;
+        std::exception_ptr error;
+    } job{task, nullptr};
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if(pthread_attr_setstacksize(&attr, std::max<size_t>(stack_size, PTHREAD_STACK_MIN)) != 0) {
+        pthread_attr_destroy(&attr);
+        throw std::runtime_error("unable to set stack size"s);
+    }
+    pthread_t thread;
+    int error = pthread_create(&thread, &attr, [](void* arg) -> void* {
+        auto& job = *static_cast<Job*>(arg);
+        try {
+            job.task();
+        }
+        catch(...) {
+            job.error = std::current_exception();
+        }
+        return nullptr;
+    }, &job);
+    pthread_attr_destroy(&attr);
+    if(error != 0) {
+        throw std::runtime_error("unable to allocate "s + std::to_string(stack_size >> 20) + " MiB of stack for the interpreter thread: "s
+                                 + std::strerror(error));
+    }
+    pthread_join(thread, nullptr);
+    if(job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
 Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
     : name_(name)
     , methods_(std::move(methods))
@@ -127,6 +293,14 @@ const std::string& Class::GetName() const {
     return name_;
 }
 
+const std::vector<Method>& Class::GetMethods() const {
+    return methods_;
+}
+
+const Class* Class::GetParent() const {
+    return parent_;
+}
+
 void Class::Print(ostream& os, [[maybe_unused]] Context& context) {
     os << "Class "s << GetName();
 }
@@ -164,8 +338,9 @@ bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
         auto lhs_ptr = lhs.TryAs<ClassInstance>();
         auto rhs_ptr = rhs.TryAs<ClassInstance>();
         if(lhs_ptr && rhs_ptr && lhs_ptr->HasMethod("__eq__"s, 1)) {
-            auto obj_ptr = lhs_ptr->Call("__eq__"s, {rhs}, context).TryAs<Bool>();
-            return obj_ptr->GetValue();
+            //the holder keeps the result alive while it is read
+            ObjectHolder result = lhs_ptr->Call("__eq__"s, {rhs}, context);
+            return result.TryAs<Bool>()->GetValue();
         }
     }
     throw std::runtime_error("uncompatible types"s);
@@ -197,8 +372,9 @@ bool Less(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
         auto lhs_ptr = lhs.TryAs<ClassInstance>();
         auto rhs_ptr = rhs.TryAs<ClassInstance>();
         if(lhs_ptr && rhs_ptr && lhs_ptr->HasMethod("__lt__"s, 1)) {
-            auto obj_ptr = lhs_ptr->Call("__lt__"s, {rhs}, context).TryAs<Bool>();
-            return obj_ptr->GetValue();
+            //the holder keeps the result alive while it is read
+            ObjectHolder result = lhs_ptr->Call("__lt__"s, {rhs}, context);
+            return result.TryAs<Bool>()->GetValue();
         }
     }
     throw std::runtime_error("uncompatible types"s);
@@ -223,4 +399,69 @@ bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& c
     return !Less(lhs, rhs, context);
 }
 
+ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+    //try numbers
+    {
+        auto lhs_num_ptr = lhs.TryAs<Number>();
+        auto rhs_num_ptr = rhs.TryAs<Number>();
+        if(lhs_num_ptr && rhs_num_ptr) {
+            return ObjectHolder::Own(Number{lhs_num_ptr->GetValue() + rhs_num_ptr->GetValue()});
+        }
+    }
+    //try strings
+    {
+        auto lhs_str_ptr = lhs.TryAs<String>();
+        auto rhs_str_ptr = rhs.TryAs<String>();
+        if(lhs_str_ptr && rhs_str_ptr) {
+            return ObjectHolder::Own(String{lhs_str_ptr->GetValue() + rhs_str_ptr->GetValue()});
+        }
+    }
+    //try ClassInstance
+    {
+        auto lhs_ci_ptr = lhs.TryAs<ClassInstance>();
+        if(lhs_ci_ptr && lhs_ci_ptr->HasMethod("__add__"s, 1u)) {
+            return lhs_ci_ptr->Call("__add__"s, {rhs}, context);
+        }
+    }
+    throw std::runtime_error("unable to add"s);
+}
+
+ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    auto lhs_num_ptr = lhs.TryAs<Number>();
+    auto rhs_num_ptr = rhs.TryAs<Number>();
+    if(lhs_num_ptr && rhs_num_ptr) {
+        return ObjectHolder::Own(Number{lhs_num_ptr->GetValue() - rhs_num_ptr->GetValue()});
+    }
+    throw std::runtime_error("unable to sub"s);
+}
+
+ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    auto lhs_num_ptr = lhs.TryAs<Number>();
+    auto rhs_num_ptr = rhs.TryAs<Number>();
+    if(lhs_num_ptr && rhs_num_ptr) {
+        return ObjectHolder::Own(Number{lhs_num_ptr->GetValue() * rhs_num_ptr->GetValue()});
+    }
+    throw std::runtime_error("unable to mult"s);
+}
+
+ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    auto lhs_num_ptr = lhs.TryAs<Number>();
+    auto rhs_num_ptr = rhs.TryAs<Number>();
+    if(lhs_num_ptr && rhs_num_ptr && rhs_num_ptr->GetValue()) {
+        return ObjectHolder::Own(Number{lhs_num_ptr->GetValue() / rhs_num_ptr->GetValue()});
+    }
+    throw std::runtime_error("unable to div"s);
+}
+
+std::string ToString(const ObjectHolder& object, Context& context) {
+    std::ostringstream oss;
+    if(!object) {
+        oss << "None"s;
+    }
+    else {
+        object->Print(oss, context);
+    }
+    return oss.str();
+}
+
 }  // namespace runtime
@@ -1,20 +1,40 @@
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <typeinfo>
 #include <unordered_map>
 #include <vector>
 
 namespace runtime {
 
+class CallStack;
+class MethodExecutor;
+
 // Контекст исполнения инструкций Mython
 class Context {
 public:
     // Возвращает поток вывода для команд print
     virtual std::ostream& GetOutputStream() = 0;
 
+    // Возвращает стек активаций методов либо nullptr, если контекст его не предоставляет.
+    // В последнем случае записи активаций создаются на стеке C++
+    virtual CallStack* GetCallStack() {
+        return nullptr;
+    }
+
+    // Возвращает исполнитель тел методов либо nullptr, если методы исполняются обходом
+    // их синтаксического дерева
+    virtual MethodExecutor* GetMethodExecutor() {
+        return nullptr;
+    }
+
 protected:
     ~Context() = default;
 };
@@ -38,9 +58,15 @@ public:
     // object копируется или перемещается в кучу
     template <typename T>
     [[nodiscard]] static ObjectHolder Own(T&& object) {
+        allocation_count_.fetch_add(1u, std::memory_order_relaxed);
         return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
     }
 
+    // Возвращает количество объектов, размещённых в куче через Own с начала работы программы
+    [[nodiscard]] static size_t GetAllocationCount() {
+        return allocation_count_.load(std::memory_order_relaxed);
+    }
+
     // Создаёт ObjectHolder, не владеющий объектом (аналог слабой ссылки)
     [[nodiscard]] static ObjectHolder Share(Object& object);
     // Создаёт пустой ObjectHolder, соответствующий значению None
@@ -61,13 +87,28 @@ public:
         return dynamic_cast<T*>(this->Get());
     }
 
+    // Возвращает указатель на объект, если его динамический тип в точности совпадает с T
+    // (наследники T не подходят), либо nullptr. Работает быстрее TryAs
+    template <typename T>
+    [[nodiscard]] T* TryAsExact() const {
+        auto ptr = this->Get();
+        return ptr && typeid(*ptr) == typeid(T) ? static_cast<T*>(ptr) : nullptr;
+    }
+
     // Возвращает true, если ObjectHolder не пуст
     explicit operator bool() const;
 
+    // Возвращает true, если никакой другой владеющий ObjectHolder не хранит этот объект, то есть
+    // изменение объекта на месте не заметит никто, кроме владельца. Невладеющие ObjectHolder,
+    // созданные Share, не учитываются
+    [[nodiscard]] bool IsExclusive() const;
+
 private:
     explicit ObjectHolder(std::shared_ptr<Object> data);
     void AssertIsValid() const;
 
+    inline static std::atomic<size_t> allocation_count_{0};
+
     std::shared_ptr<Object> data_;
 };
 
@@ -120,6 +161,31 @@ public:
     void Print(std::ostream& os, Context& context) override;
 };
 
+// Приблизительный счётчик, который одновременно увеличивают несколько потоков. Увеличения из
+// разных потоков, совпавшие по времени, могут потеряться, зато увеличение не блокирует шину.
+// При копировании и перемещении переносится текущее значение
+class CallCounter {
+public:
+    CallCounter() = default;
+    CallCounter(const CallCounter& other)
+        : count_(other.Get()) {
+    }
+    CallCounter& operator=(const CallCounter& other) {
+        count_.store(other.Get(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    [[nodiscard]] size_t Get() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+    void Increment() {
+        count_.store(Get() + 1, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<size_t> count_{0};
+};
+
 // Метод класса
 struct Method {
     // Имя метода
@@ -128,6 +194,77 @@ struct Method {
     std::vector<std::string> formal_params;
     // Тело метода
     std::unique_ptr<Executable> body;
+    // Количество вызовов метода через ClassInstance::Call во всех выполнениях программы.
+    // По нему находятся часто вызываемые методы
+    mutable CallCounter call_count = {};
+};
+
+// Исключение, выбрасываемое при превышении максимальной глубины вызовов методов
+class StackOverflowError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Стек активаций Mython-методов, размещённый в куче.
+// Каждая запись - таблица символов с параметрами вызова метода. Записи переиспользуются
+// между вызовами, поэтому глубокая рекурсия не приводит к повторным выделениям памяти
+class CallStack {
+public:
+    static constexpr size_t DEFAULT_MAX_DEPTH = 10000u;
+
+    explicit CallStack(size_t max_depth = DEFAULT_MAX_DEPTH);
+
+    // Добавляет на вершину стека пустую запись активации и возвращает ссылку на неё.
+    // Ссылка остаётся действительной до вызова Pop для этой записи.
+    // При превышении максимальной глубины выбрасывает StackOverflowError
+    Closure& Push();
+    // Удаляет запись с вершины стека, освобождая хранящиеся в ней объекты
+    void Pop();
+
+    [[nodiscard]] size_t Depth() const;
+    // Возвращает максимальную глубину, достигнутую за время работы
+    [[nodiscard]] size_t PeakDepth() const;
+    [[nodiscard]] size_t MaxDepth() const;
+private:
+    std::deque<Closure> frames_;
+    size_t depth_ = 0;
+    size_t peak_depth_ = 0;
+    size_t max_depth_;
+};
+
+// Выбрасывает StackOverflowError, если в стеке C++ текущего потока осталось меньше
+// NATIVE_STACK_RESERVE байт. Вызывается при каждом вызове метода Mython: глубина выражений
+// и блоков внутри одного вызова ограничена парсером, и обходу его тела хватает резерва
+void CheckNativeStack();
+// Возвращает true, если в стеке C++ текущего потока осталось меньше bytes байт сверх
+// NATIVE_STACK_RESERVE
+[[nodiscard]] bool IsNativeStackBelow(size_t bytes);
+
+#ifdef __SANITIZE_ADDRESS__
+//AddressSanitizer surrounds stack variables with redzones, which makes frames larger
+constexpr size_t NATIVE_STACK_RESERVE = 4u * 1024u * 1024u;
+#else
+constexpr size_t NATIVE_STACK_RESERVE = 1024u * 1024u;
+#endif
+
+// Выполняет task в отдельном потоке, стек которого размещается в куче и имеет размер
+// stack_size байт. Исключение, выброшенное task, пробрасывается в вызывающий поток.
+// Если стек такого размера не удаётся выделить, выбрасывает std::runtime_error
+void RunOnHeapStack(size_t stack_size, const std::function<void()>& task);
+
+class ClassInstance;
+
+// Исполнитель тел методов. Позволяет заменить обход синтаксического дерева другим
+// механизмом исполнения, например виртуальной машиной
+class MethodExecutor {
+public:
+    // Выполняет метод method объекта self с аргументами actual_args.
+    // Количество аргументов уже проверено вызывающей стороной
+    virtual ObjectHolder Invoke(ClassInstance& self, const Method& method,
+                                const std::vector<ObjectHolder>& actual_args, Context& context) = 0;
+
+protected:
+    ~MethodExecutor() = default;
 };
 
 // Класс
@@ -143,6 +280,12 @@ public:
     // Возвращает имя класса
     [[nodiscard]] const std::string& GetName() const;
 
+    // Возвращает методы, объявленные в самом классе (без унаследованных)
+    [[nodiscard]] const std::vector<Method>& GetMethods() const;
+
+    // Возвращает родительский класс либо nullptr
+    [[nodiscard]] const Class* GetParent() const;
+
     // Выводит в os строку "Class <имя класса>", например "Class cat"
     void Print(std::ostream& os, Context& context) override;
 private:
@@ -171,6 +314,11 @@ public:
     ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
                       Context& context);
 
+    // Вызывает у объекта заранее найденный метод method. Количество actual_args должно
+    // совпадать с количеством формальных параметров метода
+    ObjectHolder Call(const Method& method, const std::vector<ObjectHolder>& actual_args,
+                      Context& context);
+
     // Возвращает true, если объект имеет метод method, принимающий argument_count параметров
     [[nodiscard]] bool HasMethod(const std::string& method, size_t argument_count) const;
 
@@ -178,6 +326,9 @@ public:
     [[nodiscard]] Closure& Fields();
     // Возвращает константную ссылку на Closure, содержащую поля объекта
     [[nodiscard]] const Closure& Fields() const;
+
+    // Возвращает класс объекта
+    [[nodiscard]] const Class& GetClass() const;
 private:
     const Class* class_ptr_;
     Closure fields_;
@@ -211,6 +362,22 @@ bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& cont
 // Возвращает значение, противоположное Less(lhs, rhs, context)
 bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 
+/*
+ * Арифметические операции Mython. Поддерживаются:
+ *  Add: число + число, строка + строка, объект + значение, если у объекта есть метод __add__
+ *  Sub, Mult, Div: только числа, деление на 0 запрещено
+ * В остальных случаях функции выбрасывают исключение runtime_error.
+ *
+ * Параметр context задаёт контекст для выполнения метода __add__
+ */
+ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs);
+ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs);
+ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs);
+
+// Возвращает строковое представление значения, None выводится как "None"
+std::string ToString(const ObjectHolder& object, Context& context);
+
 // Контекст-заглушка, применяется в тестах.
 // В этом контексте весь вывод перенаправляется в строковый поток вывода output
 struct DummyContext : Context {
@@ -221,19 +388,62 @@ struct DummyContext : Context {
     std::ostringstream output;
 };
 
-// Простой контекст, в нём вывод происходит в поток output, переданный в конструктор
+// Простой контекст, в нём вывод происходит в поток output, переданный в конструктор.
+// Если задан call_stack, записи активаций методов размещаются в нём
 class SimpleContext : public runtime::Context {
 public:
-    explicit SimpleContext(std::ostream& output)
-        : output_(output) {
+    explicit SimpleContext(std::ostream& output, CallStack* call_stack = nullptr)
+        : output_(output)
+        , call_stack_(call_stack) {
+    }
+
+    // Ссылку на исполнитель методов держит контекст, исполнитель должен пережить его
+    void SetMethodExecutor(MethodExecutor* executor) {
+        executor_ = executor;
     }
 
     std::ostream& GetOutputStream() override {
         return output_;
     }
 
+    CallStack* GetCallStack() override {
+        return call_stack_;
+    }
+
+    MethodExecutor* GetMethodExecutor() override {
+        return executor_;
+    }
+
 private:
     std::ostream& output_;
+    CallStack* call_stack_;
+    MethodExecutor* executor_ = nullptr;
+};
+
+// Контекст, передающий вывод и стек вызовов базовому контексту base,
+// а исполнение тел методов - исполнителю executor
+class ExecutorContext : public runtime::Context {
+public:
+    ExecutorContext(Context& base, MethodExecutor& executor)
+        : base_(base)
+        , executor_(executor) {
+    }
+
+    std::ostream& GetOutputStream() override {
+        return base_.GetOutputStream();
+    }
+
+    CallStack* GetCallStack() override {
+        return base_.GetCallStack();
+    }
+
+    MethodExecutor* GetMethodExecutor() override {
+        return &executor_;
+    }
+
+private:
+    Context& base_;
+    MethodExecutor& executor_;
 };
 
 }  // namespace runtime
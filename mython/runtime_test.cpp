@@ -474,6 +474,24 @@ void TestComparison() {
     }
 }
 
+void TestComparisonResultLifetime() {
+    //__eq__ and __lt__ return objects nobody else holds; with MYTHON_SANITIZE reading them
+    //after they are freed is reported
+    auto fresh_true = []([[maybe_unused]] Closure& closure, [[maybe_unused]] Context& ctx) {
+        return ObjectHolder::Own(Bool{true});
+    };
+    std::vector<Method> methods;
+    methods.push_back({"__eq__"s, {"rhs"s}, std::make_unique<TestMethodBody>(fresh_true)});
+    methods.push_back({"__lt__"s, {"rhs"s}, std::make_unique<TestMethodBody>(fresh_true)});
+    Class cls{"Fresh"s, std::move(methods), nullptr};
+    ClassInstance lhs{cls};
+    ClassInstance rhs{cls};
+
+    DummyContext context;
+    ASSERT(Equal(ObjectHolder::Share(lhs), ObjectHolder::Share(rhs), context));
+    ASSERT(Less(ObjectHolder::Share(lhs), ObjectHolder::Share(rhs), context));
+}
+
 void TestClass() {
     vector<Method> methods;
     Closure* passed_closure = nullptr;
@@ -538,6 +556,7 @@ void RunObjectsTests(TestRunner& tr) {
     RUN_TEST(tr, runtime::TestMethodInvocation);
     RUN_TEST(tr, runtime::TestIsTrue);
     RUN_TEST(tr, runtime::TestComparison);
+    RUN_TEST(tr, runtime::TestComparisonResultLifetime);
     RUN_TEST(tr, runtime::TestClass);
     RUN_TEST(tr, runtime::TestClassInstance);
 }
@@ -1,7 +1,10 @@
 #include "statement.h"
 
+#include <atomic>
+#include <cassert>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
 
 using namespace std;
 
@@ -14,8 +17,121 @@ using runtime::ObjectHolder;
 namespace {
 const string ADD_METHOD = "__add__"s;
 const string INIT_METHOD = "__init__"s;
+
+std::atomic<size_t> specializations_count{0};
+std::atomic<size_t> deoptimizations_count{0};
+std::atomic<size_t> deferred_bodies_count{0};
+std::atomic<size_t> compiled_bodies_count{0};
+
+void CountSpecialization() {
+    specializations_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CountDeoptimization() {
+    deoptimizations_count.fetch_add(1, std::memory_order_relaxed);
+}
 }  // namespace
 
+template <typename T, typename Key>
+unique_ptr<ValueStatement<T>> ConstantPool::Intern(unordered_map<Key, ObjectHolder>& objects, Key value) {
+    auto it = objects.find(value);
+    if(it == objects.end()) {
+        ObjectHolder object = ObjectHolder::Own(T{value});
+        it = objects.emplace(std::move(value), std::move(object)).first;
+    }
+    return make_unique<ValueStatement<T>>(it->second);
+}
+
+unique_ptr<NumericConst> ConstantPool::MakeNumber(int value) {
+    return Intern<runtime::Number>(numbers_, value);
+}
+
+unique_ptr<StringConst> ConstantPool::MakeString(string value) {
+    return Intern<runtime::String>(strings_, std::move(value));
+}
+
+unique_ptr<BoolConst> ConstantPool::MakeBool(bool value) {
+    return Intern<runtime::Bool>(bools_, value);
+}
+
+void ConstantPool::Clear() {
+    numbers_.clear();
+    strings_.clear();
+    bools_.clear();
+}
+
+SpecializationStats GetSpecializationStats() {
+    return {specializations_count.load(std::memory_order_relaxed),
+            deoptimizations_count.load(std::memory_order_relaxed)};
+}
+
+void ResetSpecializationStats() {
+    specializations_count.store(0, std::memory_order_relaxed);
+    deoptimizations_count.store(0, std::memory_order_relaxed);
+}
+
+LazyCompilationStats GetLazyCompilationStats() {
+    return {deferred_bodies_count.load(std::memory_order_relaxed),
+            compiled_bodies_count.load(std::memory_order_relaxed)};
+}
+
+void ResetLazyCompilationStats() {
+    deferred_bodies_count.store(0, std::memory_order_relaxed);
+    compiled_bodies_count.store(0, std::memory_order_relaxed);
+}
+
+OperandTypes ClassifyOperands(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+    if(lhs.TryAsExact<runtime::Number>() && rhs.TryAsExact<runtime::Number>()) {
+        return OperandTypes::NUMBERS;
+    }
+    if(lhs.TryAsExact<runtime::String>() && rhs.TryAsExact<runtime::String>()) {
+        return OperandTypes::STRINGS;
+    }
+    return OperandTypes::GENERIC;
+}
+
+void Specialization::Observe(OperandTypes observed) {
+    if(state_.load(std::memory_order_relaxed) != OperandTypes::UNINITIALIZED) {
+        return;
+    }
+    if(observed != last_observed_.load(std::memory_order_relaxed)) {
+        last_observed_.store(observed, std::memory_order_relaxed);
+        hits_.store(0, std::memory_order_relaxed);
+    }
+    //an observation lost to a concurrent run only delays the specialization
+    const uint8_t hits = hits_.load(std::memory_order_relaxed) + 1;
+    hits_.store(hits, std::memory_order_relaxed);
+    if(hits < SPECIALIZE_AFTER) {
+        return;
+    }
+    state_.store(observed, std::memory_order_relaxed);
+    if(observed != OperandTypes::GENERIC) {
+        CountSpecialization();
+    }
+}
+
+void Specialization::Preset(OperandTypes state) {
+    if(state_.load(std::memory_order_relaxed) != OperandTypes::UNINITIALIZED) {
+        return;
+    }
+    state_.store(state, std::memory_order_relaxed);
+    if(state != OperandTypes::GENERIC && state != OperandTypes::UNINITIALIZED) {
+        CountSpecialization();
+    }
+}
+
+void Specialization::Disable() {
+    state_.store(OperandTypes::GENERIC, std::memory_order_relaxed);
+}
+
+void Specialization::Deoptimize() {
+    CountDeoptimization();
+    last_observed_.store(OperandTypes::UNINITIALIZED, std::memory_order_relaxed);
+    hits_.store(0, std::memory_order_relaxed);
+    const bool may_respecialize = deoptimizations_.fetch_add(1, std::memory_order_relaxed) + 1 < MAX_DEOPTIMIZATIONS;
+    state_.store(may_respecialize ? OperandTypes::UNINITIALIZED : OperandTypes::GENERIC, std::memory_order_relaxed);
+}
+
 VariableValue::VariableValue(const std::string& var_name) 
     : head_(var_name)
 {
@@ -35,6 +151,15 @@ void PrintObject(const ObjectHolder& obj_h, Context& context) {
     }
 }
 
+std::vector<std::string> VariableValue::GetDottedIds() const {
+    std::vector<std::string> result{head_};
+    result.insert(result.end(), body_.begin(), body_.end());
+    if(!tail_.empty()) {
+        result.push_back(tail_);
+    }
+    return result;
+}
+
 ObjectHolder VariableValue::Execute(Closure& closure, [[maybe_unused]] Context& context) {
     auto head_obj_holder_iter = closure.find(head_);
     if(head_obj_holder_iter == closure.end()) {
@@ -95,27 +220,28 @@ ObjectHolder FieldAssignment::Execute(Closure& closure, Context& context) {
 }
 
 NewInstance::NewInstance(const runtime::Class& class_) 
-    : instance_holder_(runtime::ObjectHolder::Own(std::forward<runtime::ClassInstance>(runtime::ClassInstance{class_})))
+    : class_(class_)
 {
 }
 
-NewInstance::NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args)
-    : instance_holder_(runtime::ObjectHolder::Own(std::forward<runtime::ClassInstance>(runtime::ClassInstance{class_})))
+NewInstance::NewInstance(const runtime::Class& class_, StatementList args)
+    : class_(class_)
     , args_(std::move(args))
 {
 }
 
 ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
-    size_t argc = args_.size();
-    auto& class_instance_ = *instance_holder_.TryAs<runtime::ClassInstance>();
-    if(class_instance_.HasMethod("__init__"s, argc)) {
+    //every execution creates its own object, so the tree can be run again
+    auto instance_holder = runtime::ObjectHolder::Own(runtime::ClassInstance{class_});
+    auto& class_instance = *instance_holder.TryAs<runtime::ClassInstance>();
+    if(class_instance.HasMethod(INIT_METHOD, args_.size())) {
         std::vector<runtime::ObjectHolder> argv;
         for(auto& next_arg : args_) {
             argv.emplace_back(next_arg->Execute(closure, context));
         }
-        class_instance_.Call("__init__"s, argv, context);
+        class_instance.Call(INIT_METHOD, argv, context);
     }
-    return instance_holder_;
+    return instance_holder;
 }
 
 Print::Print(unique_ptr<Statement> argument) 
@@ -123,7 +249,7 @@ Print::Print(unique_ptr<Statement> argument)
     data_.emplace_back(std::move(argument));
 }
 
-Print::Print(vector<unique_ptr<Statement>> args)
+Print::Print(StatementList args)
     : data_(std::move(args))
 {
 }
@@ -152,141 +278,266 @@ ObjectHolder Print::Execute(Closure& closure, Context& context) {
 }
 
 MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method,
-                       std::vector<std::unique_ptr<Statement>> args) 
+                       StatementList args) 
     : object_(std::move(object))
     , method_(std::move(method))
     , argv_(std::move(args))
 {
 }
 
+const runtime::Method* MethodCall::ResolveMethod(const runtime::Class& cls) {
+    const CacheEntry* cached = cache_.load(std::memory_order_acquire);
+    if(cached && cached->cls == &cls) {
+        return cached->method;
+    }
+    auto method = cls.GetMethod(method_);
+    if(!method || method->formal_params.size() != argv_.size()) {
+        return nullptr;
+    }
+    if(used_entries_.load(std::memory_order_relaxed) <= cache_entries_.size()) {
+        //concurrent runs take different entries, so an entry is written once, before it is published
+        const size_t entry = used_entries_.fetch_add(1, std::memory_order_relaxed);
+        if(entry > 0) {
+            //the call site has seen another class, respecialize it for the new one
+            CountDeoptimization();
+        }
+        if(entry < cache_entries_.size()) {
+            CountSpecialization();
+            cache_entries_[entry] = {&cls, method};
+            cache_.store(&cache_entries_[entry], std::memory_order_release);
+        }
+        else {
+            cache_.store(nullptr, std::memory_order_release);
+        }
+    }
+    return method;
+}
+
+bool MethodCall::PrefillCache(const runtime::Class& cls) {
+    if(auto cached_class = GetCachedClass()) {
+        return cached_class == &cls;
+    }
+    return ResolveMethod(cls) != nullptr;
+}
+
 ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
-    auto obj_ptr = object_->Execute(closure, context).TryAs<runtime::ClassInstance>();
+    return ExecuteOn(object_->Execute(closure, context), closure, context);
+}
+
+ObjectHolder MethodCall::ExecuteOn(const ObjectHolder& receiver, Closure& closure, Context& context) {
+    auto obj_ptr = receiver.TryAs<runtime::ClassInstance>();
     if(!obj_ptr) {
         throw std::runtime_error("object is not ClassInstance"s);
     }
-    if(!obj_ptr->HasMethod(method_, argv_.size())) {
+    auto method = ResolveMethod(obj_ptr->GetClass());
+    if(!method) {
         throw std::runtime_error("object has no method: "s.append(method_));
     }
     std::vector<ObjectHolder> transformed_argv{};
+    transformed_argv.reserve(argv_.size());
     std::transform(argv_.begin(), argv_.end(), std::back_inserter(transformed_argv),
         [&closure, &context](const auto& x) {return x->Execute(closure, context);});
-    return obj_ptr->Call(method_, transformed_argv, context);
+    return obj_ptr->Call(*method, transformed_argv, context);
+}
+
+InlinedMethodCall::InlinedMethodCall(std::unique_ptr<MethodCall> call, const runtime::Method& method,
+                                     std::vector<std::string> bindings, std::vector<std::string> locals,
+                                     std::unique_ptr<Statement> body, bool returns_value)
+    : call_(std::move(call))
+    , method_(method)
+    , bindings_(std::move(bindings))
+    , locals_(std::move(locals))
+    , body_(std::move(body))
+    , returns_value_(returns_value)
+{
 }
 
-ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
-    std::ostringstream oss;
-    auto obj_holder = arg_->Execute(closure, context);
-    runtime::Object* obj_ptr;
-    if(!obj_holder || !(obj_ptr = obj_holder.Get())) {
-        oss << "None"s;
+bool InlinedMethodCall::Matches(const runtime::Class& cls) {
+    if(matched_class_.load(std::memory_order_relaxed) == &cls) {
+        return true;
     }
-    else {
-        obj_ptr->Print(oss, context);
+    if(cls.GetMethod(call_->GetMethodName()) != &method_) {
+        return false;
+    }
+    matched_class_.store(&cls, std::memory_order_relaxed);
+    return true;
+}
+
+ObjectHolder InlinedMethodCall::Execute(Closure& closure, Context& context) {
+    //the inlined body nests in the caller as deep as the call it replaces
+    runtime::CheckNativeStack();
+    auto receiver = call_->Object()->Execute(closure, context);
+    auto instance = receiver.TryAs<runtime::ClassInstance>();
+    if(!instance || !Matches(instance->GetClass())) {
+        fallbacks_.fetch_add(1, std::memory_order_relaxed);
+        return call_->ExecuteOn(receiver, closure, context);
     }
-    std::string str = oss.str();
-    return runtime::ObjectHolder::Own(runtime::String{str});
+    const auto& args = call_->Args();
+    closure[bindings_.front()] = receiver;
+    for(size_t i = 0; i < args.size(); ++i) {
+        closure[bindings_[i + 1]] = args[i]->Execute(closure, context);
+    }
+    auto result = body_->Execute(closure, context);
+    for(const auto& name : bindings_) {
+        closure.erase(name);
+    }
+    for(const auto& name : locals_) {
+        closure.erase(name);
+    }
+    return returns_value_ ? result : ObjectHolder::None();
+}
+
+ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
+    return runtime::ObjectHolder::Own(runtime::String{runtime::ToString(arg_->Execute(closure, context), context)});
 }
 
 ObjectHolder Add::Execute(Closure& closure, Context& context) {
     auto lhs_obj_holder = lhs_->Execute(closure, context);
     auto rhs_obj_holder = rhs_->Execute(closure, context);
-    //try numbers
-    {
-        auto lhs_num_ptr = lhs_obj_holder.TryAs<runtime::Number>();
-        auto rhs_num_ptr = rhs_obj_holder.TryAs<runtime::Number>();
-        if(lhs_num_ptr && rhs_num_ptr) {
-            return runtime::ObjectHolder::Own(runtime::Number{lhs_num_ptr->GetValue() + rhs_num_ptr->GetValue()});
-        }
-    }
-    //try strings
-    {
-        auto lhs_str_ptr = lhs_obj_holder.TryAs<runtime::String>();
-        auto rhs_str_ptr = rhs_obj_holder.TryAs<runtime::String>();
-        if(lhs_str_ptr && rhs_str_ptr) {
-            return runtime::ObjectHolder::Own(runtime::String{lhs_str_ptr->GetValue() + rhs_str_ptr->GetValue()});
+    switch(specialization_.GetState()) {
+        case OperandTypes::NUMBERS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::Number>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::Number>();
+            if(lhs && rhs) {
+                return ObjectHolder::Own(runtime::Number{lhs->GetValue() + rhs->GetValue()});
+            }
+            specialization_.Deoptimize();
+            break;
         }
-    }
-    //try ClassInstance
-    {
-        auto lhs_ci_ptr = lhs_obj_holder.TryAs<runtime::ClassInstance>();
-        if(lhs_ci_ptr && lhs_ci_ptr->HasMethod("__add__"s, 1u)) {
-            return lhs_ci_ptr->Call("__add__"s, {rhs_obj_holder}, context);
+        case OperandTypes::STRINGS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::String>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::String>();
+            if(lhs && rhs) {
+                return ObjectHolder::Own(runtime::String{lhs->GetValue() + rhs->GetValue()});
+            }
+            specialization_.Deoptimize();
+            break;
         }
+        case OperandTypes::GENERIC:
+            return runtime::Add(lhs_obj_holder, rhs_obj_holder, context);
+        case OperandTypes::UNINITIALIZED:
+            break;
     }
-    throw std::runtime_error("unable to add"s);
+    specialization_.Observe(ClassifyOperands(lhs_obj_holder, rhs_obj_holder));
+    return runtime::Add(lhs_obj_holder, rhs_obj_holder, context);
 }
 
 ObjectHolder Sub::Execute(Closure& closure, Context& context) {
     auto lhs_obj_holder = lhs_->Execute(closure, context);
     auto rhs_obj_holder = rhs_->Execute(closure, context);
-    //try numbers
-    {
-        auto lhs_num_ptr = lhs_obj_holder.TryAs<runtime::Number>();
-        auto rhs_num_ptr = rhs_obj_holder.TryAs<runtime::Number>();
-        if(lhs_num_ptr && rhs_num_ptr) {
-            return runtime::ObjectHolder::Own(runtime::Number{lhs_num_ptr->GetValue() - rhs_num_ptr->GetValue()});
+    switch(specialization_.GetState()) {
+        case OperandTypes::NUMBERS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::Number>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::Number>();
+            if(lhs && rhs) {
+                return ObjectHolder::Own(runtime::Number{lhs->GetValue() - rhs->GetValue()});
+            }
+            specialization_.Deoptimize();
+            break;
         }
+        case OperandTypes::STRINGS:
+        case OperandTypes::GENERIC:
+            return runtime::Sub(lhs_obj_holder, rhs_obj_holder);
+        case OperandTypes::UNINITIALIZED:
+            break;
     }
-    throw std::runtime_error("unable to sub"s);
+    //only numbers have a specialized variant
+    specialization_.Observe(ClassifyOperands(lhs_obj_holder, rhs_obj_holder) == OperandTypes::NUMBERS
+                            ? OperandTypes::NUMBERS : OperandTypes::GENERIC);
+    return runtime::Sub(lhs_obj_holder, rhs_obj_holder);
 }
 
 ObjectHolder Mult::Execute(Closure& closure, Context& context) {
     auto lhs_obj_holder = lhs_->Execute(closure, context);
     auto rhs_obj_holder = rhs_->Execute(closure, context);
-    //try numbers
-    {
-        auto lhs_num_ptr = lhs_obj_holder.TryAs<runtime::Number>();
-        auto rhs_num_ptr = rhs_obj_holder.TryAs<runtime::Number>();
-        if(lhs_num_ptr && rhs_num_ptr) {
-            return runtime::ObjectHolder::Own(runtime::Number{lhs_num_ptr->GetValue() * rhs_num_ptr->GetValue()});
+    switch(specialization_.GetState()) {
+        case OperandTypes::NUMBERS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::Number>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::Number>();
+            if(lhs && rhs) {
+                return ObjectHolder::Own(runtime::Number{lhs->GetValue() * rhs->GetValue()});
+            }
+            specialization_.Deoptimize();
+            break;
         }
+        case OperandTypes::STRINGS:
+        case OperandTypes::GENERIC:
+            return runtime::Mult(lhs_obj_holder, rhs_obj_holder);
+        case OperandTypes::UNINITIALIZED:
+            break;
     }
-    throw std::runtime_error("unable to mult"s);
+    //only numbers have a specialized variant
+    specialization_.Observe(ClassifyOperands(lhs_obj_holder, rhs_obj_holder) == OperandTypes::NUMBERS
+                            ? OperandTypes::NUMBERS : OperandTypes::GENERIC);
+    return runtime::Mult(lhs_obj_holder, rhs_obj_holder);
 }
 
 ObjectHolder Div::Execute(Closure& closure, Context& context) {
     auto lhs_obj_holder = lhs_->Execute(closure, context);
     auto rhs_obj_holder = rhs_->Execute(closure, context);
-    //try numbers
-    {
-        auto lhs_num_ptr = lhs_obj_holder.TryAs<runtime::Number>();
-        auto rhs_num_ptr = rhs_obj_holder.TryAs<runtime::Number>();
-        if(lhs_num_ptr && rhs_num_ptr && rhs_num_ptr->GetValue()) {
-            return runtime::ObjectHolder::Own(runtime::Number{lhs_num_ptr->GetValue() / rhs_num_ptr->GetValue()});
+    switch(specialization_.GetState()) {
+        case OperandTypes::NUMBERS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::Number>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::Number>();
+            if(lhs && rhs) {
+                if(rhs->GetValue() == 0) {
+                    return runtime::Div(lhs_obj_holder, rhs_obj_holder);
+                }
+                return ObjectHolder::Own(runtime::Number{lhs->GetValue() / rhs->GetValue()});
+            }
+            specialization_.Deoptimize();
+            break;
         }
+        case OperandTypes::STRINGS:
+        case OperandTypes::GENERIC:
+            return runtime::Div(lhs_obj_holder, rhs_obj_holder);
+        case OperandTypes::UNINITIALIZED:
+            break;
     }
-    throw std::runtime_error("unable to div"s);
+    //only numbers have a specialized variant
+    specialization_.Observe(ClassifyOperands(lhs_obj_holder, rhs_obj_holder) == OperandTypes::NUMBERS
+                            ? OperandTypes::NUMBERS : OperandTypes::GENERIC);
+    return runtime::Div(lhs_obj_holder, rhs_obj_holder);
 }
 
-ObjectHolder Or::Execute(Closure& closure, Context& context) {
-    const auto True = runtime::ObjectHolder::Own(runtime::Bool{true});
-    const auto False = runtime::ObjectHolder::Own(runtime::Bool{false});
-    
-    auto lhs_obj_holder = lhs_->Execute(closure, context);
-    if(!runtime::IsTrue(lhs_obj_holder)) {
-        auto rhs_obj_holder = rhs_->Execute(closure, context);
-        return runtime::IsTrue(rhs_obj_holder) ? True : False;
+bool ConditionCache::Evaluate(Statement& node, Closure& closure, Context& context) {
+    ConditionExpression* expression;
+    if(node_.load(std::memory_order_acquire) == &node) {
+        expression = expression_.load(std::memory_order_relaxed);
     }
-    return True;
+    else {
+        expression = dynamic_cast<ConditionExpression*>(&node);
+        expression_.store(expression, std::memory_order_relaxed);
+        node_.store(&node, std::memory_order_release);
+    }
+    if(expression) {
+        return expression->EvaluateCondition(closure, context);
+    }
+    return runtime::IsTrue(node.Execute(closure, context));
+}
+
+ObjectHolder Or::Execute(Closure& closure, Context& context) {
+    return ObjectHolder::Own(runtime::Bool{EvaluateCondition(closure, context)});
+}
+
+bool Or::EvaluateCondition(Closure& closure, Context& context) {
+    return lhs_condition_.Evaluate(*lhs_, closure, context) || rhs_condition_.Evaluate(*rhs_, closure, context);
 }
 
 ObjectHolder And::Execute(Closure& closure, Context& context) {
-    const auto True = runtime::ObjectHolder::Own(runtime::Bool{true});
-    const auto False = runtime::ObjectHolder::Own(runtime::Bool{false});
-    
-    auto lhs_obj_holder = lhs_->Execute(closure, context);
-    if(runtime::IsTrue(lhs_obj_holder)) {
-        auto rhs_obj_holder = rhs_->Execute(closure, context);
-        return runtime::IsTrue(rhs_obj_holder) ? True : False;
-    }
-    return False;
+    return ObjectHolder::Own(runtime::Bool{EvaluateCondition(closure, context)});
+}
+
+bool And::EvaluateCondition(Closure& closure, Context& context) {
+    return lhs_condition_.Evaluate(*lhs_, closure, context) && rhs_condition_.Evaluate(*rhs_, closure, context);
 }
 
 ObjectHolder Not::Execute(Closure& closure, Context& context) {
-    const auto True = runtime::ObjectHolder::Own(runtime::Bool{true});
-    const auto False = runtime::ObjectHolder::Own(runtime::Bool{false});
-    
-    return runtime::IsTrue(arg_->Execute(closure, context)) ? False : True;
+    return ObjectHolder::Own(runtime::Bool{EvaluateCondition(closure, context)});
+}
+
+bool Not::EvaluateCondition(Closure& closure, Context& context) {
+    return !argument_condition_.Evaluate(*arg_, closure, context);
 }
 
 ObjectHolder Compound::Execute(Closure& closure, Context& context) {
@@ -311,6 +562,27 @@ ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
     return runtime::ObjectHolder::None();
 }
 
+LazyMethodBody::LazyMethodBody(Compiler compile)
+    : compile_(std::move(compile))
+{
+    deferred_bodies_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+ObjectHolder LazyMethodBody::Execute(Closure& closure, Context& context) {
+    return Compile().Execute(closure, context);
+}
+
+Statement& LazyMethodBody::Compile() {
+    //runs calling the method for the first time at once wait for the one that builds the body
+    std::call_once(compiled_, [this] {
+        body_ = compile_();
+        //the saved tokens are not needed any more
+        compile_ = nullptr;
+        compiled_bodies_count.fetch_add(1, std::memory_order_relaxed);
+    });
+    return *body_;
+}
+
 ObjectHolder Return::Execute(Closure& closure, Context& context) {
     auto result = statement_->Execute(closure, context);
     if(result) {
@@ -339,7 +611,7 @@ IfElse::IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement>
 }
 
 ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
-    if(runtime::IsTrue(condition_->Execute(closure, context))) {
+    if(condition_cache_.Evaluate(*condition_, closure, context)) {
         return if_body_->Execute(closure, context);
     }
     else if(else_body_) {
@@ -351,14 +623,272 @@ ObjectHolder IfElse::Execute(Closure& closure, Context& context) {
 Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
     : BinaryOperation(std::move(lhs), std::move(rhs))
     , cmp_(cmp)
+    , kind_(Kind::CUSTOM)
 {
+    using ComparatorFn = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+    if(auto fn_ptr = cmp_.target<ComparatorFn>()) {
+        const std::pair<ComparatorFn, Kind> kinds[] = {
+            {runtime::Equal, Kind::EQUAL},
+            {runtime::NotEqual, Kind::NOT_EQUAL},
+            {runtime::Less, Kind::LESS},
+            {runtime::Greater, Kind::GREATER},
+            {runtime::LessOrEqual, Kind::LESS_OR_EQUAL},
+            {runtime::GreaterOrEqual, Kind::GREATER_OR_EQUAL},
+        };
+        for(const auto& [fn, kind] : kinds) {
+            if(*fn_ptr == fn) {
+                kind_ = kind;
+            }
+        }
+    }
+    if(kind_ == Kind::CUSTOM) {
+        //values are compared by an arbitrary function, nothing to specialize
+        specialization_.Disable();
+    }
+}
+
+template <typename T>
+bool Comparison::CompareValues(const T& lhs, const T& rhs) const {
+    switch(kind_) {
+        case Kind::EQUAL:
+            return lhs == rhs;
+        case Kind::NOT_EQUAL:
+            return lhs != rhs;
+        case Kind::LESS:
+            return lhs < rhs;
+        case Kind::GREATER:
+            return lhs > rhs;
+        case Kind::LESS_OR_EQUAL:
+            return lhs <= rhs;
+        case Kind::GREATER_OR_EQUAL:
+            return lhs >= rhs;
+        case Kind::CUSTOM:
+            break;
+    }
+    throw std::logic_error("custom comparator cannot be specialized"s);
 }
 
 ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
-    const auto True = runtime::ObjectHolder::Own(runtime::Bool{true});
-    const auto False = runtime::ObjectHolder::Own(runtime::Bool{false});
-    
-    return cmp_(lhs_->Execute(closure, context), rhs_->Execute(closure, context), context) ? True : False;
+    return ObjectHolder::Own(runtime::Bool{EvaluateCondition(closure, context)});
+}
+
+bool Comparison::EvaluateCondition(Closure& closure, Context& context) {
+    auto lhs_obj_holder = lhs_->Execute(closure, context);
+    auto rhs_obj_holder = rhs_->Execute(closure, context);
+    switch(specialization_.GetState()) {
+        case OperandTypes::NUMBERS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::Number>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::Number>();
+            if(lhs && rhs) {
+                return CompareValues(lhs->GetValue(), rhs->GetValue());
+            }
+            specialization_.Deoptimize();
+            break;
+        }
+        case OperandTypes::STRINGS: {
+            auto lhs = lhs_obj_holder.TryAsExact<runtime::String>();
+            auto rhs = rhs_obj_holder.TryAsExact<runtime::String>();
+            if(lhs && rhs) {
+                return CompareValues(lhs->GetValue(), rhs->GetValue());
+            }
+            specialization_.Deoptimize();
+            break;
+        }
+        case OperandTypes::GENERIC:
+            return cmp_(lhs_obj_holder, rhs_obj_holder, context);
+        case OperandTypes::UNINITIALIZED:
+            break;
+    }
+    specialization_.Observe(ClassifyOperands(lhs_obj_holder, rhs_obj_holder));
+    return cmp_(lhs_obj_holder, rhs_obj_holder, context);
+}
+
+namespace {
+
+//the optimizer has proven the type of the value, so it is not checked
+template <typename T>
+const T& Unchecked(const ObjectHolder& object) {
+    assert(object.TryAsExact<T>());
+    return *static_cast<const T*>(object.Get());
+}
+
+}  // namespace
+
+int NumberOperands::EvaluateOperand(Statement& operand, IntExpression* unboxed,
+                                    Closure& closure, Context& context) {
+    if(unboxed) {
+        return unboxed->EvaluateInt(closure, context);
+    }
+    return Unchecked<runtime::Number>(operand.Execute(closure, context)).GetValue();
+}
+
+ObjectHolder NumberAdd::Execute(Closure& closure, Context& context) {
+    return ObjectHolder::Own(runtime::Number{EvaluateInt(closure, context)});
+}
+
+int NumberAdd::EvaluateInt(Closure& closure, Context& context) {
+    const int lhs = EvaluateOperand(*lhs_, lhs_int_, closure, context);
+    const int rhs = EvaluateOperand(*rhs_, rhs_int_, closure, context);
+    return lhs + rhs;
+}
+
+ObjectHolder StringAdd::Execute(Closure& closure, Context& context) {
+    auto lhs = lhs_->Execute(closure, context);
+    auto rhs = rhs_->Execute(closure, context);
+    return ObjectHolder::Own(runtime::String{Unchecked<runtime::String>(lhs).GetValue()
+                                             + Unchecked<runtime::String>(rhs).GetValue()});
+}
+
+ObjectHolder NumberSub::Execute(Closure& closure, Context& context) {
+    return ObjectHolder::Own(runtime::Number{EvaluateInt(closure, context)});
+}
+
+int NumberSub::EvaluateInt(Closure& closure, Context& context) {
+    const int lhs = EvaluateOperand(*lhs_, lhs_int_, closure, context);
+    const int rhs = EvaluateOperand(*rhs_, rhs_int_, closure, context);
+    return lhs - rhs;
+}
+
+ObjectHolder NumberMult::Execute(Closure& closure, Context& context) {
+    return ObjectHolder::Own(runtime::Number{EvaluateInt(closure, context)});
+}
+
+int NumberMult::EvaluateInt(Closure& closure, Context& context) {
+    const int lhs = EvaluateOperand(*lhs_, lhs_int_, closure, context);
+    const int rhs = EvaluateOperand(*rhs_, rhs_int_, closure, context);
+    return lhs * rhs;
+}
+
+ObjectHolder NumberDiv::Execute(Closure& closure, Context& context) {
+    return ObjectHolder::Own(runtime::Number{EvaluateInt(closure, context)});
+}
+
+int NumberDiv::EvaluateInt(Closure& closure, Context& context) {
+    const int lhs = EvaluateOperand(*lhs_, lhs_int_, closure, context);
+    const int rhs = EvaluateOperand(*rhs_, rhs_int_, closure, context);
+    if(rhs == 0) {
+        //let runtime report the error the same way as for boxed numbers
+        runtime::Div(ObjectHolder::Own(runtime::Number{lhs}), ObjectHolder::Own(runtime::Number{rhs}));
+    }
+    return lhs / rhs;
+}
+
+bool NumberComparison::EvaluateCondition(Closure& closure, Context& context) {
+    const int lhs = EvaluateOperand(*lhs_, lhs_int_, closure, context);
+    const int rhs = EvaluateOperand(*rhs_, rhs_int_, closure, context);
+    return CompareValues(lhs, rhs);
+}
+
+bool StringComparison::EvaluateCondition(Closure& closure, Context& context) {
+    auto lhs = lhs_->Execute(closure, context);
+    auto rhs = rhs_->Execute(closure, context);
+    return CompareValues(Unchecked<runtime::String>(lhs).GetValue(), Unchecked<runtime::String>(rhs).GetValue());
+}
+
+namespace {
+
+//casts node to T keeping its constness
+template <typename T, typename Node>
+auto* As(Node& node) {
+    return dynamic_cast<std::conditional_t<std::is_const_v<Node>, const T, T>*>(&node);
+}
+
+template <typename Node, typename Visit>
+void ForEachChildImpl(Node& node, Visit&& visit) {
+    auto visit_all = [&visit](auto& children) {
+        for(auto& child : children) {
+            visit(child);
+        }
+    };
+    if(auto compound = As<Compound>(node)) {
+        visit_all(compound->Statements());
+    }
+    else if(auto assignment = As<Assignment>(node)) {
+        visit(assignment->Value());
+    }
+    else if(auto field_assignment = As<FieldAssignment>(node)) {
+        visit(field_assignment->Value());
+    }
+    else if(auto new_instance = As<NewInstance>(node)) {
+        visit_all(new_instance->Args());
+    }
+    else if(auto print = As<Print>(node)) {
+        visit_all(print->Args());
+    }
+    else if(auto call = As<MethodCall>(node)) {
+        visit(call->Object());
+        visit_all(call->Args());
+    }
+    else if(auto inlined = As<InlinedMethodCall>(node)) {
+        visit(inlined->GetCall().Object());
+        visit_all(inlined->GetCall().Args());
+        visit(inlined->Body());
+    }
+    else if(auto unary = As<UnaryOperation>(node)) {
+        visit(unary->Argument());
+    }
+    else if(auto binary = As<BinaryOperation>(node)) {
+        visit(binary->Lhs());
+        visit(binary->Rhs());
+    }
+    else if(auto body = As<MethodBody>(node)) {
+        visit(body->Body());
+    }
+    else if(auto lazy = As<LazyMethodBody>(node)) {
+        if(lazy->Body()) {
+            visit(lazy->Body());
+        }
+    }
+    else if(auto ret = As<Return>(node)) {
+        visit(ret->Value());
+    }
+    else if(auto if_else = As<IfElse>(node)) {
+        visit(if_else->Condition());
+        visit(if_else->IfBody());
+        if(if_else->ElseBody()) {
+            visit(if_else->ElseBody());
+        }
+    }
+}
+
+}  // namespace
+
+void ForEachChild(Statement& node, const std::function<void(std::unique_ptr<Statement>&)>& visit) {
+    ForEachChildImpl(node, visit);
+}
+
+void ForEachChild(const Statement& node, const std::function<void(const Statement&)>& visit) {
+    //the children are only read, never replaced
+    ForEachChildImpl(node, [&visit](const std::unique_ptr<Statement>& child) {
+        visit(*child);
+    });
+}
+
+void CollectAssignedVariables(const Statement& body, std::vector<std::string>& names) {
+    if(auto compound = dynamic_cast<const Compound*>(&body)) {
+        for(const auto& stmt : compound->Statements()) {
+            CollectAssignedVariables(*stmt, names);
+        }
+    }
+    else if(auto assignment = dynamic_cast<const Assignment*>(&body)) {
+        names.push_back(assignment->GetName());
+    }
+    else if(auto definition = dynamic_cast<const ClassDefinition*>(&body)) {
+        names.push_back(definition->GetClass().GetName());
+    }
+    else if(auto if_else = dynamic_cast<const IfElse*>(&body)) {
+        CollectAssignedVariables(*if_else->IfBody(), names);
+        if(if_else->ElseBody()) {
+            CollectAssignedVariables(*if_else->ElseBody(), names);
+        }
+    }
+    else if(auto method_body = dynamic_cast<const MethodBody*>(&body)) {
+        CollectAssignedVariables(*method_body->Body(), names);
+    }
+}
+
+Statement* GetMethodBody(const runtime::Method& method) {
+    return dynamic_cast<Statement*>(method.body.get());
 }
 
 }  // namespace ast
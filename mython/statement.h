@@ -1,36 +1,135 @@
 #pragma once
 
+#include "node_arena.h"
 #include "runtime.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <functional>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
 namespace ast {
 
-using Statement = runtime::Executable;
+// Узел синтаксического дерева программы.
+// Узлы дерева запоминают при выполнении результаты проверок, специализации операций и кэши
+// вызовов, а тела методов строятся при первом вызове. Это состояние сохраняется между
+// выполнениями и обновляется атомарно, поэтому одно дерево могут выполнять одновременно
+// несколько потоков, каждый со своими Closure и Context
+class Statement : public runtime::Executable {
+public:
+    // Размещают узел в текущей арене узлов потока (NodeArena), если она есть, иначе в куче
+    static void* operator new(size_t size);
+    static void operator delete(void* node) noexcept;
+};
+
+// Потомки узла. Массивы, созданные при разборе программы, размещаются в её арене узлов
+using StatementList = std::vector<std::unique_ptr<Statement>, NodeArenaAllocator<std::unique_ptr<Statement>>>;
+
+// Положение узла в исходном тексте программы. Нулевая строка означает, что положение неизвестно
+struct SourceLocation {
+    size_t line = 0;
+    size_t column = 0;
+};
+
+// Выражение, значение которого можно получить как условие. EvaluateCondition возвращает то же,
+// что runtime::IsTrue от значения выражения, но не размещает в куче объект runtime::Bool
+class ConditionExpression {
+public:
+    virtual ~ConditionExpression() = default;
+
+    virtual bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) = 0;
+};
+
+// Вычисляет условие, заданное узлом: через EvaluateCondition, если узел его поддерживает,
+// иначе через Execute и runtime::IsTrue. Результат проверки узла запоминается при первом
+// вычислении, поэтому узел нельзя заменять, после того как программа начала выполняться
+class ConditionCache {
+public:
+    bool Evaluate(Statement& node, runtime::Closure& closure, runtime::Context& context);
+
+private:
+    // expression_ записывается раньше node_, поэтому поток, увидевший node_, видит и expression_
+    std::atomic<const Statement*> node_{nullptr};
+    std::atomic<ConditionExpression*> expression_{nullptr};
+};
 
 // Выражение, возвращающее значение типа T,
 // используется как основа для создания констант
 template <typename T>
-class ValueStatement : public Statement {
+class ValueStatement : public Statement, public ConditionExpression {
 public:
     explicit ValueStatement(T v)
-        : value_(std::move(v)) {
+        : ValueStatement(runtime::ObjectHolder::Own(std::move(v))) {
+    }
+
+    // Константа, разделяющая объект с другими узлами, например полученный из ConstantPool.
+    // object должен хранить значение типа T
+    explicit ValueStatement(runtime::ObjectHolder object)
+        : object_(std::move(object))
+        , is_true_(runtime::IsTrue(object_)) {
     }
 
     runtime::ObjectHolder Execute(runtime::Closure& /*closure*/,
                                   runtime::Context& /*context*/) override {
-        return runtime::ObjectHolder::Share(value_);
+        return object_;
+    }
+
+    bool EvaluateCondition(runtime::Closure& /*closure*/, runtime::Context& /*context*/) override {
+        return is_true_;
+    }
+
+    [[nodiscard]] const T& GetValue() const {
+        return static_cast<const T&>(*object_);
+    }
+
+    // Объект со значением константы. Все выполнения узла возвращают этот же объект
+    [[nodiscard]] const runtime::ObjectHolder& GetObject() const {
+        return object_;
     }
 
 private:
-    T value_;
+    runtime::ObjectHolder object_;
+    bool is_true_;
 };
 
 using NumericConst = ValueStatement<runtime::Number>;
 using StringConst = ValueStatement<runtime::String>;
 using BoolConst = ValueStatement<runtime::Bool>;
 
+/*
+Пул констант программы. Литералы с одинаковым значением получают из пула один и тот же
+объект, поэтому повторяющаяся в тексте константа занимает память один раз. Объекты пула не
+изменяются и живут, пока на них ссылается хотя бы один узел, в том числе после удаления пула
+*/
+class ConstantPool {
+public:
+    // Возвращают узел-константу со значением value
+    std::unique_ptr<NumericConst> MakeNumber(int value);
+    std::unique_ptr<StringConst> MakeString(std::string value);
+    std::unique_ptr<BoolConst> MakeBool(bool value);
+
+    // Количество различных констант в пуле
+    [[nodiscard]] size_t GetSize() const {
+        return numbers_.size() + strings_.size() + bools_.size();
+    }
+
+    // Забывает все константы. Узлы, уже получившие объекты, продолжают их разделять
+    void Clear();
+
+private:
+    template <typename T, typename Key>
+    static std::unique_ptr<ValueStatement<T>> Intern(std::unordered_map<Key, runtime::ObjectHolder>& objects,
+                                                     Key value);
+
+    std::unordered_map<int, runtime::ObjectHolder> numbers_;
+    std::unordered_map<std::string, runtime::ObjectHolder> strings_;
+    std::unordered_map<bool, runtime::ObjectHolder> bools_;
+};
+
 /*
 Вычисляет значение переменной либо цепочки вызовов полей объектов id1.id2.id3.
 Например, выражение circle.center.x - цепочка вызовов полей объектов в инструкции:
@@ -42,6 +141,9 @@ public:
     explicit VariableValue(std::vector<std::string> dotted_ids);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, [[maybe_unused]] runtime::Context& context) override;
+
+    // Возвращает цепочку имён id1.id2.id3 в виде списка
+    [[nodiscard]] std::vector<std::string> GetDottedIds() const;
 private:
     std::string head_;
     std::vector<std::string> body_{};
@@ -54,6 +156,16 @@ public:
     Assignment(std::string var, std::unique_ptr<Statement> rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const std::string& GetName() const {
+        return name_;
+    }
+    std::unique_ptr<Statement>& Value() {
+        return data_ptr_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Value() const {
+        return data_ptr_;
+    }
 private:
     std::string name_;
     std::unique_ptr<Statement> data_ptr_;
@@ -65,6 +177,19 @@ public:
     FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const VariableValue& Object() const {
+        return object_;
+    }
+    [[nodiscard]] const std::string& GetFieldName() const {
+        return field_name_;
+    }
+    std::unique_ptr<Statement>& Value() {
+        return data_ptr_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Value() const {
+        return data_ptr_;
+    }
 private:
     VariableValue object_;
     std::string field_name_;
@@ -88,21 +213,97 @@ p.set_name("Ivan")
 class NewInstance : public Statement {
 public:
     explicit NewInstance(const runtime::Class& class_);
-    NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
-    // Возвращает объект, содержащий значение типа ClassInstance
+    NewInstance(const runtime::Class& class_, StatementList args);
+    // Возвращает новый при каждом выполнении объект, содержащий значение типа ClassInstance
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const runtime::Class& GetClass() const {
+        return class_;
+    }
+    StatementList& Args() {
+        return args_;
+    }
+    [[nodiscard]] const StatementList& Args() const {
+        return args_;
+    }
 private:
-    runtime::ObjectHolder instance_holder_;
-    std::vector<std::unique_ptr<Statement>> args_;
+    const runtime::Class& class_;
+    StatementList args_;
 };
 
 // Значение None
-class None : public Statement {
+class None : public Statement, public ConditionExpression {
 public:
     runtime::ObjectHolder Execute([[maybe_unused]] runtime::Closure& closure,
                                   [[maybe_unused]] runtime::Context& context) override {
         return {};
     }
+
+    bool EvaluateCondition([[maybe_unused]] runtime::Closure& closure,
+                           [[maybe_unused]] runtime::Context& context) override {
+        return false;
+    }
+};
+
+// Счётчики самоспециализации узлов, общие для всех синтаксических деревьев
+struct SpecializationStats {
+    // Сколько раз узлы переходили к специализированному варианту
+    size_t specializations = 0;
+    // Сколько раз у специализированного варианта не выполнялось охранное условие
+    size_t deoptimizations = 0;
+};
+
+SpecializationStats GetSpecializationStats();
+void ResetSpecializationStats();
+
+// Типы операндов, под которые специализирован узел.
+// GENERIC означает, что узел выполняет общий вариант операции
+enum class OperandTypes : uint8_t {
+    UNINITIALIZED,
+    NUMBERS,
+    STRINGS,
+    GENERIC,
+};
+
+// Возвращает NUMBERS, если оба операнда - числа, STRINGS, если оба - строки, иначе GENERIC
+OperandTypes ClassifyOperands(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs);
+
+/*
+Состояние самоспециализирующегося узла.
+Пока узел не специализирован, он выполняет общий вариант операции и запоминает типы операндов.
+Если SPECIALIZE_AFTER выполнений подряд увидели одинаковые типы, узел переходит к
+специализированному варианту. Когда охранное условие специализированного варианта нарушается,
+узел деоптимизируется: возвращается к общему варианту и может специализироваться заново.
+После MAX_DEOPTIMIZATIONS деоптимизаций, а также если операнды не подходят ни под один
+специализированный вариант, узел навсегда остаётся в состоянии GENERIC.
+Если узел одновременно выполняют несколько потоков, часть наблюдений может потеряться, а узел
+специализироваться под типы, увиденные одним из них. Это безопасно: охранные условия
+специализированного варианта проверяются при каждом выполнении
+*/
+class Specialization {
+public:
+    static constexpr uint8_t SPECIALIZE_AFTER = 2;
+    static constexpr uint8_t MAX_DEOPTIMIZATIONS = 4;
+
+    [[nodiscard]] OperandTypes GetState() const {
+        return state_.load(std::memory_order_relaxed);
+    }
+
+    // Запоминает типы операндов, увиденные общим вариантом операции
+    void Observe(OperandTypes observed);
+    // Отменяет специализацию после нарушения охранного условия
+    void Deoptimize();
+    // Оставляет узел в состоянии GENERIC
+    void Disable();
+    // Переводит ещё не специализированный узел в состояние state, например по сохранённому профилю.
+    // Охранные условия проверяются как обычно
+    void Preset(OperandTypes state);
+
+private:
+    std::atomic<OperandTypes> state_{OperandTypes::UNINITIALIZED};
+    std::atomic<OperandTypes> last_observed_{OperandTypes::UNINITIALIZED};
+    std::atomic<uint8_t> hits_{0};
+    std::atomic<uint8_t> deoptimizations_{0};
 };
 
 // Команда print
@@ -111,7 +312,7 @@ public:
     // Инициализирует команду print для вывода значения выражения argument
     explicit Print(std::unique_ptr<Statement> argument);
     // Инициализирует команду print для вывода списка значений args
-    explicit Print(std::vector<std::unique_ptr<Statement>> args);
+    explicit Print(StatementList args);
 
     // Инициализирует команду print для вывода значения переменной name
     static std::unique_ptr<Print> Variable(const std::string& name);
@@ -119,21 +320,133 @@ public:
     // Во время выполнения команды print вывод должен осуществляться в поток, возвращаемый из
     // context.GetOutputStream()
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    StatementList& Args() {
+        return data_;
+    }
+    [[nodiscard]] const StatementList& Args() const {
+        return data_;
+    }
 private:
-    std::vector<std::unique_ptr<Statement>> data_;
+    StatementList data_;
 };
 
 // Вызывает метод object.method со списком параметров args
 class MethodCall : public Statement {
 public:
     MethodCall(std::unique_ptr<Statement> object, std::string method,
-               std::vector<std::unique_ptr<Statement>> args);
+               StatementList args);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    // Вызывает метод у уже вычисленного объекта receiver, вычисляя только аргументы вызова
+    runtime::ObjectHolder ExecuteOn(const runtime::ObjectHolder& receiver, runtime::Closure& closure,
+                                    runtime::Context& context);
+
+    std::unique_ptr<Statement>& Object() {
+        return object_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Object() const {
+        return object_;
+    }
+    [[nodiscard]] const std::string& GetMethodName() const {
+        return method_;
+    }
+    StatementList& Args() {
+        return argv_;
+    }
+    [[nodiscard]] const StatementList& Args() const {
+        return argv_;
+    }
+    // Класс объекта, для которого закэширован метод, либо nullptr
+    [[nodiscard]] const runtime::Class* GetCachedClass() const {
+        const CacheEntry* cached = cache_.load(std::memory_order_acquire);
+        return cached ? cached->cls : nullptr;
+    }
+    // Заполняет пустой кэш методом класса cls, как если бы вызов уже выполнялся для его объекта.
+    // Возвращает false, если у класса нет подходящего метода
+    bool PrefillCache(const runtime::Class& cls);
+    // Положение начала выражения, у которого вызывается метод
+    [[nodiscard]] const SourceLocation& GetLocation() const {
+        return location_;
+    }
+    void SetLocation(SourceLocation location) {
+        location_ = location;
+    }
 private:
+    // Метод, найденный для объектов класса cls
+    struct CacheEntry {
+        const runtime::Class* cls = nullptr;
+        const runtime::Method* method = nullptr;
+    };
+
+    // Находит метод у объекта класса cls и запоминает его во встроенном кэше.
+    // Смена закэшированного класса считается деоптимизацией. После
+    // Specialization::MAX_DEOPTIMIZATIONS деоптимизаций кэш больше не заполняется
+    const runtime::Method* ResolveMethod(const runtime::Class& cls);
+
     std::unique_ptr<Statement> object_;
     std::string method_;
-    std::vector<std::unique_ptr<Statement>> argv_;
+    StatementList argv_;
+    // Каждая специализация заполняет свою запись и только затем публикует её в cache_, поэтому
+    // потоки, одновременно выполняющие вызов, всегда видят согласованные класс и метод
+    std::array<CacheEntry, Specialization::MAX_DEOPTIMIZATIONS> cache_entries_;
+    std::atomic<const CacheEntry*> cache_{nullptr};
+    std::atomic<size_t> used_entries_{0};
+    SourceLocation location_;
+};
+
+/*
+Вызов метода, тело которого оптимизатор встроил в место вызова.
+Если у объекта, для которого вызывается метод, ему соответствует метод method, то сам объект и
+аргументы вызова записываются в closure под именами bindings (первым идёт self, затем параметры
+в порядке их объявления) и в том же closure вычисляется body. Если returns_value, значение body
+становится значением вызова, иначе body - инструкции метода без return и вызов возвращает None.
+После этого из closure удаляются bindings и имена locals, которым присваивает body.
+Иначе выполняется обычный вызов call для уже вычисленного объекта.
+Имена в bindings и locals не должны совпадать с именами переменных программы
+*/
+class InlinedMethodCall : public Statement {
+public:
+    InlinedMethodCall(std::unique_ptr<MethodCall> call, const runtime::Method& method,
+                      std::vector<std::string> bindings, std::vector<std::string> locals,
+                      std::unique_ptr<Statement> body, bool returns_value);
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const MethodCall& GetCall() const {
+        return *call_;
+    }
+    MethodCall& GetCall() {
+        return *call_;
+    }
+    [[nodiscard]] const runtime::Method& GetMethod() const {
+        return method_;
+    }
+    std::unique_ptr<Statement>& Body() {
+        return body_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Body() const {
+        return body_;
+    }
+    [[nodiscard]] bool ReturnsValue() const {
+        return returns_value_;
+    }
+    // Количество вызовов, для которых выполнялся обычный вызов метода
+    [[nodiscard]] size_t GetFallbackCount() const {
+        return fallbacks_.load(std::memory_order_relaxed);
+    }
+private:
+    // Проверяет, что у объекта класса cls вызывается именно встроенный метод
+    bool Matches(const runtime::Class& cls);
+
+    std::unique_ptr<MethodCall> call_;
+    const runtime::Method& method_;
+    std::vector<std::string> bindings_;
+    std::vector<std::string> locals_;
+    std::unique_ptr<Statement> body_;
+    bool returns_value_;
+    std::atomic<const runtime::Class*> matched_class_{nullptr};
+    std::atomic<size_t> fallbacks_{0};
 };
 
 /*
@@ -157,6 +470,13 @@ public:
         : arg_(std::move(argument))
     {
     }
+
+    std::unique_ptr<Statement>& Argument() {
+        return arg_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Argument() const {
+        return arg_;
+    }
 protected:
     std::unique_ptr<Statement> arg_;
 };
@@ -176,9 +496,38 @@ public:
         , rhs_(std::move(rhs))
     {
     }
+
+    std::unique_ptr<Statement>& Lhs() {
+        return lhs_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Lhs() const {
+        return lhs_;
+    }
+    std::unique_ptr<Statement>& Rhs() {
+        return rhs_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Rhs() const {
+        return rhs_;
+    }
+    [[nodiscard]] const Specialization& GetSpecialization() const {
+        return specialization_;
+    }
+    Specialization& GetSpecialization() {
+        return specialization_;
+    }
+    // Положение знака операции
+    [[nodiscard]] const SourceLocation& GetLocation() const {
+        return location_;
+    }
+    void SetLocation(SourceLocation location) {
+        location_ = location;
+    }
 protected:
     std::unique_ptr<Statement> lhs_;
     std::unique_ptr<Statement> rhs_;
+    SourceLocation location_;
+    // Используется арифметическими операциями и сравнениями
+    Specialization specialization_;
 };
 
 // Возвращает результат операции + над аргументами lhs и rhs
@@ -229,32 +578,43 @@ public:
 };
 
 // Возвращает результат вычисления логической операции or над lhs и rhs
-class Or : public BinaryOperation {
+class Or : public BinaryOperation, public ConditionExpression {
 public:
     using BinaryOperation::BinaryOperation;
     // Значение аргумента rhs вычисляется, только если значение lhs
     // после приведения к Bool равно False
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) override;
+private:
+    ConditionCache lhs_condition_;
+    ConditionCache rhs_condition_;
 };
 
 // Возвращает результат вычисления логической операции and над lhs и rhs
-class And : public BinaryOperation {
+class And : public BinaryOperation, public ConditionExpression {
 public:
     using BinaryOperation::BinaryOperation;
     // Значение аргумента rhs вычисляется, только если значение lhs
     // после приведения к Bool равно True
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) override;
+private:
+    ConditionCache lhs_condition_;
+    ConditionCache rhs_condition_;
 };
 
 // Возвращает результат вычисления логической операции not над единственным аргументом операции
-class Not : public UnaryOperation {
+class Not : public UnaryOperation, public ConditionExpression {
 public:
     using UnaryOperation::UnaryOperation;
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) override;
+private:
+    ConditionCache argument_condition_;
 };
 
 template<typename T, typename... Args>
-void VariadicUnpack(std::vector<std::unique_ptr<Statement>>& container, T&& head, Args&&... args) {
+void VariadicUnpack(StatementList& container, T&& head, Args&&... args) {
     container.emplace_back(std::forward<T>(head));
     if constexpr (sizeof...(args) > 0u) {
         VariadicUnpack(container, std::forward<Args>(args)...);
@@ -280,8 +640,15 @@ public:
 
     // Последовательно выполняет добавленные инструкции. Возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    StatementList& Statements() {
+        return argv_;
+    }
+    [[nodiscard]] const StatementList& Statements() const {
+        return argv_;
+    }
 private:
-    std::vector<std::unique_ptr<Statement>> argv_;
+    StatementList argv_;
 };
 
 // Тело метода. Как правило, содержит составную инструкцию
@@ -293,10 +660,60 @@ public:
     // Если внутри body была выполнена инструкция return, возвращает результат return
     // В противном случае возвращает None
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    std::unique_ptr<Statement>& Body() {
+        return arg_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Body() const {
+        return arg_;
+    }
 private:
     std::unique_ptr<Statement> arg_;
 };
 
+/*
+Тело метода, синтаксическое дерево которого строится при первом выполнении, то есть при первом
+вызове метода через runtime::ClassInstance::Call. До этого хранится только функция compile,
+которая строит дерево, как правило MethodBody, из сохранённых при разборе токенов тела.
+Ошибки, найденные при построении дерева, выбрасываются из Execute. Если метод впервые вызывают
+одновременно несколько потоков, дерево строит один из них, а остальные ждут его
+*/
+class LazyMethodBody : public Statement {
+public:
+    using Compiler = std::function<std::unique_ptr<Statement>()>;
+
+    explicit LazyMethodBody(Compiler compile);
+
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    // Строит дерево тела, если оно ещё не построено, и возвращает его
+    Statement& Compile();
+
+    // Построенное дерево тела либо nullptr
+    std::unique_ptr<Statement>& Body() {
+        return body_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Body() const {
+        return body_;
+    }
+
+private:
+    Compiler compile_;
+    std::unique_ptr<Statement> body_;
+    std::once_flag compiled_;
+};
+
+// Счётчики отложенного построения тел методов, общие для всех синтаксических деревьев
+struct LazyCompilationStats {
+    // Сколько тел методов отложено до первого вызова
+    size_t deferred = 0;
+    // Сколько из них построено
+    size_t compiled = 0;
+};
+
+LazyCompilationStats GetLazyCompilationStats();
+void ResetLazyCompilationStats();
+
 // Выполняет инструкцию return с выражением statement
 class Return : public Statement {
 public:
@@ -308,6 +725,13 @@ public:
     // Останавливает выполнение текущего метода. После выполнения инструкции return метод,
     // внутри которого она была исполнена, должен вернуть результат вычисления выражения statement.
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    std::unique_ptr<Statement>& Value() {
+        return statement_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Value() const {
+        return statement_;
+    }
 private:
     std::unique_ptr<Statement> statement_;
 };
@@ -321,6 +745,10 @@ public:
     // Создаёт внутри closure новый объект, совпадающий с именем класса и значением, переданным в
     // конструктор
     runtime::ObjectHolder Execute(runtime::Closure& closure, [[maybe_unused]] runtime::Context& context) override;
+
+    [[nodiscard]] const runtime::Class& GetClass() const {
+        return static_cast<const runtime::Class&>(*class_);
+    }
 private:
     runtime::ObjectHolder class_;
 };
@@ -333,14 +761,35 @@ public:
            std::unique_ptr<Statement> else_body);
 
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+
+    std::unique_ptr<Statement>& Condition() {
+        return condition_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& Condition() const {
+        return condition_;
+    }
+    std::unique_ptr<Statement>& IfBody() {
+        return if_body_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& IfBody() const {
+        return if_body_;
+    }
+    // Может вернуть nullptr, если ветка else отсутствует
+    std::unique_ptr<Statement>& ElseBody() {
+        return else_body_;
+    }
+    [[nodiscard]] const std::unique_ptr<Statement>& ElseBody() const {
+        return else_body_;
+    }
 private:
     std::unique_ptr<Statement> condition_;
     std::unique_ptr<Statement> if_body_;
     std::unique_ptr<Statement> else_body_;
+    ConditionCache condition_cache_;
 };
 
 // Операция сравнения
-class Comparison : public BinaryOperation {
+class Comparison : public BinaryOperation, public ConditionExpression {
 public:
     // Comparator задаёт функцию, выполняющую сравнение значений аргументов
     using Comparator = std::function<bool(const runtime::ObjectHolder&,
@@ -349,10 +798,145 @@ public:
     Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
 
     // Вычисляет значение выражений lhs и rhs и возвращает результат работы comparator,
-    // приведённый к типу runtime::Bool
+    // приведённый к типу runtime::Bool.
+    // Если comparator - одна из функций сравнения runtime, узел специализируется
+    // под сравнение чисел либо строк
     runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    // Возвращает результат работы comparator без создания объекта runtime::Bool
+    bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) override;
+
+    [[nodiscard]] const Comparator& GetComparator() const {
+        return cmp_;
+    }
+    // Возвращает true, если comparator - одна из функций сравнения runtime
+    [[nodiscard]] bool HasBuiltinComparator() const {
+        return kind_ != Kind::CUSTOM;
+    }
+protected:
+    // Сравнивает значения встроенным способом. Нельзя вызывать для произвольного comparator
+    template <typename T>
+    [[nodiscard]] bool CompareValues(const T& lhs, const T& rhs) const;
+
 private:
+    enum class Kind : uint8_t {
+        EQUAL,
+        NOT_EQUAL,
+        LESS,
+        GREATER,
+        LESS_OR_EQUAL,
+        GREATER_OR_EQUAL,
+        CUSTOM,
+    };
+
     Comparator cmp_;
+    Kind kind_;
 };
 
+/*
+Варианты операций для аргументов, типы которых выведены оптимизатором (optimizer::MakeTypeSpecialization).
+Типы значений аргументов не проверяются, поэтому такой узел можно создать, только если доказано,
+что оба аргумента всегда вычисляются в объекты указанного типа. Для остальных механизмов
+исполнения они неотличимы от базовых операций
+*/
+
+// Выражение, значение которого - число. Операция, потребляющая это значение сразу,
+// может получить его через EvaluateInt, не размещая в куче объект runtime::Number
+class IntExpression {
+public:
+    virtual ~IntExpression() = default;
+
+    virtual int EvaluateInt(runtime::Closure& closure, runtime::Context& context) = 0;
+};
+
+/*
+Числовые аргументы операции. Если аргумент - IntExpression, значение которого не покидает
+операцию (это устанавливает оптимизатор, optimizer::MakeEscapeAnalysis), оно вычисляется через
+EvaluateInt, иначе - через Execute. Заданные указатели действительны, пока аргументы не заменены
+*/
+class NumberOperands {
+public:
+    void SetUnboxedOperands(IntExpression* lhs, IntExpression* rhs) {
+        lhs_int_ = lhs;
+        rhs_int_ = rhs;
+    }
+    [[nodiscard]] bool HasUnboxedOperands() const {
+        return lhs_int_ || rhs_int_;
+    }
+
+protected:
+    static int EvaluateOperand(Statement& operand, IntExpression* unboxed,
+                               runtime::Closure& closure, runtime::Context& context);
+
+    IntExpression* lhs_int_ = nullptr;
+    IntExpression* rhs_int_ = nullptr;
+};
+
+// Сложение чисел
+class NumberAdd : public Add, public NumberOperands, public IntExpression {
+public:
+    using Add::Add;
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    int EvaluateInt(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Конкатенация строк
+class StringAdd : public Add {
+public:
+    using Add::Add;
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Вычитание чисел
+class NumberSub : public Sub, public NumberOperands, public IntExpression {
+public:
+    using Sub::Sub;
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    int EvaluateInt(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Умножение чисел
+class NumberMult : public Mult, public NumberOperands, public IntExpression {
+public:
+    using Mult::Mult;
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    int EvaluateInt(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Деление чисел. Деление на ноль, как и в Div, приводит к выбрасыванию исключения runtime_error
+class NumberDiv : public Div, public NumberOperands, public IntExpression {
+public:
+    using Div::Div;
+    runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+    int EvaluateInt(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Сравнение чисел. Comparator должен быть одной из функций сравнения runtime
+class NumberComparison : public Comparison, public NumberOperands {
+public:
+    using Comparison::Comparison;
+    bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Сравнение строк. Comparator должен быть одной из функций сравнения runtime
+class StringComparison : public Comparison {
+public:
+    using Comparison::Comparison;
+    bool EvaluateCondition(runtime::Closure& closure, runtime::Context& context) override;
+};
+
+// Вызывает visit для каждого непосредственного потомка node. Потомок передаётся по ссылке
+// на владеющий им указатель, поэтому visit может заменить его другим узлом.
+// Тела методов класса, объявленного в ClassDefinition, потомками не считаются.
+// Потомок LazyMethodBody - дерево тела, если оно уже построено
+void ForEachChild(Statement& node, const std::function<void(std::unique_ptr<Statement>&)>& visit);
+void ForEachChild(const Statement& node, const std::function<void(const Statement&)>& visit);
+
+// Возвращает тело метода, если оно - узел синтаксического дерева, иначе nullptr
+// (например, для тела, написанного на C++)
+Statement* GetMethodBody(const runtime::Method& method);
+
+// Добавляет в names имена переменных, которым присваиваются значения внутри body,
+// а также имена объявленных в нём классов. Тела методов не просматриваются
+void CollectAssignedVariables(const Statement& body, std::vector<std::string>& names);
+
 }  // namespace ast
@@ -161,7 +161,7 @@ void TestPrintMultipleStatements() {
     runtime::String hello("hello"s);
     Closure closure = {{"word"s, ObjectHolder::Share(hello)}, {"empty"s, ObjectHolder::None()}};
 
-    vector<unique_ptr<Statement>> args;
+    StatementList args;
     args.push_back(make_unique<VariableValue>("word"s));
     args.push_back(make_unique<NumericConst>(57));
     args.push_back(make_unique<StringConst>("Python"s));
@@ -287,6 +287,90 @@ void TestClassInstanceAddWithoutMethod() {
     ASSERT(context.output.str().empty());
 }
 
+void TestSelfSpecialization() {
+    runtime::DummyContext context;
+    ResetSpecializationStats();
+
+    Closure closure;
+    Add sum(make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    ASSERT(sum.GetSpecialization().GetState() == OperandTypes::UNINITIALIZED);
+
+    closure["x"s] = ObjectHolder::Own(runtime::Number(2));
+    closure["y"s] = ObjectHolder::Own(runtime::Number(3));
+    for(int i = 0; i < Specialization::SPECIALIZE_AFTER; ++i) {
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+    }
+    ASSERT(sum.GetSpecialization().GetState() == OperandTypes::NUMBERS);
+    ASSERT_EQUAL(GetSpecializationStats().specializations, 1u);
+
+    //the guard fails, the node falls back to the generic variant and respecializes
+    closure["x"s] = ObjectHolder::Own(runtime::String("2"s));
+    closure["y"s] = ObjectHolder::Own(runtime::String("3"s));
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "23"s);
+    ASSERT(sum.GetSpecialization().GetState() == OperandTypes::UNINITIALIZED);
+    ASSERT_EQUAL(GetSpecializationStats().deoptimizations, 1u);
+    ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "23"s);
+    ASSERT(sum.GetSpecialization().GetState() == OperandTypes::STRINGS);
+    ASSERT_EQUAL(GetSpecializationStats().specializations, 2u);
+
+    //a node that keeps changing types stays generic
+    for(int i = 0; i < Specialization::MAX_DEOPTIMIZATIONS; ++i) {
+        closure["x"s] = ObjectHolder::Own(runtime::Number(i));
+        closure["y"s] = ObjectHolder::Own(runtime::Number(1));
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), i + 1);
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), i + 1);
+        closure["x"s] = ObjectHolder::Own(runtime::String("a"s));
+        closure["y"s] = ObjectHolder::Own(runtime::String("b"s));
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "ab"s);
+        ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "ab"s);
+    }
+    ASSERT(sum.GetSpecialization().GetState() == OperandTypes::GENERIC);
+    ASSERT_THROWS(sum.Execute(closure = {}, context), std::runtime_error);
+
+    Comparison less(runtime::Less, make_unique<VariableValue>("x"s), make_unique<VariableValue>("y"s));
+    closure["x"s] = ObjectHolder::Own(runtime::Number(1));
+    closure["y"s] = ObjectHolder::Own(runtime::Number(2));
+    less.Execute(closure, context);
+    less.Execute(closure, context);
+    ASSERT(less.GetSpecialization().GetState() == OperandTypes::NUMBERS);
+    ASSERT(runtime::IsTrue(less.Execute(closure, context)));
+    closure["x"s] = ObjectHolder::Own(runtime::String("b"s));
+    closure["y"s] = ObjectHolder::Own(runtime::String("a"s));
+    ASSERT(!runtime::IsTrue(less.Execute(closure, context)));
+
+    ASSERT(context.output.str().empty());
+}
+
+void TestMethodCallInlineCache() {
+    runtime::DummyContext context;
+    ResetSpecializationStats();
+
+    vector<runtime::Method> base_methods;
+    base_methods.push_back({"value"s, {}, make_unique<MethodBody>(make_unique<Return>(make_unique<NumericConst>(1)))});
+    runtime::Class base("Base"s, std::move(base_methods), nullptr);
+    vector<runtime::Method> derived_methods;
+    derived_methods.push_back({"value"s, {}, make_unique<MethodBody>(make_unique<Return>(make_unique<NumericConst>(2)))});
+    runtime::Class derived("Derived"s, std::move(derived_methods), &base);
+
+    Closure closure;
+    MethodCall call(make_unique<VariableValue>("obj"s), "value"s, {});
+    closure["obj"s] = ObjectHolder::Own(runtime::ClassInstance(base));
+    ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 1);
+    ASSERT(call.GetCachedClass() == &base);
+    ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 1);
+
+    closure["obj"s] = ObjectHolder::Own(runtime::ClassInstance(derived));
+    ASSERT_OBJECT_VALUE_EQUAL(call.Execute(closure, context), 2);
+    ASSERT(call.GetCachedClass() == &derived);
+    ASSERT_EQUAL(GetSpecializationStats().specializations, 2u);
+    ASSERT_EQUAL(GetSpecializationStats().deoptimizations, 1u);
+
+    MethodCall missing(make_unique<VariableValue>("obj"s), "value"s, {});
+    missing.Args().push_back(make_unique<NumericConst>(1));
+    ASSERT_THROWS(missing.Execute(closure, context), std::runtime_error);
+    ASSERT(missing.GetCachedClass() == nullptr);
+}
+
 void TestCompound() {
     runtime::DummyContext context;
 
@@ -453,6 +537,38 @@ void TestNot() {
     test_not(false);
 }
 
+void TestConditionsWithoutAllocations() {
+    runtime::DummyContext context;
+    Closure closure;
+    closure["x"s] = ObjectHolder::Own(runtime::Number(2));
+    closure["s"s] = ObjectHolder::Own(runtime::String("ab"s));
+
+    //not (x < 1 or s == 'ab') and 'text'
+    auto condition = make_unique<And>(
+        make_unique<Not>(make_unique<Or>(
+            make_unique<Comparison>(runtime::Less, make_unique<VariableValue>("x"s), make_unique<NumericConst>(1)),
+            make_unique<Comparison>(runtime::Equal, make_unique<VariableValue>("s"s), make_unique<StringConst>("ab"s)))),
+        make_unique<StringConst>("text"s));
+    auto& condition_ref = *condition;
+    IfElse if_else(std::move(condition), Print::Variable("x"s), Print::Variable("s"s));
+
+    const size_t allocations = ObjectHolder::GetAllocationCount();
+    if_else.Execute(closure, context);
+    ASSERT_EQUAL(ObjectHolder::GetAllocationCount(), allocations);
+    ASSERT_EQUAL(context.output.str(), "ab\n"s);
+
+    //used as a value, the condition is boxed once
+    auto value = condition_ref.Execute(closure, context);
+    ASSERT(value.TryAs<runtime::Bool>() && !value.TryAs<runtime::Bool>()->GetValue());
+    ASSERT_EQUAL(ObjectHolder::GetAllocationCount(), allocations + 1u);
+
+    //the variable is not a condition expression and is converted by IsTrue
+    closure["x"s] = ObjectHolder::Own(runtime::Number(0));
+    IfElse by_value(make_unique<VariableValue>("x"s), Print::Variable("x"s), nullptr);
+    ASSERT(!by_value.Execute(closure, context));
+    ASSERT_EQUAL(context.output.str(), "ab\n"s);
+}
+
 }  // namespace
 
 void RunUnitTests(TestRunner& tr) {
@@ -469,6 +585,8 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestBadAddition);
     RUN_TEST(tr, ast::TestSuccessfulClassInstanceAdd);
     RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
+    RUN_TEST(tr, ast::TestSelfSpecialization);
+    RUN_TEST(tr, ast::TestMethodCallInlineCache);
     RUN_TEST(tr, ast::TestCompound);
     RUN_TEST(tr, ast::TestFields);
     RUN_TEST(tr, ast::TestBaseClass);
@@ -476,6 +594,7 @@ void RunUnitTests(TestRunner& tr) {
     RUN_TEST(tr, ast::TestOr);
     RUN_TEST(tr, ast::TestAnd);
     RUN_TEST(tr, ast::TestNot);
+    RUN_TEST(tr, ast::TestConditionsWithoutAllocations);
 }
 
 }  // namespace ast
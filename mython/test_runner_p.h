@@ -81,8 +81,18 @@ inline void Assert(bool b, const std::string& hint) {
 
 class TestRunner {
 public:
+    TestRunner() = default;
+
+    // Запускает только тесты, в имени которых есть подстрока filter
+    explicit TestRunner(std::string filter)
+        : filter_(std::move(filter)) {
+    }
+
     template <class TestFunc>
     void RunTest(TestFunc func, const std::string& test_name) {
+        if (test_name.find(filter_) == std::string::npos) {
+            return;
+        }
         try {
             func();
             std::cerr << test_name << " OK" << std::endl;
@@ -104,6 +114,7 @@ public:
     }
 
 private:
+    std::string filter_;
     int fail_count = 0;
 };
 
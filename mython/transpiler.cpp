@@ -0,0 +1,538 @@
+#include "transpiler.h"
+
+#include "statement.h"
+
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace transpiler {
+
+namespace {
+
+//helpers shared by every emitted program. Operands are passed in braced lists,
+//which keeps the left-to-right evaluation order of the interpreter
+const char* const PRELUDE = R"(namespace {
+
+using runtime::Context;
+using runtime::ObjectHolder;
+
+class NativeBody : public runtime::Executable {
+public:
+    using Function = ObjectHolder (*)(runtime::Closure&, Context&);
+
+    explicit NativeBody(Function function)
+        : function_(function) {
+    }
+
+    ObjectHolder Execute(runtime::Closure& closure, Context& context) override {
+        return function_(closure, context);
+    }
+
+private:
+    Function function_;
+};
+
+class Variable {
+public:
+    explicit Variable(const char* name)
+        : name_(name) {
+    }
+
+    const ObjectHolder& Get() const {
+        if(!defined_) {
+            throw std::runtime_error(std::string("there is no object: ") + name_);
+        }
+        return value_;
+    }
+
+    const ObjectHolder& Set(ObjectHolder value) {
+        value_ = std::move(value);
+        defined_ = true;
+        return value_;
+    }
+
+private:
+    const char* name_;
+    ObjectHolder value_;
+    bool defined_ = false;
+};
+
+struct Operands {
+    ObjectHolder lhs;
+    ObjectHolder rhs;
+};
+
+using Comparator = bool (*)(const ObjectHolder&, const ObjectHolder&, Context&);
+
+const ObjectHolder TRUE_VALUE = ObjectHolder::Own(runtime::Bool{true});
+const ObjectHolder FALSE_VALUE = ObjectHolder::Own(runtime::Bool{false});
+
+[[maybe_unused]] const ObjectHolder& Bool(bool value) {
+    return value ? TRUE_VALUE : FALSE_VALUE;
+}
+
+[[maybe_unused]] runtime::ClassInstance& AsInstance(const ObjectHolder& object) {
+    auto instance = object.TryAs<runtime::ClassInstance>();
+    if(!instance) {
+        throw std::runtime_error("object is not ClassInstance");
+    }
+    return *instance;
+}
+
+[[maybe_unused]] ObjectHolder GetField(const ObjectHolder& object, const char* name) {
+    auto instance = object.TryAs<runtime::ClassInstance>();
+    if(!instance) {
+        throw std::runtime_error("object is not a ClassInstance");
+    }
+    auto it = instance->Fields().find(name);
+    if(it == instance->Fields().end()) {
+        throw std::runtime_error(std::string("there is no field: ") + name);
+    }
+    return it->second;
+}
+
+[[maybe_unused]] ObjectHolder SetField(const Operands& operands, const char* name) {
+    return AsInstance(operands.lhs).Fields()[name] = operands.rhs;
+}
+
+[[maybe_unused]] ObjectHolder CallMethod(const char* name, const std::vector<ObjectHolder>& values, Context& context) {
+    auto& instance = AsInstance(values.front());
+    std::vector<ObjectHolder> args(values.begin() + 1, values.end());
+    if(!instance.HasMethod(name, args.size())) {
+        throw std::runtime_error(std::string("object has no method: ") + name);
+    }
+    return instance.Call(name, args, context);
+}
+
+[[maybe_unused]] ObjectHolder NewInstance(const runtime::Class& cls, const std::vector<ObjectHolder>& args, Context& context) {
+    auto holder = ObjectHolder::Own(runtime::ClassInstance{cls});
+    auto& instance = *holder.TryAs<runtime::ClassInstance>();
+    if(instance.HasMethod("__init__", args.size())) {
+        instance.Call("__init__", args, context);
+    }
+    return holder;
+}
+
+[[maybe_unused]] ObjectHolder Undefined(const char* name) {
+    throw std::runtime_error(std::string("there is no object: ") + name);
+}
+
+[[maybe_unused]] void Print(const std::vector<ObjectHolder>& values, Context& context) {
+    auto& out = context.GetOutputStream();
+    for(size_t i = 0; i < values.size(); ++i) {
+        if(values[i]) {
+            values[i]->Print(out, context);
+        }
+        else {
+            out << "None";
+        }
+        if(i + 1 < values.size()) {
+            out << ' ';
+        }
+    }
+    out << '\n';
+}
+
+[[maybe_unused]] ObjectHolder Str(const ObjectHolder& value, Context& context) {
+    return ObjectHolder::Own(runtime::String{runtime::ToString(value, context)});
+}
+
+[[maybe_unused]] ObjectHolder Add(const Operands& operands, Context& context) {
+    return runtime::Add(operands.lhs, operands.rhs, context);
+}
+
+[[maybe_unused]] ObjectHolder Sub(const Operands& operands) {
+    return runtime::Sub(operands.lhs, operands.rhs);
+}
+
+[[maybe_unused]] ObjectHolder Mult(const Operands& operands) {
+    return runtime::Mult(operands.lhs, operands.rhs);
+}
+
+[[maybe_unused]] ObjectHolder Div(const Operands& operands) {
+    return runtime::Div(operands.lhs, operands.rhs);
+}
+
+[[maybe_unused]] ObjectHolder Compare(Comparator comparator, const Operands& operands, Context& context) {
+    return Bool(comparator(operands.lhs, operands.rhs, context));
+}
+
+)";
+
+const char* const EPILOGUE = R"(
+int main() {
+    try {
+        DefineClasses();
+        runtime::SimpleContext context{std::cout};
+        RunProgram(context);
+    }
+    catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+)";
+
+string Quote(const string& value) {
+    ostringstream out;
+    out << '"';
+    for(unsigned char c : value) {
+        switch(c) {
+            case '"':
+                out << "\\\""sv;
+                break;
+            case '\\':
+                out << "\\\\"sv;
+                break;
+            case '\n':
+                out << "\\n"sv;
+                break;
+            case '\t':
+                out << "\\t"sv;
+                break;
+            case '\r':
+                out << "\\r"sv;
+                break;
+            default:
+                if(c < 0x20 || c >= 0x7F) {
+                    //octal escapes never swallow the following characters beyond three digits
+                    out << '\\' << static_cast<char>('0' + (c >> 6)) << static_cast<char>('0' + ((c >> 3) & 7))
+                        << static_cast<char>('0' + (c & 7));
+                }
+                else {
+                    out << c;
+                }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+string IntLiteral(int value) {
+    if(value == INT_MIN) {
+        return "(-"s + to_string(INT_MAX) + " - 1)"s;
+    }
+    return to_string(value);
+}
+
+string ComparatorName(const ast::Comparison::Comparator& comparator) {
+    using ComparatorFn = bool (*)(const runtime::ObjectHolder&, const runtime::ObjectHolder&, runtime::Context&);
+    static const pair<ComparatorFn, const char*> known[] = {
+        {runtime::Equal, "runtime::Equal"},
+        {runtime::NotEqual, "runtime::NotEqual"},
+        {runtime::Less, "runtime::Less"},
+        {runtime::Greater, "runtime::Greater"},
+        {runtime::LessOrEqual, "runtime::LessOrEqual"},
+        {runtime::GreaterOrEqual, "runtime::GreaterOrEqual"},
+    };
+    if(auto fn_ptr = comparator.target<ComparatorFn>()) {
+        for(const auto& [fn, name] : known) {
+            if(*fn_ptr == fn) {
+                return name;
+            }
+        }
+    }
+    throw TranspileError("comparison with a custom comparator cannot be translated to C++"s);
+}
+
+class Emitter {
+public:
+    explicit Emitter(ostream& out)
+        : out_(out)
+    {
+    }
+
+    void EmitProgram(const ast::Statement& program) {
+        CollectClasses(program);
+
+        //function bodies are generated first, since they register constants
+        ostringstream functions;
+        for(size_t i = 0; i < methods_.size(); ++i) {
+            EmitMethod(i, functions);
+        }
+        ostringstream main_body;
+        EmitScope(program, {}, main_body);
+
+        out_ << "// Generated by interpreter --emit-cpp\n"sv
+             << "#include \"runtime.h\"\n\n#include <iostream>\n#include <memory>\n#include <stdexcept>\n"sv
+             << "#include <string>\n#include <vector>\n\n"sv
+             << PRELUDE;
+        for(size_t i = 0; i < constants_.size(); ++i) {
+            out_ << "const ObjectHolder k"sv << i << " = "sv << constants_[i] << ";\n"sv;
+        }
+        out_ << '\n';
+        for(size_t i = 0; i < classes_.size(); ++i) {
+            out_ << "std::unique_ptr<runtime::Class> class"sv << i << ";  // "sv << classes_[i]->GetName() << '\n';
+        }
+        out_ << '\n' << functions.str();
+        EmitDefineClasses();
+        out_ << "void RunProgram([[maybe_unused]] Context& context) {\n"sv << main_body.str() << "}\n\n"sv
+             << "}  // namespace\n"sv << EPILOGUE;
+    }
+
+private:
+    struct MethodInfo {
+        const runtime::Class* cls;
+        const runtime::Method* method;
+        const ast::MethodBody* body;
+    };
+
+    void CollectClasses(const ast::Statement& node) {
+        if(auto compound = dynamic_cast<const ast::Compound*>(&node)) {
+            for(const auto& stmt : compound->Statements()) {
+                CollectClasses(*stmt);
+            }
+        }
+        else if(auto if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+            CollectClasses(*if_else->IfBody());
+            if(if_else->ElseBody()) {
+                CollectClasses(*if_else->ElseBody());
+            }
+        }
+        else if(auto body = dynamic_cast<const ast::MethodBody*>(&node)) {
+            CollectClasses(*body->Body());
+        }
+        else if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            const auto& cls = definition->GetClass();
+            if(class_index_.count(&cls)) {
+                return;
+            }
+            class_index_[&cls] = classes_.size();
+            classes_.push_back(&cls);
+            for(const auto& method : cls.GetMethods()) {
+                auto method_body = dynamic_cast<const ast::MethodBody*>(method.body.get());
+                if(!method_body) {
+                    throw TranspileError("method "s + cls.GetName() + "."s + method.name
+                                         + " has no Mython body"s);
+                }
+                method_index_[&method] = methods_.size();
+                methods_.push_back({&cls, &method, method_body});
+                CollectClasses(*method_body);
+            }
+        }
+    }
+
+    size_t ClassIndex(const runtime::Class& cls) const {
+        auto it = class_index_.find(&cls);
+        if(it == class_index_.end()) {
+            throw TranspileError("class "s + cls.GetName() + " is used but never defined"s);
+        }
+        return it->second;
+    }
+
+    void EmitDefineClasses() {
+        out_ << "void DefineClasses() {\n"sv;
+        for(size_t i = 0; i < classes_.size(); ++i) {
+            const auto& cls = *classes_[i];
+            out_ << "    {\n        std::vector<runtime::Method> methods;\n"sv;
+            for(const auto& method : cls.GetMethods()) {
+                out_ << "        methods.push_back({"sv << Quote(method.name) << ", {"sv;
+                for(size_t p = 0; p < method.formal_params.size(); ++p) {
+                    out_ << (p ? ", "sv : ""sv) << Quote(method.formal_params[p]);
+                }
+                out_ << "}, std::make_unique<NativeBody>(method"sv << method_index_.at(&method) << ")});\n"sv;
+            }
+            out_ << "        class"sv << i << " = std::make_unique<runtime::Class>("sv << Quote(cls.GetName())
+                 << ", std::move(methods), "sv;
+            if(cls.GetParent()) {
+                out_ << "class"sv << ClassIndex(*cls.GetParent()) << ".get()"sv;
+            }
+            else {
+                out_ << "nullptr"sv;
+            }
+            out_ << ");\n    }\n"sv;
+        }
+        out_ << "}\n\n"sv;
+    }
+
+    void EmitMethod(size_t index, ostream& out) {
+        const auto& [cls, method, body] = methods_[index];
+        vector<string> params{"self"s};
+        params.insert(params.end(), method->formal_params.begin(), method->formal_params.end());
+        out << "// "sv << cls->GetName() << '.' << method->name << '\n'
+            << "ObjectHolder method"sv << index << "(runtime::Closure& closure, [[maybe_unused]] Context& context) {\n"sv;
+        for(const auto& param : params) {
+            out << "    Variable v_"sv << param << "("sv << Quote(param) << ");\n"sv
+                << "    v_"sv << param << ".Set(closure.at("sv << Quote(param) << "));\n"sv;
+        }
+        in_method_ = true;
+        EmitScope(*body->Body(), params, out);
+        in_method_ = false;
+        out << "    return ObjectHolder::None();\n}\n\n"sv;
+    }
+
+    //declares the variables assigned in body and emits its statements
+    void EmitScope(const ast::Statement& body, const vector<string>& predefined, ostream& out) {
+        vector<string> assigned;
+        ast::CollectAssignedVariables(body, assigned);
+        variables_ = set<string>(predefined.begin(), predefined.end());
+        for(const auto& name : assigned) {
+            if(variables_.insert(name).second) {
+                out << "    Variable v_"sv << name << "("sv << Quote(name) << ");\n"sv;
+            }
+        }
+        EmitStatement(body, 1, out);
+    }
+
+    void EmitStatement(const ast::Statement& node, int depth, ostream& out) {
+        const string indent(depth * 4u, ' ');
+        if(auto compound = dynamic_cast<const ast::Compound*>(&node)) {
+            for(const auto& stmt : compound->Statements()) {
+                EmitStatement(*stmt, depth, out);
+            }
+        }
+        else if(auto if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+            out << indent << "if(runtime::IsTrue("sv << Expression(*if_else->Condition()) << ")) {\n"sv;
+            EmitStatement(*if_else->IfBody(), depth + 1, out);
+            if(if_else->ElseBody()) {
+                out << indent << "}\n"sv << indent << "else {\n"sv;
+                EmitStatement(*if_else->ElseBody(), depth + 1, out);
+            }
+            out << indent << "}\n"sv;
+        }
+        else if(auto ret = dynamic_cast<const ast::Return*>(&node)) {
+            if(!in_method_) {
+                throw TranspileError("return outside of a method"s);
+            }
+            out << indent << "return "sv << Expression(*ret->Value()) << ";\n"sv;
+        }
+        else if(auto print = dynamic_cast<const ast::Print*>(&node)) {
+            out << indent << "Print("sv << List(print->Args()) << ", context);\n"sv;
+        }
+        else if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            const auto& cls = definition->GetClass();
+            out << indent << "v_"sv << cls.GetName() << ".Set(ObjectHolder::Share(*class"sv << ClassIndex(cls)
+                << "));\n"sv;
+        }
+        else if(dynamic_cast<const ast::MethodBody*>(&node)) {
+            throw TranspileError("method body outside of a class"s);
+        }
+        else {
+            out << indent << "(void)"sv << Expression(node) << ";\n"sv;
+        }
+    }
+
+    string List(const ast::StatementList& items, string first = {}) {
+        string result = "{"s + first;
+        for(const auto& item : items) {
+            if(result.size() > 1u) {
+                result += ", "s;
+            }
+            result += Expression(*item);
+        }
+        return result + "}"s;
+    }
+
+    string Operands(const ast::BinaryOperation& operation) {
+        return "Operands{"s + Expression(*operation.Lhs()) + ", "s + Expression(*operation.Rhs()) + "}"s;
+    }
+
+    string Constant(string initializer) {
+        constants_.push_back(std::move(initializer));
+        return "k"s + to_string(constants_.size() - 1u);
+    }
+
+    string Variable(const string& name) {
+        if(!variables_.count(name)) {
+            return "Undefined("s + Quote(name) + ")"s;
+        }
+        return "v_"s + name + ".Get()"s;
+    }
+
+    string Expression(const ast::Statement& node) {
+        if(auto num = dynamic_cast<const ast::NumericConst*>(&node)) {
+            return Constant("ObjectHolder::Own(runtime::Number{"s + IntLiteral(num->GetValue().GetValue()) + "})"s);
+        }
+        if(auto str = dynamic_cast<const ast::StringConst*>(&node)) {
+            return Constant("ObjectHolder::Own(runtime::String{"s + Quote(str->GetValue().GetValue()) + "})"s);
+        }
+        if(auto boolean = dynamic_cast<const ast::BoolConst*>(&node)) {
+            return boolean->GetValue().GetValue() ? "TRUE_VALUE"s : "FALSE_VALUE"s;
+        }
+        if(dynamic_cast<const ast::None*>(&node)) {
+            return "ObjectHolder::None()"s;
+        }
+        if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+            auto ids = var->GetDottedIds();
+            string result = Variable(ids.front());
+            for(size_t i = 1; i < ids.size(); ++i) {
+                result = "GetField("s + result + ", "s + Quote(ids[i]) + ")"s;
+            }
+            return result;
+        }
+        if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+            return "v_"s + assignment->GetName() + ".Set("s + Expression(*assignment->Value()) + ")"s;
+        }
+        if(auto field_assignment = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+            return "SetField(Operands{"s + Expression(field_assignment->Object()) + ", "s
+                 + Expression(*field_assignment->Value()) + "}, "s + Quote(field_assignment->GetFieldName()) + ")"s;
+        }
+        if(auto inlined = dynamic_cast<const ast::InlinedMethodCall*>(&node)) {
+            return Expression(inlined->GetCall());
+        }
+        if(auto call = dynamic_cast<const ast::MethodCall*>(&node)) {
+            return "CallMethod("s + Quote(call->GetMethodName()) + ", "s
+                 + List(call->Args(), Expression(*call->Object())) + ", context)"s;
+        }
+        if(auto new_instance = dynamic_cast<const ast::NewInstance*>(&node)) {
+            return "NewInstance(*class"s + to_string(ClassIndex(new_instance->GetClass())) + ", "s
+                 + List(new_instance->Args()) + ", context)"s;
+        }
+        if(auto stringify = dynamic_cast<const ast::Stringify*>(&node)) {
+            return "Str("s + Expression(*stringify->Argument()) + ", context)"s;
+        }
+        if(auto not_op = dynamic_cast<const ast::Not*>(&node)) {
+            return "Bool(!runtime::IsTrue("s + Expression(*not_op->Argument()) + "))"s;
+        }
+        if(auto or_op = dynamic_cast<const ast::Or*>(&node)) {
+            return "Bool(runtime::IsTrue("s + Expression(*or_op->Lhs()) + ") || runtime::IsTrue("s
+                 + Expression(*or_op->Rhs()) + "))"s;
+        }
+        if(auto and_op = dynamic_cast<const ast::And*>(&node)) {
+            return "Bool(runtime::IsTrue("s + Expression(*and_op->Lhs()) + ") && runtime::IsTrue("s
+                 + Expression(*and_op->Rhs()) + "))"s;
+        }
+        if(auto comparison = dynamic_cast<const ast::Comparison*>(&node)) {
+            return "Compare("s + ComparatorName(comparison->GetComparator()) + ", "s + Operands(*comparison)
+                 + ", context)"s;
+        }
+        if(auto add = dynamic_cast<const ast::Add*>(&node)) {
+            return "Add("s + Operands(*add) + ", context)"s;
+        }
+        if(auto sub = dynamic_cast<const ast::Sub*>(&node)) {
+            return "Sub("s + Operands(*sub) + ")"s;
+        }
+        if(auto mult = dynamic_cast<const ast::Mult*>(&node)) {
+            return "Mult("s + Operands(*mult) + ")"s;
+        }
+        if(auto div = dynamic_cast<const ast::Div*>(&node)) {
+            return "Div("s + Operands(*div) + ")"s;
+        }
+        throw TranspileError("statement cannot be used as an expression in C++"s);
+    }
+
+    ostream& out_;
+    vector<const runtime::Class*> classes_;
+    unordered_map<const runtime::Class*, size_t> class_index_;
+    vector<MethodInfo> methods_;
+    unordered_map<const runtime::Method*, size_t> method_index_;
+    vector<string> constants_;
+    set<string> variables_;
+    bool in_method_ = false;
+};
+
+}  // namespace
+
+void EmitCpp(const ast::Statement& program, ostream& out) {
+    Emitter(out).EmitProgram(program);
+}
+
+}  // namespace transpiler
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <ostream>
+#include <stdexcept>
+
+namespace ast {
+class Statement;
+}
+
+namespace transpiler {
+
+class TranspileError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/*
+Выводит в out единицу трансляции C++, которая выполняет программу так же, как интерпретатор.
+Программа верхнего уровня и тела методов превращаются в функции C++, переменные - в локальные
+переменные этих функций. Объекты, операции и вызовы методов реализуются библиотекой
+mython_runtime, с которой нужно скомпоновать полученный файл:
+    c++ -std=c++17 -I<каталог mython> program.cpp -L<каталог сборки> -lmython_runtime -pthread
+Выбрасывает TranspileError, если программа содержит узлы, которые нельзя перевести в C++
+*/
+void EmitCpp(const ast::Statement& program, std::ostream& out);
+
+}  // namespace transpiler
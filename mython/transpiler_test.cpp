@@ -0,0 +1,76 @@
+#include "lexer.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+#include "transpiler.h"
+
+using namespace std;
+
+namespace transpiler {
+
+namespace {
+
+string Transpile(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    auto tree = ParseProgram(lexer);
+    ostringstream out;
+    EmitCpp(*tree, out);
+    return out.str();
+}
+
+void AssertContains(const string& text, const string& fragment) {
+    Assert(text.find(fragment) != string::npos, "missing fragment: "s + fragment);
+}
+
+void TestEmitProgram() {
+    const string code = Transpile(R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def next():
+    self.value = self.value + 1
+    return self.value
+
+c = Counter(41)
+if c.next() > 41:
+  print 'ok', c.value
+else:
+  print unknown
+)"s);
+    AssertContains(code, "#include \"runtime.h\""s);
+    AssertContains(code, "std::unique_ptr<runtime::Class> class0;  // Counter\n"s);
+    AssertContains(code, "// Counter.next\nObjectHolder method1("s);
+    AssertContains(code, "methods.push_back({\"__init__\", {\"start\"}, std::make_unique<NativeBody>(method0)});"s);
+    AssertContains(code, "class0 = std::make_unique<runtime::Class>(\"Counter\", std::move(methods), nullptr);"s);
+    AssertContains(code, "    Variable v_c(\"c\");\n"s);
+    AssertContains(code, "v_c.Set(NewInstance(*class0, {k"s);
+    AssertContains(code, "if(runtime::IsTrue(Compare(runtime::Greater, Operands{CallMethod(\"next\", {v_c.Get()}, context), k"s);
+    AssertContains(code, "Print({Undefined(\"unknown\")}, context);"s);
+    AssertContains(code, "int main() {"s);
+}
+
+void TestStringConstants() {
+    const string code = Transpile("print 'a\\tb\"c'\n"s);
+    AssertContains(code, R"(runtime::String{"a\tb\"c"})"s);
+}
+
+void TestUntranslatable() {
+    auto custom = [](const runtime::ObjectHolder&, const runtime::ObjectHolder&, runtime::Context&) {
+        return true;
+    };
+    ast::Comparison comparison(custom, make_unique<ast::NumericConst>(1), make_unique<ast::NumericConst>(2));
+    ostringstream out;
+    ASSERT_THROWS(EmitCpp(comparison, out), TranspileError);
+}
+
+}  // namespace
+
+void RunTranspilerTests(TestRunner& tr) {
+    RUN_TEST(tr, transpiler::TestEmitProgram);
+    RUN_TEST(tr, transpiler::TestStringConstants);
+    RUN_TEST(tr, transpiler::TestUntranslatable);
+}
+
+}  // namespace transpiler
@@ -0,0 +1,290 @@
+#include "type_inference.h"
+
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace optimizer {
+
+using ast::Statement;
+
+namespace {
+
+using Environment = unordered_map<string, ValueType>;
+
+//a variable keeps its type after a branch only if every path assigns the same type
+void Join(Environment& env, const Environment& other) {
+    for(auto& [name, type] : env) {
+        auto it = other.find(name);
+        if(it == other.end() || it->second != type) {
+            type = ValueType::ANY;
+        }
+    }
+    for(const auto& [name, type] : other) {
+        if(!env.count(name)) {
+            env.emplace(name, ValueType::ANY);
+        }
+    }
+}
+
+bool ProducesValue(const Statement& node) {
+    return !dynamic_cast<const ast::Compound*>(&node) && !dynamic_cast<const ast::IfElse*>(&node)
+        && !dynamic_cast<const ast::MethodBody*>(&node) && !dynamic_cast<const ast::ClassDefinition*>(&node)
+        && !dynamic_cast<const ast::Return*>(&node) && !dynamic_cast<const ast::Print*>(&node);
+}
+
+class Inference {
+public:
+    explicit Inference(TypeMap& types)
+        : types_(types)
+    {
+    }
+
+    ValueType Infer(const Statement& node, Environment& env) {
+        const ValueType type = InferNode(node, env);
+        if(ProducesValue(node)) {
+            types_[&node] = type;
+        }
+        return type;
+    }
+
+private:
+    ValueType InferNode(const Statement& node, Environment& env) {
+        if(dynamic_cast<const ast::NumericConst*>(&node)) {
+            return ValueType::NUMBER;
+        }
+        if(dynamic_cast<const ast::StringConst*>(&node)) {
+            return ValueType::STRING;
+        }
+        if(dynamic_cast<const ast::BoolConst*>(&node)) {
+            return ValueType::BOOL;
+        }
+        if(dynamic_cast<const ast::None*>(&node)) {
+            return ValueType::NONE;
+        }
+        if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+            auto ids = var->GetDottedIds();
+            auto it = env.find(ids.front());
+            return ids.size() == 1u && it != env.end() ? it->second : ValueType::ANY;
+        }
+        if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+            const ValueType type = Infer(*assignment->Value(), env);
+            env[assignment->GetName()] = type;
+            return type;
+        }
+        if(auto field_assignment = dynamic_cast<const ast::FieldAssignment*>(&node)) {
+            return Infer(*field_assignment->Value(), env);
+        }
+        if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+            //a method runs in its own closure where only self and the parameters are defined
+            for(const auto& method : definition->GetClass().GetMethods()) {
+                Environment method_env;
+                if(auto body = ast::GetMethodBody(method)) {
+                    Infer(*body, method_env);
+                }
+            }
+            env[definition->GetClass().GetName()] = ValueType::ANY;
+            return ValueType::ANY;
+        }
+        if(auto if_else = dynamic_cast<const ast::IfElse*>(&node)) {
+            Infer(*if_else->Condition(), env);
+            Environment else_env = env;
+            Infer(*if_else->IfBody(), env);
+            if(if_else->ElseBody()) {
+                Infer(*if_else->ElseBody(), else_env);
+            }
+            Join(env, else_env);
+            return ValueType::NONE;
+        }
+        if(dynamic_cast<const ast::Or*>(&node) || dynamic_cast<const ast::And*>(&node)) {
+            //the right operand is evaluated only on some paths
+            const auto& operation = static_cast<const ast::BinaryOperation&>(node);
+            Infer(*operation.Lhs(), env);
+            Environment rhs_env = env;
+            Infer(*operation.Rhs(), rhs_env);
+            Join(env, rhs_env);
+            return ValueType::BOOL;
+        }
+        if(auto inlined = dynamic_cast<const ast::InlinedMethodCall*>(&node)) {
+            //either the inlined body or the ordinary call runs
+            Infer(*inlined->GetCall().Object(), env);
+            for(const auto& arg : inlined->GetCall().Args()) {
+                Infer(*arg, env);
+            }
+            Environment body_env = env;
+            Infer(*inlined->Body(), body_env);
+            Join(env, body_env);
+            return ValueType::ANY;
+        }
+        if(auto binary = dynamic_cast<const ast::BinaryOperation*>(&node)) {
+            const ValueType lhs = Infer(*binary->Lhs(), env);
+            const ValueType rhs = Infer(*binary->Rhs(), env);
+            return InferOperation(node, lhs, rhs);
+        }
+        if(dynamic_cast<const ast::Stringify*>(&node) || dynamic_cast<const ast::Not*>(&node)) {
+            Infer(*static_cast<const ast::UnaryOperation&>(node).Argument(), env);
+            return dynamic_cast<const ast::Not*>(&node) ? ValueType::BOOL : ValueType::STRING;
+        }
+        //the rest evaluates its children in order and yields an arbitrary value
+        ast::ForEachChild(node, [this, &env](const Statement& child) {
+            Infer(child, env);
+        });
+        return dynamic_cast<const ast::Compound*>(&node) ? ValueType::NONE : ValueType::ANY;
+    }
+
+    static ValueType InferOperation(const Statement& node, ValueType lhs, ValueType rhs) {
+        if(dynamic_cast<const ast::Comparison*>(&node)) {
+            return ValueType::BOOL;
+        }
+        if(lhs != rhs) {
+            return ValueType::ANY;
+        }
+        if(lhs == ValueType::NUMBER) {
+            return ValueType::NUMBER;
+        }
+        //only addition is defined for strings, the others fail on them
+        if(lhs == ValueType::STRING && dynamic_cast<const ast::Add*>(&node)) {
+            return ValueType::STRING;
+        }
+        return ValueType::ANY;
+    }
+
+    TypeMap& types_;
+};
+
+string_view GetNodeName(const Statement& node) {
+    //typed variants go before the operations they are derived from
+    static const pair<const type_info*, string_view> NAMES[] = {
+        {&typeid(ast::NumericConst), "NumericConst"sv},
+        {&typeid(ast::StringConst), "StringConst"sv},
+        {&typeid(ast::BoolConst), "BoolConst"sv},
+        {&typeid(ast::None), "None"sv},
+        {&typeid(ast::VariableValue), "VariableValue"sv},
+        {&typeid(ast::Assignment), "Assignment"sv},
+        {&typeid(ast::FieldAssignment), "FieldAssignment"sv},
+        {&typeid(ast::Print), "Print"sv},
+        {&typeid(ast::MethodCall), "MethodCall"sv},
+        {&typeid(ast::InlinedMethodCall), "InlinedMethodCall"sv},
+        {&typeid(ast::NewInstance), "NewInstance"sv},
+        {&typeid(ast::Stringify), "Stringify"sv},
+        {&typeid(ast::NumberAdd), "NumberAdd"sv},
+        {&typeid(ast::StringAdd), "StringAdd"sv},
+        {&typeid(ast::Add), "Add"sv},
+        {&typeid(ast::NumberSub), "NumberSub"sv},
+        {&typeid(ast::Sub), "Sub"sv},
+        {&typeid(ast::NumberMult), "NumberMult"sv},
+        {&typeid(ast::Mult), "Mult"sv},
+        {&typeid(ast::NumberDiv), "NumberDiv"sv},
+        {&typeid(ast::Div), "Div"sv},
+        {&typeid(ast::Or), "Or"sv},
+        {&typeid(ast::And), "And"sv},
+        {&typeid(ast::Not), "Not"sv},
+        {&typeid(ast::NumberComparison), "NumberComparison"sv},
+        {&typeid(ast::StringComparison), "StringComparison"sv},
+        {&typeid(ast::Comparison), "Comparison"sv},
+        {&typeid(ast::Compound), "Compound"sv},
+        {&typeid(ast::Return), "Return"sv},
+        {&typeid(ast::ClassDefinition), "ClassDefinition"sv},
+        {&typeid(ast::IfElse), "IfElse"sv},
+        {&typeid(ast::MethodBody), "MethodBody"sv},
+    };
+    for(const auto& [type, name] : NAMES) {
+        if(*type == typeid(node)) {
+            return name;
+        }
+    }
+    return "Statement"sv;
+}
+
+bool IsTyped(const Statement& node) {
+    return dynamic_cast<const ast::NumberAdd*>(&node) || dynamic_cast<const ast::StringAdd*>(&node)
+        || dynamic_cast<const ast::NumberSub*>(&node) || dynamic_cast<const ast::NumberMult*>(&node)
+        || dynamic_cast<const ast::NumberDiv*>(&node) || dynamic_cast<const ast::NumberComparison*>(&node)
+        || dynamic_cast<const ast::StringComparison*>(&node);
+}
+
+bool IsArithmeticOrComparison(const Statement& node) {
+    return dynamic_cast<const ast::Add*>(&node) || dynamic_cast<const ast::Sub*>(&node)
+        || dynamic_cast<const ast::Mult*>(&node) || dynamic_cast<const ast::Div*>(&node)
+        || dynamic_cast<const ast::Comparison*>(&node);
+}
+
+struct DumpStats {
+    size_t operations = 0;
+    size_t typed = 0;
+};
+
+void Dump(const Statement& node, const TypeMap& types, size_t depth, DumpStats& stats, ostream& out) {
+    out << string(depth * 2u, ' ') << GetNodeName(node);
+    if(auto var = dynamic_cast<const ast::VariableValue*>(&node)) {
+        const auto ids = var->GetDottedIds();
+        out << ' ';
+        for(size_t i = 0; i < ids.size(); ++i) {
+            out << (i ? "."sv : ""sv) << ids[i];
+        }
+    }
+    else if(auto assignment = dynamic_cast<const ast::Assignment*>(&node)) {
+        out << ' ' << assignment->GetName();
+    }
+    else if(auto call = dynamic_cast<const ast::MethodCall*>(&node)) {
+        out << ' ' << call->GetMethodName();
+    }
+    if(auto it = types.find(&node); it != types.end()) {
+        out << ": "sv << GetTypeName(it->second);
+    }
+    out << '\n';
+
+    if(IsArithmeticOrComparison(node)) {
+        ++stats.operations;
+        stats.typed += IsTyped(node) ? 1u : 0u;
+    }
+    if(auto definition = dynamic_cast<const ast::ClassDefinition*>(&node)) {
+        const auto& cls = definition->GetClass();
+        out << string(depth * 2u + 2u, ' ') << "class "sv << cls.GetName() << '\n';
+        for(const auto& method : cls.GetMethods()) {
+            out << string(depth * 2u + 4u, ' ') << "def "sv << method.name << '\n';
+            if(auto body = ast::GetMethodBody(method)) {
+                Dump(*body, types, depth + 3u, stats, out);
+            }
+        }
+    }
+    ast::ForEachChild(node, [&](const Statement& child) {
+        Dump(child, types, depth + 1u, stats, out);
+    });
+}
+
+}  // namespace
+
+string_view GetTypeName(ValueType type) {
+    switch(type) {
+        case ValueType::NONE:
+            return "None"sv;
+        case ValueType::NUMBER:
+            return "Number"sv;
+        case ValueType::STRING:
+            return "String"sv;
+        case ValueType::BOOL:
+            return "Bool"sv;
+        case ValueType::ANY:
+            break;
+    }
+    return "Any"sv;
+}
+
+TypeMap InferTypes(const Statement& program) {
+    TypeMap types;
+    Environment env;
+    Inference(types).Infer(program, env);
+    return types;
+}
+
+void DumpTypes(const Statement& program, ostream& out) {
+    DumpStats stats;
+    Dump(program, InferTypes(program), 0, stats, out);
+    out << "typed operations: "sv << stats.typed << " of "sv << stats.operations << '\n';
+}
+
+}  // namespace optimizer
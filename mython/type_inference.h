@@ -0,0 +1,40 @@
+#pragma once
+
+#include "statement.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+
+namespace optimizer {
+
+// Тип значения выражения, выведенный до исполнения программы
+enum class ValueType : uint8_t {
+    NONE,
+    NUMBER,
+    STRING,
+    BOOL,
+    // Значение может быть любым, в том числе объектом класса
+    ANY,
+};
+
+std::string_view GetTypeName(ValueType type);
+
+// Типы выражений: для каждого узла, вычисляющего значение, - тип этого значения
+// в той точке программы, где расположен узел
+using TypeMap = std::unordered_map<const ast::Statement*, ValueType>;
+
+/*
+Выводит типы выражений программы и тел методов объявленных в ней классов.
+Типы переменных отслеживаются по присваиваниям в порядке исполнения, после if/else
+переменная сохраняет тип, только если он одинаков в обеих ветках. Параметры методов,
+поля объектов и результаты вызовов методов имеют тип ANY
+*/
+TypeMap InferTypes(const ast::Statement& program);
+
+// Выводит дерево программы с выведенными типами выражений и количество операций,
+// для которых выбран вариант без проверки типов
+void DumpTypes(const ast::Statement& program, std::ostream& out);
+
+}  // namespace optimizer
@@ -0,0 +1,128 @@
+#include "lexer.h"
+#include "optimizer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+#include "type_inference.h"
+
+using namespace std;
+
+namespace optimizer {
+
+namespace {
+
+unique_ptr<ast::Statement> Parse(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+const ast::Statement& Statement(const unique_ptr<ast::Statement>& program, size_t index) {
+    return *dynamic_cast<const ast::Compound&>(*program).Statements().at(index);
+}
+
+const ast::Statement& AssignedValue(const unique_ptr<ast::Statement>& program, size_t index) {
+    return *dynamic_cast<const ast::Assignment&>(Statement(program, index)).Value();
+}
+
+string Run(ast::Statement& program) {
+    runtime::Closure closure;
+    ostringstream output;
+    runtime::SimpleContext context{output};
+    program.Execute(closure, context);
+    return output.str();
+}
+
+void TestInferTypes() {
+    auto program = Parse(R"(
+x = 1
+s = 'a' + 'b'
+b = x < 2
+if b:
+  x = 'one'
+  y = 2
+else:
+  y = 3
+z = y * 2
+w = x
+)"s);
+    auto types = InferTypes(*program);
+    ASSERT(types.at(&AssignedValue(program, 0)) == ValueType::NUMBER);
+    ASSERT(types.at(&AssignedValue(program, 1)) == ValueType::STRING);
+    ASSERT(types.at(&AssignedValue(program, 2)) == ValueType::BOOL);
+    //both branches assign a number to y, but only one of them changes x
+    ASSERT(types.at(&AssignedValue(program, 4)) == ValueType::NUMBER);
+    ASSERT(types.at(&AssignedValue(program, 5)) == ValueType::ANY);
+}
+
+void TestTypeSpecialization() {
+    auto program = Parse(R"(
+class Box:
+  def __init__(v):
+    self.v = v
+  def scaled(n):
+    k = 10
+    return self.v * n + k * 2
+
+n = 7
+s = 'a'
+print n + 1, n - 1, n * 2, n / 2, n < 8, s + 'b', s == 'a'
+b = Box(2)
+print b.scaled(3), n + s == 'x'
+)"s);
+    MakeTypeSpecialization()->Run(program);
+
+    const auto& args = dynamic_cast<const ast::Print&>(Statement(program, 3)).Args();
+    ASSERT(dynamic_cast<const ast::NumberAdd*>(args[0].get()));
+    ASSERT(dynamic_cast<const ast::NumberSub*>(args[1].get()));
+    ASSERT(dynamic_cast<const ast::NumberMult*>(args[2].get()));
+    ASSERT(dynamic_cast<const ast::NumberDiv*>(args[3].get()));
+    ASSERT(dynamic_cast<const ast::NumberComparison*>(args[4].get()));
+    ASSERT(dynamic_cast<const ast::StringAdd*>(args[5].get()));
+    ASSERT(dynamic_cast<const ast::StringComparison*>(args[6].get()));
+
+    //fields and parameters may hold anything, locals assigned from literals are known,
+    //so only k * 2 is typed in the method
+    ostringstream dump;
+    DumpTypes(*program, dump);
+    ASSERT(dump.str().find("NumberMult: Number"s) != string::npos);
+    ASSERT(dump.str().find("typed operations: 8 of 12\n"s) != string::npos);
+
+    //a number added to a string is left to fail at run time
+    try {
+        Run(*program);
+        ASSERT(false);
+    }
+    catch(const runtime_error&) {
+    }
+}
+
+void TestTypedExecution() {
+    const string text = R"(
+x = 6
+y = 3
+s = 'ab'
+print x + y, x - y, x * y, x / y, x > y, s + 'c', s < 'b'
+)"s;
+    auto program = Parse(text);
+    MakeTypeSpecialization()->Run(program);
+    ASSERT_EQUAL(Run(*program), "9 3 18 2 True abc True\n"s);
+
+    auto division = Parse("x = 1\ny = 0\nprint x / y\n"s);
+    MakeTypeSpecialization()->Run(division);
+    try {
+        Run(*division);
+        ASSERT(false);
+    }
+    catch(const runtime_error&) {
+    }
+}
+
+}  // namespace
+
+void RunTypeInferenceTests(TestRunner& tr) {
+    RUN_TEST(tr, optimizer::TestInferTypes);
+    RUN_TEST(tr, optimizer::TestTypeSpecialization);
+    RUN_TEST(tr, optimizer::TestTypedExecution);
+}
+
+}  // namespace optimizer
@@ -0,0 +1,499 @@
+#include "vm.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MYTHON_COMPUTED_GOTO 1
+#endif
+
+namespace vm {
+
+using bytecode::Function;
+using bytecode::Instruction;
+using bytecode::OpCode;
+using runtime::ObjectHolder;
+
+namespace {
+
+//machine code calls methods recursively on the C++ stack, so it is entered only while this much
+//of the stack is left above the reserve
+constexpr size_t NATIVE_CODE_STACK_BYTES = 1024u * 1024u;
+
+const ObjectHolder TRUE_VALUE = ObjectHolder::Own(runtime::Bool{true});
+const ObjectHolder FALSE_VALUE = ObjectHolder::Own(runtime::Bool{false});
+
+inline const runtime::Number* AsNumber(const ObjectHolder& holder) {
+    return holder.TryAsExact<runtime::Number>();
+}
+
+inline runtime::ClassInstance* AsInstance(const ObjectHolder& holder) {
+    return holder.TryAsExact<runtime::ClassInstance>();
+}
+
+class FrameGuard {
+public:
+    FrameGuard(RegisterStack& stack, size_t count)
+        : stack_(stack)
+        , count_(count)
+        , frame_(stack.Allocate(count))
+    {
+    }
+    FrameGuard(const FrameGuard&) = delete;
+    FrameGuard& operator=(const FrameGuard&) = delete;
+    ~FrameGuard() {
+        stack_.Release(frame_, count_);
+    }
+    ObjectHolder* Registers() const {
+        return frame_;
+    }
+private:
+    RegisterStack& stack_;
+    size_t count_;
+    ObjectHolder* frame_;
+};
+
+//keeps an activation record on the call stack of the context while a method runs
+class CallStackGuard {
+public:
+    explicit CallStackGuard(runtime::Context& context)
+        : stack_(context.GetCallStack())
+    {
+        if(stack_) {
+            stack_->Push();
+        }
+    }
+    CallStackGuard(const CallStackGuard&) = delete;
+    CallStackGuard& operator=(const CallStackGuard&) = delete;
+    ~CallStackGuard() {
+        if(stack_) {
+            stack_->Pop();
+        }
+    }
+private:
+    runtime::CallStack* stack_;
+};
+
+}  // namespace
+
+const ObjectHolder& MakeBool(bool value) {
+    return value ? TRUE_VALUE : FALSE_VALUE;
+}
+
+runtime::Closure& GetFields(const ObjectHolder& holder) {
+    auto instance = AsInstance(holder);
+    if(!instance) {
+        throw std::runtime_error("object is not a ClassInstance"s);
+    }
+    return instance->Fields();
+}
+
+const runtime::Method& ResolveMethod(const runtime::ClassInstance& instance, const Function& function,
+                                     const bytecode::CallSite& site) {
+    const auto& cls = instance.GetClass();
+    if(site.cached_class == &cls) {
+        return *site.cached_method;
+    }
+    const auto& name = function.names[site.target];
+    const auto* method = cls.GetMethod(name);
+    if(!method || method->formal_params.size() != site.arg_count) {
+        throw std::runtime_error("object has no method: "s + name);
+    }
+    site.cached_class = &cls;
+    site.cached_method = method;
+    return *method;
+}
+
+void PrintValues(const ObjectHolder* values, size_t count, runtime::Context& context) {
+    auto& out = context.GetOutputStream();
+    for(size_t i = 0; i < count; ++i) {
+        if(values[i]) {
+            values[i]->Print(out, context);
+        }
+        else {
+            out << "None"sv;
+        }
+        if(i + 1u < count) {
+            out << ' ';
+        }
+    }
+    out << '\n';
+}
+
+runtime::ObjectHolder* RegisterStack::Allocate(size_t count) {
+    if(chunks_.empty()) {
+        chunks_.push_back({std::make_unique<ObjectHolder[]>(std::max(CHUNK_SIZE, count)), std::max(CHUNK_SIZE, count), 0});
+    }
+    if(chunks_[current_].top + count > chunks_[current_].size) {
+        ++current_;
+        if(current_ == chunks_.size()) {
+            chunks_.emplace_back();
+        }
+        auto& chunk = chunks_[current_];
+        if(chunk.size < count) {
+            chunk.size = std::max(CHUNK_SIZE, count);
+            chunk.data = std::make_unique<ObjectHolder[]>(chunk.size);
+        }
+    }
+    auto& chunk = chunks_[current_];
+    ObjectHolder* result = chunk.data.get() + chunk.top;
+    chunk.top += count;
+    return result;
+}
+
+void RegisterStack::Release(runtime::ObjectHolder* frame, size_t count) {
+    auto& chunk = chunks_[current_];
+    assert(frame == chunk.data.get() + chunk.top - count);
+    for(size_t i = 0; i < count; ++i) {
+        frame[i] = ObjectHolder::None();
+    }
+    chunk.top -= count;
+    if(chunk.top == 0 && current_ > 0) {
+        --current_;
+    }
+}
+
+VirtualMachine::VirtualMachine(bytecode::Module module)
+    : module_(std::move(module))
+{
+}
+
+const bytecode::Module& VirtualMachine::GetModule() const {
+    return module_;
+}
+
+void VirtualMachine::SetJitThreshold(size_t threshold) {
+    jit_threshold_ = threshold;
+}
+
+size_t VirtualMachine::GetNativeFunctionCount() const {
+    return std::count_if(native_functions_.begin(), native_functions_.end(),
+                         [](const auto& item) { return item.second != nullptr; });
+}
+
+const jit::NativeFunction* VirtualMachine::GetNativeFunction(const Function& function) {
+    auto it = native_functions_.find(&function);
+    if(it == native_functions_.end()) {
+        //a failed compilation is remembered too, so it is not retried on every call
+        it = native_functions_.emplace(&function, jit::Compile(function)).first;
+    }
+    return it->second.get();
+}
+
+void VirtualMachine::Run(runtime::Context& context) {
+    runtime::ExecutorContext machine_context(context, *this);
+    FrameGuard frame(registers_, module_.main.register_count);
+    Execute(module_.main, frame.Registers(), machine_context);
+}
+
+ObjectHolder VirtualMachine::Invoke(runtime::ClassInstance& self, const runtime::Method& method,
+                                    const std::vector<ObjectHolder>& actual_args,
+                                    runtime::Context& context) {
+    const Function* function = module_.GetMethod(self.GetClass(), method);
+    if(!function) {
+        //method body is not a Mython syntax tree, execute it directly
+        runtime::Closure arguments;
+        for(size_t i = 0; i < method.formal_params.size(); ++i) {
+            arguments[method.formal_params[i]] = actual_args[i];
+        }
+        arguments["self"s] = ObjectHolder::Share(self);
+        return method.body->Execute(arguments, context);
+    }
+    return RunMethod(*function, method, ObjectHolder::Share(self), actual_args.data(), context);
+}
+
+ObjectHolder VirtualMachine::CallMethod(const ObjectHolder& self, const runtime::Method& method,
+                                        const ObjectHolder* args, runtime::Context& context) {
+    auto& instance = static_cast<runtime::ClassInstance&>(*self);
+    const Function* function = module_.GetMethod(instance.GetClass(), method);
+    if(!function) {
+        //the argument vector is built here rather than in the dispatch loop: a computed goto leaves
+        //the block of an instruction without running the destructors of its locals
+        return instance.Call(method, std::vector<ObjectHolder>(args, args + method.formal_params.size()), context);
+    }
+    //the same bookkeeping as ClassInstance::Call does before Invoke
+    runtime::CheckNativeStack();
+    method.call_count.Increment();
+    CallStackGuard guard(context);
+    return RunMethod(*function, method, self, args, context);
+}
+
+ObjectHolder VirtualMachine::CreateInstance(const Function& function, const bytecode::CallSite& site,
+                                            const ObjectHolder* r, runtime::Context& context) {
+    auto holder = ObjectHolder::Own(runtime::ClassInstance{*function.classes[site.target]});
+    if(site.init) {
+        CallMethod(holder, *site.init, r + site.first_arg, context);
+    }
+    return holder;
+}
+
+ObjectHolder VirtualMachine::RunMethod(const Function& function, const runtime::Method& method, const ObjectHolder& self,
+                                       const ObjectHolder* args, runtime::Context& context) {
+    FrameGuard frame(registers_, function.register_count);
+    ObjectHolder* registers = frame.Registers();
+    registers[0] = self;
+    std::copy(args, args + method.formal_params.size(), registers + 1);
+    if(jit_threshold_ != 0 && method.call_count.Get() >= jit_threshold_
+       && !runtime::IsNativeStackBelow(NATIVE_CODE_STACK_BYTES)) {
+        if(auto native = GetNativeFunction(function)) {
+            return native->Run(*this, registers, context);
+        }
+    }
+    return Execute(function, registers, context);
+}
+
+const Function* VirtualMachine::FindInterpretedMethod(const runtime::Class& cls, const runtime::Method& method) {
+    const Function* function = module_.GetMethod(cls, method);
+    //the call about to be made is counted by ClassInstance::Call or PushFrame, as in Invoke
+    if(function && jit_threshold_ != 0 && method.call_count.Get() + 1u >= jit_threshold_
+       && !runtime::IsNativeStackBelow(NATIVE_CODE_STACK_BYTES) && GetNativeFunction(*function)) {
+        return nullptr;
+    }
+    return function;
+}
+
+ObjectHolder* VirtualMachine::PushFrame(const Function& callee, const runtime::Method& method, const Function& caller,
+                                        const Instruction* call, ObjectHolder* r, runtime::Context& context) {
+    frames_.push_back({&caller, call, r, &callee, nullptr});
+    try {
+        if(auto stack = context.GetCallStack()) {
+            stack->Push();
+        }
+    }
+    catch(...) {
+        frames_.pop_back();
+        throw;
+    }
+    //from here on UnwindFrames takes the frame off if anything throws
+    ObjectHolder* registers = registers_.Allocate(callee.register_count);
+    frames_.back().registers = registers;
+    const auto& site = caller.call_sites[call->c];
+    std::copy(r + site.first_arg, r + site.first_arg + site.arg_count, registers + 1);
+    method.call_count.Increment();
+    return registers;
+}
+
+void VirtualMachine::PopFrame(const ObjectHolder& result, runtime::Context& context) {
+    const CallFrame& frame = frames_.back();
+    //a constructor call leaves the new object in its register
+    if(frame.call->op != OpCode::NewInstance) {
+        frame.caller_registers[frame.call->a] = result;
+    }
+    UnwindFrames(frames_.size() - 1u, context);
+}
+
+void VirtualMachine::UnwindFrames(size_t base, runtime::Context& context) {
+    while(frames_.size() > base) {
+        const CallFrame& frame = frames_.back();
+        if(frame.registers) {
+            registers_.Release(frame.registers, frame.callee->register_count);
+        }
+        if(auto stack = context.GetCallStack()) {
+            stack->Pop();
+        }
+        frames_.pop_back();
+    }
+}
+
+ObjectHolder VirtualMachine::Execute(const Function& entry, ObjectHolder* r, runtime::Context& context) {
+    //methods called by this loop keep their frames above base until they return
+    struct FramesGuard {
+        VirtualMachine& machine;
+        size_t base;
+        runtime::Context& context;
+        ~FramesGuard() {
+            machine.UnwindFrames(base, context);
+        }
+    } frames_guard{*this, frames_.size(), context};
+    const size_t base = frames_guard.base;
+
+    const Function* function = &entry;
+    const Instruction* code = function->code.data();
+    const Instruction* ip = code;
+
+#ifdef MYTHON_COMPUTED_GOTO
+    static const void* const dispatch_table[] = {
+#define MYTHON_OPCODE_LABEL(name, mnemonic) &&op_##name,
+        MYTHON_OPCODES(MYTHON_OPCODE_LABEL)
+#undef MYTHON_OPCODE_LABEL
+    };
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() goto* dispatch_table[static_cast<size_t>(ip->op)]
+    VM_DISPATCH();
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_DISPATCH() continue
+    for(;;) switch(ip->op) {
+#endif
+//instruction blocks must not hold objects with destructors when they dispatch: a computed
+//goto does not destroy them
+#define VM_NEXT() \
+    ++ip;         \
+    VM_DISPATCH()
+//continues with the callee that PushFrame has prepared registers for
+#define VM_ENTER(callee, registers)   \
+    function = callee;                \
+    code = function->code.data();     \
+    ip = code;                        \
+    r = registers;                    \
+    VM_DISPATCH()
+//returns value from the function being executed to the caller inside the loop or out of Execute
+#define VM_RETURN(value)                               \
+    if(frames_.size() == base) {                       \
+        return value;                                  \
+    }                                                  \
+    {                                                  \
+        const CallFrame frame = frames_.back();        \
+        PopFrame(value, context);                      \
+        function = frame.caller;                       \
+        code = function->code.data();                  \
+        ip = frame.call;                               \
+        r = frame.caller_registers;                    \
+    }                                                  \
+    VM_NEXT()
+#define VM_ARITHMETIC(name, op, slow_path)                                                         \
+    VM_CASE(name) {                                                                                \
+        auto lhs = AsNumber(r[ip->b]);                                                             \
+        auto rhs = AsNumber(r[ip->c]);                                                             \
+        r[ip->a] = lhs && rhs ? ObjectHolder::Own(runtime::Number{lhs->GetValue() op rhs->GetValue()}) \
+                              : slow_path;                                                         \
+        VM_NEXT();                                                                                 \
+    }
+#define VM_COMPARISON(name, op)                                                                    \
+    VM_CASE(name) {                                                                                \
+        auto lhs = AsNumber(r[ip->b]);                                                             \
+        auto rhs = AsNumber(r[ip->c]);                                                             \
+        r[ip->a] = MakeBool(lhs && rhs ? lhs->GetValue() op rhs->GetValue()                        \
+                                       : runtime::name(r[ip->b], r[ip->c], context));              \
+        VM_NEXT();                                                                                 \
+    }
+
+    VM_CASE(LoadConst) {
+        r[ip->a] = function->constants[ip->b];
+        VM_NEXT();
+    }
+    VM_CASE(LoadNone) {
+        r[ip->a] = ObjectHolder::None();
+        VM_NEXT();
+    }
+    VM_CASE(Move) {
+        r[ip->a] = r[ip->b];
+        VM_NEXT();
+    }
+    VM_CASE(GetField) {
+        auto& fields = GetFields(r[ip->b]);
+        const auto& name = function->names[ip->c];
+        auto it = fields.find(name);
+        if(it == fields.end()) {
+            throw std::runtime_error("there is no field: "s + name);
+        }
+        r[ip->a] = it->second;
+        VM_NEXT();
+    }
+    VM_CASE(SetField) {
+        GetFields(r[ip->a])[function->names[ip->b]] = r[ip->c];
+        VM_NEXT();
+    }
+    VM_ARITHMETIC(Add, +, runtime::Add(r[ip->b], r[ip->c], context))
+    VM_ARITHMETIC(Sub, -, runtime::Sub(r[ip->b], r[ip->c]))
+    VM_ARITHMETIC(Mult, *, runtime::Mult(r[ip->b], r[ip->c]))
+    VM_CASE(Div) {
+        auto lhs = AsNumber(r[ip->b]);
+        auto rhs = AsNumber(r[ip->c]);
+        r[ip->a] = lhs && rhs && rhs->GetValue() != 0
+                 ? ObjectHolder::Own(runtime::Number{lhs->GetValue() / rhs->GetValue()})
+                 : runtime::Div(r[ip->b], r[ip->c]);
+        VM_NEXT();
+    }
+    VM_COMPARISON(Equal, ==)
+    VM_COMPARISON(NotEqual, !=)
+    VM_COMPARISON(Less, <)
+    VM_COMPARISON(Greater, >)
+    VM_COMPARISON(LessOrEqual, <=)
+    VM_COMPARISON(GreaterOrEqual, >=)
+    VM_CASE(Compare) {
+        r[ip->a] = MakeBool(function->comparators[ip->c](r[ip->b], r[ip->b + 1u], context));
+        VM_NEXT();
+    }
+    VM_CASE(Not) {
+        r[ip->a] = MakeBool(!runtime::IsTrue(r[ip->b]));
+        VM_NEXT();
+    }
+    VM_CASE(ToBool) {
+        r[ip->a] = MakeBool(runtime::IsTrue(r[ip->b]));
+        VM_NEXT();
+    }
+    VM_CASE(Jump) {
+        ip = code + ip->b;
+        VM_DISPATCH();
+    }
+    VM_CASE(JumpIfFalse) {
+        ip = runtime::IsTrue(r[ip->a]) ? ip + 1 : code + ip->b;
+        VM_DISPATCH();
+    }
+    VM_CASE(JumpIfTrue) {
+        ip = runtime::IsTrue(r[ip->a]) ? code + ip->b : ip + 1;
+        VM_DISPATCH();
+    }
+    VM_CASE(Call) {
+        const auto& site = function->call_sites[ip->c];
+        auto instance = AsInstance(r[ip->b]);
+        if(!instance) {
+            throw std::runtime_error("object is not ClassInstance"s);
+        }
+        const auto& method = ResolveMethod(*instance, *function, site);
+        const Function* callee = FindInterpretedMethod(instance->GetClass(), method);
+        if(!callee) {
+            r[ip->a] = CallMethod(r[ip->b], method, r + site.first_arg, context);
+            VM_NEXT();
+        }
+        ObjectHolder* registers = PushFrame(*callee, method, *function, ip, r, context);
+        registers[0] = r[ip->b];
+        VM_ENTER(callee, registers);
+    }
+    VM_CASE(NewInstance) {
+        const auto& site = function->call_sites[ip->c];
+        const auto& cls = *function->classes[site.target];
+        const Function* init = site.init ? FindInterpretedMethod(cls, *site.init) : nullptr;
+        if(!init) {
+            r[ip->a] = CreateInstance(*function, site, r, context);
+            VM_NEXT();
+        }
+        ObjectHolder* registers = PushFrame(*init, *site.init, *function, ip, r, context);
+        registers[0] = ObjectHolder::Own(runtime::ClassInstance{cls});
+        r[ip->a] = registers[0];
+        VM_ENTER(init, registers);
+    }
+    VM_CASE(Stringify) {
+        r[ip->a] = ObjectHolder::Own(runtime::String{runtime::ToString(r[ip->b], context)});
+        VM_NEXT();
+    }
+    VM_CASE(Print) {
+        PrintValues(r + ip->a, ip->b, context);
+        VM_NEXT();
+    }
+    VM_CASE(Undefined) {
+        throw std::runtime_error("there is no object: "s + function->names[ip->b]);
+    }
+    VM_CASE(Return) {
+        VM_RETURN(r[ip->a]);
+    }
+    VM_CASE(ReturnNone) {
+        VM_RETURN(ObjectHolder::None());
+    }
+
+#ifndef MYTHON_COMPUTED_GOTO
+    }
+#endif
+#undef VM_COMPARISON
+#undef VM_ARITHMETIC
+#undef VM_RETURN
+#undef VM_ENTER
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_CASE
+}
+
+}  // namespace vm
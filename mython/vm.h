@@ -0,0 +1,125 @@
+#pragma once
+
+#include "bytecode.h"
+#include "jit.h"
+#include "runtime.h"
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace vm {
+
+// Стек регистров виртуальной машины. Регистры вызванной функции выделяются блоком
+// и освобождаются в обратном порядке. Блоки не перемещаются в памяти, пока функция выполняется
+class RegisterStack {
+public:
+    runtime::ObjectHolder* Allocate(size_t count);
+    // Освобождает последний выделенный блок, сбрасывая значения регистров
+    void Release(runtime::ObjectHolder* frame, size_t count);
+
+private:
+    static constexpr size_t CHUNK_SIZE = 16u * 1024u;
+
+    struct Chunk {
+        std::unique_ptr<runtime::ObjectHolder[]> data;
+        size_t size = 0;
+        size_t top = 0;
+    };
+
+    std::vector<Chunk> chunks_;
+    size_t current_ = 0;
+};
+
+// Операции, общие для виртуальной машины и машинного кода, созданного jit::Compile
+
+// Возвращает общий для всей программы объект Bool с заданным значением
+const runtime::ObjectHolder& MakeBool(bool value);
+// Возвращает поля объекта либо выбрасывает runtime_error, если holder - не ClassInstance
+runtime::Closure& GetFields(const runtime::ObjectHolder& holder);
+// Находит метод, вызываемый в site, используя встроенный кэш вызова
+const runtime::Method& ResolveMethod(const runtime::ClassInstance& instance, const bytecode::Function& function,
+                                     const bytecode::CallSite& site);
+// Выводит count значений через пробел и завершает строку, как инструкция print
+void PrintValues(const runtime::ObjectHolder* values, size_t count, runtime::Context& context);
+
+// Регистровая виртуальная машина, исполняющая программу, скомпилированную bytecode::Compile.
+// Пока программа выполняется, машина исполняет и все вызовы методов Mython, в том числе
+// сделанные из runtime (например, __str__ при выводе объекта). Методы, вызванные инструкциями
+// CALL и NEW, выполняются в том же цикле, что и вызвавшая их функция: их регистры кладутся на
+// стек регистров, и глубина рекурсии не ограничена стеком C++. Машинный код вызывается только
+// пока в стеке C++ достаточно места, иначе горячие методы тоже интерпретируются
+class VirtualMachine : public runtime::MethodExecutor {
+public:
+    explicit VirtualMachine(bytecode::Module module);
+
+    // Выполняет функцию верхнего уровня модуля. Вывод направляется в context
+    void Run(runtime::Context& context);
+
+    runtime::ObjectHolder Invoke(runtime::ClassInstance& self, const runtime::Method& method,
+                                 const std::vector<runtime::ObjectHolder>& actual_args,
+                                 runtime::Context& context) override;
+
+    // Вызывает method объекта self (ClassInstance) с аргументами args вне цикла Execute, например из
+    // машинного кода. Вызов учитывается в стеке активаций и счётчике вызовов, как в
+    // runtime::ClassInstance::Call, но аргументы не собираются в вектор
+    runtime::ObjectHolder CallMethod(const runtime::ObjectHolder& self, const runtime::Method& method,
+                                     const runtime::ObjectHolder* args, runtime::Context& context);
+    // Создаёт объект класса, указанного в site, и вызывает его __init__ с аргументами из регистров r
+    runtime::ObjectHolder CreateInstance(const bytecode::Function& function, const bytecode::CallSite& site,
+                                         const runtime::ObjectHolder* r, runtime::Context& context);
+
+    [[nodiscard]] const bytecode::Module& GetModule() const;
+
+    static constexpr size_t DEFAULT_JIT_THRESHOLD = 100;
+
+    // Метод, вызванный не менее threshold раз, компилируется в машинный код
+    // и дальше исполняется им. Значение 0 отключает компиляцию
+    void SetJitThreshold(size_t threshold);
+    // Возвращает количество методов, скомпилированных в машинный код
+    [[nodiscard]] size_t GetNativeFunctionCount() const;
+
+private:
+    // Активация метода, вызванного внутри цикла Execute
+    struct CallFrame {
+        const bytecode::Function* caller;
+        // Инструкция CALL или NEW вызвавшей функции
+        const bytecode::Instruction* call;
+        runtime::ObjectHolder* caller_registers;
+        const bytecode::Function* callee;
+        runtime::ObjectHolder* registers;
+    };
+
+    runtime::ObjectHolder Execute(const bytecode::Function& function, runtime::ObjectHolder* registers,
+                                  runtime::Context& context);
+    // Выполняет method с телом function для объекта self и аргументов args: машинным кодом, если
+    // метод уже горячий, иначе в цикле Execute
+    runtime::ObjectHolder RunMethod(const bytecode::Function& function, const runtime::Method& method,
+                                    const runtime::ObjectHolder& self, const runtime::ObjectHolder* args,
+                                    runtime::Context& context);
+    // Возвращает байт-код метода, если вызов метода можно выполнить внутри цикла Execute, либо
+    // nullptr, если тело метода не является синтаксическим деревом Mython или метод пора
+    // исполнять машинным кодом
+    const bytecode::Function* FindInterpretedMethod(const runtime::Class& cls, const runtime::Method& method);
+    // Начинает вызов method, сделанный инструкцией call функции caller: кладёт активацию на стек и
+    // копирует в регистры метода аргументы из регистров r. Возвращает регистры метода, регистр 0
+    // (self) заполняет вызывающая сторона
+    runtime::ObjectHolder* PushFrame(const bytecode::Function& callee, const runtime::Method& method,
+                                     const bytecode::Function& caller, const bytecode::Instruction* call,
+                                     runtime::ObjectHolder* r, runtime::Context& context);
+    // Завершает вызов на вершине стека активаций, передавая result вызвавшей функции
+    void PopFrame(const runtime::ObjectHolder& result, runtime::Context& context);
+    // Снимает со стека активации выше base, например при исключении
+    void UnwindFrames(size_t base, runtime::Context& context);
+    // Возвращает машинный код функции, компилируя его при первом обращении,
+    // либо nullptr, если платформа не поддерживает компиляцию
+    const jit::NativeFunction* GetNativeFunction(const bytecode::Function& function);
+
+    bytecode::Module module_;
+    RegisterStack registers_;
+    std::vector<CallFrame> frames_;
+    size_t jit_threshold_ = DEFAULT_JIT_THRESHOLD;
+    std::unordered_map<const bytecode::Function*, std::unique_ptr<jit::NativeFunction>> native_functions_;
+};
+
+}  // namespace vm
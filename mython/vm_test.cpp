@@ -0,0 +1,235 @@
+#include "bytecode.h"
+#include "lexer.h"
+#include "parse.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+using namespace std;
+
+namespace vm {
+
+namespace {
+
+unique_ptr<ast::Statement> Parse(const string& program) {
+    istringstream input(program);
+    parse::Lexer lexer(input);
+    return ParseProgram(lexer);
+}
+
+string RunOnTreeWalker(const string& program) {
+    runtime::DummyContext context;
+    runtime::Closure closure;
+    Parse(program)->Execute(closure, context);
+    return context.output.str();
+}
+
+string RunOnMachine(const string& program, size_t jit_threshold = VirtualMachine::DEFAULT_JIT_THRESHOLD) {
+    auto tree = Parse(program);
+    runtime::DummyContext context;
+    VirtualMachine machine(bytecode::Compile(*tree));
+    machine.SetJitThreshold(jit_threshold);
+    machine.Run(context);
+    return context.output.str();
+}
+
+void TestClassesAndOperators() {
+    const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __add__(other):
+    return self.x + other.x + self.y + other.y
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+  def __lt__(other):
+    return self.x < other.x or self.x == other.x and self.y < other.y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+class Point3(Point):
+  def __init__(x, y, z):
+    self.x = x
+    self.y = y
+    self.z = z
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ', ' + str(self.z) + ')'
+
+a = Point(1, 2)
+b = Point(3, 4)
+c = a + b
+print a, b, c, str(c)
+print a == b, a != b, a < b, a > b, a <= b, a >= b
+p = Point3(1, 2, 3)
+p.x = p.x * 10 - 2 / 2
+print p, p.x, Point
+if not a < b:
+  print 'wrong'
+else:
+  print 'right'
+x = 0 or 'value'
+y = 1 and None
+print x, y, not None, 'a' < 'b', 10 / 3
+)"s;
+    ASSERT_EQUAL(RunOnMachine(program), RunOnTreeWalker(program));
+    ASSERT_EQUAL(RunOnMachine(program, 1), RunOnTreeWalker(program));
+}
+
+void TestRecursion() {
+    const string program = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+f = Fib()
+print f.calc(15)
+)"s;
+    ASSERT_EQUAL(RunOnMachine(program), "610\n"s);
+    ASSERT_EQUAL(RunOnMachine(program, 0), "610\n"s);
+
+    //calls and constructors run in the dispatch loop, so the depth is not bounded by the C++ stack;
+    //machine code is left for the loop before it would exhaust the stack
+    const string deep_program = R"(
+class Link:
+  def __init__(factory, depth):
+    self.depth = 0
+    if depth > 0:
+      next = factory.make(depth - 1)
+      self.depth = next.depth + 1
+
+class Factory:
+  def make(depth):
+    return Link(self, depth)
+
+class Counter:
+  def down(n):
+    if n > 0:
+      return self.down(n - 1) + 1
+    return 0
+
+c = Counter()
+f = Factory()
+link = f.make(100000)
+print c.down(100000), link.depth
+)"s;
+    ASSERT_EQUAL(RunOnMachine(deep_program), "100000 100000\n"s);
+    ASSERT_EQUAL(RunOnMachine(deep_program, 0), "100000 100000\n"s);
+}
+
+void TestRuntimeErrors() {
+    ASSERT_THROWS(RunOnMachine("print x\n"s), std::runtime_error);
+    ASSERT_THROWS(RunOnMachine("x = 1 / 0\n"s), std::runtime_error);
+    ASSERT_THROWS(RunOnMachine("x = 1 + 'a'\n"s), std::runtime_error);
+    ASSERT_THROWS(RunOnMachine("class A:\n  def f():\n    return 1\na = A()\nx = a.g()\n"s),
+                  std::runtime_error);
+}
+
+void TestNativeCode() {
+    const string program = R"(
+class Counter:
+  def __init__():
+    self.value = 0
+
+  def step(n):
+    if n > 0 and n != 3:
+      self.value = self.value + n * 2 - 1
+    else:
+      self.value = self.value - 1
+    return self.value >= 10
+
+  def add(x, y):
+    return x + y
+
+c = Counter()
+first = c.step(5)
+print first, c.step(3), c.step(0), c.step(4), c.value
+print c.add(1, 2), c.add('a', 'b'), c.add(c.add(1, 1), 40)
+)"s;
+    auto tree = Parse(program);
+    runtime::DummyContext context;
+    VirtualMachine machine(bytecode::Compile(*tree));
+    machine.SetJitThreshold(1);
+    machine.Run(context);
+    ASSERT_EQUAL(context.output.str(), RunOnTreeWalker(program));
+    if(jit::IsSupported()) {
+        ASSERT_EQUAL(machine.GetNativeFunctionCount(), 3u);
+    }
+
+    //errors raised by runtime helpers propagate out of native code
+    const string failing = R"(
+class A:
+  def add(x):
+    return x + 1
+
+a = A()
+print a.add(1)
+print a.add('s')
+)"s;
+    ASSERT_THROWS(RunOnMachine(failing, 1), std::runtime_error);
+    ASSERT_EQUAL(RunOnMachine("class A:\n  def f():\n    return 1\na = A()\nprint a.f()\n"s, 0), "1\n"s);
+
+    //division, constants fused into operations and comparisons fused with jumps fall back to
+    //the generic instructions for operands that are not numbers
+    const string fused = R"(
+class Calc:
+  def mix(x, y):
+    z = x
+    x = x + 1
+    if x / y > 2:
+      z = z * 3 - x / 2
+    if not x < 10 or y == 5:
+      return z
+    less = x - 1 < y
+    return str(z) + ' ' + str(less)
+
+  def half(x):
+    return x / 2
+
+  def min(x, y):
+    if x < y:
+      return x
+    return y
+
+c = Calc()
+print c.mix(1, 1), c.mix(10, 2), c.mix(9, 5), c.mix(7, 4), c.mix(-8, 3)
+print c.min(1, 2), c.min('b', 'a'), c.min(3, -3)
+print c.half(7), c.half(-7), c.half(0)
+)"s;
+    ASSERT_EQUAL(RunOnMachine(fused, 1), RunOnTreeWalker(fused));
+    ASSERT_THROWS(RunOnMachine("class A:\n  def f(x, y):\n    return x / y\na = A()\nprint a.f(1, 1)\nprint a.f(1, 0)\n"s, 1),
+                  std::runtime_error);
+}
+
+void TestDisassembler() {
+    auto tree = Parse("x = 2\nprint x + 3\n"s);
+    auto module = bytecode::Compile(*tree);
+    ostringstream listing;
+    bytecode::Disassemble(module, listing);
+    const string expected = R"(function <main> (params: 0, registers: 3, constants: 2)
+  0000  LOADK     r0(x), k0    ; 2
+  0001  LOADK     r2, k1    ; 3
+  0002  ADD       r1, r0(x), r2
+  0003  PRINT     r1 x1
+  0004  RETNONE   
+)"s;
+    ASSERT_EQUAL(listing.str(), expected);
+}
+
+}  // namespace
+
+void RunVirtualMachineTests(TestRunner& tr) {
+    RUN_TEST(tr, vm::TestClassesAndOperators);
+    RUN_TEST(tr, vm::TestRecursion);
+    RUN_TEST(tr, vm::TestRuntimeErrors);
+    RUN_TEST(tr, vm::TestNativeCode);
+    RUN_TEST(tr, vm::TestDisassembler);
+}
+
+}  // namespace vm